@@ -0,0 +1,118 @@
+import paho.mqtt.client as mqtt
+import shutil
+import subprocess
+import sys
+import time
+
+# Prueba del uplink (store-and-forward) de la ESP32 contra un mosquitto local.
+# La ESP32 debe estar compilada con UPLINK_HOST = IP de esta PC y UPLINK_PORT = UPSTREAM_PORT.
+# Uso: python test_uplink.py
+
+# Dirección IP de la ESP32 que está actuando como broker
+BROKER_IP = "192.168.1.100"  # Sustituye con la IP real de tu ESP32
+BROKER_PORT = 1883  # Puerto por defecto de MQTT
+
+# Mosquitto local que hace de broker de la nube
+UPSTREAM_IP = "127.0.0.1"
+UPSTREAM_PORT = 1883
+UPSTREAM_PREFIX = ""  # Igual que UPLINK_TOPIC_PREFIX
+
+# Tópico reenviado por el uplink (filtro "rack0/sens/#")
+TEST_TOPIC = "rack0/sens/ambient/temperature"
+
+MESSAGES = 20  # Mensajes por fase
+DELIVERY_TIMEOUT = 90  # Segundos; cubre el backoff máximo de reconexión (60 s + jitter)
+
+received = []
+
+
+# Guarda los valores que llegan al broker de la nube
+def on_message(client, userdata, msg):
+    if msg.topic == UPSTREAM_PREFIX + TEST_TOPIC:
+        received.append(msg.payload.decode())
+
+
+def start_mosquitto():
+    return subprocess.Popen(["mosquitto", "-p", str(UPSTREAM_PORT)],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+def upstream_client():
+    client = mqtt.Client()
+    client.on_message = on_message
+    for _ in range(50):
+        try:
+            client.connect(UPSTREAM_IP, UPSTREAM_PORT, 60)
+            break
+        except OSError:
+            time.sleep(0.1)  # Mosquitto todavía arrancando
+    client.subscribe(UPSTREAM_PREFIX + "#")
+    client.loop_start()
+    return client
+
+
+# Publica valores numerados en la ESP32 (20.001, 20.002, ...)
+def publish_batch(esp32, first):
+    values = [f"20.{i:03d}" for i in range(first, first + MESSAGES)]
+    for value in values:
+        esp32.publish(TEST_TOPIC, value)
+        time.sleep(0.05)
+    return values
+
+
+# Espera a que lleguen todos los valores esperados, en orden
+def wait_for(expected):
+    deadline = time.time() + DELIVERY_TIMEOUT
+    while time.time() < deadline:
+        if [v for v in received if v in expected] == expected:
+            return True
+        time.sleep(0.5)
+    return False
+
+
+if shutil.which("mosquitto") is None:
+    print("No se encontró mosquitto en el PATH")
+    sys.exit(2)
+
+esp32 = mqtt.Client()
+esp32.connect(BROKER_IP, BROKER_PORT, 60)
+esp32.loop_start()
+
+ok = True
+
+# Fase 1: la nube está disponible, los mensajes se reenvían directamente
+mosquitto = start_mosquitto()
+upstream = upstream_client()
+time.sleep(2)  # Dar tiempo a que la ESP32 se conecte
+expected = publish_batch(esp32, 1)
+if wait_for(expected):
+    print(f"Fase 1 OK: {MESSAGES} mensajes reenviados")
+else:
+    print(f"Fase 1 FALLÓ: recibidos {len(received)} de {MESSAGES}")
+    ok = False
+
+# Fase 2: la nube cae, la ESP32 guarda los mensajes en flash
+upstream.loop_stop()
+mosquitto.terminate()
+mosquitto.wait()
+received.clear()
+time.sleep(2)
+expected = publish_batch(esp32, 101)
+print("Mosquitto detenido, mensajes publicados durante la caída")
+time.sleep(5)
+
+# Fase 3: la nube vuelve, los mensajes guardados llegan en orden
+mosquitto = start_mosquitto()
+upstream = upstream_client()
+if wait_for(expected):
+    print(f"Fase 3 OK: {MESSAGES} mensajes entregados tras la reconexión, en orden")
+else:
+    print(f"Fase 3 FALLÓ: recibidos {[v for v in received if v in expected]}")
+    ok = False
+
+upstream.loop_stop()
+esp32.loop_stop()
+mosquitto.terminate()
+mosquitto.wait()
+
+sys.exit(0 if ok else 1)
@@ -24,6 +24,9 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+// Wire protocol shared with the gateway (topic tables, IDs, framing)
+#include "rack_proto.h"
+
 // --------------------
 // OPERATION MODE MACROS
 // --------------------
@@ -36,36 +39,66 @@ typedef int8_t ERROR_CODE;
 // --------------------
 // ERROR CONTROL MACROS
 // --------------------
-#define SUCCESS_           0   // Operation successful
-#define ERROR_            -1   // Generic error code
-#define CHAR_NOT_FOUND_   -2   // Specified character not found in string
-#define UNKNOWN_TOPIC     -3   // Unrecognized topic for this system
+#define SUCCESS_          RACK_PROTO_SUCCESS          // Operation successful
+#define ERROR_            RACK_PROTO_ERROR            // Generic error code
+#define CHAR_NOT_FOUND_   RACK_PROTO_CHAR_NOT_FOUND   // Specified character not found in string
+#define UNKNOWN_TOPIC     RACK_PROTO_UNKNOWN_TOPIC    // Unrecognized topic for this system
+#define INVALID_VALUE     RACK_PROTO_INVALID_VALUE    // Value is not a number
 
 
 // MQTT Topics Definitions
+// Rack prefix of the topics, the rest is shared with the gateway
+#define RACK_PREFIX "rack0/"
+
 /* Sensor Topics:
 * These topics represent the MQTT communication topics for sensor data collection.
 * The topics correspond to various sensors such as temperature, humidity, pH, TDS, and EC.
 */
-#define TOPIC_WATER_TEMPERATURE "rack0/sens/water/temperature"
-#define TOPIC_AMBIENT_TEMPERATURE "rack0/sens/ambient/temperature"
-#define TOPIC_AMBIENT_HUMIDITY "rack0/sens/ambient/humidity"
-#define TOPIC_WATER_PH "rack0/sens/water/ph"
-#define TOPIC_WATER_TDS "rack0/sens/water/tds"
-#define TOPIC_WATER_EC "rack0/sens/water/ec"
+#define TOPIC_WATER_TEMPERATURE RACK_PREFIX RACK_PROTO_TOPIC_WATER_TEMPERATURE
+#define TOPIC_AMBIENT_TEMPERATURE RACK_PREFIX RACK_PROTO_TOPIC_AMBIENT_TEMPERATURE
+#define TOPIC_AMBIENT_HUMIDITY RACK_PREFIX RACK_PROTO_TOPIC_AMBIENT_HUMIDITY
+#define TOPIC_WATER_PH RACK_PREFIX RACK_PROTO_TOPIC_WATER_PH
+#define TOPIC_WATER_TDS RACK_PREFIX RACK_PROTO_TOPIC_WATER_TDS
+#define TOPIC_WATER_EC RACK_PREFIX RACK_PROTO_TOPIC_WATER_EC
 
 /* Actuator Topics:
 * These topics represent the MQTT communication topics for controlling actuators.
 * The actuators include systems like watering, dosing pumps, lights, fans, and a humidifier.
 */
-#define TOPIC_WATERING "rack0/actu/watering0"
-#define TOPIC_DOSE_PUMP0 "rack0/actu/dose_pump0"
-#define TOPIC_DOSE_PUMP1 "rack0/actu/dose_pump1"
-#define TOPIC_DOSE_PUMP2 "rack0/actu/dose_pump2"
-#define TOPIC_LIGHT_CONTROL "rack0/actu/light/control"
-#define TOPIC_FAN_CONTROL0 "rack0/actu/fan/control0"
-#define TOPIC_FAN_CONTROL1 "rack0/actu/fan/control1"
-#define TOPIC_HUMIDIFIER "rack0/actu/humidifier"
+#define TOPIC_WATERING RACK_PREFIX RACK_PROTO_TOPIC_WATERING
+#define TOPIC_DOSE_PUMP0 RACK_PREFIX RACK_PROTO_TOPIC_DOSE_PUMP0
+#define TOPIC_DOSE_PUMP1 RACK_PREFIX RACK_PROTO_TOPIC_DOSE_PUMP1
+#define TOPIC_DOSE_PUMP2 RACK_PREFIX RACK_PROTO_TOPIC_DOSE_PUMP2
+#define TOPIC_LIGHT_CONTROL RACK_PREFIX RACK_PROTO_TOPIC_LIGHT_CONTROL
+#define TOPIC_FAN_CONTROL0 RACK_PREFIX RACK_PROTO_TOPIC_FAN_CONTROL0
+#define TOPIC_FAN_CONTROL1 RACK_PREFIX RACK_PROTO_TOPIC_FAN_CONTROL1
+#define TOPIC_HUMIDIFIER RACK_PREFIX RACK_PROTO_TOPIC_HUMIDIFIER
+
+/* Actuator configuration topics:
+* Runtime settings of the actuator board, such as the PWM timer frequencies.
+*/
+#define TOPIC_PWM_FREQ_TIM3 RACK_PREFIX RACK_PROTO_TOPIC_PWM_FREQ_TIM3
+#define TOPIC_PWM_FREQ_TIM4 RACK_PREFIX RACK_PROTO_TOPIC_PWM_FREQ_TIM4
+#define TOPIC_FAN_RPM_TARGET0 RACK_PREFIX RACK_PROTO_TOPIC_FAN_RPM_TARGET0
+#define TOPIC_FAN_RPM_TARGET1 RACK_PREFIX RACK_PROTO_TOPIC_FAN_RPM_TARGET1
+#define TOPIC_PID_SETPOINT0 RACK_PREFIX RACK_PROTO_TOPIC_PID_SETPOINT0
+#define TOPIC_PID_SETPOINT1 RACK_PREFIX RACK_PROTO_TOPIC_PID_SETPOINT1
+#define TOPIC_PID_ENABLE0 RACK_PREFIX RACK_PROTO_TOPIC_PID_ENABLE0
+#define TOPIC_PID_ENABLE1 RACK_PREFIX RACK_PROTO_TOPIC_PID_ENABLE1
+#define TOPIC_HUMIDIFIER_SYNC RACK_PREFIX RACK_PROTO_TOPIC_HUMIDIFIER_SYNC
+#define TOPIC_RTC_TIME RACK_PREFIX RACK_PROTO_TOPIC_RTC_TIME
+#define TOPIC_SCHEDULE_ENABLE RACK_PREFIX RACK_PROTO_TOPIC_SCHEDULE_ENABLE
+
+// Link report topics, see uart_link.h
+#define TOPIC_LINK_PREFIX RACK_PREFIX RACK_PROTO_TOPIC_SENS_LINK
+#define TOPIC_LINK_BAUD TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_BAUD
+#define TOPIC_LINK_RX_RATE TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_RX_RATE
+#define TOPIC_LINK_TX_RATE TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_TX_RATE
+#define TOPIC_LINK_ERRORS TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_ERRORS
+#define TOPIC_LINK_TX_HELD TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_TX_HELD
+#define TOPIC_LINK_CREDIT_STALLS TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_CREDIT_STALLS
+#define TOPIC_LINK_CREDIT_LOST TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_CREDIT_LOST
+#define TOPIC_LINK_TX_DROPPED TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_TX_DROPPED
 
 // List of HW peripherals used
 extern ADC_HandleTypeDef hadc1;
@@ -78,6 +111,6 @@ extern UART_HandleTypeDef huart1;
 void delay_us(uint16_t us);    // Function to delay execution for specified microseconds
 
 void publishTopic(const char* topic, float val); // Function to publish a message with topic and value
-ERROR_CODE reciveTopic(char *msg, float *val);  // Function to receive a message with topic and value
+ERROR_CODE receiveTopic(char *msg, float *val); // Function to receive a message with topic and value
 
 #endif /* INC_UTILS_H_ */
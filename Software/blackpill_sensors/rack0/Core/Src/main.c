@@ -27,6 +27,7 @@
 // User's libraries
 // #include "bme680.h"
 #include "utils.h"
+#include "uart_link.h"
 #include "DHT11_22.h"
 #include "phADC.h"
 #include "DS18B20.h"
@@ -74,12 +75,6 @@ PHsensor PHsens;
 uint8_t DHThumedad[2];     // Two bytes storage for the reading
 uint8_t DHTtemperatura[2]; // Two bytes storage for the reading
 
-// UART parsing variables
-uint8_t Final_Data[50];
-uint8_t RxData[50];
-uint8_t temp[2]; // [dataBYE][null chcaracter]
-int ind = 0;
-
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -137,7 +132,7 @@ int main(void)
 
   // HW
   HAL_TIM_Base_Start(&htim11); // used for Us delay in Utils.h
-  HAL_UART_Receive_IT(&huart1, temp, strlen(temp));
+  UartLink_Init(); // DMA reception and transmission, baud rate negotiated by the gateway
 
   // SENSORS INITIALIZATION
   /* BME680*/
@@ -434,21 +429,28 @@ static void MX_GPIO_Init(void)
 
 /* USER CODE BEGIN 4 */
 
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
 {
-  memcpy(RxData + ind, temp, 1);
-  if (ind++ >= 50)
+  if (huart->Instance == USART1)
   {
-    indx = 0;
+    UartLink_RxEventISR(Size); // Idle line, half or full RX DMA buffer
   }
+}
 
-  if (temp[0] == '\n')
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+  if (huart->Instance == USART1)
   {
-    memcpy(FinalData, RxData, indx);
-    indx = 0;
+    UartLink_TxCpltISR(); // Next chunk of the TX ring
   }
+}
 
-  HAL_UART_Receive_IT(&huart1, temp, 1); // start next data receive interrupt
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+  if (huart->Instance == USART1)
+  {
+    UartLink_ErrorISR(); // Restarts the reception after an overrun
+  }
 }
 
 void I2C_Scan(void)
@@ -458,7 +460,7 @@ void I2C_Scan(void)
   HAL_StatusTypeDef result;
   uint8_t i;
   buffer_len = sprintf(buffer, "Scanning I2C bus:\r\n");
-  HAL_UART_Transmit(&huart1, (uint8_t *)buffer, buffer_len, 1000);
+  UartLink_Write((uint8_t *)buffer, (uint16_t)buffer_len);
 
   for (i = 1; i < 128; i++)
   {
@@ -466,11 +468,11 @@ void I2C_Scan(void)
     if (result == HAL_OK)
     {
       buffer_len = sprintf(buffer, "0x%02X ", i);
-      HAL_UART_Transmit(&huart1, (uint8_t *)buffer, buffer_len, 1000);
+      UartLink_Write((uint8_t *)buffer, (uint16_t)buffer_len);
     }
   }
   buffer_len = sprintf(buffer, "\r\n");
-  HAL_UART_Transmit(&huart1, (uint8_t *)buffer, buffer_len, 1000);
+  UartLink_Write((uint8_t *)buffer, (uint16_t)buffer_len);
 }
 /* USER CODE END 4 */
 
@@ -14,41 +14,7 @@
 #define SRC_UTILS_C_
 
 #include "utils.h"
-
-/*
- * List of Valid Topics
- * This array includes all predefined topics for either sensors (DAQ) or actuators (ACT),
- * depending on the compilation flags.
- */
-#ifdef DAQ
-/* Sensor Topics Array */
-const char* valid_topics[] = {
-    TOPIC_WATER_TEMPERATURE,
-    TOPIC_AMBIENT_TEMPERATURE,
-    TOPIC_AMBIENT_HUMIDITY,
-    TOPIC_WATER_PH,
-    TOPIC_WATER_TDS,
-    TOPIC_WATER_EC
-};
-size_t num_valid_topics = sizeof(valid_topics) / sizeof(valid_topics[0]);
-
-#elif defined(ACT)
-/* Actuator Topics Array */
-const char* valid_topics[] = {
-    TOPIC_WATERING,
-    TOPIC_DOSE_PUMP0,
-    TOPIC_DOSE_PUMP1,
-    TOPIC_DOSE_PUMP2,
-    TOPIC_LIGHT_CONTROL,
-    TOPIC_FAN_CONTROL0,
-    TOPIC_FAN_CONTROL1,
-    TOPIC_HUMIDIFIER
-};
-size_t num_valid_topics = sizeof(valid_topics) / sizeof(valid_topics[0]);
-
-#else
-#error "Either DAQ or ACT must be defined."
-#endif
+#include "uart_link.h"
 
 /* Function Definitions */
 
@@ -81,58 +47,54 @@ void delay_us(uint16_t us)
  */
 void publishTopic(const char* topic, float val)
 {
-    char uart_buf[50] = {0};
-    sprintf(uart_buf, "%s*%.2f\r\n", topic, val);  // Format the topic and value into the buffer
-
-    size_t len = strlen(uart_buf);  // Calculate the length of the message
-
-    HAL_UART_Transmit(&huart1, (uint8_t*)uart_buf, len, HAL_MAX_DELAY);  // Transmit the message over UART
-
-    HAL_Delay(3000);  // Add a 3-second delay (optional, can be adjusted based on system needs)
-}
+    char uart_buf[RACK_PROTO_LINE_SIZE];
+    int len;
+
+    // Formatted in thousandths with integer math, no float printf; NaN or out of range -> "nan"
+    if (val > -2000000.0f && val < 2000000.0f) {
+        milli_t milli = (milli_t)(val * 1000.0f + (val < 0.0f ? -0.5f : 0.5f));
+        len = RackProto_EncodeMilli(uart_buf, sizeof(uart_buf), NULL, topic, milli, 2);
+    } else {
+        len = RackProto_EncodeText(uart_buf, sizeof(uart_buf), topic, "nan");
+    }
+    len = RackProto_EndFrame(uart_buf, sizeof(uart_buf), len);
 
-// Function to identify a valid topic
-static ERROR_CODE identifyTopic(const char *topic) {
-    for (int i = 0; i < num_valid_topics; i++) {
-        if (strcmp(topic, valid_topics[i]) == 0) {
-            return SUCCESS; // Topic is valid
-        }
+    if (len > 0) {
+        UartLink_Write((uint8_t*)uart_buf, (uint16_t)len);  // Queued for the UART DMA
     }
-    return UNKNOWN_TOPIC; // Topic not found
+
+    UartLink_Delay(3000);  // Add a 3-second delay (optional, can be adjusted based on system needs), answering the gateway meanwhile
 }
 
 /*
- * Function to receive and parse topic and value from a message.
+ * Function to receive and parse topic and value from a message, split in place.
  */
-ERROR_CODE reciveTopic(char *msg, float *val) {
-    // Search for the '*' character
-    char *pos = strchr(msg, '*');
-
-    if (pos != NULL) {
-        // Calculate the index (position) of the '*' character
-        int8_t index = pos - msg;
-
-        // Separate the topic and data
-        char topic[50] = {0};  // Buffer for the topic
-        char data[4] = {0};    // Buffer for the data (3 characters + '\0')
-
-        // Copy the topic
-        strncpy(topic, msg, index);  // Copy up to the '*' character
-        topic[index] = '\0';         // Ensure null-terminated string
-
-        // Copy the data after '*'
-        strncpy(data, pos + 1, 3);   // Copy 3 characters after '*'
-        data[3] = '\0';             // Ensure null-terminated string
+ERROR_CODE receiveTopic(char *msg, float *val) {
+    RackFrame frame;
+    milli_t milli;
 
-        // Convert data to a numeric value
-        *val = atof(data);
+    if (RackProto_DecodeFrame(msg, &frame) != RACK_PROTO_SUCCESS) {
+        return CHAR_NOT_FOUND_;
+    }
 
-        // Identify the topic
-        return identifyTopic(topic);
+    // Identify the topic: one of this board's topics under RACK_PREFIX
+    if (strncmp(frame.topic, RACK_PREFIX, sizeof(RACK_PREFIX) - 1U) != 0) {
+        return UNKNOWN_TOPIC;
+    }
+#ifdef DAQ
+    if (RackProto_FindSensor(frame.topic + sizeof(RACK_PREFIX) - 1U) < 0) {
+#else
+    if (RackProto_FindActuator(frame.topic + sizeof(RACK_PREFIX) - 1U) < 0) {
+#endif
+        return UNKNOWN_TOPIC;
     }
 
-    // If '*' character is not found
-    return CHAR_NOT_FOUND_;
+    // Convert data to a numeric value
+    if (!RackProto_ParseMilli(frame.value, &milli)) {
+        return INVALID_VALUE;
+    }
+    *val = (float)milli / 1000.0f;
+    return SUCCESS_;
 }
 
 ERROR_CODE actuatorMotorsHandler(uint8_t actu, uint8_t val){
@@ -0,0 +1,110 @@
+/*
+ * actuator_pwm.h
+ *
+ *  Description:
+ *      Runtime configuration of the PWM timers (TIM3 and TIM4) that drive the Rack 0
+ *      actuators. Each timer can be retuned in frequency and resolution without a reflash,
+ *      and duty cycles are stored in a timer-independent 16-bit scale so they survive a
+ *      change of auto-reload value.
+ */
+
+#ifndef INC_ACTUATOR_PWM_H_
+#define INC_ACTUATOR_PWM_H_
+
+/******************************************************************************
+ * SECTION 1: LIBRARIES
+ *****************************************************************************/
+// Standard C Libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+// STM32 HAL Libraries
+#include "stm32f1xx_hal.h"
+#include "main.h"
+
+/******************************************************************************
+ * SECTION 2: MACROS
+ *****************************************************************************/
+
+/** Default timer configuration (matches the CubeMX setup: 72 MHz / 72 / 100) */
+#define PWM_DEFAULT_FREQ_HZ    10000U  // Default PWM frequency
+#define PWM_DEFAULT_STEPS      100U    // Default number of duty steps (ARR + 1)
+
+/** Duty scales */
+#define PWM_DUTY16_MAX         65535U  // Full scale of the 16-bit duty API
+#define PWM_PERMILLE_MAX       1000U   // Full scale of the permille duty API
+
+/** Limits accepted by PWM_ConfigTimer() */
+#define PWM_MIN_STEPS          2U      // Below this the output is just on/off
+#define PWM_MAX_STEPS          65536U  // 16-bit auto-reload register
+
+/******************************************************************************
+ * SECTION 3: ENUMERATIONS
+ *****************************************************************************/
+
+/** PWM timers available for actuators */
+typedef enum {
+    PWM_TIMER_3 = 0,   // TIM3: dose pumps 0 and 1
+    PWM_TIMER_4,       // TIM4: dose pump 2, grow light and fans
+    PWM_TIMER_COUNT
+} PWMTimer;
+
+/******************************************************************************
+ * SECTION 4: FUNCTION PROTOTYPES
+ *****************************************************************************/
+
+/**
+ * @brief  Reset every PWM channel to 0% and start the outputs.
+ * @retval None
+ */
+void PWM_Init(void);
+
+/**
+ * @brief  Reconfigure the frequency and resolution of a PWM timer.
+ *         Duty cycles of the channels on that timer are preserved.
+ * @param  timer Timer to reconfigure.
+ * @param  freqHz Desired PWM frequency in Hz.
+ * @param  steps Desired number of duty steps (ARR + 1), or 0 to pick the highest
+ *         resolution that the timer clock allows at that frequency.
+ * @retval true if the timer was reconfigured, false if the request is not reachable.
+ */
+bool PWM_ConfigTimer(PWMTimer timer, uint32_t freqHz, uint32_t steps);
+
+/**
+ * @brief  Set the duty cycle of an actuator channel in permille (0-1000).
+ * @param  actuatorID Actuator ID (see TopicActuatorIndex in utils.h).
+ * @param  permille Duty cycle in permille.
+ * @retval true if successful, false if the ID has no PWM channel or the value is out of range.
+ */
+bool PWM_SetDutyPermille(uint8_t actuatorID, uint16_t permille);
+
+/**
+ * @brief  Set the duty cycle of an actuator channel on a 16-bit scale (0-65535).
+ * @param  actuatorID Actuator ID (see TopicActuatorIndex in utils.h).
+ * @param  duty Duty cycle, 65535 being always on.
+ * @retval true if successful, false if the ID has no PWM channel.
+ */
+bool PWM_SetDuty16(uint8_t actuatorID, uint16_t duty);
+
+/**
+ * @brief  Get the duty cycle of an actuator channel in permille.
+ * @param  actuatorID Actuator ID.
+ * @retval Duty cycle in permille, 0 for IDs without a PWM channel.
+ */
+uint16_t PWM_GetDutyPermille(uint8_t actuatorID);
+
+/**
+ * @brief  Get the current frequency of a PWM timer.
+ * @param  timer Timer to query.
+ * @retval Frequency in Hz.
+ */
+uint32_t PWM_GetFrequency(PWMTimer timer);
+
+/**
+ * @brief  Get the current resolution of a PWM timer.
+ * @param  timer Timer to query.
+ * @retval Number of duty steps (ARR + 1).
+ */
+uint32_t PWM_GetResolution(PWMTimer timer);
+
+#endif /* INC_ACTUATOR_PWM_H_ */
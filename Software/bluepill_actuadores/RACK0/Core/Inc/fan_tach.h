@@ -0,0 +1,134 @@
+/*
+ * fan_tach.h
+ *
+ *  Description:
+ *      Tachometer capture and closed-loop speed control for the Rack 0 fans.
+ *      TIM1 captures the tach pulses of both fans (CH1 = PA8 for FAN_CONTROL0,
+ *      CH4 = PA11 for FAN_CONTROL1); RPM is computed in the capture interrupt and the
+ *      speed loop runs from the TIM1 update interrupt, so the main loop never polls.
+ */
+
+#ifndef INC_FAN_TACH_H_
+#define INC_FAN_TACH_H_
+
+/******************************************************************************
+ * SECTION 1: LIBRARIES
+ *****************************************************************************/
+// Standard C Libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+// STM32 HAL Libraries
+#include "stm32f1xx_hal.h"
+#include "main.h"
+
+/******************************************************************************
+ * SECTION 2: MACROS
+ *****************************************************************************/
+
+/** Capture timer */
+#define TACH_TICK_HZ           100000U  // TIM1 tick (72 MHz / 720), 10 us resolution
+#define TACH_PERIOD_TICKS      10000U   // TIM1 update every 100 ms (speed loop rate)
+#define TACH_LOOP_HZ           (TACH_TICK_HZ / TACH_PERIOD_TICKS)
+
+/** Fan characteristics */
+#define FAN_COUNT              2U       // FAN_CONTROL0 and FAN_CONTROL1
+#define FAN_PULSES_PER_REV     2U       // Standard PC fans give two tach pulses per turn
+#define FAN_MAX_RPM            3000U    // RPM at 100% duty, used as feed-forward
+#define FAN_MIN_RPM            200U     // Below this the fan is considered stopped
+#define FAN_STALL_TIMEOUT_MS   1000U    // No pulse for this long -> 0 RPM
+#define FAN_PUBLISH_PERIOD_MS  1000U    // RPM report period to the gateway
+
+/** Speed controller gains (integer ratios, permille per RPM of error) */
+#define FAN_KP_NUM             1
+#define FAN_KP_DEN             10
+#define FAN_KI_NUM             1
+#define FAN_KI_DEN             40
+#define FAN_MIN_DUTY_PERMILLE  150U     // Lowest duty that still spins the fans
+
+/******************************************************************************
+ * SECTION 3: DATA TYPES & STRUCTURES
+ *****************************************************************************/
+
+/** Per fan tachometer and controller state */
+typedef struct {
+    uint32_t lastEdge;       // Extended timestamp of the last tach edge (ticks)
+    uint32_t periodTicks;    // Last measured tach period (ticks)
+    uint16_t rpm;            // Measured speed
+    uint16_t targetRpm;      // Commanded speed, 0 = open loop
+    int32_t  integral;       // Integral term (permille)
+    uint16_t drivenLoops;    // Consecutive speed-loop ticks with the fan driven
+    bool     edgeSeen;       // lastEdge holds a valid timestamp
+    bool     stalled;        // Driven but no tach pulses
+} FanTach;
+
+extern TIM_HandleTypeDef htim1;
+
+/******************************************************************************
+ * SECTION 4: FUNCTION PROTOTYPES
+ *****************************************************************************/
+
+/**
+ * @brief  Configure TIM1 for tach capture on PA8/PA11 and start the speed loop.
+ * @retval None
+ */
+void FanTach_Init(void);
+
+/**
+ * @brief  Set the commanded speed of a fan. 0 returns the fan to open-loop duty control;
+ *         a nonzero speed takes the fan from any PID loop driving it.
+ * @param  fan Fan index (0 = FAN_CONTROL0, 1 = FAN_CONTROL1).
+ * @param  rpm Target speed in RPM.
+ * @retval true if successful, false for an invalid fan or speed.
+ */
+bool FanTach_SetTarget(uint8_t fan, uint16_t rpm);
+
+/**
+ * @brief  Leave speed control of the fan driven by an actuator (a PID loop takes over).
+ *         The duty currently applied is kept.
+ * @param  actuatorID Actuator ID.
+ * @retval None
+ */
+void FanTach_ReleaseActuator(uint8_t actuatorID);
+
+/**
+ * @brief  Get the commanded speed of a fan.
+ * @param  fan Fan index.
+ * @retval Target speed in RPM, 0 in open loop.
+ */
+uint16_t FanTach_GetTarget(uint8_t fan);
+
+/**
+ * @brief  Get the measured speed of a fan.
+ * @param  fan Fan index.
+ * @retval Speed in RPM.
+ */
+uint16_t FanTach_GetRPM(uint8_t fan);
+
+/**
+ * @brief  Get the stall flags of both fans.
+ * @retval Bit n set if fan n is driven but not turning.
+ */
+uint8_t FanTach_GetStallMask(void);
+
+/**
+ * @brief  Publish RPM and stall state of both fans to the gateway.
+ * @retval None
+ */
+void FanTach_Publish(void);
+
+/**
+ * @brief  TIM1 capture handler, called from HAL_TIM_IC_CaptureCallback().
+ * @param  htim Timer handle that triggered the capture.
+ * @retval None
+ */
+void FanTach_CaptureISR(TIM_HandleTypeDef *htim);
+
+/**
+ * @brief  TIM1 update handler, called from HAL_TIM_PeriodElapsedCallback().
+ *         Runs stall detection and the speed controller.
+ * @retval None
+ */
+void FanTach_UpdateISR(void);
+
+#endif /* INC_FAN_TACH_H_ */
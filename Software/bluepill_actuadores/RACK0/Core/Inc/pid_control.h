@@ -0,0 +1,129 @@
+/*
+ * pid_control.h
+ *
+ *  Description:
+ *      Fixed-rate, fixed-point (Q16.16) PID engine for the Rack 0 actuator board.
+ *      Loops run from the TIM2 control tick, read process values forwarded by the gateway
+ *      and drive the PWM actuators directly, so closed-loop control keeps working without
+ *      a round trip through MQTT. The STM32F1 has no FPU: no float math is used at runtime.
+ */
+
+#ifndef INC_PID_CONTROL_H_
+#define INC_PID_CONTROL_H_
+
+/******************************************************************************
+ * SECTION 1: LIBRARIES
+ *****************************************************************************/
+// Standard C Libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+// Q16.16 type and macros, shared with the gateway
+#include "rack_proto.h"
+
+/******************************************************************************
+ * SECTION 2: MACROS
+ *****************************************************************************/
+
+/** Engine configuration */
+#define PID_MAX_LOOPS          2U       // Number of control loops
+#define PID_RATE_HZ            10U      // Loop execution rate
+#define PID_PV_TIMEOUT_S       60U      // Process value older than this -> failsafe output
+
+/******************************************************************************
+ * SECTION 3: DATA TYPES & STRUCTURES
+ *****************************************************************************/
+
+/** Control action */
+typedef enum {
+    PID_DIRECT = 0,   // Output rises when PV is below SP (heating, dosing)
+    PID_REVERSE       // Output rises when PV is above SP (cooling, venting)
+} PIDAction;
+
+/** Control loop */
+typedef struct {
+    uint8_t   sensorID;     // Process value source (TopicSensorIndex)
+    uint8_t   actuatorID;   // Output actuator (TopicActuatorIndex, PWM only)
+    PIDAction action;       // Direct or reverse acting
+    q16_t     kp;           // Proportional gain, permille per unit of error
+    q16_t     ki;           // Integral gain, permille per unit of error and second
+    q16_t     kd;           // Derivative gain, permille per unit per second of PV change
+    q16_t     outMin;       // Output low limit, permille
+    q16_t     outMax;       // Output high limit, permille
+    q16_t     failsafe;     // Output while the PV is stale, permille
+    q16_t     setpoint;     // Setpoint, PV units
+    bool      enabled;      // Loop active
+
+    // Runtime state
+    q16_t     pv;           // Last process value
+    q16_t     prevPv;       // PV on the previous execution (derivative on measurement)
+    q16_t     integral;     // Integral term, permille
+    uint16_t  pvAge;        // Executions since the last PV update
+    bool      pvValid;      // At least one PV received
+    uint16_t  output;       // Last output, permille
+} PIDLoop;
+
+/******************************************************************************
+ * SECTION 4: FUNCTION PROTOTYPES
+ *****************************************************************************/
+
+/**
+ * @brief  Load the default loop table. All loops start disabled.
+ * @retval None
+ */
+void PID_Init(void);
+
+/**
+ * @brief  Control tick handler, called from the TIM2 control tick interrupt.
+ *         Executes every loop at PID_RATE_HZ.
+ * @retval None
+ */
+void PID_Tick(void);
+
+/**
+ * @brief  Set the setpoint of a loop.
+ * @param  loop Loop index.
+ * @param  setpoint Setpoint in PV units (Q16.16).
+ * @retval true if successful, false for an invalid loop.
+ */
+bool PID_SetSetpoint(uint8_t loop, q16_t setpoint);
+
+/**
+ * @brief  Enable or disable a loop. Enabling starts bumpless from the current output
+ *         and takes the actuator from the fan speed loop, if it drives a fan.
+ * @param  loop Loop index.
+ * @param  enable true to enable.
+ * @retval true if successful, false for an invalid loop.
+ */
+bool PID_Enable(uint8_t loop, bool enable);
+
+/**
+ * @brief  Update the process value of every loop fed by a sensor.
+ * @param  sensorID Sensor index (TopicSensorIndex).
+ * @param  value Process value (Q16.16).
+ * @retval None
+ */
+void PID_SetProcessValue(uint8_t sensorID, q16_t value);
+
+/**
+ * @brief  Disable the loops driving an actuator (manual command takes over).
+ * @param  actuatorID Actuator ID.
+ * @retval None
+ */
+void PID_ReleaseActuator(uint8_t actuatorID);
+
+/**
+ * @brief  Check whether an enabled loop currently owns an actuator.
+ * @param  actuatorID Actuator ID.
+ * @retval true if a loop is driving the actuator.
+ */
+bool PID_IsDriving(uint8_t actuatorID);
+
+/**
+ * @brief  Get a loop (read-only).
+ * @param  loop Loop index.
+ * @retval Pointer to the loop, NULL for an invalid index.
+ */
+const PIDLoop *PID_GetLoop(uint8_t loop);
+
+#endif /* INC_PID_CONTROL_H_ */
@@ -0,0 +1,107 @@
+/*
+ * pulse_seq.h
+ *
+ *  Description:
+ *      Non-blocking pulse-train sequencer for devices controlled through emulated button
+ *      presses (e.g. the humidifier). Patterns such as "press 200 ms, wait 300 ms,
+ *      press 200 ms" are played from the TIM2 control tick, and the logical state the
+ *      presses lead to is tracked so the device can be driven to a target state.
+ */
+
+#ifndef INC_PULSE_SEQ_H_
+#define INC_PULSE_SEQ_H_
+
+/******************************************************************************
+ * SECTION 1: LIBRARIES
+ *****************************************************************************/
+// Standard C Libraries
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// STM32 HAL Libraries
+#include "stm32f1xx_hal.h"
+#include "main.h"
+
+/******************************************************************************
+ * SECTION 2: MACROS
+ *****************************************************************************/
+
+/** Sequencer configuration */
+#define PULSE_SEQ_MAX_STEPS      16U     // Steps per pattern (press, wait, press, ...)
+#define PULSE_SEQ_TICK_MS        10U     // Resolution, one TIM2 control tick
+
+/** Humidifier button */
+#define HUM_PRESS_MS             200U    // Button held down
+#define HUM_RELEASE_MS           300U    // Gap between presses
+#define HUM_STATES               2U      // Each press cycles OFF -> ON -> OFF
+#define HUM_PRESS_LEVEL          GPIO_PIN_SET
+
+/******************************************************************************
+ * SECTION 3: ENUMERATIONS
+ *****************************************************************************/
+
+/** Button-emulated devices */
+typedef enum {
+    PULSE_CH_HUMIDIFIER = 0,
+    PULSE_CH_COUNT
+} PulseChannel;
+
+/******************************************************************************
+ * SECTION 4: FUNCTION PROTOTYPES
+ *****************************************************************************/
+
+/**
+ * @brief  Release every button and reset the logical states to 0 (OFF).
+ * @retval None
+ */
+void PulseSeq_Init(void);
+
+/**
+ * @brief  Play a raw pattern. Steps alternate press/release, starting with a press.
+ *         Each completed press advances the logical state by one.
+ * @param  ch Channel.
+ * @param  stepsMs Step durations in milliseconds.
+ * @param  count Number of steps (1 to PULSE_SEQ_MAX_STEPS).
+ * @retval true if started, false if the channel is busy or the pattern is invalid.
+ */
+bool PulseSeq_Start(PulseChannel ch, const uint16_t *stepsMs, uint8_t count);
+
+/**
+ * @brief  Drive a channel to a logical state with the required number of presses.
+ *         If a sequence is running, the target is applied once it finishes.
+ * @param  ch Channel.
+ * @param  state Target state (0 = OFF).
+ * @retval true if accepted, false for an invalid channel or state.
+ */
+bool PulseSeq_SetState(PulseChannel ch, uint8_t state);
+
+/**
+ * @brief  Overwrite the tracked state without pressing (resync after a manual press).
+ * @param  ch Channel.
+ * @param  state Actual device state.
+ * @retval true if accepted, false for an invalid channel or state.
+ */
+bool PulseSeq_SyncState(PulseChannel ch, uint8_t state);
+
+/**
+ * @brief  Get the logical state of a channel.
+ * @param  ch Channel.
+ * @retval Current state, updated as presses complete.
+ */
+uint8_t PulseSeq_GetState(PulseChannel ch);
+
+/**
+ * @brief  Check whether a channel is playing a sequence.
+ * @param  ch Channel.
+ * @retval true while busy.
+ */
+bool PulseSeq_IsBusy(PulseChannel ch);
+
+/**
+ * @brief  Control tick handler, called every PULSE_SEQ_TICK_MS from the TIM2 interrupt.
+ * @retval None
+ */
+void PulseSeq_Tick(void);
+
+#endif /* INC_PULSE_SEQ_H_ */
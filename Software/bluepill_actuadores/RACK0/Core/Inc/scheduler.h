@@ -0,0 +1,109 @@
+/*
+ * scheduler.h
+ *
+ *  Description:
+ *      On-device photoperiod and irrigation scheduler for Rack 0, driven by the RTC alarm.
+ *      A compact table in flash describes light on/off with sunrise/sunset ramps, periodic
+ *      watering pulses and fan duty by time of day. Outputs are computed from the time of
+ *      day alone, so a reset or a missed alarm never leaves an actuator stuck. Remote
+ *      commands override the schedule of an actuator for a limited time.
+ */
+
+#ifndef INC_SCHEDULER_H_
+#define INC_SCHEDULER_H_
+
+/******************************************************************************
+ * SECTION 1: LIBRARIES
+ *****************************************************************************/
+// Standard C Libraries
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// STM32 HAL Libraries
+#include "stm32f1xx_hal.h"
+#include "main.h"
+
+/******************************************************************************
+ * SECTION 2: MACROS
+ *****************************************************************************/
+
+/** Scheduler configuration */
+#define SCHED_STEP_S           10U       // RTC alarm period (ramp and pulse resolution)
+#define SCHED_OVERRIDE_MIN     60U       // Lifetime of a remote override
+#define SCHED_DAY_S            86400UL
+
+/** Backup register marking the RTC time as valid (set by Sched_SetTime) */
+#define SCHED_RTC_BKP_REG      RTC_BKP_DR1
+#define SCHED_RTC_MAGIC        0x5CEDU
+
+/** Helpers for the schedule table */
+#define SCHED_HM(h, m)         ((uint16_t)((h) * 60U + (m)))   // Minute of day
+
+/******************************************************************************
+ * SECTION 3: ENUMERATIONS & STRUCTURES
+ *****************************************************************************/
+
+/** Kind of schedule entry */
+typedef enum {
+    SCHED_LEVEL = 0,   // Constant level inside the window (fans)
+    SCHED_RAMP,        // Sunrise ramp, hold, sunset ramp (lights)
+    SCHED_PULSE        // On for pulseS every periodMin inside the window (watering)
+} ScheduleKind;
+
+/** Schedule entry (12 bytes, stored in flash) */
+typedef struct {
+    uint8_t  actuatorID;   // TopicActuatorIndex
+    uint8_t  kind;         // ScheduleKind
+    uint16_t startMin;     // Window start, minute of day
+    uint16_t endMin;       // Window end, minute of day (may wrap past midnight)
+    uint16_t level;        // Output level, permille (LEVEL/RAMP)
+    uint16_t rampMin;      // Ramp duration (RAMP) or pulse period in minutes (PULSE)
+    uint16_t pulseS;       // Pulse duration in seconds (PULSE)
+} ScheduleEntry;
+
+/******************************************************************************
+ * SECTION 4: FUNCTION PROTOTYPES
+ *****************************************************************************/
+
+/**
+ * @brief  Start the schedule. Outputs are only driven once the RTC holds a valid time.
+ * @param  hrtc RTC handle.
+ * @retval None
+ */
+void Sched_Init(RTC_HandleTypeDef *hrtc);
+
+/**
+ * @brief  Evaluate the schedule if the RTC alarm fired. Call from the main loop.
+ * @retval None
+ */
+void Sched_Process(void);
+
+/**
+ * @brief  RTC alarm handler, called from HAL_RTC_AlarmAEventCallback().
+ * @retval None
+ */
+void Sched_AlarmISR(void);
+
+/**
+ * @brief  Set the time of day and mark the RTC as valid.
+ * @param  hhmm Time as HHMM (e.g. 1330).
+ * @retval true if successful, false for an invalid time.
+ */
+bool Sched_SetTime(uint16_t hhmm);
+
+/**
+ * @brief  Enable or disable the schedule.
+ * @param  enable true to enable.
+ * @retval None
+ */
+void Sched_Enable(bool enable);
+
+/**
+ * @brief  Suspend the schedule of an actuator for SCHED_OVERRIDE_MIN (remote command).
+ * @param  actuatorID Actuator ID.
+ * @retval None
+ */
+void Sched_Override(uint8_t actuatorID);
+
+#endif /* INC_SCHEDULER_H_ */
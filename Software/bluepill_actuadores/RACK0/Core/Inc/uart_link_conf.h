@@ -0,0 +1,31 @@
+/*
+ * uart_link_conf.h
+ *
+ *  Description:
+ *      Peripherals of the gateway link on the Rack 0 actuator board (STM32F103),
+ *      for the shared uart_link module in Software/common/uart_link.
+ */
+
+#ifndef INC_UART_LINK_CONF_H_
+#define INC_UART_LINK_CONF_H_
+
+/** UART and its DMA requests: DMA1 channels 5 (RX) and 4 (TX) */
+#define LINK_UART              huart1           // Set up by MX_USART1_UART_Init()
+#define LINK_HDMA_RX           hdma_usart1_rx   // Served by DMA1_Channel5_IRQHandler()
+#define LINK_HDMA_TX           hdma_usart1_tx   // Served by DMA1_Channel4_IRQHandler()
+#define LINK_DMA_RX            DMA1_Channel5
+#define LINK_DMA_TX            DMA1_Channel4
+#define LINK_DMA_RX_IRQn       DMA1_Channel5_IRQn
+#define LINK_DMA_TX_IRQn       DMA1_Channel4_IRQn
+#define LINK_DMA_CLK_ENABLE()  __HAL_RCC_DMA1_CLK_ENABLE()
+#define LINK_PCLK_FREQ()       HAL_RCC_GetPCLK2Freq()   // USART1 is on APB2
+
+/** Hardware flow control: RTS on PA12, CTS on PA11. PA11 is the FAN_CONTROL1
+ *  tach input, so it can only be enabled without it. */
+#define LINK_HW_FLOW_CONTROL   0
+#define LINK_FLOW_GPIO_PORT    GPIOA
+#define LINK_FLOW_CTS_PIN      GPIO_PIN_11
+#define LINK_FLOW_RTS_PIN      GPIO_PIN_12
+#define LINK_FLOW_GPIO_CLK_ENABLE() __HAL_RCC_GPIOA_CLK_ENABLE()
+
+#endif /* INC_UART_LINK_CONF_H_ */
@@ -24,6 +24,9 @@
 #include <stdbool.h>         // For boolean type support
 #include <stdlib.h>          // For standard functions (atoi, etc.)
 
+// Wire protocol shared with the gateway (topic tables, IDs, framing)
+#include "rack_proto.h"
+
 // --------------------
 // OPERATION MODE MACROS
 // --------------------
@@ -39,34 +42,68 @@
 // ----------------------
 typedef int8_t ERROR_CODE;
 
-// Error codes for the system
-#define SUCCESS            0   // Operation successful
-#define ERROR              -1  // General error
-#define CHAR_NOT_FOUND     -2  // Character not found in string
-#define UNKNOWN_TOPIC      -3  // Unrecognized topic
-#define UNKNOWN_ACTUATOR   -4  // Unrecognized actuator
-#define UNKNOWN_SENSOR     -5  // Unrecognized sensor
+// Error codes for the system, also sent as the CODE of an ACK
+#define SUCCESS            RACK_PROTO_SUCCESS           // Operation successful
+#define ERROR              RACK_PROTO_ERROR             // General error
+#define CHAR_NOT_FOUND     RACK_PROTO_CHAR_NOT_FOUND    // Character not found in string
+#define UNKNOWN_TOPIC      RACK_PROTO_UNKNOWN_TOPIC     // Unrecognized topic
+#define UNKNOWN_ACTUATOR   RACK_PROTO_UNKNOWN_ACTUATOR  // Unrecognized actuator
+#define UNKNOWN_SENSOR     RACK_PROTO_UNKNOWN_SENSOR    // Unrecognized sensor
+#define INVALID_VALUE      RACK_PROTO_INVALID_VALUE     // Value out of range for the target
 
 // ------------------------
 // MQTT TOPIC DEFINITIONS
 // ------------------------
+// Rack prefix of the topics, the rest is shared with the gateway
+#define RACK_PREFIX "rack0/"
+
 // Sensor topics for MQTT communication
-#define TOPIC_WATER_TEMPERATURE "rack0/sens/water/temperature"
-#define TOPIC_AMBIENT_TEMPERATURE "rack0/sens/ambient/temperature"
-#define TOPIC_AMBIENT_HUMIDITY "rack0/sens/ambient/humidity"
-#define TOPIC_WATER_PH "rack0/sens/water/ph"
-#define TOPIC_WATER_TDS "rack0/sens/water/tds"
-#define TOPIC_WATER_EC "rack0/sens/water/ec"
+#define TOPIC_WATER_TEMPERATURE RACK_PREFIX RACK_PROTO_TOPIC_WATER_TEMPERATURE
+#define TOPIC_AMBIENT_TEMPERATURE RACK_PREFIX RACK_PROTO_TOPIC_AMBIENT_TEMPERATURE
+#define TOPIC_AMBIENT_HUMIDITY RACK_PREFIX RACK_PROTO_TOPIC_AMBIENT_HUMIDITY
+#define TOPIC_WATER_PH RACK_PREFIX RACK_PROTO_TOPIC_WATER_PH
+#define TOPIC_WATER_TDS RACK_PREFIX RACK_PROTO_TOPIC_WATER_TDS
+#define TOPIC_WATER_EC RACK_PREFIX RACK_PROTO_TOPIC_WATER_EC
 
 // Actuator topics for MQTT communication
-#define TOPIC_WATERING "rack0/actu/watering0"
-#define TOPIC_DOSE_PUMP0 "rack0/actu/dose_pump0"
-#define TOPIC_DOSE_PUMP1 "rack0/actu/dose_pump1"
-#define TOPIC_DOSE_PUMP2 "rack0/actu/dose_pump2"
-#define TOPIC_LIGHT_CONTROL "rack0/actu/light/control"
-#define TOPIC_FAN_CONTROL0 "rack0/actu/fan/control0"
-#define TOPIC_FAN_CONTROL1 "rack0/actu/fan/control1"
-#define TOPIC_HUMIDIFIER "rack0/actu/humidifier"
+#define TOPIC_WATERING RACK_PREFIX RACK_PROTO_TOPIC_WATERING
+#define TOPIC_DOSE_PUMP0 RACK_PREFIX RACK_PROTO_TOPIC_DOSE_PUMP0
+#define TOPIC_DOSE_PUMP1 RACK_PREFIX RACK_PROTO_TOPIC_DOSE_PUMP1
+#define TOPIC_DOSE_PUMP2 RACK_PREFIX RACK_PROTO_TOPIC_DOSE_PUMP2
+#define TOPIC_LIGHT_CONTROL RACK_PREFIX RACK_PROTO_TOPIC_LIGHT_CONTROL
+#define TOPIC_FAN_CONTROL0 RACK_PREFIX RACK_PROTO_TOPIC_FAN_CONTROL0
+#define TOPIC_FAN_CONTROL1 RACK_PREFIX RACK_PROTO_TOPIC_FAN_CONTROL1
+#define TOPIC_HUMIDIFIER RACK_PREFIX RACK_PROTO_TOPIC_HUMIDIFIER
+
+// Actuator configuration topics for MQTT communication
+#define TOPIC_PWM_FREQ_TIM3 RACK_PREFIX RACK_PROTO_TOPIC_PWM_FREQ_TIM3
+#define TOPIC_PWM_FREQ_TIM4 RACK_PREFIX RACK_PROTO_TOPIC_PWM_FREQ_TIM4
+#define TOPIC_FAN_RPM_TARGET0 RACK_PREFIX RACK_PROTO_TOPIC_FAN_RPM_TARGET0
+#define TOPIC_FAN_RPM_TARGET1 RACK_PREFIX RACK_PROTO_TOPIC_FAN_RPM_TARGET1
+#define TOPIC_PID_SETPOINT0 RACK_PREFIX RACK_PROTO_TOPIC_PID_SETPOINT0
+#define TOPIC_PID_SETPOINT1 RACK_PREFIX RACK_PROTO_TOPIC_PID_SETPOINT1
+#define TOPIC_PID_ENABLE0 RACK_PREFIX RACK_PROTO_TOPIC_PID_ENABLE0
+#define TOPIC_PID_ENABLE1 RACK_PREFIX RACK_PROTO_TOPIC_PID_ENABLE1
+#define TOPIC_HUMIDIFIER_SYNC RACK_PREFIX RACK_PROTO_TOPIC_HUMIDIFIER_SYNC
+#define TOPIC_RTC_TIME RACK_PREFIX RACK_PROTO_TOPIC_RTC_TIME
+#define TOPIC_SCHEDULE_ENABLE RACK_PREFIX RACK_PROTO_TOPIC_SCHEDULE_ENABLE
+
+// Fan and humidifier state published back to the gateway, see fan_tach.h and pulse_seq.h
+#define TOPIC_FAN_RPM0 RACK_PREFIX RACK_PROTO_TOPIC_FAN_RPM0
+#define TOPIC_FAN_RPM1 RACK_PREFIX RACK_PROTO_TOPIC_FAN_RPM1
+#define TOPIC_FAN_STALL RACK_PREFIX RACK_PROTO_TOPIC_FAN_STALL
+#define TOPIC_HUMIDIFIER_STATE RACK_PREFIX RACK_PROTO_TOPIC_HUMIDIFIER_STATE
+
+// Link report topics, see uart_link.h
+#define TOPIC_LINK_PREFIX RACK_PREFIX RACK_PROTO_TOPIC_ACTU_LINK
+#define TOPIC_LINK_BAUD TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_BAUD
+#define TOPIC_LINK_RX_RATE TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_RX_RATE
+#define TOPIC_LINK_TX_RATE TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_TX_RATE
+#define TOPIC_LINK_ERRORS TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_ERRORS
+#define TOPIC_LINK_TX_HELD TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_TX_HELD
+#define TOPIC_LINK_CREDIT_STALLS TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_CREDIT_STALLS
+#define TOPIC_LINK_CREDIT_LOST TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_CREDIT_LOST
+#define TOPIC_LINK_TX_DROPPED TOPIC_LINK_PREFIX RACK_PROTO_TOPIC_LINK_TX_DROPPED
 
 // -----------------------
 // PERIPHERAL DEFINITIONS
@@ -89,6 +126,63 @@ extern TIM_HandleTypeDef htim4;  // Additional timers for control
 #error "Either DAQ or ACT must be defined."
 #endif
 
+// ------------------------
+// SENSOR IDS
+// ------------------------
+// Same order as the sensor topics
+typedef enum {
+    WATER_TEMPERATURE = RACK_SENSOR_WATER_TEMPERATURE,
+    AMBIENT_TEMPERATURE = RACK_SENSOR_AMBIENT_TEMPERATURE,
+    AMBIENT_HUMIDITY = RACK_SENSOR_AMBIENT_HUMIDITY,
+    WATER_PH = RACK_SENSOR_WATER_PH,
+    WATER_TDS = RACK_SENSOR_WATER_TDS,
+    WATER_EC = RACK_SENSOR_WATER_EC,
+    NUM_SENSOR_TOPICS = RACK_SENSOR_COUNT
+} TopicSensorIndex;
+
+#ifdef ACT
+// ------------------------
+// ACTUATOR IDS
+// ------------------------
+// IDs sent by the gateway as "ID*VAL\r\n", in the same order as the actuator topics
+typedef enum {
+    WATERING = RACK_ACTUATOR_WATERING,
+    DOSE_PUMP0 = RACK_ACTUATOR_DOSE_PUMP0,
+    DOSE_PUMP1 = RACK_ACTUATOR_DOSE_PUMP1,
+    DOSE_PUMP2 = RACK_ACTUATOR_DOSE_PUMP2,
+    LIGHT_CONTROL = RACK_ACTUATOR_LIGHT_CONTROL,
+    FAN_CONTROL0 = RACK_ACTUATOR_FAN_CONTROL0,
+    FAN_CONTROL1 = RACK_ACTUATOR_FAN_CONTROL1,
+    HUMIDIFIER = RACK_ACTUATOR_HUMIDIFIER,
+    NUM_ACTUATORS = RACK_ACTUATOR_PHYSICAL_COUNT,       // Number of physical actuators
+    PWM_FREQ_TIM3 = RACK_ACTUATOR_PWM_FREQ_TIM3,        // TIM3 PWM frequency in Hz
+    PWM_FREQ_TIM4 = RACK_ACTUATOR_PWM_FREQ_TIM4,        // TIM4 PWM frequency in Hz
+    FAN_RPM0 = RACK_ACTUATOR_FAN_RPM0,                  // FAN_CONTROL0 closed-loop target in RPM (0 = open loop)
+    FAN_RPM1 = RACK_ACTUATOR_FAN_RPM1,                  // FAN_CONTROL1 closed-loop target in RPM (0 = open loop)
+    PID_SETPOINT0 = RACK_ACTUATOR_PID_SETPOINT0,        // PID loop 0 setpoint (decimal, PV units)
+    PID_SETPOINT1 = RACK_ACTUATOR_PID_SETPOINT1,        // PID loop 1 setpoint (decimal, PV units)
+    PID_ENABLE0 = RACK_ACTUATOR_PID_ENABLE0,            // PID loop 0 enable (0/1)
+    PID_ENABLE1 = RACK_ACTUATOR_PID_ENABLE1,            // PID loop 1 enable (0/1)
+    HUMIDIFIER_SYNC = RACK_ACTUATOR_HUMIDIFIER_SYNC,    // Humidifier actual state, resyncs without pressing
+    RTC_TIME = RACK_ACTUATOR_RTC_TIME,                  // Time of day as HHMM, marks the RTC as valid
+    SCHEDULE_ENABLE = RACK_ACTUATOR_SCHEDULE_ENABLE,    // On-device schedule enable (0/1)
+    NUM_TOPICS = RACK_ACTUATOR_COUNT
+} TopicActuatorIndex;
+
+// Process values forwarded by the gateway use ID = PV_ID_BASE + TopicSensorIndex
+#define PV_ID_BASE          RACK_PROTO_PV_ID_BASE
+
+// Commands "ID*VAL#SEQ" are answered with "ack*SEQ,CODE,APPLY_US"
+#define ACK_TOPIC           RACK_PROTO_ACK_TOPIC
+
+// ------------------------
+// CONTROL TICK (TIM2)
+// ------------------------
+// TIM2 free-runs at 1 MHz; CH1 compare interrupts give the fixed-rate control tick
+#define CONTROL_TICK_HZ     100U
+#define CONTROL_TICK_US     (1000000U / CONTROL_TICK_HZ)
+#endif
+
 // ------------------------
 // FUNCTION PROTOTYPES
 // ------------------------
@@ -106,6 +200,21 @@ ERROR_CODE receiveTopic(char *msg, float *val);
 #elif defined(ACT)
 // ACT-specific functions (if any)
 ERROR_CODE actuatorMotorsHandler(uint8_t actu, uint8_t val);
+
+// Dispatches a received "ID*VAL" command to the actuator or configuration handler
+ERROR_CODE actuatorCommandHandler(uint8_t id, const char *val);
+
+// Starts TIM2 and its CH1 control tick interrupt
+void startControlTick(void);
+
+// Schedules the next control tick, called from the TIM2 CH1 compare interrupt
+void controlTickRearm(void);
+
+// Microseconds since a frame was stamped with the TIM2 count and the HAL tick
+uint32_t commandApplyTime(uint16_t stampUs, uint32_t stampMs);
+
+// Acknowledges a sequenced command with its error code and apply time
+void publishAck(uint16_t seq, ERROR_CODE code, uint32_t applyUs);
 #else
 #error "Either DAQ or ACT must be defined."
 #endif
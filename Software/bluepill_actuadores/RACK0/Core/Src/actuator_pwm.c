@@ -0,0 +1,186 @@
+/*
+ * actuator_pwm.c
+ *
+ *  Description:
+ *      Implementation of the runtime PWM configuration for the Rack 0 actuators.
+ */
+
+#include "actuator_pwm.h"
+#include "utils.h"
+
+/******************************************************************************
+ * SECTION 1: PRIVATE TYPES & DATA
+ *****************************************************************************/
+
+/** Mapping of an actuator ID to its timer output */
+typedef struct {
+    PWMTimer timer;      // Timer driving the output
+    uint32_t channel;    // HAL channel (TIM_CHANNEL_x)
+    bool     isPWM;      // false for GPIO driven actuators
+} PWMChannel;
+
+/** Actuator ID -> PWM output, indexed by TopicActuatorIndex */
+static const PWMChannel pwmChannels[NUM_ACTUATORS] = {
+    [WATERING]      = { PWM_TIMER_3, 0,             false },  // GPIO (WATgpio)
+    [DOSE_PUMP0]    = { PWM_TIMER_3, TIM_CHANNEL_3, true  },
+    [DOSE_PUMP1]    = { PWM_TIMER_3, TIM_CHANNEL_4, true  },
+    [DOSE_PUMP2]    = { PWM_TIMER_4, TIM_CHANNEL_1, true  },
+    [LIGHT_CONTROL] = { PWM_TIMER_4, TIM_CHANNEL_2, true  },
+    [FAN_CONTROL0]  = { PWM_TIMER_4, TIM_CHANNEL_3, true  },
+    [FAN_CONTROL1]  = { PWM_TIMER_4, TIM_CHANNEL_4, true  },
+    [HUMIDIFIER]    = { PWM_TIMER_3, 0,             false },  // GPIO (HUMgpio)
+};
+
+/** Timer handles, indexed by PWMTimer */
+static TIM_HandleTypeDef *const pwmTimers[PWM_TIMER_COUNT] = {
+    &htim3,
+    &htim4
+};
+
+/** Last duty requested per actuator, on the 16-bit scale */
+static uint16_t dutyShadow[NUM_ACTUATORS] = {0};
+
+/******************************************************************************
+ * SECTION 2: PRIVATE FUNCTIONS
+ *****************************************************************************/
+
+/**
+ * @brief  Input clock of TIM3/TIM4. APB1 timers run at twice PCLK1 whenever
+ *         the APB1 prescaler is not 1.
+ * @retval Timer clock in Hz.
+ */
+static uint32_t PWM_TimerClock(void) {
+    uint32_t clk = HAL_RCC_GetPCLK1Freq();
+
+    if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) {
+        clk *= 2U;
+    }
+    return clk;
+}
+
+/**
+ * @brief  Convert a 16-bit duty to a compare value for the current ARR (rounded).
+ * @param  timer Timer owning the channel.
+ * @param  duty Duty on the 16-bit scale.
+ * @retval Compare value. Full scale returns ARR + 1 so the output stays on.
+ */
+static uint32_t PWM_DutyToCompare(PWMTimer timer, uint16_t duty) {
+    uint32_t steps = __HAL_TIM_GET_AUTORELOAD(pwmTimers[timer]) + 1U;
+
+    return (uint32_t)(((uint64_t)duty * steps + (PWM_DUTY16_MAX / 2U)) / PWM_DUTY16_MAX);
+}
+
+/**
+ * @brief  Write the shadowed duty of an actuator to its compare register.
+ * @param  actuatorID Actuator ID with a PWM channel.
+ * @retval None
+ */
+static void PWM_Apply(uint8_t actuatorID) {
+    const PWMChannel *ch = &pwmChannels[actuatorID];
+
+    __HAL_TIM_SET_COMPARE(pwmTimers[ch->timer], ch->channel,
+                          PWM_DutyToCompare(ch->timer, dutyShadow[actuatorID]));
+}
+
+/******************************************************************************
+ * SECTION 3: PUBLIC FUNCTIONS
+ *****************************************************************************/
+
+void PWM_Init(void) {
+    for (uint8_t i = 0; i < NUM_ACTUATORS; i++) {
+        if (!pwmChannels[i].isPWM) {
+            continue;
+        }
+        dutyShadow[i] = 0;
+        PWM_Apply(i);
+        HAL_TIM_PWM_Start(pwmTimers[pwmChannels[i].timer], pwmChannels[i].channel);
+    }
+}
+
+bool PWM_ConfigTimer(PWMTimer timer, uint32_t freqHz, uint32_t steps) {
+    if (timer >= PWM_TIMER_COUNT || freqHz == 0U) {
+        return false;
+    }
+
+    uint32_t ticks = PWM_TimerClock() / freqHz;  // Timer ticks per PWM period
+    uint32_t prescaler;
+
+    if (steps == 0U) {
+        // Highest resolution: smallest prescaler that keeps ARR within 16 bits
+        prescaler = (ticks + PWM_MAX_STEPS - 1U) / PWM_MAX_STEPS;
+        if (prescaler == 0U) {
+            prescaler = 1U;
+        }
+        steps = ticks / prescaler;
+    } else {
+        if (steps > PWM_MAX_STEPS) {
+            return false;
+        }
+        prescaler = ticks / steps;
+    }
+
+    if (prescaler == 0U || prescaler > 65536U || steps < PWM_MIN_STEPS) {
+        return false;  // Frequency/resolution pair not reachable
+    }
+
+    TIM_HandleTypeDef *htim = pwmTimers[timer];
+
+    __HAL_TIM_SET_PRESCALER(htim, prescaler - 1U);
+    __HAL_TIM_SET_AUTORELOAD(htim, steps - 1U);
+    htim->Init.Prescaler = prescaler - 1U;
+    htim->Init.Period = steps - 1U;
+
+    // Rescale the compare registers so every channel keeps its duty
+    for (uint8_t i = 0; i < NUM_ACTUATORS; i++) {
+        if (pwmChannels[i].isPWM && pwmChannels[i].timer == timer) {
+            PWM_Apply(i);
+        }
+    }
+
+    // Load the new prescaler right away instead of at the next overflow
+    htim->Instance->EGR = TIM_EGR_UG;
+    return true;
+}
+
+bool PWM_SetDutyPermille(uint8_t actuatorID, uint16_t permille) {
+    if (permille > PWM_PERMILLE_MAX) {
+        return false;
+    }
+    return PWM_SetDuty16(actuatorID,
+                         (uint16_t)(((uint32_t)permille * PWM_DUTY16_MAX + PWM_PERMILLE_MAX / 2U) / PWM_PERMILLE_MAX));
+}
+
+bool PWM_SetDuty16(uint8_t actuatorID, uint16_t duty) {
+    if (actuatorID >= NUM_ACTUATORS || !pwmChannels[actuatorID].isPWM) {
+        return false;
+    }
+
+    dutyShadow[actuatorID] = duty;
+    PWM_Apply(actuatorID);
+    return true;
+}
+
+uint16_t PWM_GetDutyPermille(uint8_t actuatorID) {
+    if (actuatorID >= NUM_ACTUATORS || !pwmChannels[actuatorID].isPWM) {
+        return 0;
+    }
+    return (uint16_t)(((uint32_t)dutyShadow[actuatorID] * PWM_PERMILLE_MAX + PWM_DUTY16_MAX / 2U) / PWM_DUTY16_MAX);
+}
+
+uint32_t PWM_GetFrequency(PWMTimer timer) {
+    if (timer >= PWM_TIMER_COUNT) {
+        return 0;
+    }
+
+    TIM_HandleTypeDef *htim = pwmTimers[timer];
+    uint32_t ticks = (htim->Instance->PSC + 1U) * (__HAL_TIM_GET_AUTORELOAD(htim) + 1U);
+
+    return PWM_TimerClock() / ticks;
+}
+
+uint32_t PWM_GetResolution(PWMTimer timer) {
+    if (timer >= PWM_TIMER_COUNT) {
+        return 0;
+    }
+    return __HAL_TIM_GET_AUTORELOAD(pwmTimers[timer]) + 1U;
+}
@@ -0,0 +1,256 @@
+/*
+ * fan_tach.c
+ *
+ *  Description:
+ *      Implementation of the fan tachometer capture and the closed-loop speed control.
+ */
+
+#include "fan_tach.h"
+#include "actuator_pwm.h"
+#include "pid_control.h"
+#include "utils.h"
+
+/******************************************************************************
+ * SECTION 1: PRIVATE MACROS & DATA
+ *****************************************************************************/
+
+/** Shortest tach period accepted (~20000 RPM), shorter edges are treated as noise */
+#define TACH_MIN_PERIOD_TICKS  (60U * TACH_TICK_HZ / (20000U * FAN_PULSES_PER_REV))
+
+/** Stall timeout in capture ticks and in speed-loop ticks */
+#define TACH_STALL_TICKS       (FAN_STALL_TIMEOUT_MS * (TACH_TICK_HZ / 1000U))
+#define TACH_STALL_LOOPS       (FAN_STALL_TIMEOUT_MS * TACH_LOOP_HZ / 1000U)
+
+TIM_HandleTypeDef htim1;
+
+/** Fan state, indexed by fan number */
+static volatile FanTach fans[FAN_COUNT];
+
+/** Number of TIM1 updates, extends the 16-bit capture to 32 bits */
+static volatile uint32_t tachUpdates = 0;
+
+/** PWM actuator driving each fan */
+static const uint8_t fanActuator[FAN_COUNT] = { FAN_CONTROL0, FAN_CONTROL1 };
+
+/******************************************************************************
+ * SECTION 2: PRIVATE FUNCTIONS
+ *****************************************************************************/
+
+/**
+ * @brief  Clamp a value to a range.
+ */
+static int32_t FanTach_Clamp(int32_t val, int32_t min, int32_t max) {
+    if (val < min) {
+        return min;
+    }
+    if (val > max) {
+        return max;
+    }
+    return val;
+}
+
+/**
+ * @brief  One step of the PI speed controller with feed-forward and anti-windup.
+ * @param  fan Fan index.
+ * @retval None
+ */
+static void FanTach_Control(uint8_t fan) {
+    volatile FanTach *f = &fans[fan];
+    int32_t error = (int32_t)f->targetRpm - (int32_t)f->rpm;
+    int32_t feedForward = (int32_t)f->targetRpm * PWM_PERMILLE_MAX / FAN_MAX_RPM;
+    int32_t proportional = error * FAN_KP_NUM / FAN_KP_DEN;
+    int32_t integralStep = error * FAN_KI_NUM / FAN_KI_DEN;
+    int32_t output = feedForward + proportional + f->integral;
+
+    // Conditional integration: do not wind further into a saturated output
+    if (!((output >= (int32_t)PWM_PERMILLE_MAX && integralStep > 0) ||
+          (output <= (int32_t)FAN_MIN_DUTY_PERMILLE && integralStep < 0))) {
+        f->integral = FanTach_Clamp(f->integral + integralStep,
+                                    -(int32_t)PWM_PERMILLE_MAX, (int32_t)PWM_PERMILLE_MAX);
+    }
+
+    output = FanTach_Clamp(feedForward + proportional + f->integral,
+                           FAN_MIN_DUTY_PERMILLE, PWM_PERMILLE_MAX);
+    PWM_SetDutyPermille(fanActuator[fan], (uint16_t)output);
+}
+
+/******************************************************************************
+ * SECTION 3: PUBLIC FUNCTIONS
+ *****************************************************************************/
+
+void FanTach_Init(void) {
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    TIM_IC_InitTypeDef sConfigIC = {0};
+
+    for (uint8_t i = 0; i < FAN_COUNT; i++) {
+        memset((void *)&fans[i], 0, sizeof(fans[i]));
+    }
+
+    __HAL_RCC_TIM1_CLK_ENABLE();
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+
+    /**TIM1 GPIO Configuration
+    PA8     ------> TIM1_CH1 (tach FAN_CONTROL0)
+    PA11    ------> TIM1_CH4 (tach FAN_CONTROL1)
+    */
+    GPIO_InitStruct.Pin = GPIO_PIN_8 | GPIO_PIN_11;
+    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;  // Tach outputs are open collector
+    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+    // TIM1 sits on APB2, which is not divided: timer clock = PCLK2
+    htim1.Instance = TIM1;
+    htim1.Init.Prescaler = HAL_RCC_GetPCLK2Freq() / TACH_TICK_HZ - 1U;
+    htim1.Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim1.Init.Period = TACH_PERIOD_TICKS - 1U;
+    htim1.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    htim1.Init.RepetitionCounter = 0;
+    htim1.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+    if (HAL_TIM_IC_Init(&htim1) != HAL_OK) {
+        Error_Handler();
+    }
+
+    sConfigIC.ICPolarity = TIM_INPUTCHANNELPOLARITY_FALLING;
+    sConfigIC.ICSelection = TIM_ICSELECTION_DIRECTTI;
+    sConfigIC.ICPrescaler = TIM_ICPSC_DIV1;
+    sConfigIC.ICFilter = 0x0F;  // Longest digital filter, rejects PWM coupling on the tach line
+    if (HAL_TIM_IC_ConfigChannel(&htim1, &sConfigIC, TIM_CHANNEL_1) != HAL_OK) {
+        Error_Handler();
+    }
+    if (HAL_TIM_IC_ConfigChannel(&htim1, &sConfigIC, TIM_CHANNEL_4) != HAL_OK) {
+        Error_Handler();
+    }
+
+    HAL_NVIC_SetPriority(TIM1_CC_IRQn, 1, 0);
+    HAL_NVIC_EnableIRQ(TIM1_CC_IRQn);
+    HAL_NVIC_SetPriority(TIM1_UP_IRQn, 1, 0);
+    HAL_NVIC_EnableIRQ(TIM1_UP_IRQn);
+
+    HAL_TIM_Base_Start_IT(&htim1);
+    HAL_TIM_IC_Start_IT(&htim1, TIM_CHANNEL_1);
+    HAL_TIM_IC_Start_IT(&htim1, TIM_CHANNEL_4);
+}
+
+bool FanTach_SetTarget(uint8_t fan, uint16_t rpm) {
+    if (fan >= FAN_COUNT || rpm > FAN_MAX_RPM) {
+        return false;
+    }
+
+    HAL_NVIC_DisableIRQ(TIM1_UP_IRQn);
+    fans[fan].targetRpm = rpm;
+    fans[fan].integral = 0;
+    HAL_NVIC_EnableIRQ(TIM1_UP_IRQn);
+
+    if (rpm == 0) {
+        PWM_SetDutyPermille(fanActuator[fan], 0);
+    } else {
+        PID_ReleaseActuator(fanActuator[fan]);  // One owner per fan
+    }
+    return true;
+}
+
+void FanTach_ReleaseActuator(uint8_t actuatorID) {
+    for (uint8_t i = 0; i < FAN_COUNT; i++) {
+        if (fanActuator[i] == actuatorID) {
+            HAL_NVIC_DisableIRQ(TIM1_UP_IRQn);
+            fans[i].targetRpm = 0;
+            fans[i].integral = 0;
+            HAL_NVIC_EnableIRQ(TIM1_UP_IRQn);
+        }
+    }
+}
+
+uint16_t FanTach_GetTarget(uint8_t fan) {
+    return (fan < FAN_COUNT) ? fans[fan].targetRpm : 0;
+}
+
+uint16_t FanTach_GetRPM(uint8_t fan) {
+    return (fan < FAN_COUNT) ? fans[fan].rpm : 0;
+}
+
+uint8_t FanTach_GetStallMask(void) {
+    uint8_t mask = 0;
+
+    for (uint8_t i = 0; i < FAN_COUNT; i++) {
+        if (fans[i].stalled) {
+            mask |= (uint8_t)(1U << i);
+        }
+    }
+    return mask;
+}
+
+void FanTach_Publish(void) {
+    publishTopic(TOPIC_FAN_RPM0, FanTach_GetRPM(0));
+    publishTopic(TOPIC_FAN_RPM1, FanTach_GetRPM(1));
+    publishTopic(TOPIC_FAN_STALL, FanTach_GetStallMask());
+}
+
+void FanTach_CaptureISR(TIM_HandleTypeDef *htim) {
+    uint8_t fan;
+    uint32_t channel;
+
+    if (htim->Channel == HAL_TIM_ACTIVE_CHANNEL_1) {
+        fan = 0;
+        channel = TIM_CHANNEL_1;
+    } else if (htim->Channel == HAL_TIM_ACTIVE_CHANNEL_4) {
+        fan = 1;
+        channel = TIM_CHANNEL_4;
+    } else {
+        return;
+    }
+
+    uint32_t capture = HAL_TIM_ReadCapturedValue(htim, channel);
+    uint32_t updates = tachUpdates;
+
+    // Capture right after an overflow whose update interrupt is still pending
+    if (__HAL_TIM_GET_FLAG(htim, TIM_FLAG_UPDATE) && capture < TACH_PERIOD_TICKS / 2U) {
+        updates++;
+    }
+
+    uint32_t now = updates * TACH_PERIOD_TICKS + capture;
+    volatile FanTach *f = &fans[fan];
+
+    if (f->edgeSeen) {
+        uint32_t period = now - f->lastEdge;
+
+        if (period < TACH_MIN_PERIOD_TICKS) {
+            return;  // Glitch, keep the previous edge as reference
+        }
+        f->periodTicks = period;
+        f->rpm = (uint16_t)((60U * TACH_TICK_HZ) / (period * FAN_PULSES_PER_REV));
+    }
+
+    f->lastEdge = now;
+    f->edgeSeen = true;
+}
+
+void FanTach_UpdateISR(void) {
+    uint32_t now = ++tachUpdates * TACH_PERIOD_TICKS;
+
+    for (uint8_t i = 0; i < FAN_COUNT; i++) {
+        volatile FanTach *f = &fans[i];
+
+        // No pulses for too long: the fan is stopped
+        if (f->edgeSeen && (now - f->lastEdge) > TACH_STALL_TICKS) {
+            f->edgeSeen = false;
+            f->rpm = 0;
+        }
+        if (f->rpm < FAN_MIN_RPM) {
+            f->rpm = 0;
+        }
+
+        // Stall: driven for longer than the timeout without turning
+        if (PWM_GetDutyPermille(fanActuator[i]) >= FAN_MIN_DUTY_PERMILLE) {
+            if (f->drivenLoops < TACH_STALL_LOOPS) {
+                f->drivenLoops++;
+            }
+        } else {
+            f->drivenLoops = 0;
+        }
+        f->stalled = (f->drivenLoops >= TACH_STALL_LOOPS) && (f->rpm == 0);
+
+        if (f->targetRpm != 0) {
+            FanTach_Control(i);
+        }
+    }
+}
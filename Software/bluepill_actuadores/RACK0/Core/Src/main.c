@@ -27,6 +27,12 @@
 
 //UTILS LIBRARIES
 #include "rack0_actuator.h"
+#include "actuator_pwm.h"
+#include "fan_tach.h"
+#include "pid_control.h"
+#include "pulse_seq.h"
+#include "scheduler.h"
+#include "uart_link.h"
 #include "utils.h"
 
 /* USER CODE END Includes */
@@ -59,19 +65,26 @@ UART_HandleTypeDef huart1;
 // UART parsing variables
 
 /*
- * ID*NUM
- * ab*abc\r\n
+ * ID*VAL or ID*VAL#SEQ
+ * ab*abcdefgh#12345\r\n
  * data format comming
  */
-#define dataFomatL 8
-uint8_t Final_Data[dataFomatL] = {0};
-uint8_t RxData[dataFomatL] = {0};
-uint8_t temp[2]; // [dataBYE][null chcaracter]
-int indx = 0;
-char *posAstk = NULL;
-char *posCarrun = NULL;
-int ID = 0;
-int VAL = 0;
+UartLine rxLine; // Line taken from the UART link, stamped when its '\n' arrived
+RackCommand command; // rxLine split in place by RackProto_DecodeCommand
+
+// Last sequenced command per ID, answered again without reapplying on a resend
+typedef struct {
+	uint16_t seq;
+	ERROR_CODE code;
+	uint32_t applyUs;
+} CommandAck;
+CommandAck lastAck[NUM_TOPICS] = {0};
+
+// Fan RPM report
+uint32_t lastFanPublish = 0;
+
+// Humidifier state report
+uint8_t lastHumState = 0;
 
 /* USER CODE END PV */
 
@@ -130,21 +143,15 @@ int main(void)
   /********************
    * INITILIZE ACTUATOR
    ********************/
-  TIM3->CCR3 = 0;
-  TIM3->CCR4 = 0;
-  TIM4->CCR1 = 0;
-  TIM4->CCR2 = 0;
-  TIM4->CCR3 = 0;
-  TIM4->CCR4 = 0;
-  HAL_TIM_PWM_Start(&htim3, TIM_CHANNEL_3);
-  HAL_TIM_PWM_Start(&htim3, TIM_CHANNEL_4);
-  HAL_TIM_PWM_Start(&htim4, TIM_CHANNEL_1);
-  HAL_TIM_PWM_Start(&htim4, TIM_CHANNEL_2);
-  HAL_TIM_PWM_Start(&htim4, TIM_CHANNEL_3);
-  HAL_TIM_PWM_Start(&htim4, TIM_CHANNEL_4);
+  PWM_Init();
+  FanTach_Init();
+  PID_Init();
+  PulseSeq_Init();
+  startControlTick();
+  Sched_Init(&hrtc);
 
   /** Communications */
-  HAL_UART_Receive_IT(&huart1, temp, 1);
+  UartLink_Init(); // DMA reception and transmission, baud rate negotiated by the gateway
 
   /* USER CODE END 2 */
 
@@ -155,35 +162,53 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
-	if (temp[0] == '\n')
+	while (UartLink_ReadLine(&rxLine))
 	{
-		// Copy received data into Final_Data and reset the index
-		memcpy(Final_Data, RxData, indx);
-		indx = 0;
-
-		// Locate the delimiters '*' and '\r' in the data
-		posAstk = strchr((char*)Final_Data, '*');  // Position of '*'
-		posCarrun = strchr((char*)Final_Data, '\r'); // Position of '\r'
-
-		// Validate the data format
-		if (posAstk && posCarrun && posCarrun > posAstk)
+		// Split "ID*VAL#SEQ\r\n" in place; "#SEQ" after the value asks for an ACK
+		if (RackProto_DecodeCommand(rxLine.text, &command) == RACK_PROTO_SUCCESS)
 		{
-			// Replace '*' and '\r' with null terminators to split the string
-			*posAstk = '\0'; // Terminate the ID string at '*'
-			*posCarrun = '\0'; // Terminate the VALUE string at '\r'
-
-			// Convert the ID and VALUE substrings to integers
-			ID = atoi((char*)Final_Data);          // ID is before '*'
-			VAL = atoi(posAstk + 1);        // VALUE is after '*'
+			int ID = command.id;
+			uint16_t seq = command.seq;
 
-			// Ensure the ID and VALUE are within valid ranges
-			if (ID >= 0 && ID <= 99 && VAL >= 0 && VAL <= 100)
+			// Ensure the ID is within the valid range
+			if (seq != 0 && ID >= 0 && ID < NUM_TOPICS)
 			{
-				// Update the actuator states using the extracted ID and VALUE
-				actuatorMotorsHandler(ID, VAL);
+				CommandAck *ack = &lastAck[ID];
+				if (ack->seq != seq)
+				{
+					ack->code = actuatorCommandHandler(ID, command.value);
+					ack->applyUs = commandApplyTime(rxLine.stampUs, rxLine.stampMs);
+					ack->seq = seq;
+				}
+				publishAck(seq, ack->code, ack->applyUs);
+			}
+			else if (ID >= 0 && ID <= RACK_PROTO_MAX_COMMAND_ID)
+			{
+				// Range checks on the VALUE are done per command ID
+				actuatorCommandHandler(ID, command.value);
 			}
 		}
 	}
+
+	// Baud rate fallback and link throughput report
+	UartLink_Process();
+
+	// Report fan speed and stall state to the gateway
+	if (HAL_GetTick() - lastFanPublish >= FAN_PUBLISH_PERIOD_MS)
+	{
+		lastFanPublish = HAL_GetTick();
+		FanTach_Publish();
+	}
+
+	// Report the humidifier state once its button sequence settles
+	if (!PulseSeq_IsBusy(PULSE_CH_HUMIDIFIER) && PulseSeq_GetState(PULSE_CH_HUMIDIFIER) != lastHumState)
+	{
+		lastHumState = PulseSeq_GetState(PULSE_CH_HUMIDIFIER);
+		publishTopic(TOPIC_HUMIDIFIER_STATE, lastHumState);
+	}
+
+	// Photoperiod and irrigation schedule, evaluated on each RTC alarm
+	Sched_Process();
   }
   /* USER CODE END 3 */
 }
@@ -265,6 +290,11 @@ static void MX_RTC_Init(void)
   }
 
   /* USER CODE BEGIN Check_RTC_BKUP */
+  // Keep the time of day across resets once it has been set by the gateway
+  if (HAL_RTCEx_BKUPRead(&hrtc, SCHED_RTC_BKP_REG) == SCHED_RTC_MAGIC)
+  {
+    return;
+  }
 
   /* USER CODE END Check_RTC_BKUP */
 
@@ -537,12 +567,59 @@ static void MX_GPIO_Init(void)
 }
 
 /* USER CODE BEGIN 4 */
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
 {
-	memcpy(RxData+indx,temp,1);
-	if (++indx >= dataFomatL) indx = 0;
+	if (huart->Instance == USART1)
+	{
+		UartLink_RxEventISR(Size); // Idle line, half or full RX DMA buffer
+	}
+}
 
-	HAL_UART_Receive_IT(&huart1,temp,1); //start next data receive interrupt
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	if (huart->Instance == USART1)
+	{
+		UartLink_TxCpltISR(); // Next chunk of the TX ring
+	}
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+	if (huart->Instance == USART1)
+	{
+		UartLink_ErrorISR(); // Restarts the reception after an overrun
+	}
+}
+
+void HAL_TIM_IC_CaptureCallback(TIM_HandleTypeDef *htim)
+{
+	if (htim->Instance == TIM1)
+	{
+		FanTach_CaptureISR(htim); // Fan tachometer edge
+	}
+}
+
+void HAL_TIM_OC_DelayElapsedCallback(TIM_HandleTypeDef *htim)
+{
+	if (htim->Instance == TIM2 && htim->Channel == HAL_TIM_ACTIVE_CHANNEL_1)
+	{
+		controlTickRearm(); // Next tick, CONTROL_TICK_US later
+		PID_Tick();         // Fixed-rate control loops
+		PulseSeq_Tick();    // Button-emulated devices
+	}
+}
+
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
+{
+	if (htim->Instance == TIM1)
+	{
+		FanTach_UpdateISR(); // Fan stall detection and speed loop
+	}
+}
+
+void HAL_RTC_AlarmAEventCallback(RTC_HandleTypeDef *hrtc)
+{
+	Sched_AlarmISR(); // Schedule step, handled in the main loop
 }
 /* USER CODE END 4 */
 
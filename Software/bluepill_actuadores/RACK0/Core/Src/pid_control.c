@@ -0,0 +1,202 @@
+/*
+ * pid_control.c
+ *
+ *  Description:
+ *      Implementation of the fixed-point PID engine.
+ */
+
+#include "pid_control.h"
+#include "actuator_pwm.h"
+#include "fan_tach.h"
+#include "utils.h"
+
+/******************************************************************************
+ * SECTION 1: PRIVATE MACROS & DATA
+ *****************************************************************************/
+
+/** Control ticks per loop execution */
+#define PID_TICK_DIVIDER       (CONTROL_TICK_HZ / PID_RATE_HZ)
+
+/** Stale PV threshold in loop executions */
+#define PID_PV_TIMEOUT_RUNS    (PID_PV_TIMEOUT_S * PID_RATE_HZ)
+
+/** Default loop table, loaded by PID_Init() */
+static const PIDLoop pidDefaults[PID_MAX_LOOPS] = {
+    {   // Loop 0: ambient temperature -> fan 0 (cooling)
+        .sensorID = AMBIENT_TEMPERATURE, .actuatorID = FAN_CONTROL0, .action = PID_REVERSE,
+        .kp = Q16_FROM_INT(100), .ki = Q16_FROM_INT(2), .kd = 0,
+        .outMin = Q16_FROM_INT(0), .outMax = Q16_FROM_INT(1000), .failsafe = Q16_FROM_INT(500),
+        .setpoint = Q16_FROM_INT(26)
+    },
+    {   // Loop 1: ambient humidity -> fan 1 (venting)
+        .sensorID = AMBIENT_HUMIDITY, .actuatorID = FAN_CONTROL1, .action = PID_REVERSE,
+        .kp = Q16_FROM_INT(30), .ki = Q16_FROM_MILLI(500), .kd = 0,
+        .outMin = Q16_FROM_INT(0), .outMax = Q16_FROM_INT(1000), .failsafe = Q16_FROM_INT(300),
+        .setpoint = Q16_FROM_INT(70)
+    }
+};
+
+/** Loop table: run by PID_Tick() from the TIM2 interrupt, changed by the main loop with interrupts masked */
+static PIDLoop pidLoops[PID_MAX_LOOPS];
+
+/** Control tick counter used to divide the TIM2 tick down to PID_RATE_HZ */
+static uint8_t pidTickCount = 0;
+
+/******************************************************************************
+ * SECTION 2: PRIVATE FUNCTIONS
+ *****************************************************************************/
+
+/**
+ * @brief  Q16.16 multiply with 64-bit intermediate (single SMULL on Cortex-M3).
+ */
+static inline q16_t PID_Mul(q16_t a, q16_t b) {
+    return (q16_t)(((int64_t)a * b) >> 16);
+}
+
+/**
+ * @brief  Clamp a Q16.16 value to a range.
+ */
+static inline q16_t PID_Clamp(q16_t val, q16_t min, q16_t max) {
+    return (val < min) ? min : ((val > max) ? max : val);
+}
+
+/**
+ * @brief  Execute one loop.
+ * @param  pid Loop to run.
+ * @retval None
+ */
+static void PID_Run(PIDLoop *pid) {
+    q16_t output;
+
+    if (!pid->pvValid || pid->pvAge >= PID_PV_TIMEOUT_RUNS) {
+        // No fresh measurement: hold the failsafe output and restart the integrator
+        output = pid->failsafe;
+        pid->integral = 0;
+    } else {
+        pid->pvAge++;
+
+        q16_t error = pid->setpoint - pid->pv;
+        q16_t dPv = pid->pv - pid->prevPv;
+
+        if (pid->action == PID_REVERSE) {
+            error = -error;
+            dPv = -dPv;
+        }
+        pid->prevPv = pid->pv;
+
+        // Gains are per second: scale I and D to the loop period
+        q16_t proportional = PID_Mul(pid->kp, error);
+        q16_t integralStep = PID_Mul(pid->ki, error) / (q16_t)PID_RATE_HZ;
+        q16_t derivative = -PID_Mul(pid->kd, dPv) * (q16_t)PID_RATE_HZ;
+
+        output = proportional + pid->integral + integralStep + derivative;
+
+        // Anti-windup: only integrate while the output is not saturated in that direction
+        if (!((output > pid->outMax && integralStep > 0) || (output < pid->outMin && integralStep < 0))) {
+            pid->integral = PID_Clamp(pid->integral + integralStep, pid->outMin, pid->outMax);
+        }
+
+        output = PID_Clamp(proportional + pid->integral + derivative, pid->outMin, pid->outMax);
+    }
+
+    pid->output = (uint16_t)Q16_TO_INT(output);
+    PWM_SetDutyPermille(pid->actuatorID, pid->output);
+}
+
+/******************************************************************************
+ * SECTION 3: PUBLIC FUNCTIONS
+ *****************************************************************************/
+
+void PID_Init(void) {
+    memcpy(pidLoops, pidDefaults, sizeof(pidLoops));
+    pidTickCount = 0;
+}
+
+void PID_Tick(void) {
+    if (++pidTickCount < PID_TICK_DIVIDER) {
+        return;
+    }
+    pidTickCount = 0;
+
+    for (uint8_t i = 0; i < PID_MAX_LOOPS; i++) {
+        if (pidLoops[i].enabled) {
+            PID_Run(&pidLoops[i]);
+        }
+    }
+}
+
+bool PID_SetSetpoint(uint8_t loop, q16_t setpoint) {
+    if (loop >= PID_MAX_LOOPS) {
+        return false;
+    }
+    __disable_irq();
+    pidLoops[loop].setpoint = setpoint;
+    __enable_irq();
+    return true;
+}
+
+bool PID_Enable(uint8_t loop, bool enable) {
+    if (loop >= PID_MAX_LOOPS) {
+        return false;
+    }
+
+    PIDLoop *pid = &pidLoops[loop];
+
+    if (enable) {
+        FanTach_ReleaseActuator(pid->actuatorID);  // One owner per fan
+    }
+
+    // The seed and the enable flag must not interleave with a running step
+    __disable_irq();
+    if (enable && !pid->enabled) {
+        // Bumpless start: seed the integrator with the output currently applied
+        uint16_t current = PWM_GetDutyPermille(pid->actuatorID);
+
+        pid->integral = PID_Clamp(Q16_FROM_INT(current), pid->outMin, pid->outMax);
+        pid->prevPv = pid->pv;
+    }
+    pid->enabled = enable;
+    __enable_irq();
+    return true;
+}
+
+void PID_SetProcessValue(uint8_t sensorID, q16_t value) {
+    __disable_irq();
+    for (uint8_t i = 0; i < PID_MAX_LOOPS; i++) {
+        PIDLoop *pid = &pidLoops[i];
+
+        if (pid->sensorID != sensorID) {
+            continue;
+        }
+        if (!pid->pvValid) {
+            pid->prevPv = value;  // No derivative kick on the first sample
+        }
+        pid->pv = value;
+        pid->pvAge = 0;
+        pid->pvValid = true;
+    }
+    __enable_irq();
+}
+
+void PID_ReleaseActuator(uint8_t actuatorID) {
+    __disable_irq();
+    for (uint8_t i = 0; i < PID_MAX_LOOPS; i++) {
+        if (pidLoops[i].actuatorID == actuatorID) {
+            pidLoops[i].enabled = false;
+        }
+    }
+    __enable_irq();
+}
+
+bool PID_IsDriving(uint8_t actuatorID) {
+    for (uint8_t i = 0; i < PID_MAX_LOOPS; i++) {
+        if (pidLoops[i].enabled && pidLoops[i].actuatorID == actuatorID) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const PIDLoop *PID_GetLoop(uint8_t loop) {
+    return (loop < PID_MAX_LOOPS) ? &pidLoops[loop] : NULL;
+}
@@ -0,0 +1,183 @@
+/*
+ * pulse_seq.c
+ *
+ *  Description:
+ *      Implementation of the non-blocking pulse-train sequencer.
+ */
+
+#include "pulse_seq.h"
+
+/******************************************************************************
+ * SECTION 1: PRIVATE TYPES & DATA
+ *****************************************************************************/
+
+/** Output and behaviour of a button-emulated device */
+typedef struct {
+    GPIO_TypeDef *port;
+    uint16_t      pin;
+    GPIO_PinState pressLevel;
+    uint8_t       states;       // Logical states cycled by each press
+    uint16_t      pressMs;      // Press duration used by PulseSeq_SetState()
+    uint16_t      releaseMs;    // Gap duration used by PulseSeq_SetState()
+} PulseDevice;
+
+/** Sequence being played on a channel */
+typedef struct {
+    uint16_t ticks[PULSE_SEQ_MAX_STEPS];  // Step durations in control ticks
+    uint8_t  count;                       // Steps in the pattern
+    uint8_t  step;                        // Current step
+    uint16_t remaining;                   // Ticks left in the current step
+    bool     busy;                        // Sequence running
+    uint8_t  state;                       // Logical device state
+    uint8_t  target;                      // State requested while busy
+    bool     hasTarget;                   // target is pending
+} PulseSequence;
+
+static const PulseDevice pulseDevices[PULSE_CH_COUNT] = {
+    [PULSE_CH_HUMIDIFIER] = { HUMgpio_GPIO_Port, HUMgpio_Pin, HUM_PRESS_LEVEL,
+                              HUM_STATES, HUM_PRESS_MS, HUM_RELEASE_MS },
+};
+
+static volatile PulseSequence pulseSeqs[PULSE_CH_COUNT];
+
+/******************************************************************************
+ * SECTION 2: PRIVATE FUNCTIONS
+ *****************************************************************************/
+
+/**
+ * @brief  Drive the button output of a channel.
+ */
+static void PulseSeq_Write(PulseChannel ch, bool pressed) {
+    const PulseDevice *dev = &pulseDevices[ch];
+    GPIO_PinState level = pressed ? dev->pressLevel
+                                  : (dev->pressLevel == GPIO_PIN_SET ? GPIO_PIN_RESET : GPIO_PIN_SET);
+
+    HAL_GPIO_WritePin(dev->port, dev->pin, level);
+}
+
+/**
+ * @brief  Load a pattern and press the button for the first step.
+ *         Must be called with the channel idle.
+ */
+static void PulseSeq_Load(PulseChannel ch, const uint16_t *stepsMs, uint8_t count) {
+    volatile PulseSequence *seq = &pulseSeqs[ch];
+
+    for (uint8_t i = 0; i < count; i++) {
+        uint16_t ticks = (uint16_t)((stepsMs[i] + PULSE_SEQ_TICK_MS - 1U) / PULSE_SEQ_TICK_MS);
+        seq->ticks[i] = (ticks == 0U) ? 1U : ticks;
+    }
+    seq->count = count;
+    seq->step = 0;
+    seq->remaining = seq->ticks[0];
+    seq->busy = true;
+    PulseSeq_Write(ch, true);
+}
+
+/**
+ * @brief  Start the presses needed to move from the current state to the target.
+ *         Must be called with the channel idle.
+ */
+static void PulseSeq_StartTarget(PulseChannel ch, uint8_t target) {
+    const PulseDevice *dev = &pulseDevices[ch];
+    uint8_t presses = (uint8_t)((target + dev->states - pulseSeqs[ch].state) % dev->states);
+    uint16_t steps[PULSE_SEQ_MAX_STEPS];
+    uint8_t count = 0;
+
+    while (presses-- > 0U && count + 1U < PULSE_SEQ_MAX_STEPS) {
+        steps[count++] = dev->pressMs;
+        steps[count++] = dev->releaseMs;
+    }
+    if (count > 0U) {
+        PulseSeq_Load(ch, steps, count);
+    }
+}
+
+/******************************************************************************
+ * SECTION 3: PUBLIC FUNCTIONS
+ *****************************************************************************/
+
+void PulseSeq_Init(void) {
+    for (uint8_t ch = 0; ch < PULSE_CH_COUNT; ch++) {
+        memset((void *)&pulseSeqs[ch], 0, sizeof(pulseSeqs[ch]));
+        PulseSeq_Write((PulseChannel)ch, false);
+    }
+}
+
+bool PulseSeq_Start(PulseChannel ch, const uint16_t *stepsMs, uint8_t count) {
+    if (ch >= PULSE_CH_COUNT || count == 0U || count > PULSE_SEQ_MAX_STEPS) {
+        return false;
+    }
+
+    bool started = false;
+
+    __disable_irq();
+    if (!pulseSeqs[ch].busy) {
+        pulseSeqs[ch].hasTarget = false;
+        PulseSeq_Load(ch, stepsMs, count);
+        started = true;
+    }
+    __enable_irq();
+    return started;
+}
+
+bool PulseSeq_SetState(PulseChannel ch, uint8_t state) {
+    if (ch >= PULSE_CH_COUNT || state >= pulseDevices[ch].states) {
+        return false;
+    }
+
+    __disable_irq();
+    if (pulseSeqs[ch].busy) {
+        // Applied by PulseSeq_Tick() when the running sequence ends
+        pulseSeqs[ch].target = state;
+        pulseSeqs[ch].hasTarget = true;
+    } else {
+        PulseSeq_StartTarget(ch, state);
+    }
+    __enable_irq();
+    return true;
+}
+
+bool PulseSeq_SyncState(PulseChannel ch, uint8_t state) {
+    if (ch >= PULSE_CH_COUNT || state >= pulseDevices[ch].states) {
+        return false;
+    }
+    pulseSeqs[ch].state = state;
+    return true;
+}
+
+uint8_t PulseSeq_GetState(PulseChannel ch) {
+    return (ch < PULSE_CH_COUNT) ? pulseSeqs[ch].state : 0;
+}
+
+bool PulseSeq_IsBusy(PulseChannel ch) {
+    return (ch < PULSE_CH_COUNT) ? pulseSeqs[ch].busy : false;
+}
+
+void PulseSeq_Tick(void) {
+    for (uint8_t ch = 0; ch < PULSE_CH_COUNT; ch++) {
+        volatile PulseSequence *seq = &pulseSeqs[ch];
+
+        if (!seq->busy || --seq->remaining > 0U) {
+            continue;
+        }
+
+        // Even steps are presses: a completed press advances the device state
+        if ((seq->step & 1U) == 0U) {
+            seq->state = (uint8_t)((seq->state + 1U) % pulseDevices[ch].states);
+        }
+
+        if (++seq->step < seq->count) {
+            seq->remaining = seq->ticks[seq->step];
+            PulseSeq_Write((PulseChannel)ch, (seq->step & 1U) == 0U);
+            continue;
+        }
+
+        // Pattern done: release, then chase a target requested meanwhile
+        PulseSeq_Write((PulseChannel)ch, false);
+        seq->busy = false;
+        if (seq->hasTarget) {
+            seq->hasTarget = false;
+            PulseSeq_StartTarget((PulseChannel)ch, seq->target);
+        }
+    }
+}
@@ -0,0 +1,250 @@
+/*
+ * scheduler.c
+ *
+ *  Description:
+ *      Implementation of the RTC photoperiod and irrigation scheduler.
+ */
+
+#include "scheduler.h"
+#include "actuator_pwm.h"
+#include "fan_tach.h"
+#include "pid_control.h"
+#include "utils.h"
+
+/******************************************************************************
+ * SECTION 1: SCHEDULE TABLE (FLASH)
+ *****************************************************************************/
+
+/** Later entries win when windows of the same actuator overlap */
+static const ScheduleEntry scheduleTable[] = {
+    // Grow light: 16/8 photoperiod with 30 min sunrise and sunset
+    { LIGHT_CONTROL, SCHED_RAMP,  SCHED_HM(6, 0),  SCHED_HM(22, 0), 1000, 30, 0  },
+    // Watering: 60 s every 2 hours during the day
+    { WATERING,      SCHED_PULSE, SCHED_HM(6, 0),  SCHED_HM(22, 0), 0,    120, 60 },
+    // Fans: 40% during the day, 15% at night
+    { FAN_CONTROL0,  SCHED_LEVEL, SCHED_HM(22, 0), SCHED_HM(6, 0),  150,  0,  0  },
+    { FAN_CONTROL0,  SCHED_LEVEL, SCHED_HM(6, 0),  SCHED_HM(22, 0), 400,  0,  0  },
+    { FAN_CONTROL1,  SCHED_LEVEL, SCHED_HM(22, 0), SCHED_HM(6, 0),  150,  0,  0  },
+    { FAN_CONTROL1,  SCHED_LEVEL, SCHED_HM(6, 0),  SCHED_HM(22, 0), 400,  0,  0  },
+};
+
+#define SCHED_ENTRIES          (sizeof(scheduleTable) / sizeof(scheduleTable[0]))
+#define SCHED_OVERRIDE_STEPS   (SCHED_OVERRIDE_MIN * 60U / SCHED_STEP_S)
+#define SCHED_NOT_APPLIED      0xFFFFU
+
+/******************************************************************************
+ * SECTION 2: PRIVATE DATA
+ *****************************************************************************/
+
+static RTC_HandleTypeDef *schedRtc = NULL;
+static volatile bool schedAlarm = false;     // Set by the RTC alarm interrupt
+static bool schedEnabled = true;
+static uint16_t overrideSteps[NUM_ACTUATORS];  // Remaining override per actuator
+static uint16_t lastApplied[NUM_ACTUATORS];    // Last level written by the scheduler
+
+/******************************************************************************
+ * SECTION 3: PRIVATE FUNCTIONS
+ *****************************************************************************/
+
+/**
+ * @brief  Whether the RTC has been set since the last backup domain reset.
+ */
+static bool Sched_TimeValid(void) {
+    return HAL_RTCEx_BKUPRead(schedRtc, SCHED_RTC_BKP_REG) == SCHED_RTC_MAGIC;
+}
+
+/**
+ * @brief  Current time of day in seconds.
+ */
+static uint32_t Sched_Now(void) {
+    RTC_TimeTypeDef time = {0};
+
+    HAL_RTC_GetTime(schedRtc, &time, RTC_FORMAT_BIN);
+    return (uint32_t)time.Hours * 3600U + (uint32_t)time.Minutes * 60U + time.Seconds;
+}
+
+/**
+ * @brief  Arm the RTC alarm on the next SCHED_STEP_S boundary.
+ */
+static void Sched_Arm(uint32_t now) {
+    RTC_AlarmTypeDef alarm = {0};
+    uint32_t next = ((now / SCHED_STEP_S) + 1U) * SCHED_STEP_S % SCHED_DAY_S;
+
+    alarm.Alarm = RTC_ALARM_A;
+    alarm.AlarmTime.Hours = (uint8_t)(next / 3600U);
+    alarm.AlarmTime.Minutes = (uint8_t)((next / 60U) % 60U);
+    alarm.AlarmTime.Seconds = (uint8_t)(next % 60U);
+    HAL_RTC_SetAlarm_IT(schedRtc, &alarm, RTC_FORMAT_BIN);
+}
+
+/**
+ * @brief  Level of an entry at a time of day.
+ * @param  entry Schedule entry.
+ * @param  now Time of day in seconds.
+ * @param  level Output, written only if the entry is active.
+ * @retval true if the time falls inside the entry window.
+ */
+static bool Sched_EntryLevel(const ScheduleEntry *entry, uint32_t now, uint16_t *level) {
+    uint32_t start = (uint32_t)entry->startMin * 60U;
+    uint32_t length = ((uint32_t)entry->endMin * 60U + SCHED_DAY_S - start) % SCHED_DAY_S;
+    uint32_t elapsed = (now + SCHED_DAY_S - start) % SCHED_DAY_S;
+
+    if (elapsed >= length) {
+        return false;
+    }
+
+    switch (entry->kind) {
+        case SCHED_RAMP: {
+            uint32_t ramp = (uint32_t)entry->rampMin * 60U;
+            uint32_t remaining = length - elapsed;
+
+            if (ramp != 0U && elapsed < ramp) {
+                *level = (uint16_t)(entry->level * elapsed / ramp);          // Sunrise
+            } else if (ramp != 0U && remaining < ramp) {
+                *level = (uint16_t)(entry->level * remaining / ramp);        // Sunset
+            } else {
+                *level = entry->level;
+            }
+            break;
+        }
+
+        case SCHED_PULSE: {
+            uint32_t period = (uint32_t)entry->rampMin * 60U;
+            *level = (period != 0U && (elapsed % period) < entry->pulseS) ? PWM_PERMILLE_MAX : 0U;
+            break;
+        }
+
+        default:
+            *level = entry->level;
+            break;
+    }
+    return true;
+}
+
+/**
+ * @brief  Whether a closed-loop controller owns the actuator.
+ */
+static bool Sched_ClosedLoop(uint8_t actuatorID) {
+    if (actuatorID == FAN_CONTROL0 || actuatorID == FAN_CONTROL1) {
+        if (FanTach_GetTarget(actuatorID - FAN_CONTROL0) != 0U) {
+            return true;
+        }
+    }
+    return PID_IsDriving(actuatorID);
+}
+
+/**
+ * @brief  Drive an actuator to a scheduled level.
+ */
+static void Sched_Apply(uint8_t actuatorID, uint16_t level) {
+    if (lastApplied[actuatorID] == level) {
+        return;
+    }
+    lastApplied[actuatorID] = level;
+
+    if (actuatorID == WATERING) {
+        actuatorMotorsHandler(WATERING, level != 0U);  // GPIO driven pump
+    } else {
+        PWM_SetDutyPermille(actuatorID, level);
+    }
+}
+
+/**
+ * @brief  Evaluate the whole table at a time of day.
+ */
+static void Sched_Evaluate(uint32_t now) {
+    uint16_t level[NUM_ACTUATORS];
+    bool managed[NUM_ACTUATORS] = {false};
+
+    for (uint8_t i = 0; i < SCHED_ENTRIES; i++) {
+        const ScheduleEntry *entry = &scheduleTable[i];
+
+        if (!managed[entry->actuatorID]) {
+            managed[entry->actuatorID] = true;
+            level[entry->actuatorID] = 0;  // Off outside every window
+        }
+        Sched_EntryLevel(entry, now, &level[entry->actuatorID]);
+    }
+
+    for (uint8_t id = 0; id < NUM_ACTUATORS; id++) {
+        if (overrideSteps[id] > 0U) {
+            overrideSteps[id]--;
+            continue;
+        }
+        if (!managed[id]) {
+            continue;
+        }
+        if (Sched_ClosedLoop(id)) {
+            lastApplied[id] = SCHED_NOT_APPLIED;  // Re-apply once released
+            continue;
+        }
+        Sched_Apply(id, level[id]);
+    }
+}
+
+/******************************************************************************
+ * SECTION 4: PUBLIC FUNCTIONS
+ *****************************************************************************/
+
+void Sched_Init(RTC_HandleTypeDef *hrtc) {
+    schedRtc = hrtc;
+    memset(overrideSteps, 0, sizeof(overrideSteps));
+    memset(lastApplied, 0xFF, sizeof(lastApplied));
+
+    HAL_NVIC_SetPriority(RTC_Alarm_IRQn, 3, 0);
+    HAL_NVIC_EnableIRQ(RTC_Alarm_IRQn);
+
+    // First evaluation from the main loop, which also arms the alarm
+    schedAlarm = Sched_TimeValid();
+}
+
+void Sched_Process(void) {
+    if (!schedAlarm) {
+        return;
+    }
+    schedAlarm = false;
+
+    uint32_t now = Sched_Now();
+
+    if (schedEnabled) {
+        Sched_Evaluate(now);
+    }
+    Sched_Arm(now);
+}
+
+void Sched_AlarmISR(void) {
+    schedAlarm = true;
+}
+
+bool Sched_SetTime(uint16_t hhmm) {
+    RTC_TimeTypeDef time = {0};
+
+    time.Hours = (uint8_t)(hhmm / 100U);
+    time.Minutes = (uint8_t)(hhmm % 100U);
+    if (time.Hours > 23U || time.Minutes > 59U) {
+        return false;
+    }
+    if (HAL_RTC_SetTime(schedRtc, &time, RTC_FORMAT_BIN) != HAL_OK) {
+        return false;
+    }
+    HAL_RTCEx_BKUPWrite(schedRtc, SCHED_RTC_BKP_REG, SCHED_RTC_MAGIC);
+
+    schedAlarm = true;  // Re-evaluate and re-arm from the new time
+    return true;
+}
+
+void Sched_Enable(bool enable) {
+    schedEnabled = enable;
+    if (enable) {
+        memset(lastApplied, 0xFF, sizeof(lastApplied));
+        schedAlarm = Sched_TimeValid();
+    }
+}
+
+void Sched_Override(uint8_t actuatorID) {
+    if (actuatorID >= NUM_ACTUATORS) {
+        return;
+    }
+    overrideSteps[actuatorID] = SCHED_OVERRIDE_STEPS;
+    lastApplied[actuatorID] = SCHED_NOT_APPLIED;  // Re-apply once the override expires
+}
@@ -13,61 +13,14 @@
 #define SRC_UTILS_C_
 
 #include "utils.h"
-
-// ---------------------------
-// List of Valid Topics
-// ---------------------------
-
-#ifdef DAQ
-/* Sensor Topics Array */
-const char* valid_topics[] = {
-    TOPIC_WATER_TEMPERATURE,
-    TOPIC_AMBIENT_TEMPERATURE,
-    TOPIC_AMBIENT_HUMIDITY,
-    TOPIC_WATER_PH,
-    TOPIC_WATER_TDS,
-    TOPIC_WATER_EC
-};
-size_t num_valid_topics = sizeof(valid_topics) / sizeof(valid_topics[0]);
-
-typedef enum {
-    WATER_TEMPERATURE = 0,
-    AMBIENT_TEMPERATURE,
-    AMBIENT_HUMIDITY,
-    WATER_PH,
-    WATER_TDS,
-    WATER_EC,
-    NUM_SENSOR_TOPICS
-} TopicSensorIndex;
-
-#elif defined(ACT)
-/* Actuator Topics Array */
-const char* valid_topics[] = {
-    TOPIC_WATERING,
-    TOPIC_DOSE_PUMP0,
-    TOPIC_DOSE_PUMP1,
-    TOPIC_DOSE_PUMP2,
-    TOPIC_LIGHT_CONTROL,
-    TOPIC_FAN_CONTROL0,
-    TOPIC_FAN_CONTROL1,
-    TOPIC_HUMIDIFIER
-};
-size_t num_valid_topics = sizeof(valid_topics) / sizeof(valid_topics[0]);
-
-typedef enum {
-    WATERING = 0,
-    DOSE_PUMP0,
-    DOSE_PUMP1,
-    DOSE_PUMP2,
-    LIGHT_CONTROL,
-    FAN_CONTROL0,
-    FAN_CONTROL1,
-    HUMIDIFIER,
-    NUM_TOPICS
-} TopicActuatorIndex;
-
-#else
-#error "Either DAQ or ACT must be defined."
+#include "uart_link.h"
+
+#ifdef ACT
+#include "actuator_pwm.h"
+#include "fan_tach.h"
+#include "pid_control.h"
+#include "pulse_seq.h"
+#include "scheduler.h"
 #endif
 
 // ---------------------------
@@ -78,97 +31,86 @@ typedef enum {
  * @brief Delays execution for a specified number of microseconds.
  *
  * This function uses a hardware timer (TIM2) to provide a precise delay
- * in microseconds. The counter of the timer is set to 0, and the function
- * waits until the timer reaches the desired delay.
+ * in microseconds. TIM2 free-runs (it also paces the control tick), so the
+ * elapsed time is measured from the current count instead of resetting it.
  *
  * @param us The number of microseconds to delay.
  */
 void delay_us(uint16_t us)
 {
-    __HAL_TIM_SET_COUNTER(&htim2, 0);  // Set the counter value to 0
-    while (__HAL_TIM_GET_COUNTER(&htim2) < us);  // Wait for the counter to reach the specified delay
+    uint16_t start = __HAL_TIM_GET_COUNTER(&htim2);  // Reference count
+    while ((uint16_t)(__HAL_TIM_GET_COUNTER(&htim2) - start) < us);  // Wait, wrap-safe
 }
 
 /**
  * @brief Publishes a message with a given topic and floating-point value over UART.
  *
  * This function formats a message with the given topic and value, then
- * transmits it over UART (USART1). The format is: <topic>*<value>\r\n.
+ * queues it on the UART link (USART1, sent by DMA). The format is: <topic>*<value>\r\n.
  *
  * @param topic The MQTT topic to send.
  * @param val The floating-point value to include in the message.
  */
 void publishTopic(const char* topic, float val)
 {
-    char uart_buf[50] = {0};
-    sprintf(uart_buf, "%s*%.2f\r\n", topic, val);  // Format the topic and value into the buffer
-
-    size_t len = strlen(uart_buf);  // Calculate the length of the message
-
-    HAL_UART_Transmit(&huart1, (uint8_t*)uart_buf, len, HAL_MAX_DELAY);  // Transmit the message over UART
-
-    HAL_Delay(3000);  // Optional delay after publishing the message (adjustable based on needs)
-}
+    char uart_buf[RACK_PROTO_LINE_SIZE];
+    int len;
+
+    // Formatted in thousandths with integer math, no float printf; NaN or out of range -> "nan"
+    if (val > -2000000.0f && val < 2000000.0f) {
+        milli_t milli = (milli_t)(val * 1000.0f + (val < 0.0f ? -0.5f : 0.5f));
+        len = RackProto_EncodeMilli(uart_buf, sizeof(uart_buf), NULL, topic, milli, 2);
+    } else {
+        len = RackProto_EncodeText(uart_buf, sizeof(uart_buf), topic, "nan");
+    }
+    len = RackProto_EndFrame(uart_buf, sizeof(uart_buf), len);
 
-/**
- * @brief Identifies if the topic provided exists in the list of valid topics.
- *
- * This function checks if the given topic is part of the predefined valid topics.
- *
- * @param topic The topic to check.
- * @return ERROR_CODE Returns SUCCESS if valid, otherwise returns UNKNOWN_TOPIC.
- */
-static ERROR_CODE identifyTopic(const char *topic)
-{
-    for (int i = 0; i < num_valid_topics; i++) {
-        if (strcmp(topic, valid_topics[i]) == 0) {
-            return SUCCESS;  // Topic is valid
-        }
+    if (len > 0) {
+        UartLink_Write((uint8_t*)uart_buf, (uint16_t)len);  // Queued for the UART DMA
     }
-    return UNKNOWN_TOPIC;  // Topic not found
+
+#ifdef DAQ
+    UartLink_Delay(3000);  // Optional delay after publishing the message (adjustable based on needs)
+#endif
 }
 
 /**
  * @brief Receives a message with topic and value, and parses the value from the string.
  *
- * This function searches for the '*' character to separate the topic and value,
- * then converts the value from string to float. It also verifies that the topic is valid.
+ * The message is split in place at the '*' delimiter and the value is parsed as a
+ * decimal number. The topic must be one of this board's topics under RACK_PREFIX.
  *
- * @param msg The message string.
+ * @param msg The message string, modified in place.
  * @param val Pointer to the float where the value will be stored.
  * @return ERROR_CODE Returns SUCCESS if the message is valid and successfully parsed,
  *         or an error code indicating failure.
  */
-ERROR_CODE reciveTopic(char *msg, float *val)
+ERROR_CODE receiveTopic(char *msg, float *val)
 {
-    // Search for the '*' character
-    char *pos = strchr(msg, '*');
+    RackFrame frame;
+    milli_t milli;
 
-    if (pos != NULL) {
-        // Calculate the index (position) of the '*' character
-        int8_t index = pos - msg;
-
-        // Separate the topic and data
-        char topic[50] = {0};  // Buffer for the topic
-        char data[4] = {0};    // Buffer for the data (3 characters + '\0')
-
-        // Copy the topic up to the '*' character
-        strncpy(topic, msg, index);
-        topic[index] = '\0';  // Ensure null-termination
-
-        // Copy the data after '*' (3 characters maximum)
-        strncpy(data, pos + 1, 3);
-        data[3] = '\0';  // Ensure null-termination
-
-        // Convert data to a numeric value
-        *val = atof(data);
+    if (RackProto_DecodeFrame(msg, &frame) != RACK_PROTO_SUCCESS) {
+        return CHAR_NOT_FOUND;
+    }
 
-        // Identify the topic
-        return identifyTopic(topic);
+    // Identify the topic
+    if (strncmp(frame.topic, RACK_PREFIX, sizeof(RACK_PREFIX) - 1U) != 0) {
+        return UNKNOWN_TOPIC;
+    }
+#ifdef DAQ
+    if (RackProto_FindSensor(frame.topic + sizeof(RACK_PREFIX) - 1U) < 0) {
+#else
+    if (RackProto_FindActuator(frame.topic + sizeof(RACK_PREFIX) - 1U) < 0) {
+#endif
+        return UNKNOWN_TOPIC;
     }
 
-    // If '*' character is not found, return error
-    return CHAR_NOT_FOUND;
+    if (!RackProto_ParseMilli(frame.value, &milli)) {
+        return INVALID_VALUE;
+    }
+    *val = (float)milli / 1000.0f;
+    return SUCCESS;
 }
 
 /**
@@ -198,37 +140,191 @@ ERROR_CODE actuatorMotorsHandler(uint8_t actu, uint8_t val)
 	        break;
 
 	    case DOSE_PUMP0:
-	        TIM3->CCR3 = val;  // Set PWM for dose pump 0
+	        PID_ReleaseActuator(DOSE_PUMP0);
+	        PWM_SetDutyPermille(DOSE_PUMP0, val * 10);  // Set PWM for dose pump 0
 	        break;
 
 	    case DOSE_PUMP1:
-	        TIM3->CCR4 = val;  // Set PWM for dose pump 1
+	        PID_ReleaseActuator(DOSE_PUMP1);
+	        PWM_SetDutyPermille(DOSE_PUMP1, val * 10);  // Set PWM for dose pump 1
 	        break;
 
 	    case DOSE_PUMP2:
-	        TIM4->CCR1 = val;  // Set PWM for dose pump 2
+	        PID_ReleaseActuator(DOSE_PUMP2);
+	        PWM_SetDutyPermille(DOSE_PUMP2, val * 10);  // Set PWM for dose pump 2
 	        break;
 
 	    case LIGHT_CONTROL:
-	        TIM4->CCR2 = val;  // Set PWM for light control
+	        PID_ReleaseActuator(LIGHT_CONTROL);
+	        PWM_SetDutyPermille(LIGHT_CONTROL, val * 10);  // Set PWM for light control
 	        break;
 
 	    case FAN_CONTROL0:
-	        TIM4->CCR3 = val;  // Set PWM for fan 0
+	        FanTach_SetTarget(0, 0);  // A direct duty command leaves closed-loop control
+	        PID_ReleaseActuator(FAN_CONTROL0);
+	        PWM_SetDutyPermille(FAN_CONTROL0, val * 10);  // Set PWM for fan 0
 	        break;
 
 	    case FAN_CONTROL1:
-	        TIM4->CCR4 = val;  // Set PWM for fan 1
+	        FanTach_SetTarget(1, 0);  // A direct duty command leaves closed-loop control
+	        PID_ReleaseActuator(FAN_CONTROL1);
+	        PWM_SetDutyPermille(FAN_CONTROL1, val * 10);  // Set PWM for fan 1
+	        break;
+
+	    case HUMIDIFIER: 	   // Press the humidifier button until it reaches the requested state
+	        PulseSeq_SetState(PULSE_CH_HUMIDIFIER,
+	                          (uint8_t)((val * (HUM_STATES - 1U) + 99U) / 100U));
 	        break;
 
-	    case HUMIDIFIER: 	   // Send pulse to Humidifier
-	        HAL_GPIO_TogglePin(HUMgpio_GPIO_Port, HUMgpio_Pin);
 	    default:
 	        return UNKNOWN_ACTUATOR;  // Invalid actuator
 	}
     return SUCCESS;
 }
 
+/**
+ * @brief Dispatches a command received from the gateway.
+ *
+ * Actuator IDs take a percentage (0-100); configuration IDs take their own units
+ * (PWM_FREQ_TIMx: frequency in Hz, retuned at the highest resolution available;
+ * FAN_RPMx: closed-loop fan speed in RPM, 0 to return to open loop;
+ * PID_SETPOINTx and process values: decimal numbers in the units of the sensor;
+ * RTC_TIME: time of day as HHMM). A remote actuator command suspends the on-device
+ * schedule of that actuator for SCHED_OVERRIDE_MIN.
+ *
+ * @param id The command ID (see TopicActuatorIndex).
+ * @param val The value string following the '*' delimiter.
+ * @return ERROR_CODE Returns SUCCESS if the command was applied,
+ *         or an error code if the ID or the value is not valid.
+ */
+ERROR_CODE actuatorCommandHandler(uint8_t id, const char *val)
+{
+	// Process values and setpoints are decimal, parsed to fixed point. A non-numeric
+	// value ("nan" from a failed sensor) is rejected so the process value goes stale
+	if (id >= PV_ID_BASE && id < PV_ID_BASE + NUM_SENSOR_TOPICS) {
+	    milli_t pv;
+	    if (RackProto_ParseMilli(val, &pv) == NULL) return INVALID_VALUE;
+	    PID_SetProcessValue(id - PV_ID_BASE, Q16_FROM_MILLI(pv));
+	    return SUCCESS;
+	}
+	if (id == PID_SETPOINT0 || id == PID_SETPOINT1) {
+	    milli_t setpoint;
+	    if (RackProto_ParseMilli(val, &setpoint) == NULL) return INVALID_VALUE;
+	    return PID_SetSetpoint(id - PID_SETPOINT0, Q16_FROM_MILLI(setpoint)) ? SUCCESS : INVALID_VALUE;
+	}
+
+	long num = atol(val);
+
+	if (num < 0) {
+	    return INVALID_VALUE;
+	}
+
+	switch (id) {
+	    case PWM_FREQ_TIM3:
+	        return PWM_ConfigTimer(PWM_TIMER_3, (uint32_t)num, 0) ? SUCCESS : INVALID_VALUE;
+
+	    case PWM_FREQ_TIM4:
+	        return PWM_ConfigTimer(PWM_TIMER_4, (uint32_t)num, 0) ? SUCCESS : INVALID_VALUE;
+
+	    case FAN_RPM0:
+	        return FanTach_SetTarget(0, (uint16_t)num) ? SUCCESS : INVALID_VALUE;
+
+	    case FAN_RPM1:
+	        return FanTach_SetTarget(1, (uint16_t)num) ? SUCCESS : INVALID_VALUE;
+
+	    case PID_ENABLE0:
+	    case PID_ENABLE1:
+	        return PID_Enable(id - PID_ENABLE0, num != 0) ? SUCCESS : INVALID_VALUE;
+
+	    case HUMIDIFIER_SYNC:
+	        return PulseSeq_SyncState(PULSE_CH_HUMIDIFIER, (uint8_t)num) ? SUCCESS : INVALID_VALUE;
+
+	    case RTC_TIME:
+	        return Sched_SetTime((uint16_t)num) ? SUCCESS : INVALID_VALUE;
+
+	    case SCHEDULE_ENABLE:
+	        Sched_Enable(num != 0);
+	        return SUCCESS;
+
+	    default:
+	        if (id >= NUM_ACTUATORS) {
+	            return UNKNOWN_ACTUATOR;
+	        }
+	        if (num > 100) {
+	            return INVALID_VALUE;
+	        }
+	        Sched_Override(id);
+	        return actuatorMotorsHandler(id, (uint8_t)num);
+	}
+}
+
+/**
+ * @brief Starts the fixed-rate control tick.
+ *
+ * TIM2 counts at 1 MHz over its full 16-bit range; the CH1 compare match fires
+ * every CONTROL_TICK_US and is re-armed from the interrupt, so the counter is
+ * never reset and can still be used for microsecond timestamps and delay_us().
+ */
+void startControlTick(void)
+{
+	__HAL_TIM_SET_COMPARE(&htim2, TIM_CHANNEL_1, CONTROL_TICK_US);
+	__HAL_TIM_CLEAR_FLAG(&htim2, TIM_FLAG_CC1);
+	__HAL_TIM_ENABLE_IT(&htim2, TIM_IT_CC1);
+
+	HAL_NVIC_SetPriority(TIM2_IRQn, 2, 0);
+	HAL_NVIC_EnableIRQ(TIM2_IRQn);
+
+	HAL_TIM_Base_Start(&htim2);
+}
+
+/**
+ * @brief Schedules the next control tick one period after the previous one.
+ */
+void controlTickRearm(void)
+{
+	uint16_t next = (uint16_t)(__HAL_TIM_GET_COMPARE(&htim2, TIM_CHANNEL_1) + CONTROL_TICK_US);
+	__HAL_TIM_SET_COMPARE(&htim2, TIM_CHANNEL_1, next);
+}
+
+/**
+ * @brief Time elapsed since a received frame was stamped.
+ *
+ * The free-running TIM2 count gives microseconds but wraps every 65.5 ms, so past
+ * 60 ms the HAL tick is used instead, at millisecond resolution.
+ *
+ * @param stampUs TIM2 count when the frame completed.
+ * @param stampMs HAL tick when the frame completed.
+ * @return Elapsed microseconds.
+ */
+uint32_t commandApplyTime(uint16_t stampUs, uint32_t stampMs)
+{
+	uint16_t elapsedUs = (uint16_t)(__HAL_TIM_GET_COUNTER(&htim2) - stampUs);
+	uint32_t elapsedMs = HAL_GetTick() - stampMs;
+
+	return (elapsedMs < 60U) ? elapsedUs : elapsedMs * 1000U;
+}
+
+/**
+ * @brief Acknowledges a sequenced command to the gateway.
+ *
+ * Sent as "ack*SEQ,CODE,APPLY_US\r\n" once the command handler has returned, so
+ * the gateway learns whether the command was applied and how long it took.
+ *
+ * @param seq The sequence number of the command.
+ * @param code The handler's ERROR_CODE (SUCCESS when applied).
+ * @param applyUs Microseconds from the frame's reception to the handler's return.
+ */
+void publishAck(uint16_t seq, ERROR_CODE code, uint32_t applyUs)
+{
+	char uart_buf[40];
+	RackAck ack = {seq, code, applyUs};
+	int len = RackProto_EndFrame(uart_buf, sizeof(uart_buf), RackProto_EncodeAck(uart_buf, sizeof(uart_buf), &ack));
+
+	if (len > 0) {
+	    UartLink_WriteAck((uint8_t*)uart_buf, (uint16_t)len);  // May use the ring space kept for ACKs
+	}
+}
+
 #else
 #error "Either DAQ or ACT must be defined."
 #endif
@@ -0,0 +1,226 @@
+/*
+ * rack_proto_bench.c
+ * Description: Host benchmark of the rack protocol library. Times each encoder,
+ *              decoder and number conversion against the stdio/stdlib code it
+ *              replaced on the boards and the gateway (snprintf "%.2f", strtod,
+ *              strchr + atoi), after checking that both format and parse numbers alike.
+ *              Prints nanoseconds per call.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "rack_proto.h"
+
+#define BENCH_DEFAULT_ITERATIONS 1000000L /**< Calls per case unless given on the command line */
+
+static long iterations = BENCH_DEFAULT_ITERATIONS;
+static volatile long sink; /**< Keeps results alive */
+
+static const char *const values[] = {"23.45", "-3.5", "6.80", "1250", "0.125", "99.99", "-0.01", "417.3"};
+#define VALUE_COUNT (sizeof(values) / sizeof(values[0]))
+
+/* =======================
+ * Timing
+ * =======================
+ */
+static double nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+typedef void (*BenchCase)(long i);
+
+static double run(BenchCase fn)
+{
+    for (long i = 0; i < iterations / 10; i++) // Warm up
+    {
+        fn(i);
+    }
+    double start = nowNs();
+    for (long i = 0; i < iterations; i++)
+    {
+        fn(i);
+    }
+    return (nowNs() - start) / (double)iterations;
+}
+
+static void report(const char *name, BenchCase proto, BenchCase baseline)
+{
+    double protoNs = run(proto);
+    double baselineNs = run(baseline);
+    printf("%-16s %8.1f ns  %8.1f ns  %5.2fx\n", name, protoNs, baselineNs, baselineNs / protoNs);
+}
+
+/* =======================
+ * Cases
+ * =======================
+ */
+static void encodeSensorProto(long i)
+{
+    char buf[RACK_PROTO_LINE_SIZE];
+    int length = RackProto_EncodeMilli(buf, sizeof(buf), "rack0/", RackProto_SensorTopics[i % RACK_SENSOR_COUNT],
+                                       (milli_t)(i % 100000) - 50000, 2);
+    sink += RackProto_EndFrame(buf, sizeof(buf), length);
+}
+
+static void encodeSensorStdio(long i)
+{
+    char buf[RACK_PROTO_LINE_SIZE];
+    sink += snprintf(buf, sizeof(buf), "rack0/%s*%.2f\r\n", RackProto_SensorTopics[i % RACK_SENSOR_COUNT],
+                     (float)((i % 100000) - 50000) / 1000.0f);
+}
+
+static void decodeFrameProto(long i)
+{
+    char line[] = "rack0/sens/water/temperature*23.45\r\n";
+    RackFrame frame;
+    milli_t value = 0;
+    RackProto_DecodeFrame(line, &frame);
+    RackProto_ParseMilli(frame.value, &value);
+    sink += value + (long)i;
+}
+
+static void decodeFrameStdio(long i)
+{
+    char line[] = "rack0/sens/water/temperature*23.45\r\n";
+    char *separator = strchr(line, '*');
+    *separator = '\0';
+    sink += (long)(strtod(separator + 1, NULL) * 1000.0) + (long)i;
+}
+
+static void encodeCommandProto(long i)
+{
+    char buf[RACK_PROTO_LINE_SIZE];
+    int length = RackProto_EncodeCommand(buf, sizeof(buf), (int)(i % RACK_ACTUATOR_COUNT), values[i % VALUE_COUNT],
+                                         (uint16_t)(i % 65535 + 1));
+    sink += RackProto_EndFrame(buf, sizeof(buf), length);
+}
+
+static void encodeCommandStdio(long i)
+{
+    char buf[RACK_PROTO_LINE_SIZE];
+    sink += snprintf(buf, sizeof(buf), "%d*%s#%u\r\n", (int)(i % RACK_ACTUATOR_COUNT), values[i % VALUE_COUNT],
+                     (unsigned)(i % 65535 + 1));
+}
+
+static void decodeCommandProto(long i)
+{
+    char line[] = "12*1250#4711\r\n";
+    RackCommand command;
+    RackProto_DecodeCommand(line, &command);
+    sink += command.id + command.seq + (long)i;
+}
+
+static void decodeCommandStdio(long i)
+{
+    char line[] = "12*1250#4711\r\n";
+    char *separator = strchr(line, '*');
+    char *mark = strchr(separator, '#');
+    *separator = '\0';
+    *mark = '\0';
+    sink += atoi(line) + atoi(mark + 1) + (long)i;
+}
+
+static void parseProto(long i)
+{
+    milli_t value = 0;
+    RackProto_ParseMilli(values[i % VALUE_COUNT], &value);
+    sink += value;
+}
+
+static void parseStdio(long i)
+{
+    sink += (long)(strtod(values[i % VALUE_COUNT], NULL) * 1000.0);
+}
+
+static void formatProto(long i)
+{
+    char buf[16];
+    sink += RackProto_FormatMilli(buf, sizeof(buf), (milli_t)(i % 100000) - 50000, 2);
+}
+
+static void formatStdio(long i)
+{
+    char buf[16];
+    sink += snprintf(buf, sizeof(buf), "%.2f", (double)((i % 100000) - 50000) / 1000.0);
+}
+
+static void encodeAckProto(long i)
+{
+    char buf[RACK_PROTO_LINE_SIZE];
+    RackAck ack = {(uint16_t)(i % 65535 + 1), (int8_t)-(i % 7), (uint32_t)i};
+    int length = RackProto_EncodeAck(buf, sizeof(buf), &ack);
+    sink += RackProto_EndFrame(buf, sizeof(buf), length);
+}
+
+static void encodeAckStdio(long i)
+{
+    char buf[RACK_PROTO_LINE_SIZE];
+    sink += snprintf(buf, sizeof(buf), "ack*%u,%d,%lu\r\n", (unsigned)(i % 65535 + 1), (int)-(i % 7),
+                     (unsigned long)i);
+}
+
+/* =======================
+ * Cross-check
+ * =======================
+ */
+
+/**
+ * Thousandths must format like printf "%.3f" and parse back to themselves.
+ */
+static int crossCheck(void)
+{
+    int mismatches = 0;
+    for (milli_t value = -100000; value <= 100000; value += 7)
+    {
+        char proto[32];
+        char stdio[32];
+        RackProto_FormatMilli(proto, sizeof(proto), value, 3);
+        snprintf(stdio, sizeof(stdio), "%.3f", (double)value / 1000.0);
+        if (strcmp(proto, stdio) != 0)
+        {
+            fprintf(stderr, "format mismatch: %s vs %s\n", proto, stdio);
+            mismatches++;
+        }
+        milli_t parsed = 0;
+        if (!RackProto_ParseMilli(stdio, &parsed) || parsed != value)
+        {
+            fprintf(stderr, "parse mismatch: %s -> %ld\n", stdio, (long)parsed);
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        iterations = strtol(argv[1], NULL, 10);
+        if (iterations <= 0)
+        {
+            fprintf(stderr, "usage: %s [iterations per case]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (crossCheck() != 0)
+    {
+        return 1;
+    }
+
+    printf("%-16s %11s  %11s  %6s\n", "case", "rack_proto", "stdio", "speedup");
+    report("encode sensor", encodeSensorProto, encodeSensorStdio);
+    report("decode sensor", decodeFrameProto, decodeFrameStdio);
+    report("encode command", encodeCommandProto, encodeCommandStdio);
+    report("decode command", decodeCommandProto, decodeCommandStdio);
+    report("encode ack", encodeAckProto, encodeAckStdio);
+    report("parse number", parseProto, parseStdio);
+    report("format number", formatProto, formatStdio);
+    return 0;
+}
@@ -0,0 +1,299 @@
+/*
+ * rack_proto.h
+ *
+ *  Description:
+ *      Wire protocol shared by the rack boards and the gateway: topic tables,
+ *      board IDs, error codes, "topic*value\r\n" and "ID*VAL#SEQ\r\n" framing,
+ *      and the fixed-point types carried in the values. Portable C99 without
+ *      HAL or heap: the STM32F1 and STM32F4 firmwares, the ESP32 gateway and
+ *      the host build all compile this same file. Numbers are parsed and
+ *      formatted with integer arithmetic only, so no float printf is needed.
+ */
+
+#ifndef RACK_PROTO_H_
+#define RACK_PROTO_H_
+
+/******************************************************************************
+ * SECTION 1: LIBRARIES
+ *****************************************************************************/
+// Standard C Libraries
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+ * SECTION 2: MACROS
+ *****************************************************************************/
+
+/** Framing */
+#define RACK_PROTO_SEPARATOR    '*'      // Between topic (or ID) and value
+#define RACK_PROTO_SEQ_MARK     '#'      // Before the sequence number of a command
+#define RACK_PROTO_FRAME_END    "\r\n"   // Terminates every frame
+#define RACK_PROTO_LINE_SIZE    96U      // Longest frame, terminator included
+
+/** Board IDs of the gateway's lines "ID*VAL" (0-99 are board commands) */
+#define RACK_PROTO_MAX_COMMAND_ID 99
+#define RACK_PROTO_PV_ID_BASE   40       // Forwarded process values: PV_ID_BASE + sensor index
+#define RACK_PROTO_BAUD_ID      100      // Baud proposal "100*RATE"
+#define RACK_PROTO_CREDIT_ID    101      // Credit grant "101*RECEIVED,FREE"
+
+/** Board frame topics that are not MQTT topics */
+#define RACK_PROTO_ACK_TOPIC    "ack"    // "ack*SEQ,CODE,APPLY_US"
+#define RACK_PROTO_BAUD_TOPIC   "baud"   // "baud*RATE", "baud*0" when RATE cannot be set
+#define RACK_PROTO_CREDIT_TOPIC "credit" // "credit*RECEIVED,FREE"
+
+/** Error codes, also the CODE of an ACK */
+#define RACK_PROTO_SUCCESS          0    // Operation successful
+#define RACK_PROTO_ERROR            -1   // General error
+#define RACK_PROTO_CHAR_NOT_FOUND   -2   // Character not found in string
+#define RACK_PROTO_UNKNOWN_TOPIC    -3   // Unrecognized topic
+#define RACK_PROTO_UNKNOWN_ACTUATOR -4   // Unrecognized actuator
+#define RACK_PROTO_UNKNOWN_SENSOR   -5   // Unrecognized sensor
+#define RACK_PROTO_INVALID_VALUE    -6   // Value out of range for the target
+#define RACK_PROTO_NOT_QUEUED       -7   // Gateway link could not queue the command
+
+/** Sensor topics, relative to the rack prefix ("rack0/" + topic) */
+#define RACK_PROTO_TOPIC_WATER_TEMPERATURE   "sens/water/temperature"
+#define RACK_PROTO_TOPIC_AMBIENT_TEMPERATURE "sens/ambient/temperature"
+#define RACK_PROTO_TOPIC_AMBIENT_HUMIDITY    "sens/ambient/humidity"
+#define RACK_PROTO_TOPIC_WATER_PH            "sens/water/ph"
+#define RACK_PROTO_TOPIC_WATER_TDS           "sens/water/tds"
+#define RACK_PROTO_TOPIC_WATER_EC            "sens/water/ec"
+
+/** Actuator topics, relative to the rack prefix */
+#define RACK_PROTO_TOPIC_WATERING            "actu/watering0"
+#define RACK_PROTO_TOPIC_DOSE_PUMP0          "actu/dose_pump0"
+#define RACK_PROTO_TOPIC_DOSE_PUMP1          "actu/dose_pump1"
+#define RACK_PROTO_TOPIC_DOSE_PUMP2          "actu/dose_pump2"
+#define RACK_PROTO_TOPIC_LIGHT_CONTROL       "actu/light/control"
+#define RACK_PROTO_TOPIC_FAN_CONTROL0        "actu/fan/control0"
+#define RACK_PROTO_TOPIC_FAN_CONTROL1        "actu/fan/control1"
+#define RACK_PROTO_TOPIC_HUMIDIFIER          "actu/humidifier"
+#define RACK_PROTO_TOPIC_PWM_FREQ_TIM3       "actu/pwm/tim3/frequency"
+#define RACK_PROTO_TOPIC_PWM_FREQ_TIM4       "actu/pwm/tim4/frequency"
+#define RACK_PROTO_TOPIC_FAN_RPM_TARGET0     "actu/fan/rpm0"
+#define RACK_PROTO_TOPIC_FAN_RPM_TARGET1     "actu/fan/rpm1"
+#define RACK_PROTO_TOPIC_PID_SETPOINT0       "actu/pid/loop0/setpoint"
+#define RACK_PROTO_TOPIC_PID_SETPOINT1       "actu/pid/loop1/setpoint"
+#define RACK_PROTO_TOPIC_PID_ENABLE0         "actu/pid/loop0/enable"
+#define RACK_PROTO_TOPIC_PID_ENABLE1         "actu/pid/loop1/enable"
+#define RACK_PROTO_TOPIC_HUMIDIFIER_SYNC     "actu/humidifier/sync"
+#define RACK_PROTO_TOPIC_RTC_TIME            "actu/rtc/time"
+#define RACK_PROTO_TOPIC_SCHEDULE_ENABLE     "actu/schedule/enable"
+
+/** Actuator board state published back to the gateway, relative to the rack prefix */
+#define RACK_PROTO_TOPIC_FAN_RPM0            "sens/fan/rpm0"
+#define RACK_PROTO_TOPIC_FAN_RPM1            "sens/fan/rpm1"
+#define RACK_PROTO_TOPIC_FAN_STALL           "sens/fan/stall"            // Bit n set -> fan n stalled
+#define RACK_PROTO_TOPIC_HUMIDIFIER_STATE    "sens/humidifier/state"
+
+/** Link reports of each board: rack prefix + board link prefix + report */
+#define RACK_PROTO_TOPIC_ACTU_LINK           "actu/link/"
+#define RACK_PROTO_TOPIC_SENS_LINK           "sens/link/"
+#define RACK_PROTO_TOPIC_LINK_BAUD           "baud"
+#define RACK_PROTO_TOPIC_LINK_RX_RATE        "rx_bytes_s"
+#define RACK_PROTO_TOPIC_LINK_TX_RATE        "tx_bytes_s"
+#define RACK_PROTO_TOPIC_LINK_ERRORS         "errors"
+#define RACK_PROTO_TOPIC_LINK_TX_HELD        "tx_held"
+#define RACK_PROTO_TOPIC_LINK_CREDIT_STALLS  "credit_stalls"
+#define RACK_PROTO_TOPIC_LINK_CREDIT_LOST    "credit_lost"
+#define RACK_PROTO_TOPIC_LINK_TX_DROPPED     "tx_dropped"
+
+/** Q16.16 fixed point */
+#define Q16_ONE                 65536L
+#define Q16_FROM_INT(x)         ((q16_t)((x) * Q16_ONE))
+#define Q16_FROM_MILLI(x)       ((q16_t)(((int64_t)(x) * Q16_ONE) / 1000))
+#define Q16_TO_INT(x)           ((int32_t)((x) >> 16))
+#define Q16_TO_MILLI(x)         ((milli_t)(((int64_t)(x) * 1000 + ((x) < 0 ? -Q16_ONE / 2 : Q16_ONE / 2)) / Q16_ONE))
+
+/** Turns a numeric macro into a string literal (e.g. RACK_PROTO_STR(RACK_PROTO_BAUD_ID) -> "100") */
+#define RACK_PROTO_STR(x)       RACK_PROTO_STR_(x)
+#define RACK_PROTO_STR_(x)      #x
+
+/******************************************************************************
+ * SECTION 3: DATA TYPES & STRUCTURES
+ *****************************************************************************/
+
+/** Q16.16 signed fixed-point number */
+typedef int32_t q16_t;
+
+/** Signed number in thousandths (23.45 -> 23450) */
+typedef int32_t milli_t;
+
+/** Sensor IDs, in the order of the sensor topics */
+typedef enum {
+    RACK_SENSOR_WATER_TEMPERATURE = 0,
+    RACK_SENSOR_AMBIENT_TEMPERATURE,
+    RACK_SENSOR_AMBIENT_HUMIDITY,
+    RACK_SENSOR_WATER_PH,
+    RACK_SENSOR_WATER_TDS,
+    RACK_SENSOR_WATER_EC,
+    RACK_SENSOR_COUNT
+} RackSensor;
+
+/** Actuator board command IDs, in the order of the actuator topics */
+typedef enum {
+    RACK_ACTUATOR_WATERING = 0,
+    RACK_ACTUATOR_DOSE_PUMP0,
+    RACK_ACTUATOR_DOSE_PUMP1,
+    RACK_ACTUATOR_DOSE_PUMP2,
+    RACK_ACTUATOR_LIGHT_CONTROL,
+    RACK_ACTUATOR_FAN_CONTROL0,
+    RACK_ACTUATOR_FAN_CONTROL1,
+    RACK_ACTUATOR_HUMIDIFIER,
+    RACK_ACTUATOR_PHYSICAL_COUNT,                              // Physical actuators, 0-100 %
+    RACK_ACTUATOR_PWM_FREQ_TIM3 = RACK_ACTUATOR_PHYSICAL_COUNT, // TIM3 PWM frequency in Hz
+    RACK_ACTUATOR_PWM_FREQ_TIM4,                               // TIM4 PWM frequency in Hz
+    RACK_ACTUATOR_FAN_RPM0,                                    // Fan 0 closed-loop target in RPM (0 = open loop)
+    RACK_ACTUATOR_FAN_RPM1,                                    // Fan 1 closed-loop target in RPM (0 = open loop)
+    RACK_ACTUATOR_PID_SETPOINT0,                               // PID loop 0 setpoint (decimal, PV units)
+    RACK_ACTUATOR_PID_SETPOINT1,                               // PID loop 1 setpoint (decimal, PV units)
+    RACK_ACTUATOR_PID_ENABLE0,                                 // PID loop 0 enable (0/1)
+    RACK_ACTUATOR_PID_ENABLE1,                                 // PID loop 1 enable (0/1)
+    RACK_ACTUATOR_HUMIDIFIER_SYNC,                             // Humidifier actual state, resyncs without pressing
+    RACK_ACTUATOR_RTC_TIME,                                    // Time of day as HHMM
+    RACK_ACTUATOR_SCHEDULE_ENABLE,                             // On-device schedule enable (0/1)
+    RACK_ACTUATOR_COUNT
+} RackActuator;
+
+/** Board frame "topic*value", split in place */
+typedef struct {
+    char *topic;                // Null-terminated topic
+    char *value;                // Null-terminated value, blanks and terminator trimmed
+} RackFrame;
+
+/** Gateway command "ID*VAL" or "ID*VAL#SEQ", split in place */
+typedef struct {
+    int16_t id;                 // Board ID
+    char *value;                // Null-terminated value, terminator trimmed
+    uint16_t seq;               // Sequence number asking for an ACK, 0 for none
+} RackCommand;
+
+/** ACK value "SEQ,CODE,APPLY_US" */
+typedef struct {
+    uint16_t seq;               // Sequence number of the command
+    int8_t code;                // Error code of the command handler
+    uint32_t applyUs;           // Microseconds from reception to the handler's return
+} RackAck;
+
+/** Topic tables, indexed by RackSensor and RackActuator */
+extern const char *const RackProto_SensorTopics[RACK_SENSOR_COUNT];
+extern const char *const RackProto_ActuatorTopics[RACK_ACTUATOR_COUNT];
+
+/******************************************************************************
+ * SECTION 4: PUBLIC FUNCTION PROTOTYPES
+ *****************************************************************************/
+
+/**
+ * @brief  Looks up a rack-relative sensor topic ("sens/water/ph").
+ * @return Its RackSensor, or -1.
+ */
+int RackProto_FindSensor(const char *topic);
+
+/**
+ * @brief  Looks up a rack-relative actuator topic ("actu/fan/rpm0").
+ * @return Its RackActuator, or -1.
+ */
+int RackProto_FindActuator(const char *topic);
+
+/**
+ * @brief  Skips the rack prefix of a full topic ("rack0/sens/water/ph" -> "sens/water/ph").
+ * @return The rack-relative topic, or the topic itself when it has a single level.
+ */
+const char *RackProto_SkipRack(const char *topic);
+
+/**
+ * @brief  Parses a decimal number into thousandths, rounding the fourth decimal
+ *         (" -23.4567" -> -23457). Leading blanks and a sign are accepted.
+ * @param  text The number.
+ * @param  value Receives the value.
+ * @return The first character after the number, NULL if there are no digits
+ *         or the value does not fit.
+ */
+const char *RackProto_ParseMilli(const char *text, milli_t *value);
+
+/**
+ * @brief  Parses a decimal number into Q16.16, saturating at the Q16 range.
+ * @param  text The number.
+ * @return The value, 0 without digits.
+ */
+q16_t RackProto_ParseQ16(const char *text);
+
+/**
+ * @brief  Formats thousandths with 0 to 3 decimals, rounding the dropped
+ *         ones (23456, 2 -> "23.46").
+ * @param  buf Destination buffer.
+ * @param  size Size of the buffer.
+ * @param  value The value in thousandths.
+ * @param  decimals Decimals written.
+ * @return Length written, -1 if the buffer is too small.
+ */
+int RackProto_FormatMilli(char *buf, size_t size, milli_t value, uint8_t decimals);
+
+/**
+ * @brief  Splits a board frame "topic*value[\r\n]" in place.
+ * @return RACK_PROTO_SUCCESS, or RACK_PROTO_CHAR_NOT_FOUND without a separator.
+ */
+int8_t RackProto_DecodeFrame(char *line, RackFrame *frame);
+
+/**
+ * @brief  Splits a gateway command "ID*VAL[#SEQ][\r\n]" in place.
+ * @return RACK_PROTO_SUCCESS, RACK_PROTO_CHAR_NOT_FOUND without a separator
+ *         or RACK_PROTO_UNKNOWN_ACTUATOR when the ID is not a number.
+ */
+int8_t RackProto_DecodeCommand(char *line, RackCommand *command);
+
+/**
+ * @brief  Parses an ACK value "SEQ,CODE,APPLY_US".
+ * @return RACK_PROTO_SUCCESS, or RACK_PROTO_INVALID_VALUE.
+ */
+int8_t RackProto_DecodeAck(const char *value, RackAck *ack);
+
+/**
+ * @brief  Writes "topic*value" with a number in thousandths.
+ * @param  prefix Prepended to the topic (e.g. "rack0/"), NULL for none.
+ * @return Length written, -1 if the buffer is too small.
+ */
+int RackProto_EncodeMilli(char *buf, size_t size, const char *prefix, const char *topic, milli_t value,
+                          uint8_t decimals);
+
+/**
+ * @brief  Writes "topic*value" with a text value (e.g. "nan").
+ * @return Length written, -1 if the buffer is too small.
+ */
+int RackProto_EncodeText(char *buf, size_t size, const char *topic, const char *value);
+
+/**
+ * @brief  Writes "topic*value" with an unsigned integer value.
+ * @return Length written, -1 if the buffer is too small.
+ */
+int RackProto_EncodeUnsigned(char *buf, size_t size, const char *topic, uint32_t value);
+
+/**
+ * @brief  Writes a command "ID*VAL", or "ID*VAL#SEQ" when seq is not 0.
+ * @return Length written, -1 if the buffer is too small.
+ */
+int RackProto_EncodeCommand(char *buf, size_t size, int id, const char *value, uint16_t seq);
+
+/**
+ * @brief  Writes "ack*SEQ,CODE,APPLY_US".
+ * @return Length written, -1 if the buffer is too small.
+ */
+int RackProto_EncodeAck(char *buf, size_t size, const RackAck *ack);
+
+/**
+ * @brief  Appends RACK_PROTO_FRAME_END to a line written by an encoder.
+ * @param  length Length of the line, negative when encoding failed.
+ * @return New length, -1 if the buffer is too small.
+ */
+int RackProto_EndFrame(char *buf, size_t size, int length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RACK_PROTO_H_ */
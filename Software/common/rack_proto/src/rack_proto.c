@@ -0,0 +1,417 @@
+/*
+ * rack_proto.c
+ *
+ *  Description:
+ *      Implementation of the shared rack wire protocol. Integer arithmetic only,
+ *      no HAL, no heap and no stdio.
+ */
+
+#include "rack_proto.h"
+
+#include <string.h>
+
+/******************************************************************************
+ * SECTION 1: PRIVATE MACROS & DATA
+ *****************************************************************************/
+
+#define RACK_PROTO_MILLI_MAX   2147483647LL  // Largest magnitude in thousandths
+
+const char *const RackProto_SensorTopics[RACK_SENSOR_COUNT] = {
+    RACK_PROTO_TOPIC_WATER_TEMPERATURE,
+    RACK_PROTO_TOPIC_AMBIENT_TEMPERATURE,
+    RACK_PROTO_TOPIC_AMBIENT_HUMIDITY,
+    RACK_PROTO_TOPIC_WATER_PH,
+    RACK_PROTO_TOPIC_WATER_TDS,
+    RACK_PROTO_TOPIC_WATER_EC
+};
+
+const char *const RackProto_ActuatorTopics[RACK_ACTUATOR_COUNT] = {
+    RACK_PROTO_TOPIC_WATERING,
+    RACK_PROTO_TOPIC_DOSE_PUMP0,
+    RACK_PROTO_TOPIC_DOSE_PUMP1,
+    RACK_PROTO_TOPIC_DOSE_PUMP2,
+    RACK_PROTO_TOPIC_LIGHT_CONTROL,
+    RACK_PROTO_TOPIC_FAN_CONTROL0,
+    RACK_PROTO_TOPIC_FAN_CONTROL1,
+    RACK_PROTO_TOPIC_HUMIDIFIER,
+    RACK_PROTO_TOPIC_PWM_FREQ_TIM3,
+    RACK_PROTO_TOPIC_PWM_FREQ_TIM4,
+    RACK_PROTO_TOPIC_FAN_RPM_TARGET0,
+    RACK_PROTO_TOPIC_FAN_RPM_TARGET1,
+    RACK_PROTO_TOPIC_PID_SETPOINT0,
+    RACK_PROTO_TOPIC_PID_SETPOINT1,
+    RACK_PROTO_TOPIC_PID_ENABLE0,
+    RACK_PROTO_TOPIC_PID_ENABLE1,
+    RACK_PROTO_TOPIC_HUMIDIFIER_SYNC,
+    RACK_PROTO_TOPIC_RTC_TIME,
+    RACK_PROTO_TOPIC_SCHEDULE_ENABLE
+};
+
+static const uint32_t powersOfTen[] = {1U, 10U, 100U, 1000U};
+
+/******************************************************************************
+ * SECTION 2: PRIVATE FUNCTIONS
+ *****************************************************************************/
+
+static bool RackProto_IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool RackProto_IsBlank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+/**
+ * @brief  Looks up a topic in a table.
+ * @return Its index, or -1.
+ */
+static int RackProto_Find(const char *const *table, int count, const char *topic) {
+    for (int i = 0; i < count; i++) {
+        // The first character rules out most entries without a call
+        if (table[i][0] == topic[0] && strcmp(table[i], topic) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief  Appends a string to a line being encoded.
+ * @param  length Current length, negative after a failed append.
+ * @return New length, -1 if the buffer is too small.
+ */
+static int RackProto_Append(char *buf, size_t size, int length, const char *text) {
+    if (length < 0) {
+        return -1;
+    }
+    size_t textLength = strlen(text);
+    if ((size_t)length + textLength >= size) {
+        return -1;
+    }
+    memcpy(buf + length, text, textLength + 1U);
+    return length + (int)textLength;
+}
+
+/**
+ * @brief  Appends one character to a line being encoded.
+ */
+static int RackProto_AppendChar(char *buf, size_t size, int length, char c) {
+    if (length < 0 || (size_t)length + 1U >= size) {
+        return -1;
+    }
+    buf[length++] = c;
+    buf[length] = '\0';
+    return length;
+}
+
+/**
+ * @brief  Appends an unsigned integer, with at least minDigits digits.
+ */
+static int RackProto_AppendDigits(char *buf, size_t size, int length, uint32_t value, uint8_t minDigits) {
+    char digits[10];
+    uint8_t count = 0;
+
+    do {
+        digits[count++] = (char)('0' + value % 10U);
+        value /= 10U;
+    } while (value != 0U || count < minDigits);
+
+    if (length < 0 || (size_t)length + count >= size) {
+        return -1;
+    }
+    while (count > 0U) {
+        buf[length++] = digits[--count];
+    }
+    buf[length] = '\0';
+    return length;
+}
+
+/**
+ * @brief  Appends a signed integer.
+ */
+static int RackProto_AppendSigned(char *buf, size_t size, int length, int32_t value) {
+    if (value < 0) {
+        length = RackProto_AppendChar(buf, size, length, '-');
+        return RackProto_AppendDigits(buf, size, length, 0U - (uint32_t)value, 1U);
+    }
+    return RackProto_AppendDigits(buf, size, length, (uint32_t)value, 1U);
+}
+
+/**
+ * @brief  Appends thousandths with 0 to 3 decimals.
+ */
+static int RackProto_AppendMilli(char *buf, size_t size, int length, milli_t value, uint8_t decimals) {
+    if (decimals > 3U) {
+        decimals = 3U;
+    }
+    uint32_t magnitude = (value < 0) ? 0U - (uint32_t)value : (uint32_t)value;
+    uint32_t step = powersOfTen[3U - decimals];
+    uint32_t rounded = magnitude / step + ((magnitude % step) * 2U >= step ? 1U : 0U);
+    uint32_t scale = powersOfTen[decimals];
+
+    if (value < 0 && rounded != 0U) {
+        length = RackProto_AppendChar(buf, size, length, '-');
+    }
+    length = RackProto_AppendDigits(buf, size, length, rounded / scale, 1U);
+    if (decimals > 0U) {
+        length = RackProto_AppendChar(buf, size, length, '.');
+        length = RackProto_AppendDigits(buf, size, length, rounded % scale, decimals);
+    }
+    return length;
+}
+
+/**
+ * @brief  Reads an unsigned decimal number.
+ * @return The first character after it, NULL without digits or above max.
+ */
+static const char *RackProto_ParseUnsigned(const char *text, uint32_t max, uint32_t *value) {
+    uint32_t number = 0;
+
+    if (!RackProto_IsDigit(*text)) {
+        return NULL;
+    }
+    while (RackProto_IsDigit(*text)) {
+        uint32_t digit = (uint32_t)(*text++ - '0');
+        if (number > (max - digit) / 10U) {
+            return NULL;
+        }
+        number = number * 10U + digit;
+    }
+    *value = number;
+    return text;
+}
+
+/**
+ * @brief  Cuts a value at the frame terminator and trims trailing blanks.
+ */
+static void RackProto_TrimEnd(char *value) {
+    size_t length = strcspn(value, "\r\n");
+
+    while (length > 0U && RackProto_IsBlank(value[length - 1U])) {
+        length--;
+    }
+    value[length] = '\0';
+}
+
+/******************************************************************************
+ * SECTION 3: PUBLIC FUNCTIONS
+ *****************************************************************************/
+
+int RackProto_FindSensor(const char *topic) {
+    return RackProto_Find(RackProto_SensorTopics, RACK_SENSOR_COUNT, topic);
+}
+
+int RackProto_FindActuator(const char *topic) {
+    return RackProto_Find(RackProto_ActuatorTopics, RACK_ACTUATOR_COUNT, topic);
+}
+
+const char *RackProto_SkipRack(const char *topic) {
+    const char *level = strchr(topic, '/');
+    return level ? level + 1 : topic;
+}
+
+const char *RackProto_ParseMilli(const char *text, milli_t *value) {
+    bool negative = false;
+    bool digits = false;
+    int64_t number = 0;
+
+    while (RackProto_IsBlank(*text)) {
+        text++;
+    }
+    if (*text == '-' || *text == '+') {
+        negative = (*text == '-');
+        text++;
+    }
+    while (RackProto_IsDigit(*text)) {
+        number = number * 10 + (*text++ - '0');
+        if (number * 1000 > RACK_PROTO_MILLI_MAX) {
+            return NULL;
+        }
+        digits = true;
+    }
+    number *= 1000;
+    if (*text == '.') {
+        text++;
+        int64_t scale = 100;
+        while (RackProto_IsDigit(*text)) {
+            if (scale > 0) {
+                number += (*text - '0') * scale;
+                scale /= 10;
+            } else if (scale == 0) {
+                number += (*text >= '5') ? 1 : 0; // Fourth decimal rounds
+                scale = -1;
+            }
+            text++;
+            digits = true;
+        }
+    }
+    if (!digits || number > RACK_PROTO_MILLI_MAX) {
+        return NULL;
+    }
+    *value = (milli_t)(negative ? -number : number);
+    return text;
+}
+
+q16_t RackProto_ParseQ16(const char *text) {
+    bool negative = false;
+    int64_t integer = 0;
+    int64_t fraction = 0;
+    int64_t scale = 1;
+
+    while (RackProto_IsBlank(*text)) {
+        text++;
+    }
+    if (*text == '-' || *text == '+') {
+        negative = (*text == '-');
+        text++;
+    }
+    while (RackProto_IsDigit(*text)) {
+        if (integer < 32768) {
+            integer = integer * 10 + (*text - '0');
+        }
+        text++;
+    }
+    if (*text == '.') {
+        text++;
+        while (RackProto_IsDigit(*text) && scale < 100000) {
+            fraction = fraction * 10 + (*text - '0');
+            scale *= 10;
+            text++;
+        }
+    }
+
+    int64_t value = (integer << 16) + ((fraction << 16) + scale / 2) / scale;
+    if (value > INT32_MAX) {
+        value = INT32_MAX;
+    }
+    return (q16_t)(negative ? -value : value);
+}
+
+int RackProto_FormatMilli(char *buf, size_t size, milli_t value, uint8_t decimals) {
+    if (size == 0U) {
+        return -1;
+    }
+    buf[0] = '\0';
+    return RackProto_AppendMilli(buf, size, 0, value, decimals);
+}
+
+int8_t RackProto_DecodeFrame(char *line, RackFrame *frame) {
+    char *separator = strchr(line, RACK_PROTO_SEPARATOR);
+    if (!separator) {
+        return RACK_PROTO_CHAR_NOT_FOUND;
+    }
+    *separator = '\0';
+
+    char *value = separator + 1;
+    while (RackProto_IsBlank(*value)) {
+        value++;
+    }
+    RackProto_TrimEnd(value);
+
+    frame->topic = line;
+    frame->value = value;
+    return RACK_PROTO_SUCCESS;
+}
+
+int8_t RackProto_DecodeCommand(char *line, RackCommand *command) {
+    char *separator = strchr(line, RACK_PROTO_SEPARATOR);
+    if (!separator) {
+        return RACK_PROTO_CHAR_NOT_FOUND;
+    }
+
+    uint32_t id;
+    if (RackProto_ParseUnsigned(line, INT16_MAX, &id) != separator) {
+        return RACK_PROTO_UNKNOWN_ACTUATOR;
+    }
+    command->id = (int16_t)id;
+    command->value = separator + 1;
+    command->seq = 0;
+    RackProto_TrimEnd(command->value);
+
+    // "#SEQ" after the value asks for an ACK
+    char *mark = strchr(command->value, RACK_PROTO_SEQ_MARK);
+    if (mark) {
+        uint32_t seq;
+        *mark = '\0';
+        if (RackProto_ParseUnsigned(mark + 1, UINT16_MAX, &seq)) {
+            command->seq = (uint16_t)seq;
+        }
+    }
+    return RACK_PROTO_SUCCESS;
+}
+
+int8_t RackProto_DecodeAck(const char *value, RackAck *ack) {
+    uint32_t seq;
+    uint32_t code;
+    uint32_t applyUs;
+    bool negative;
+
+    value = RackProto_ParseUnsigned(value, UINT16_MAX, &seq);
+    if (!value || *value != ',' || seq == 0U) {
+        return RACK_PROTO_INVALID_VALUE;
+    }
+    value++;
+    negative = (*value == '-');
+    value = RackProto_ParseUnsigned(negative ? value + 1 : value, 128U, &code);
+    if (!value || *value != ',' || (!negative && code > (uint32_t)INT8_MAX)) {
+        return RACK_PROTO_INVALID_VALUE;
+    }
+    value = RackProto_ParseUnsigned(value + 1, UINT32_MAX, &applyUs);
+    if (!value) {
+        return RACK_PROTO_INVALID_VALUE;
+    }
+
+    ack->seq = (uint16_t)seq;
+    ack->code = (int8_t)(negative ? -(int32_t)code : (int32_t)code);
+    ack->applyUs = applyUs;
+    return RACK_PROTO_SUCCESS;
+}
+
+int RackProto_EncodeMilli(char *buf, size_t size, const char *prefix, const char *topic, milli_t value,
+                          uint8_t decimals) {
+    int length = (size > 0U) ? 0 : -1;
+
+    if (prefix) {
+        length = RackProto_Append(buf, size, length, prefix);
+    }
+    length = RackProto_Append(buf, size, length, topic);
+    length = RackProto_AppendChar(buf, size, length, RACK_PROTO_SEPARATOR);
+    return RackProto_AppendMilli(buf, size, length, value, decimals);
+}
+
+int RackProto_EncodeText(char *buf, size_t size, const char *topic, const char *value) {
+    int length = RackProto_Append(buf, size, (size > 0U) ? 0 : -1, topic);
+    length = RackProto_AppendChar(buf, size, length, RACK_PROTO_SEPARATOR);
+    return RackProto_Append(buf, size, length, value);
+}
+
+int RackProto_EncodeUnsigned(char *buf, size_t size, const char *topic, uint32_t value) {
+    int length = RackProto_Append(buf, size, (size > 0U) ? 0 : -1, topic);
+    length = RackProto_AppendChar(buf, size, length, RACK_PROTO_SEPARATOR);
+    return RackProto_AppendDigits(buf, size, length, value, 1U);
+}
+
+int RackProto_EncodeCommand(char *buf, size_t size, int id, const char *value, uint16_t seq) {
+    int length = RackProto_AppendSigned(buf, size, (size > 0U) ? 0 : -1, id);
+    length = RackProto_AppendChar(buf, size, length, RACK_PROTO_SEPARATOR);
+    length = RackProto_Append(buf, size, length, value);
+    if (seq != 0U) {
+        length = RackProto_AppendChar(buf, size, length, RACK_PROTO_SEQ_MARK);
+        length = RackProto_AppendDigits(buf, size, length, seq, 1U);
+    }
+    return length;
+}
+
+int RackProto_EncodeAck(char *buf, size_t size, const RackAck *ack) {
+    int length = RackProto_Append(buf, size, (size > 0U) ? 0 : -1, RACK_PROTO_ACK_TOPIC);
+    length = RackProto_AppendChar(buf, size, length, RACK_PROTO_SEPARATOR);
+    length = RackProto_AppendDigits(buf, size, length, ack->seq, 1U);
+    length = RackProto_AppendChar(buf, size, length, ',');
+    length = RackProto_AppendSigned(buf, size, length, ack->code);
+    length = RackProto_AppendChar(buf, size, length, ',');
+    return RackProto_AppendDigits(buf, size, length, ack->applyUs, 1U);
+}
+
+int RackProto_EndFrame(char *buf, size_t size, int length) {
+    return RackProto_Append(buf, size, length, RACK_PROTO_FRAME_END);
+}
@@ -0,0 +1,147 @@
+/*
+ * uart_link.h
+ *
+ *  Description:
+ *      DMA-driven UART link to the gateway, at a baud rate negotiated with it.
+ *      RX runs as a circular DMA transfer read on idle line, half and full
+ *      transfer, and complete lines are queued for the main loop. TX frames are
+ *      copied into a ring that the DMA drains in the background, so publishing
+ *      no longer waits for the wire. The same file builds on both rack boards:
+ *      each one names its UART, DMA channels and IRQs in uart_link_conf.h.
+ *
+ *      Flow control is credit based, as on the gateway. The board grants
+ *      "credit*RECEIVED,FREE" for its free line slots, and the gateway's
+ *      "101*RECEIVED,FREE" limits how many frames of the TX ring the DMA may
+ *      send: the others are held in the ring. Grants and baud answers go out
+ *      ahead of the held frames. A gateway that stops granting is written to
+ *      unchecked after LINK_CREDIT_TIMEOUT_MS.
+ */
+
+#ifndef INC_UART_LINK_H_
+#define INC_UART_LINK_H_
+
+/******************************************************************************
+ * SECTION 1: LIBRARIES
+ *****************************************************************************/
+// Standard C Libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+// STM32 HAL Libraries
+#include "main.h"
+
+// Board UART, DMA channels and IRQs
+#include "uart_link_conf.h"
+
+// Wire protocol shared with the gateway
+#include "rack_proto.h"
+
+/******************************************************************************
+ * SECTION 2: MACROS
+ *****************************************************************************/
+
+/** Buffers */
+#define LINK_RX_DMA_SIZE       256U     // Circular RX DMA buffer (~1.3 ms at 2 Mbaud between reads)
+#define LINK_TX_RING_SIZE      512U     // Frames waiting for the TX DMA
+#define LINK_TX_ACK_RESERVE    80U      // Ring bytes only ACKs may take (~3 ACK lines)
+#define LINK_LINE_SIZE         48U      // Longest received line, terminator included
+#define LINK_LINE_SLOTS        8U       // Received lines waiting for the main loop (one kept empty, one for a baud line)
+
+/** Baud negotiation, driven by the gateway */
+#define LINK_BAUD_DEFAULT      115200U  // Rate after reset and after a failed negotiation
+#define LINK_BAUD_MAX          2000000U // Highest rate accepted
+#define LINK_BAUD_ID           RACK_PROTO_BAUD_ID      // "100*RATE" proposes RATE, or confirms the rate just set
+#define LINK_BAUD_TOPIC        RACK_PROTO_BAUD_TOPIC   // Answer "baud*RATE", "baud*0" when RATE cannot be set
+#define LINK_BAUD_TOLERANCE    15U      // Largest baud error accepted, in permille
+#define LINK_BAUD_CONFIRM_MS   300U     // A new rate not confirmed in this time is dropped
+#define LINK_BAUD_SILENCE_MS   15000U   // Back to the default rate without a proposal for this long
+
+/** Credit-based flow control */
+#define LINK_CREDIT_ID         RACK_PROTO_CREDIT_ID    // "101*RECEIVED,FREE": lines the gateway received and can still take
+#define LINK_CREDIT_TOPIC      RACK_PROTO_CREDIT_TOPIC // Grant to the gateway "credit*RECEIVED,FREE" for the line slots
+#define LINK_CREDIT_PERIOD_MS  1000U    // Grants are repeated at least this often, replacing lost ones
+#define LINK_CREDIT_TIMEOUT_MS 3000U    // Without a grant for this long, frames go out unchecked
+#define LINK_CREDIT_SETTLE_MS  100U     // Idle time after which frames the gateway has not counted are lost
+
+/** Throughput report */
+#define LINK_PUBLISH_PERIOD_MS 10000U   // Rates, errors and credit report period to the gateway
+
+/******************************************************************************
+ * SECTION 3: DATA TYPES & STRUCTURES
+ *****************************************************************************/
+
+/** Line received from the gateway */
+typedef struct {
+    char text[LINK_LINE_SIZE];  // Line with its "\r\n", null-terminated
+    uint16_t stampUs;           // TIM2 count when its '\n' was read (actuator board only)
+    uint32_t stampMs;           // HAL tick when its '\n' was read
+} UartLine;
+
+extern UART_HandleTypeDef LINK_UART;
+extern DMA_HandleTypeDef LINK_HDMA_RX;
+extern DMA_HandleTypeDef LINK_HDMA_TX;
+
+/******************************************************************************
+ * SECTION 4: PUBLIC FUNCTION PROTOTYPES
+ *****************************************************************************/
+
+/**
+ * @brief Sets up the UART DMA channels (and RTS/CTS with LINK_HW_FLOW_CONTROL)
+ *        and starts the circular reception. Call after the UART's MX_ init.
+ */
+void UartLink_Init(void);
+
+/**
+ * @brief Queues bytes for the TX DMA without waiting. Lines are held in the
+ *        ring while the gateway has no credit for them; once the ring is full
+ *        up to LINK_TX_ACK_RESERVE the bytes are dropped and counted.
+ * @param data Bytes to send.
+ * @param len Number of bytes.
+ * @return true if queued.
+ */
+bool UartLink_Write(const uint8_t *data, uint16_t len);
+
+/**
+ * @brief UartLink_Write() for command ACKs, which may also take the
+ *        LINK_TX_ACK_RESERVE bytes. A dropped ACK makes the gateway resend.
+ * @param data Bytes to send.
+ * @param len Number of bytes.
+ * @return true if queued.
+ */
+bool UartLink_WriteAck(const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Takes the oldest received line, granting the gateway credit for the
+ *        freed slot. Baud proposals are answered here and never returned.
+ * @param line Receives the line.
+ * @return true if a line was taken.
+ */
+bool UartLink_ReadLine(UartLine *line);
+
+/**
+ * @brief Baud rate fallback, periodic grants and the throughput report,
+ *        called from the main loop.
+ */
+void UartLink_Process(void);
+
+/**
+ * @brief HAL_Delay() that keeps answering the gateway, for boards that
+ *        pace their loop with long delays. Received lines are discarded.
+ * @param ms Milliseconds to wait.
+ */
+void UartLink_Delay(uint32_t ms);
+
+/**
+ * @brief Current baud rate.
+ */
+uint32_t UartLink_GetBaud(void);
+
+/**
+ * @brief HAL callback hooks, called from HAL_UARTEx_RxEventCallback,
+ *        HAL_UART_TxCpltCallback and HAL_UART_ErrorCallback.
+ */
+void UartLink_RxEventISR(uint16_t size);
+void UartLink_TxCpltISR(void);
+void UartLink_ErrorISR(void);
+
+#endif /* INC_UART_LINK_H_ */
@@ -0,0 +1,624 @@
+/*
+ * uart_link.c
+ *
+ *  Description:
+ *      Implementation of the DMA-driven UART link and of the board side of the
+ *      baud rate negotiation and credit-based flow control.
+ */
+
+#include "uart_link.h"
+#include "utils.h"
+
+/******************************************************************************
+ * SECTION 1: PRIVATE MACROS & DATA
+ *****************************************************************************/
+
+#if !defined(STM32F1) && !defined(STM32F4)
+#error "uart_link.c supports the STM32F1 and STM32F4 only."
+#endif
+
+DMA_HandleTypeDef LINK_HDMA_RX;
+DMA_HandleTypeDef LINK_HDMA_TX;
+
+/** Reception: DMA buffer, line being assembled and lines for the main loop */
+static uint8_t rxDma[LINK_RX_DMA_SIZE];
+static uint16_t rxTail = 0;                  // Next byte of rxDma to read
+static char rxLine[LINK_LINE_SIZE];
+static uint8_t rxLength = 0;
+static bool rxOverlong = false;
+static UartLine lines[LINK_LINE_SLOTS];
+static volatile uint8_t lineHead = 0;        // Written by the RX interrupt
+static volatile uint8_t lineTail = 0;        // Written by the main loop
+
+/** Transmission: ring drained by the DMA, one contiguous chunk at a time */
+static uint8_t txRing[LINK_TX_RING_SIZE];
+static volatile uint16_t txHead = 0;         // Written by the main loop
+static volatile uint16_t txTail = 0;         // Written by the TX interrupt
+static volatile uint16_t txChunk = 0;        // Bytes in flight, 0 when the DMA is idle
+static volatile bool txPaused = false;       // Only the baud answer goes out while switching rates
+
+/** Control lines, sent ahead of the ring */
+static char txControl[LINK_LINE_SIZE];
+static volatile uint8_t txControlLength = 0; // Bytes in flight, 0 when none
+static volatile bool baudAnswerPending = false;
+static volatile uint32_t baudAnswer = 0;
+static volatile bool grantPending = false;
+
+/** Credit: lines counted both ways, compared as 16-bit differences */
+static volatile uint16_t rxCount = 0;        // Lines received from the gateway, control lines excluded
+static uint16_t grantReceived = 0;           // rxCount in the last grant to the gateway
+static uint16_t grantFree = 0;               // Free slots in the last grant to the gateway
+static uint32_t grantMs = 0;
+static volatile uint16_t txQueued = 0;       // Lines written to the ring
+static volatile uint16_t txCount = 0;        // Lines handed to the DMA
+static uint16_t gatewayReceived = 0;         // From the gateway's last grant
+static uint16_t gatewayFree = 0;
+static uint32_t gatewayGrantMs = 0;
+static uint32_t lastDataMs = 0;
+static bool creditActive = false;            // The gateway grants credit
+static bool creditStalled = false;
+
+/** Baud rate */
+static uint32_t linkBaud = LINK_BAUD_DEFAULT;
+static bool baudPending = false;             // Switched, waiting for the gateway's confirmation
+static uint32_t baudChangedMs = 0;
+static uint32_t lastProposalMs = 0;
+
+/** Throughput */
+static volatile uint32_t rxBytes = 0;
+static volatile uint32_t txBytes = 0;
+static volatile uint32_t linkErrors = 0;     // UART errors, overlong and dropped lines
+static volatile uint32_t creditStalls = 0;   // Times lines were held for lack of credit
+static volatile uint32_t creditLost = 0;     // Lines sent but never counted by the gateway
+static uint32_t txDropped = 0;               // Writes dropped for lack of ring space
+static volatile uint16_t heldPeak = 0;       // Most lines held in the ring since the last report
+static uint32_t lastPublishMs = 0;
+static uint32_t publishedRxBytes = 0;
+static uint32_t publishedTxBytes = 0;
+
+/******************************************************************************
+ * SECTION 2: PRIVATE FUNCTIONS
+ *****************************************************************************/
+
+/**
+ * @brief  Free line slots offered to the gateway: one slot of the queue stays
+ *         empty and one is kept for a baud proposal, which is not counted.
+ */
+static uint16_t UartLink_FreeSlots(void) {
+    uint8_t used = (uint8_t)((lineHead + LINK_LINE_SLOTS - lineTail) % LINK_LINE_SLOTS);
+    return (uint16_t)(LINK_LINE_SLOTS - 2U - used);
+}
+
+/**
+ * @brief  Formats the next control line into txControl.
+ * @return Its length, 0 when none is pending.
+ */
+static int UartLink_NextControl(void) {
+    if (baudAnswerPending) {
+        baudAnswerPending = false;
+        int len = RackProto_EncodeUnsigned(txControl, sizeof(txControl), LINK_BAUD_TOPIC, baudAnswer);
+        return RackProto_EndFrame(txControl, sizeof(txControl), len);
+    }
+    if (grantPending && !txPaused) {
+        grantPending = false;
+        grantReceived = rxCount;
+        grantFree = UartLink_FreeSlots();
+        grantMs = HAL_GetTick();
+        return snprintf(txControl, sizeof(txControl), "%s*%u,%u\r\n", LINK_CREDIT_TOPIC,
+                        (unsigned)grantReceived, (unsigned)grantFree);
+    }
+    return 0;
+}
+
+/**
+ * @brief  Starts the TX DMA, if idle, on the next control line or else on the
+ *         next contiguous chunk of the ring, cut after the last line the
+ *         gateway has credit for. Called with the UART interrupts masked or
+ *         from them.
+ */
+static void UartLink_StartTx(void) {
+    if (txChunk != 0U || txControlLength != 0U) {
+        return;
+    }
+
+    int control = UartLink_NextControl();
+    if (control > 0 && control < (int)sizeof(txControl)) {
+        txControlLength = (uint8_t)control;
+        if (HAL_UART_Transmit_DMA(&LINK_UART, (uint8_t *)txControl, txControlLength) != HAL_OK) {
+            txControlLength = 0;
+        }
+        return;
+    }
+    if (txPaused || txHead == txTail) {
+        return;
+    }
+
+    uint32_t now = HAL_GetTick();
+    if (creditActive && now - gatewayGrantMs >= LINK_CREDIT_TIMEOUT_MS) {
+        creditActive = false; // The gateway stopped granting (reset, or older firmware)
+    }
+    int16_t credit = INT16_MAX;
+    if (creditActive) {
+        credit = (int16_t)(gatewayFree - (uint16_t)(txCount - gatewayReceived));
+        if (credit <= 0) {
+            if (!creditStalled) {
+                creditStalls++;
+                creditStalled = true;
+            }
+            return;
+        }
+    }
+    creditStalled = false;
+
+    uint16_t end = (txHead > txTail) ? txHead : LINK_TX_RING_SIZE;
+    uint16_t i = txTail;
+    uint16_t sent = 0;
+    while (i < end && (int16_t)sent < credit) {
+        if (txRing[i++] == '\n') {
+            sent++;
+        }
+    }
+    txChunk = i - txTail;
+    if (HAL_UART_Transmit_DMA(&LINK_UART, &txRing[txTail], txChunk) != HAL_OK) {
+        txChunk = 0;
+        return;
+    }
+    txCount += sent;
+    lastDataMs = now;
+}
+
+/**
+ * @brief  Starts the TX DMA from the main loop.
+ */
+static void UartLink_KickTx(void) {
+    __disable_irq();
+    UartLink_StartTx();
+    __enable_irq();
+}
+
+/**
+ * @brief  Applies a "101*RECEIVED,FREE" grant from the gateway, from the RX
+ *         interrupt. Credit starts with the first grant.
+ */
+static void UartLink_TakeGrant(const char *text) {
+    char *end;
+    uint16_t received = (uint16_t)strtoul(text, &end, 10);
+    if (*end != ',') {
+        return;
+    }
+    uint16_t free = (uint16_t)strtoul(end + 1, NULL, 10);
+    uint32_t now = HAL_GetTick();
+
+    int16_t inFlight = (int16_t)(txCount - received);
+    if (!creditActive || inFlight < 0) {
+        txCount = received; // First grant, or a gateway that restarted its count
+    } else if (inFlight > 0 && now - lastDataMs >= LINK_CREDIT_SETTLE_MS) {
+        creditLost += (uint32_t)inFlight; // Granted long after the last line and still not counted
+        txCount = received;
+    }
+    gatewayReceived = received;
+    gatewayFree = free;
+    gatewayGrantMs = now;
+    creditActive = true;
+    UartLink_StartTx();
+}
+
+/**
+ * @brief  Grants the gateway credit once half of the offered slots were
+ *         freed since the last grant, or when forced. Main loop only.
+ */
+static void UartLink_GrantCredit(bool force) {
+    int16_t remaining = (int16_t)(grantFree - (uint16_t)(rxCount - grantReceived));
+    int16_t gained = (int16_t)UartLink_FreeSlots() - remaining;
+
+    if (force || gained >= (int16_t)((LINK_LINE_SLOTS - 2U) / 2U) || (remaining <= 0 && gained > 0)) {
+        grantPending = true;
+        UartLink_KickTx();
+    }
+}
+
+/**
+ * @brief  Free bytes in the TX ring (one slot is kept empty).
+ */
+static uint16_t UartLink_TxFree(void) {
+    return (uint16_t)((txTail + LINK_TX_RING_SIZE - txHead - 1U) % LINK_TX_RING_SIZE);
+}
+
+/**
+ * @brief  Assembles one received byte, queuing the line on '\n'.
+ */
+static void UartLink_RxByte(uint8_t c) {
+    if (rxLength < LINK_LINE_SIZE - 1U) {
+        rxLine[rxLength++] = (char)c;
+    } else {
+        rxOverlong = true;
+    }
+    if (c != '\n') {
+        return;
+    }
+
+    // Grants are applied here, baud proposals go to the main loop uncounted
+    rxLine[rxLength] = '\0';
+    int id = rxOverlong ? -1 : atoi(rxLine);
+    char *posAstk = strchr(rxLine, '*');
+    if (id == LINK_CREDIT_ID && posAstk) {
+        UartLink_TakeGrant(posAstk + 1);
+        rxLength = 0;
+        return;
+    }
+    if (id != LINK_BAUD_ID) {
+        rxCount++;
+    }
+
+    uint8_t next = (uint8_t)((lineHead + 1U) % LINK_LINE_SLOTS);
+    if (rxOverlong || next == lineTail) {
+        linkErrors++; // Line too long, or the main loop is behind
+    } else {
+        UartLine *line = &lines[lineHead];
+        memcpy(line->text, rxLine, rxLength);
+        line->text[rxLength] = '\0';
+#ifdef ACT
+        line->stampUs = __HAL_TIM_GET_COUNTER(&htim2);
+#else
+        line->stampUs = 0;
+#endif
+        line->stampMs = HAL_GetTick();
+        lineHead = next;
+    }
+    rxLength = 0;
+    rxOverlong = false;
+}
+
+/**
+ * @brief  Writes "topic*value\r\n" with an integer value.
+ */
+static void UartLink_PublishValue(const char *topic, uint32_t value) {
+    char buf[LINK_LINE_SIZE];
+    int len = RackProto_EndFrame(buf, sizeof(buf), RackProto_EncodeUnsigned(buf, sizeof(buf), topic, value));
+
+    if (len > 0) {
+        UartLink_Write((const uint8_t *)buf, (uint16_t)len);
+    }
+}
+
+/**
+ * @brief  Checks that the UART can run at a rate within LINK_BAUD_TOLERANCE.
+ */
+static bool UartLink_BaudSupported(uint32_t rate) {
+    if (rate < LINK_BAUD_DEFAULT || rate > LINK_BAUD_MAX) {
+        return false;
+    }
+
+    // BRR holds USARTDIV in sixteenths, so the actual rate is PCLK / BRR
+    uint32_t pclk = LINK_PCLK_FREQ();
+    uint32_t brr = UART_BRR_SAMPLING16(pclk, rate);
+    if (brr < 16U) {
+        return false;
+    }
+    uint32_t actual = pclk / brr;
+    uint32_t error = (actual > rate) ? actual - rate : rate - actual;
+    return error * 1000U <= rate * LINK_BAUD_TOLERANCE;
+}
+
+/**
+ * @brief  Switches the UART to a rate once everything queued has left the wire.
+ *         Main loop only.
+ */
+static void UartLink_SetBaud(uint32_t rate) {
+    // Held lines stay in the ring and go out at the new rate
+    txPaused = true;
+    while (txChunk != 0U || txControlLength != 0U || baudAnswerPending) {
+    }
+    while (__HAL_UART_GET_FLAG(&LINK_UART, UART_FLAG_TC) == RESET) {
+    }
+
+    __HAL_UART_DISABLE(&LINK_UART);
+    LINK_UART.Init.BaudRate = rate;
+    LINK_UART.Instance->BRR = UART_BRR_SAMPLING16(LINK_PCLK_FREQ(), rate);
+    __HAL_UART_ENABLE(&LINK_UART);
+
+    // Whatever was being assembled was read at the old rate
+    __disable_irq();
+    rxLength = 0;
+    rxOverlong = false;
+    txPaused = false;
+    UartLink_StartTx();
+    __enable_irq();
+
+    linkBaud = rate;
+}
+
+/**
+ * @brief  Sends "baud*RATE" ahead of the held lines. Main loop only.
+ */
+static void UartLink_AnswerBaud(uint32_t rate) {
+    baudAnswer = rate;
+    baudAnswerPending = true;
+    UartLink_KickTx();
+}
+
+/**
+ * @brief  Answers a "100*RATE" proposal from the gateway.
+ *
+ * The current rate is a confirmation (or a keepalive) and is simply echoed. A
+ * new rate is accepted at the old rate, then set; it is dropped again unless
+ * the gateway confirms it at the new rate within LINK_BAUD_CONFIRM_MS.
+ */
+static void UartLink_BaudRequest(uint32_t rate) {
+    lastProposalMs = HAL_GetTick();
+
+    if (rate == linkBaud) {
+        baudPending = false;
+        UartLink_AnswerBaud(rate);
+        return;
+    }
+    if (!UartLink_BaudSupported(rate)) {
+        UartLink_AnswerBaud(0);
+        return;
+    }
+
+    UartLink_AnswerBaud(rate);
+    UartLink_SetBaud(rate);
+    baudPending = true;
+    baudChangedMs = HAL_GetTick();
+}
+
+#if LINK_HW_FLOW_CONTROL
+/**
+ * @brief  Routes the board's CTS and RTS pins to the UART and enables them.
+ */
+static void UartLink_InitFlowControl(void) {
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+    LINK_FLOW_GPIO_CLK_ENABLE();
+#if defined(STM32F1)
+    GPIO_InitStruct.Pin = LINK_FLOW_CTS_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    HAL_GPIO_Init(LINK_FLOW_GPIO_PORT, &GPIO_InitStruct);
+    GPIO_InitStruct.Pin = LINK_FLOW_RTS_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    HAL_GPIO_Init(LINK_FLOW_GPIO_PORT, &GPIO_InitStruct);
+#else
+    GPIO_InitStruct.Pin = LINK_FLOW_CTS_PIN | LINK_FLOW_RTS_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStruct.Alternate = LINK_FLOW_AF;
+    HAL_GPIO_Init(LINK_FLOW_GPIO_PORT, &GPIO_InitStruct);
+#endif
+
+    LINK_UART.Init.HwFlowCtl = UART_HWCONTROL_RTS_CTS;
+    if (HAL_UART_Init(&LINK_UART) != HAL_OK) {
+        Error_Handler();
+    }
+}
+#endif
+
+/**
+ * @brief  Starts (or restarts) the circular reception.
+ */
+static void UartLink_StartRx(void) {
+    rxTail = 0;
+    if (HAL_UARTEx_ReceiveToIdle_DMA(&LINK_UART, rxDma, LINK_RX_DMA_SIZE) != HAL_OK) {
+        linkErrors++;
+    }
+}
+
+/**
+ * @brief  Copies bytes into the TX ring if it has room for them beyond reserve.
+ *         Main loop only.
+ */
+static bool UartLink_Queue(const uint8_t *data, uint16_t len, uint16_t reserve) {
+    if (len >= LINK_TX_RING_SIZE) {
+        linkErrors++;
+        return false;
+    }
+    if (UartLink_TxFree() < len + reserve) {
+        // Draining, or held for a grant: never wait, the DMA or credit may take seconds
+        txDropped++;
+        UartLink_KickTx();
+        return false;
+    }
+
+    uint16_t head = txHead;
+    uint16_t newLines = 0;
+    for (uint16_t i = 0; i < len; i++) {
+        txRing[head] = data[i];
+        head = (uint16_t)((head + 1U) % LINK_TX_RING_SIZE);
+        if (data[i] == '\n') {
+            newLines++;
+        }
+    }
+
+    __disable_irq();
+    txHead = head;
+    txQueued += newLines;
+    uint16_t held = (uint16_t)(txQueued - txCount);
+    if (held > heldPeak) {
+        heldPeak = held;
+    }
+    UartLink_StartTx();
+    __enable_irq();
+    return true;
+}
+
+/******************************************************************************
+ * SECTION 3: PUBLIC FUNCTIONS
+ *****************************************************************************/
+
+void UartLink_Init(void) {
+#if LINK_HW_FLOW_CONTROL
+    UartLink_InitFlowControl();
+#endif
+    LINK_DMA_CLK_ENABLE();
+
+    LINK_HDMA_RX.Instance = LINK_DMA_RX;
+#if defined(STM32F4)
+    LINK_HDMA_RX.Init.Channel = LINK_DMA_CHANNEL;
+    LINK_HDMA_RX.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+#endif
+    LINK_HDMA_RX.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    LINK_HDMA_RX.Init.PeriphInc = DMA_PINC_DISABLE;
+    LINK_HDMA_RX.Init.MemInc = DMA_MINC_ENABLE;
+    LINK_HDMA_RX.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    LINK_HDMA_RX.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    LINK_HDMA_RX.Init.Mode = DMA_CIRCULAR;
+    LINK_HDMA_RX.Init.Priority = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(&LINK_HDMA_RX) != HAL_OK) {
+        Error_Handler();
+    }
+    __HAL_LINKDMA(&LINK_UART, hdmarx, LINK_HDMA_RX);
+
+    LINK_HDMA_TX.Instance = LINK_DMA_TX;
+#if defined(STM32F4)
+    LINK_HDMA_TX.Init.Channel = LINK_DMA_CHANNEL;
+    LINK_HDMA_TX.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+#endif
+    LINK_HDMA_TX.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    LINK_HDMA_TX.Init.PeriphInc = DMA_PINC_DISABLE;
+    LINK_HDMA_TX.Init.MemInc = DMA_MINC_ENABLE;
+    LINK_HDMA_TX.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    LINK_HDMA_TX.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    LINK_HDMA_TX.Init.Mode = DMA_NORMAL;
+    LINK_HDMA_TX.Init.Priority = DMA_PRIORITY_MEDIUM;
+    if (HAL_DMA_Init(&LINK_HDMA_TX) != HAL_OK) {
+        Error_Handler();
+    }
+    __HAL_LINKDMA(&LINK_UART, hdmatx, LINK_HDMA_TX);
+
+    HAL_NVIC_SetPriority(LINK_DMA_RX_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(LINK_DMA_RX_IRQn);
+    HAL_NVIC_SetPriority(LINK_DMA_TX_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(LINK_DMA_TX_IRQn);
+
+    lastProposalMs = HAL_GetTick();
+    lastPublishMs = HAL_GetTick();
+    UartLink_StartRx();
+    UartLink_GrantCredit(true);
+}
+
+bool UartLink_Write(const uint8_t *data, uint16_t len) {
+    return UartLink_Queue(data, len, LINK_TX_ACK_RESERVE);
+}
+
+bool UartLink_WriteAck(const uint8_t *data, uint16_t len) {
+    return UartLink_Queue(data, len, 0);
+}
+
+bool UartLink_ReadLine(UartLine *line) {
+    while (lineTail != lineHead) {
+        *line = lines[lineTail];
+        lineTail = (uint8_t)((lineTail + 1U) % LINK_LINE_SLOTS);
+        UartLink_GrantCredit(false);
+
+        // "100*RATE" is the gateway's baud negotiation
+        char *posAstk = strchr(line->text, '*');
+        if (posAstk && atoi(line->text) == LINK_BAUD_ID) {
+            UartLink_BaudRequest(strtoul(posAstk + 1, NULL, 10));
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+void UartLink_Process(void) {
+    uint32_t now = HAL_GetTick();
+
+    if (baudPending && now - baudChangedMs >= LINK_BAUD_CONFIRM_MS) {
+        // The gateway never confirmed: the rate does not work on this wire
+        baudPending = false;
+        UartLink_SetBaud(LINK_BAUD_DEFAULT);
+    } else if (linkBaud != LINK_BAUD_DEFAULT && now - lastProposalMs >= LINK_BAUD_SILENCE_MS) {
+        // The gateway was reset, or gave up on this rate
+        UartLink_SetBaud(LINK_BAUD_DEFAULT);
+    }
+
+    // Periodic grant, and held lines once credit has lapsed
+    UartLink_GrantCredit(now - grantMs >= LINK_CREDIT_PERIOD_MS);
+    UartLink_KickTx();
+
+    if (now - lastPublishMs >= LINK_PUBLISH_PERIOD_MS) {
+        uint32_t elapsed = now - lastPublishMs;
+        uint32_t rx = rxBytes;
+        uint32_t tx = txBytes;
+
+        lastPublishMs = now;
+        UartLink_PublishValue(TOPIC_LINK_BAUD, linkBaud);
+        UartLink_PublishValue(TOPIC_LINK_RX_RATE, (uint32_t)((uint64_t)(rx - publishedRxBytes) * 1000U / elapsed));
+        UartLink_PublishValue(TOPIC_LINK_TX_RATE, (uint32_t)((uint64_t)(tx - publishedTxBytes) * 1000U / elapsed));
+        UartLink_PublishValue(TOPIC_LINK_ERRORS, linkErrors);
+        UartLink_PublishValue(TOPIC_LINK_TX_HELD, heldPeak);
+        UartLink_PublishValue(TOPIC_LINK_CREDIT_STALLS, creditStalls);
+        UartLink_PublishValue(TOPIC_LINK_CREDIT_LOST, creditLost);
+        UartLink_PublishValue(TOPIC_LINK_TX_DROPPED, txDropped);
+        publishedRxBytes = rx;
+        publishedTxBytes = tx;
+        __disable_irq();
+        heldPeak = (uint16_t)(txQueued - txCount);
+        __enable_irq();
+    }
+}
+
+void UartLink_Delay(uint32_t ms) {
+    uint32_t start = HAL_GetTick();
+    UartLine line;
+
+    while (HAL_GetTick() - start < ms) {
+        while (UartLink_ReadLine(&line)) {
+            // Nothing else is read from the gateway
+        }
+        UartLink_Process();
+    }
+}
+
+uint32_t UartLink_GetBaud(void) {
+    return linkBaud;
+}
+
+void UartLink_RxEventISR(uint16_t size) {
+    // size is the DMA write position: idle line, half or full buffer
+    if (size > LINK_RX_DMA_SIZE) {
+        return;
+    }
+    for (uint16_t i = rxTail; i < size; i++) {
+        UartLink_RxByte(rxDma[i]);
+    }
+    rxBytes += (uint32_t)(size - rxTail);
+    rxTail = (size == LINK_RX_DMA_SIZE) ? 0U : size;
+}
+
+void UartLink_TxCpltISR(void) {
+    if (txControlLength != 0U) {
+        txBytes += txControlLength;
+        txControlLength = 0;
+        UartLink_StartTx();
+        return;
+    }
+    txBytes += txChunk;
+    txTail = (uint16_t)((txTail + txChunk) % LINK_TX_RING_SIZE);
+    txChunk = 0;
+    UartLink_StartTx();
+}
+
+void UartLink_ErrorISR(void) {
+    linkErrors++;
+
+    // An overrun aborts the reception; noise and framing errors do not
+    if (LINK_UART.RxState == HAL_UART_STATE_READY) {
+        rxLength = 0;
+        rxOverlong = false;
+        UartLink_StartRx();
+    }
+    // A DMA transfer error leaves its chunk behind
+    if (LINK_UART.gState == HAL_UART_STATE_READY && txControlLength != 0U) {
+        txControlLength = 0;
+        UartLink_StartTx();
+    } else if (LINK_UART.gState == HAL_UART_STATE_READY && txChunk != 0U) {
+        txTail = (uint16_t)((txTail + txChunk) % LINK_TX_RING_SIZE);
+        txChunk = 0;
+        UartLink_StartTx();
+    }
+}
@@ -0,0 +1,47 @@
+/*
+ * bridge_host.cpp
+ * Description: Runs the host build of the bridge as a standalone broker, for
+ *              broker_bench or any MQTT client. The UARTs have no boards attached.
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "utils.h"
+
+void setup();
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--port") == 0)
+        {
+            setenv("BRIDGE_HOST_PORT", argv[i + 1], 1);
+        }
+        else if (strcmp(argv[i], "--fs") == 0)
+        {
+            LittleFS.setRoot(argv[i + 1]);
+        }
+    }
+    if (argc % 2 == 0)
+    {
+        printf("usage: %s [--port p] [--fs dir]\n", argv[0]);
+        return 2;
+    }
+
+    Serial.setEcho(getenv("BRIDGE_HOST_CONSOLE") != nullptr);
+    setup();
+    const char *port = getenv("BRIDGE_HOST_PORT");
+    printf("bridge_host: pid %d, port %d\n", getpid(), port ? atoi(port) : MQTT_BROKER_PORT);
+    fflush(stdout);
+
+    // The broker and UART tasks do the work
+    for (;;)
+    {
+        pause();
+    }
+}
@@ -0,0 +1,45 @@
+/*
+ * Arduino.h
+ * Description: Host stand-in for the Arduino-ESP32 core, the subset used by the bridge.
+ */
+
+#ifndef HOST_ARDUINO_H_
+#define HOST_ARDUINO_H_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include "HardwareSerial.h"
+#include "IPAddress.h"
+#include "Stream.h"
+#include "WString.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+/**
+ * Milliseconds since the program started.
+ */
+unsigned long millis();
+
+/**
+ * Microseconds since the program started.
+ */
+unsigned long micros();
+
+void delay(uint32_t ms);
+
+/**
+ * SNTP is not simulated: the host clock is already set.
+ */
+void configTime(long gmtOffset, int daylightOffset, const char *server1, const char *server2 = nullptr,
+                const char *server3 = nullptr);
+
+#endif /* HOST_ARDUINO_H_ */
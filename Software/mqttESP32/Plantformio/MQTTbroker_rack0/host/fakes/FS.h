@@ -0,0 +1,63 @@
+/*
+ * FS.h
+ * Description: Host stand-in for the Arduino-ESP32 file system API, mapped onto a
+ *              directory of the host file system.
+ */
+
+#ifndef HOST_FS_H_
+#define HOST_FS_H_
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace fs
+{
+
+class File
+{
+public:
+    File() {}
+
+    explicit operator bool() const { return impl != nullptr; }
+    bool isDirectory() const;
+    File openNextFile();
+    const char *name() const;
+    size_t size() const;
+    bool seek(uint32_t position);
+    size_t read(uint8_t *buffer, size_t length);
+    size_t write(const uint8_t *buffer, size_t length);
+    void close() { impl.reset(); }
+
+private:
+    friend class FS;
+    struct Impl;
+    std::shared_ptr<Impl> impl;
+};
+
+class FS
+{
+public:
+    /**
+     * @param root Host directory that stands for "/".
+     */
+    explicit FS(const std::string &root = "littlefs") : root(root) {}
+
+    void setRoot(const std::string &directory) { root = directory; }
+    const std::string &getRoot() const { return root; }
+
+    File open(const char *path, const char *mode = "r");
+    bool exists(const char *path);
+    bool mkdir(const char *path);
+    bool remove(const char *path);
+
+protected:
+    std::string root;
+
+    std::string hostPath(const char *path) const { return root + path; }
+};
+
+} // namespace fs
+
+#endif /* HOST_FS_H_ */
@@ -0,0 +1,68 @@
+/*
+ * HardwareSerial.h
+ * Description: Host stand-in for an Arduino serial port, backed by an in-memory pipe.
+ *              The host side injects what the port receives; what the firmware
+ *              prints goes to stdout only when echo is enabled, so debug prints
+ *              cost a formatting pass but no terminal I/O during load tests.
+ */
+
+#ifndef HOST_HARDWARESERIAL_H_
+#define HOST_HARDWARESERIAL_H_
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "Stream.h"
+#include "WString.h"
+
+class HardwareSerial : public Stream
+{
+public:
+    explicit HardwareSerial(int number) : number(number), echo(false), written(0) {}
+
+    void begin(unsigned long baud, uint32_t config = 0, int rxPin = -1, int txPin = -1) {}
+    void end() {}
+
+    int available() override;
+    int read() override;
+    int peek() override;
+
+    size_t write(uint8_t byte);
+    size_t write(const uint8_t *data, size_t length);
+    size_t print(const char *text);
+    size_t print(const String &text) { return print(text.c_str()); }
+    size_t println(const char *text = "");
+    size_t println(const String &text) { return println(text.c_str()); }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+    /**
+     * Host side: bytes received by the port.
+     */
+    void inject(const void *data, size_t length);
+
+    /**
+     * Host side: copy the firmware's output to stdout.
+     */
+    void setEcho(bool enabled) { echo = enabled; }
+
+    /**
+     * Host side: bytes written by the firmware.
+     */
+    uint64_t bytesWritten() const { return written; }
+
+private:
+    int number;
+    std::mutex mutex;
+    std::deque<uint8_t> rx;
+    std::atomic<bool> echo;
+    std::atomic<uint64_t> written;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+
+#endif /* HOST_HARDWARESERIAL_H_ */
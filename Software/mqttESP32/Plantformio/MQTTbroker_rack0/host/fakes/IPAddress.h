@@ -0,0 +1,32 @@
+/*
+ * IPAddress.h
+ * Description: Host stand-in for the Arduino IPAddress class.
+ */
+
+#ifndef HOST_IPADDRESS_H_
+#define HOST_IPADDRESS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "WString.h"
+
+class IPAddress
+{
+public:
+    IPAddress() : octets{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+
+    String toString() const
+    {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+        return String(text);
+    }
+
+    uint8_t operator[](int index) const { return octets[index]; }
+
+private:
+    uint8_t octets[4];
+};
+
+#endif /* HOST_IPADDRESS_H_ */
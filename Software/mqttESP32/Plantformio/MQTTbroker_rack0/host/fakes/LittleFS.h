@@ -0,0 +1,26 @@
+/*
+ * LittleFS.h
+ * Description: Host stand-in for the LittleFS partition. The root directory defaults
+ *              to ./littlefs and the reported size matches the 1.5 MB partition.
+ */
+
+#ifndef HOST_LITTLEFS_H_
+#define HOST_LITTLEFS_H_
+
+#include "FS.h"
+
+#define HOST_LITTLEFS_BYTES (1536 * 1024)
+
+class LittleFSFS : public fs::FS
+{
+public:
+    /**
+     * Creates the root directory if needed.
+     */
+    bool begin(bool formatOnFail = false);
+    size_t totalBytes() const { return HOST_LITTLEFS_BYTES; }
+};
+
+extern LittleFSFS LittleFS;
+
+#endif /* HOST_LITTLEFS_H_ */
@@ -0,0 +1,130 @@
+/*
+ * PicoMQTT.h
+ * Description: Host stand-in for PicoMQTT::Server: an MQTT 3.1.1 broker on a TCP
+ *              socket with the same interface and delivery rules (QoS 0 out,
+ *              server publishes also reach its own subscriptions). Single threaded:
+ *              every call comes from the broker task, like on the ESP32. The
+ *              server's own allocations are left out of the bridge's heap count;
+ *              only the callbacks into the bridge are counted.
+ */
+
+#ifndef HOST_PICOMQTT_H_
+#define HOST_PICOMQTT_H_
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Stream.h"
+#include "WString.h"
+
+#define HOST_MQTT_CLIENT_BUFFER (64 * 1024) /**< Pending bytes per client before messages are dropped */
+#define HOST_MQTT_PACKET_MAX (16 * 1024)    /**< Largest packet accepted from a client */
+
+namespace PicoMQTT
+{
+
+enum ConnectReturnCode
+{
+    CRC_ACCEPTED = 0,
+    CRC_UNACCEPTABLE_PROTOCOL_VERSION = 1,
+    CRC_IDENTIFIER_REJECTED = 2,
+    CRC_SERVER_UNAVAILABLE = 3,
+    CRC_BAD_USERNAME_OR_PASSWORD = 4,
+    CRC_NOT_AUTHORIZED = 5,
+};
+
+class Server
+{
+public:
+    typedef std::function<void(const char *topic, const char *payload)> MessageCallback;
+    typedef std::function<void(const char *topic, Stream &payload)> StreamCallback;
+
+    explicit Server(uint16_t port = 1883);
+    virtual ~Server();
+
+    /**
+     * Listens on the port; the BRIDGE_HOST_PORT environment variable overrides it.
+     */
+    void begin();
+
+    /**
+     * Accepts connections, reads and handles client packets and flushes pending
+     * output. Never blocks.
+     */
+    void loop();
+
+    /**
+     * Delivers a message to the subscribed clients and to the local subscriptions.
+     */
+    bool publish(const char *topic, const char *payload, uint8_t qos = 0, bool retain = false);
+    bool publish(const String &topic, const String &payload, uint8_t qos = 0, bool retain = false)
+    {
+        return publish(topic.c_str(), payload.c_str(), qos, retain);
+    }
+
+    bool subscribe(const char *filter, MessageCallback callback);
+    bool subscribe(const char *filter, StreamCallback callback);
+    bool subscribe(const char *filter);
+    void unsubscribe(const char *filter);
+
+    /**
+     * Host side: connected clients and messages dropped on full client buffers.
+     */
+    size_t clientCount() const { return clients.size(); }
+    uint32_t droppedMessages() const { return dropped; }
+
+protected:
+    virtual void on_subscribe(const char *client_id, const char *topic) {}
+    virtual void on_unsubscribe(const char *client_id, const char *topic) {}
+    virtual ConnectReturnCode auth(const char *client_id, const char *username, const char *password)
+    {
+        return CRC_ACCEPTED;
+    }
+
+private:
+    struct Client
+    {
+        int socket = -1;
+        bool connected = false; /**< CONNECT accepted */
+        bool closing = false;   /**< Close once the output is flushed */
+        std::string id;
+        std::string in;
+        std::string out;
+        std::vector<std::string> filters;
+    };
+
+    struct LocalSubscription
+    {
+        std::string filter;
+        MessageCallback callback;
+        StreamCallback streamCallback;
+    };
+
+    uint16_t port;
+    int listener;
+    uint32_t dropped;
+    std::vector<Client *> clients;
+    std::vector<LocalSubscription> subscriptions;
+
+    void acceptClients();
+    bool readClient(Client &client);
+    bool handlePacket(Client &client, uint8_t header, const std::string &body);
+    void handleConnect(Client &client, const std::string &body);
+    void handleSubscribe(Client &client, const std::string &body);
+    void handleUnsubscribe(Client &client, const std::string &body);
+    void handlePublish(Client &client, uint8_t header, const std::string &body);
+    void deliver(const char *topic, const char *payload, bool retain);
+    void send(Client &client, const std::string &packet);
+    bool flush(Client &client);
+};
+
+/**
+ * MQTT topic filter match with '+' and '#'; '$' topics do not match leading wildcards.
+ */
+bool topicMatches(const char *filter, const char *topic);
+
+} // namespace PicoMQTT
+
+#endif /* HOST_PICOMQTT_H_ */
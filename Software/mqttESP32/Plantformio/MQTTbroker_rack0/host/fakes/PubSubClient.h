@@ -0,0 +1,34 @@
+/*
+ * PubSubClient.h
+ * Description: Host stand-in for PubSubClient. The upstream broker is not simulated:
+ *              connections always fail, so the uplink spools (it stays disabled
+ *              unless UPLINK_HOST is set).
+ */
+
+#ifndef HOST_PUBSUBCLIENT_H_
+#define HOST_PUBSUBCLIENT_H_
+
+#include <stdint.h>
+#include "WiFiClient.h"
+
+#define MQTT_CONNECT_FAILED -2
+
+class PubSubClient
+{
+public:
+    explicit PubSubClient(WiFiClient &client) {}
+
+    PubSubClient &setServer(const char *host, uint16_t port) { return *this; }
+    bool setBufferSize(uint16_t size) { return true; }
+    PubSubClient &setSocketTimeout(uint16_t seconds) { return *this; }
+    PubSubClient &setKeepAlive(uint16_t seconds) { return *this; }
+
+    bool connect(const char *id) { return false; }
+    bool connect(const char *id, const char *user, const char *pass) { return false; }
+    bool connected() { return false; }
+    bool loop() { return false; }
+    bool publish(const char *topic, const char *payload) { return false; }
+    int state() { return MQTT_CONNECT_FAILED; }
+};
+
+#endif /* HOST_PUBSUBCLIENT_H_ */
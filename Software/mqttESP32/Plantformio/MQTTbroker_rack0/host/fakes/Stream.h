@@ -0,0 +1,20 @@
+/*
+ * Stream.h
+ * Description: Host stand-in for the Arduino Stream interface: byte reads only.
+ */
+
+#ifndef HOST_STREAM_H_
+#define HOST_STREAM_H_
+
+class Stream
+{
+public:
+    virtual ~Stream() {}
+
+    virtual int available() = 0;
+    /** @return The next byte, or -1 when none is left. */
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+#endif /* HOST_STREAM_H_ */
@@ -0,0 +1,36 @@
+/*
+ * WString.h
+ * Description: Host stand-in for the Arduino String class (the subset used by the bridge).
+ */
+
+#ifndef HOST_WSTRING_H_
+#define HOST_WSTRING_H_
+
+#include <string>
+#include <string.h>
+
+class String
+{
+public:
+    String() {}
+    String(const char *text) : value(text ? text : "") {}
+    String(const std::string &text) : value(text) {}
+
+    unsigned int length() const { return static_cast<unsigned int>(value.size()); }
+    const char *c_str() const { return value.c_str(); }
+
+    bool operator==(const char *other) const { return value == (other ? other : ""); }
+    bool operator==(const String &other) const { return value == other.value; }
+    bool operator!=(const char *other) const { return !(*this == other); }
+    String operator+(const String &other) const { return String(value + other.value); }
+    String &operator+=(const String &other)
+    {
+        value += other.value;
+        return *this;
+    }
+
+private:
+    std::string value;
+};
+
+#endif /* HOST_WSTRING_H_ */
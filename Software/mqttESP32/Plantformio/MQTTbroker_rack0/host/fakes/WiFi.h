@@ -0,0 +1,28 @@
+/*
+ * WiFi.h
+ * Description: Host stand-in for the ESP32 Wi-Fi station: always connected, the
+ *              host's own network stack carries the traffic.
+ */
+
+#ifndef HOST_WIFI_H_
+#define HOST_WIFI_H_
+
+#include "IPAddress.h"
+#include "WiFiClient.h"
+
+#define WIFI_STA 1
+#define WL_CONNECTED 3
+
+class WiFiClass
+{
+public:
+    bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns = IPAddress()) { return true; }
+    bool mode(int mode) { return true; }
+    int begin(const char *ssid, const char *password) { return WL_CONNECTED; }
+    int status() { return WL_CONNECTED; }
+    IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+};
+
+extern WiFiClass WiFi;
+
+#endif /* HOST_WIFI_H_ */
@@ -0,0 +1,13 @@
+/*
+ * WiFiClient.h
+ * Description: Host stand-in for the Arduino TCP client (placeholder for PubSubClient).
+ */
+
+#ifndef HOST_WIFICLIENT_H_
+#define HOST_WIFICLIENT_H_
+
+class WiFiClient
+{
+};
+
+#endif /* HOST_WIFICLIENT_H_ */
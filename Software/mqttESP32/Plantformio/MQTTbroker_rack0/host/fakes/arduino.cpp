@@ -0,0 +1,162 @@
+/*
+ * arduino.cpp
+ * Description: Clock, serial ports and Wi-Fi behind the host Arduino headers.
+ */
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include "esp_heap_caps.h"
+#include <atomic>
+#include <chrono>
+#include <malloc.h>
+#include <random>
+#include <thread>
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+WiFiClass WiFi;
+
+/* =======================
+ * Clock
+ * =======================
+ */
+
+int64_t esp_timer_get_time()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long millis()
+{
+    return static_cast<unsigned long>(esp_timer_get_time() / 1000);
+}
+
+unsigned long micros()
+{
+    return static_cast<unsigned long>(esp_timer_get_time());
+}
+
+void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void configTime(long gmtOffset, int daylightOffset, const char *server1, const char *server2, const char *server3)
+{
+}
+
+uint32_t esp_random()
+{
+    static thread_local std::mt19937 generator(std::random_device{}());
+    return generator();
+}
+
+/* =======================
+ * Heap
+ * =======================
+ */
+
+static std::atomic<uint32_t> minimumFree{UINT32_MAX};
+
+uint32_t esp_get_free_heap_size()
+{
+    uint32_t free = static_cast<uint32_t>(mallinfo2().fordblks);
+    uint32_t seen = minimumFree.load();
+    while (free < seen && !minimumFree.compare_exchange_weak(seen, free))
+    {
+    }
+    return free;
+}
+
+uint32_t esp_get_minimum_free_heap_size()
+{
+    esp_get_free_heap_size();
+    return minimumFree.load();
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return esp_get_free_heap_size();
+}
+
+/* =======================
+ * HardwareSerial
+ * =======================
+ */
+
+int HardwareSerial::available()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return static_cast<int>(rx.size());
+}
+
+int HardwareSerial::read()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (rx.empty())
+    {
+        return -1;
+    }
+    int c = rx.front();
+    rx.pop_front();
+    return c;
+}
+
+int HardwareSerial::peek()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return rx.empty() ? -1 : rx.front();
+}
+
+size_t HardwareSerial::write(uint8_t byte)
+{
+    return write(&byte, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t length)
+{
+    written += length;
+    if (echo)
+    {
+        fwrite(data, 1, length, stdout);
+        fflush(stdout);
+    }
+    return length;
+}
+
+size_t HardwareSerial::print(const char *text)
+{
+    return write(reinterpret_cast<const uint8_t *>(text), strlen(text));
+}
+
+size_t HardwareSerial::println(const char *text)
+{
+    return print(text) + print("\r\n");
+}
+
+size_t HardwareSerial::printf(const char *format, ...)
+{
+    char buffer[256];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if (length < 0)
+    {
+        return 0;
+    }
+    return write(reinterpret_cast<const uint8_t *>(buffer),
+                 static_cast<size_t>(length) < sizeof(buffer) ? static_cast<size_t>(length) : sizeof(buffer) - 1);
+}
+
+void HardwareSerial::inject(const void *data, size_t length)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    std::lock_guard<std::mutex> lock(mutex);
+    rx.insert(rx.end(), bytes, bytes + length);
+}
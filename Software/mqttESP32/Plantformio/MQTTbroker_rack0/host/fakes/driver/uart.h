@@ -0,0 +1,100 @@
+/*
+ * uart.h
+ * Description: Host stand-in for the ESP-IDF UART driver used by UartLink. Each port
+ *              is an in-memory wire; see host_uart.h for the side of the rack boards.
+ */
+
+#ifndef HOST_DRIVER_UART_H_
+#define HOST_DRIVER_UART_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef int uart_port_t;
+#define UART_NUM_0 0
+#define UART_NUM_1 1
+#define UART_NUM_2 2
+#define UART_NUM_MAX 3
+#define UART_PIN_NO_CHANGE -1
+
+typedef enum
+{
+    UART_DATA_8_BITS = 3
+} uart_word_length_t;
+
+typedef enum
+{
+    UART_PARITY_DISABLE = 0
+} uart_parity_t;
+
+typedef enum
+{
+    UART_STOP_BITS_1 = 1
+} uart_stop_bits_t;
+
+typedef enum
+{
+    UART_HW_FLOWCTRL_DISABLE = 0,
+    UART_HW_FLOWCTRL_RTS = 1,
+    UART_HW_FLOWCTRL_CTS = 2,
+    UART_HW_FLOWCTRL_CTS_RTS = 3
+} uart_hw_flowcontrol_t;
+
+typedef enum
+{
+    UART_SCLK_APB = 0
+} uart_sclk_t;
+
+typedef struct
+{
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+    uart_sclk_t source_clk;
+} uart_config_t;
+
+typedef enum
+{
+    UART_DATA,
+    UART_BREAK,
+    UART_BUFFER_FULL,
+    UART_FIFO_OVF,
+    UART_FRAME_ERR,
+    UART_PARITY_ERR,
+    UART_DATA_BREAK,
+    UART_PATTERN_DET,
+    UART_EVENT_MAX
+} uart_event_type_t;
+
+typedef struct
+{
+    uart_event_type_t type;
+    size_t size;
+    bool timeout_flag;
+} uart_event_t;
+
+esp_err_t uart_driver_install(uart_port_t port, int rxBufferSize, int txBufferSize, int queueSize,
+                              QueueHandle_t *queue, int flags);
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config);
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts);
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baud);
+esp_err_t uart_get_baudrate(uart_port_t port, uint32_t *baud);
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t port, char pattern, uint8_t count, int gap, int preIdle,
+                                            int postIdle);
+esp_err_t uart_pattern_queue_reset(uart_port_t port, int length);
+int uart_pattern_pop_pos(uart_port_t port);
+esp_err_t uart_flush_input(uart_port_t port);
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size);
+int uart_read_bytes(uart_port_t port, void *buffer, uint32_t length, TickType_t ticks);
+int uart_write_bytes(uart_port_t port, const void *data, size_t length);
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks);
+
+#endif /* HOST_DRIVER_UART_H_ */
@@ -0,0 +1,19 @@
+/*
+ * esp_heap_caps.h
+ * Description: Host stand-in for the ESP-IDF heap capabilities API.
+ */
+
+#ifndef HOST_ESP_HEAP_CAPS_H_
+#define HOST_ESP_HEAP_CAPS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+
+/**
+ * The host has no fixed heap: reports the free bytes of the malloc arena.
+ */
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#endif /* HOST_ESP_HEAP_CAPS_H_ */
@@ -0,0 +1,23 @@
+/*
+ * esp_system.h
+ * Description: Host stand-in for the ESP-IDF system functions used by the bridge.
+ */
+
+#ifndef HOST_ESP_SYSTEM_H_
+#define HOST_ESP_SYSTEM_H_
+
+#include <stdint.h>
+
+uint32_t esp_random();
+
+/**
+ * Free bytes of the malloc arena; the host has no fixed heap.
+ */
+uint32_t esp_get_free_heap_size();
+
+/**
+ * Lowest esp_get_free_heap_size() seen so far.
+ */
+uint32_t esp_get_minimum_free_heap_size();
+
+#endif /* HOST_ESP_SYSTEM_H_ */
@@ -0,0 +1,16 @@
+/*
+ * esp_timer.h
+ * Description: Host stand-in for the ESP-IDF high resolution timer.
+ */
+
+#ifndef HOST_ESP_TIMER_H_
+#define HOST_ESP_TIMER_H_
+
+#include <stdint.h>
+
+/**
+ * Microseconds since the program started (monotonic).
+ */
+int64_t esp_timer_get_time();
+
+#endif /* HOST_ESP_TIMER_H_ */
@@ -0,0 +1,175 @@
+/*
+ * freertos.cpp
+ * Description: Threads, notifications and queues behind the host FreeRTOS headers.
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+struct HostTask
+{
+    std::mutex mutex;
+    std::condition_variable signal;
+    uint32_t notifications = 0;
+};
+
+struct HostQueue
+{
+    std::mutex mutex;
+    std::condition_variable signal;
+    std::deque<std::vector<uint8_t>> items;
+    size_t length;
+    size_t itemSize;
+};
+
+static thread_local HostTask *currentTask = nullptr;
+
+/**
+ * Waits on a condition for a number of ticks (portMAX_DELAY: forever).
+ */
+template <typename Predicate>
+static bool waitFor(std::condition_variable &signal, std::unique_lock<std::mutex> &lock, TickType_t ticks,
+                    Predicate ready)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        signal.wait(lock, ready);
+        return true;
+    }
+    return signal.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    // Threads not created through xTaskCreatePinnedToCore (main) get a handle on first use
+    if (!currentTask)
+    {
+        currentTask = new HostTask();
+    }
+    return currentTask;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    HostTask *task = new HostTask();
+    if (handle)
+    {
+        *handle = task; // Visible before the task runs, as on the device
+    }
+
+    std::thread([function, arg, task]()
+                {
+                    currentTask = task;
+                    function(arg);
+                })
+        .detach();
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task && task != currentTask)
+    {
+        return; // Only self-deletion is used
+    }
+    for (;;)
+    {
+        std::this_thread::sleep_for(std::chrono::hours(24));
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+    HostTask *task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+
+    waitFor(task->signal, lock, ticks, [task]()
+            { return task->notifications > 0; });
+
+    uint32_t value = task->notifications;
+    if (value > 0)
+    {
+        task->notifications = clearOnExit ? 0 : value - 1;
+    }
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifications++;
+    }
+    task->signal.notify_one();
+    return pdPASS;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    HostQueue *queue = new HostQueue();
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+
+    if (!waitFor(queue->signal, lock, ticks, [queue]()
+                 { return queue->items.size() < queue->length; }))
+    {
+        return pdFALSE;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(item);
+    queue->items.emplace_back(bytes, bytes + queue->itemSize);
+    lock.unlock();
+    queue->signal.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+
+    if (!waitFor(queue->signal, lock, ticks, [queue]()
+                 { return !queue->items.empty(); }))
+    {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    lock.unlock();
+    queue->signal.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->items.clear();
+    }
+    queue->signal.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return static_cast<UBaseType_t>(queue->items.size());
+}
@@ -0,0 +1,28 @@
+/*
+ * task.h
+ * Description: Host stand-in for the FreeRTOS task API: each task is a detached
+ *              thread with its own notification counter. Core and priority are ignored.
+ */
+
+#ifndef HOST_FREERTOS_TASK_H_
+#define HOST_FREERTOS_TASK_H_
+
+#include "FreeRTOS.h"
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+
+/**
+ * Deleting the calling task parks its thread forever.
+ */
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+#endif /* HOST_FREERTOS_TASK_H_ */
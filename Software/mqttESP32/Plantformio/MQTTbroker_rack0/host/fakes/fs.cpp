@@ -0,0 +1,156 @@
+/*
+ * fs.cpp
+ * Description: fs::File / fs::FS on top of stdio and POSIX directories.
+ */
+
+#include "FS.h"
+#include "LittleFS.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+LittleFSFS LittleFS;
+
+namespace fs
+{
+
+struct File::Impl
+{
+    std::string hostPath; /**< Path on the host */
+    std::string name;     /**< Path as seen by the firmware */
+    FILE *file = nullptr;
+    DIR *dir = nullptr;
+
+    ~Impl()
+    {
+        if (file)
+        {
+            fclose(file);
+        }
+        if (dir)
+        {
+            closedir(dir);
+        }
+    }
+};
+
+bool File::isDirectory() const
+{
+    return impl && impl->dir;
+}
+
+File File::openNextFile()
+{
+    File next;
+    if (!isDirectory())
+    {
+        return next;
+    }
+
+    for (struct dirent *entry = readdir(impl->dir); entry; entry = readdir(impl->dir))
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        next.impl = std::make_shared<Impl>();
+        next.impl->hostPath = impl->hostPath + "/" + entry->d_name;
+        next.impl->name = impl->name + "/" + entry->d_name;
+        struct stat info;
+        if (stat(next.impl->hostPath.c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+        {
+            next.impl->dir = opendir(next.impl->hostPath.c_str());
+        }
+        else
+        {
+            next.impl->file = fopen(next.impl->hostPath.c_str(), "rb");
+        }
+        break;
+    }
+    return next;
+}
+
+const char *File::name() const
+{
+    return impl ? impl->name.c_str() : "";
+}
+
+size_t File::size() const
+{
+    struct stat info;
+    if (!impl || !impl->file || fstat(fileno(impl->file), &info) != 0)
+    {
+        return 0;
+    }
+    return static_cast<size_t>(info.st_size);
+}
+
+bool File::seek(uint32_t position)
+{
+    return impl && impl->file && fseek(impl->file, position, SEEK_SET) == 0;
+}
+
+size_t File::read(uint8_t *buffer, size_t length)
+{
+    return impl && impl->file ? fread(buffer, 1, length, impl->file) : 0;
+}
+
+size_t File::write(const uint8_t *buffer, size_t length)
+{
+    return impl && impl->file ? fwrite(buffer, 1, length, impl->file) : 0;
+}
+
+File FS::open(const char *path, const char *mode)
+{
+    File opened;
+    std::string host = hostPath(path);
+    struct stat info;
+    bool isDir = stat(host.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+
+    auto impl = std::make_shared<File::Impl>();
+    impl->hostPath = host;
+    impl->name = path;
+    if (isDir)
+    {
+        impl->dir = opendir(host.c_str());
+    }
+    else
+    {
+        const char *hostMode = mode[0] == 'w' ? "wb" : mode[0] == 'a' ? "ab" : "rb";
+        impl->file = fopen(host.c_str(), hostMode);
+    }
+
+    if (impl->dir || impl->file)
+    {
+        opened.impl = impl;
+    }
+    return opened;
+}
+
+bool FS::exists(const char *path)
+{
+    return access(hostPath(path).c_str(), F_OK) == 0;
+}
+
+bool FS::mkdir(const char *path)
+{
+    return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+bool FS::remove(const char *path)
+{
+    return ::remove(hostPath(path).c_str()) == 0;
+}
+
+} // namespace fs
+
+bool LittleFSFS::begin(bool formatOnFail)
+{
+    struct stat info;
+    if (stat(root.c_str(), &info) == 0)
+    {
+        return S_ISDIR(info.st_mode);
+    }
+    return ::mkdir(root.c_str(), 0755) == 0;
+}
@@ -0,0 +1,43 @@
+/*
+ * host_uart.h
+ * Description: Board side of the host UART wires: what a rack board would put on
+ *              the gateway's RX pin, and what the gateway writes to its TX pin.
+ */
+
+#ifndef HOST_UART_H_
+#define HOST_UART_H_
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include "driver/uart.h"
+
+/**
+ * Receives the bytes written by the gateway on a port, from the writing thread.
+ */
+typedef std::function<void(const uint8_t *data, size_t length)> HostUartSink;
+
+/**
+ * Puts bytes on the RX side of a port, as if sent by a board. Delimiters raise
+ * UART_PATTERN_DET events; bytes beyond the RX ring raise UART_BUFFER_FULL and
+ * are lost, like on the device.
+ * @return Number of bytes accepted.
+ */
+size_t host_uart_inject(uart_port_t port, const void *data, size_t length);
+
+/**
+ * Sets the receiver of the gateway's writes on a port (nullptr discards them).
+ */
+void host_uart_set_sink(uart_port_t port, HostUartSink sink);
+
+/**
+ * Bytes lost on a port because its RX ring was full.
+ */
+uint64_t host_uart_overflows(uart_port_t port);
+
+/**
+ * Highest RX ring occupancy seen on a port, in bytes.
+ */
+size_t host_uart_rx_high_water(uart_port_t port);
+
+#endif /* HOST_UART_H_ */
@@ -0,0 +1,54 @@
+/*
+ * new_delete.cpp
+ * Description: Global operator new/delete on malloc/free. On the ESP32 the C++
+ *              runtime is linked statically, so --wrap=malloc already sees its
+ *              allocations; on the host it is a shared library and would not.
+ */
+
+#include <new>
+#include <stdlib.h>
+
+void *operator new(size_t size)
+{
+    void *pointer = malloc(size ? size : 1);
+    if (!pointer)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept
+{
+    free(pointer);
+}
@@ -0,0 +1,615 @@
+/*
+ * pico_mqtt.cpp
+ * Description: Non-blocking MQTT 3.1.1 broker on POSIX sockets behind PicoMQTT.h.
+ */
+
+#include "PicoMQTT.h"
+#include "heap_monitor.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace PicoMQTT
+{
+
+/* =======================
+ * Packet Encoding
+ * =======================
+ */
+
+enum PacketType
+{
+    CONNECT = 1,
+    CONNACK = 2,
+    PUBLISH = 3,
+    PUBACK = 4,
+    SUBSCRIBE = 8,
+    SUBACK = 9,
+    UNSUBSCRIBE = 10,
+    UNSUBACK = 11,
+    PINGREQ = 12,
+    PINGRESP = 13,
+    DISCONNECT = 14,
+};
+
+static std::string packet(uint8_t header, const std::string &body)
+{
+    std::string out(1, static_cast<char>(header));
+    size_t length = body.size();
+    do
+    {
+        uint8_t digit = length % 128;
+        length /= 128;
+        out += static_cast<char>(length ? digit | 0x80 : digit);
+    } while (length);
+    return out + body;
+}
+
+/**
+ * Payload handed to stream subscribers, read in place.
+ */
+class PayloadStream : public Stream
+{
+public:
+    explicit PayloadStream(const char *payload) : next(payload), end(payload + strlen(payload)) {}
+
+    int available() override { return static_cast<int>(end - next); }
+    int read() override { return next < end ? static_cast<uint8_t>(*next++) : -1; }
+    int peek() override { return next < end ? static_cast<uint8_t>(*next) : -1; }
+
+private:
+    const char *next;
+    const char *end;
+};
+
+static void putU16(std::string &out, uint16_t value)
+{
+    out += static_cast<char>(value >> 8);
+    out += static_cast<char>(value & 0xFF);
+}
+
+static void putString(std::string &out, const char *text)
+{
+    size_t length = strlen(text);
+    putU16(out, static_cast<uint16_t>(length));
+    out.append(text, length);
+}
+
+/**
+ * Cursor over a packet body; reads past the end fail and stay failed.
+ */
+struct Reader
+{
+    const std::string &body;
+    size_t position = 0;
+    bool ok = true;
+
+    explicit Reader(const std::string &body) : body(body) {}
+
+    size_t remaining() const { return ok ? body.size() - position : 0; }
+
+    uint8_t u8()
+    {
+        if (remaining() < 1)
+        {
+            ok = false;
+            return 0;
+        }
+        return static_cast<uint8_t>(body[position++]);
+    }
+
+    uint16_t u16()
+    {
+        uint16_t high = u8();
+        return static_cast<uint16_t>(high << 8 | u8());
+    }
+
+    std::string string()
+    {
+        uint16_t length = u16();
+        if (remaining() < length)
+        {
+            ok = false;
+            return std::string();
+        }
+        position += length;
+        return body.substr(position - length, length);
+    }
+};
+
+bool topicMatches(const char *filter, const char *topic)
+{
+    if (topic[0] == '$' && (filter[0] == '+' || filter[0] == '#'))
+    {
+        return false;
+    }
+
+    for (;;)
+    {
+        if (*filter == '#')
+        {
+            return true;
+        }
+        if (*filter == '+')
+        {
+            while (*topic && *topic != '/')
+            {
+                topic++;
+            }
+            filter++;
+        }
+        else
+        {
+            while (*filter && *filter != '/' && *filter == *topic)
+            {
+                filter++;
+                topic++;
+            }
+            if ((*filter && *filter != '/') || (*topic && *topic != '/'))
+            {
+                return false;
+            }
+        }
+
+        if (!*filter && !*topic)
+        {
+            return true;
+        }
+        if (*filter != '/' || *topic != '/')
+        {
+            // "a/#" also matches "a"
+            return !*topic && filter[0] == '/' && filter[1] == '#' && !filter[2];
+        }
+        filter++;
+        topic++;
+    }
+}
+
+/* =======================
+ * Server
+ * =======================
+ */
+
+Server::Server(uint16_t port) : port(port), listener(-1), dropped(0)
+{
+}
+
+Server::~Server()
+{
+    for (Client *client : clients)
+    {
+        close(client->socket);
+        delete client;
+    }
+    if (listener >= 0)
+    {
+        close(listener);
+    }
+}
+
+void Server::begin()
+{
+    // Read here, not in the constructor: the server is a global built before main()
+    const char *override = getenv("BRIDGE_HOST_PORT");
+    if (override && atoi(override) > 0)
+    {
+        port = static_cast<uint16_t>(atoi(override));
+    }
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0)
+    {
+        perror("mqtt socket");
+        return;
+    }
+
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(listener, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listener, 64) != 0)
+    {
+        perror("mqtt bind");
+        close(listener);
+        listener = -1;
+        return;
+    }
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+}
+
+void Server::loop()
+{
+    HeapMonitor::Tracking untracked(false);
+    acceptClients();
+
+    for (size_t i = 0; i < clients.size();)
+    {
+        Client &client = *clients[i];
+        bool alive = readClient(client) && flush(client) && !(client.closing && client.out.empty());
+        if (alive)
+        {
+            i++;
+            continue;
+        }
+        close(client.socket);
+        delete clients[i];
+        clients.erase(clients.begin() + i);
+    }
+}
+
+void Server::acceptClients()
+{
+    if (listener < 0)
+    {
+        return;
+    }
+
+    for (int socket = accept(listener, nullptr, nullptr); socket >= 0; socket = accept(listener, nullptr, nullptr))
+    {
+        int yes = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+        Client *client = new Client();
+        client->socket = socket;
+        clients.push_back(client);
+    }
+}
+
+/**
+ * Reads what the socket has and handles every complete packet.
+ * @return false when the client is gone or broke the protocol.
+ */
+bool Server::readClient(Client &client)
+{
+    char buffer[4096];
+    for (;;)
+    {
+        ssize_t length = recv(client.socket, buffer, sizeof(buffer), 0);
+        if (length > 0)
+        {
+            client.in.append(buffer, static_cast<size_t>(length));
+            continue;
+        }
+        if (length == 0)
+        {
+            return false;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            break;
+        }
+        return false;
+    }
+
+    size_t position = 0;
+    while (client.in.size() - position >= 2 && !client.closing)
+    {
+        size_t length = 0;
+        size_t digits = 0;
+        uint8_t digit = 0x80;
+        while ((digit & 0x80) && digits < 4 && position + 1 + digits < client.in.size())
+        {
+            digit = static_cast<uint8_t>(client.in[position + 1 + digits]);
+            length |= static_cast<size_t>(digit & 0x7F) << (7 * digits);
+            digits++;
+        }
+
+        if ((digit & 0x80) && digits == 4)
+        {
+            return false; // Malformed remaining length
+        }
+        if (digit & 0x80)
+        {
+            break; // Length not complete yet
+        }
+        if (length > HOST_MQTT_PACKET_MAX)
+        {
+            return false;
+        }
+        if (client.in.size() - position < 1 + digits + length)
+        {
+            break;
+        }
+        if (!handlePacket(client, static_cast<uint8_t>(client.in[position]),
+                          client.in.substr(position + 1 + digits, length)))
+        {
+            return false;
+        }
+        position += 1 + digits + length;
+    }
+    client.in.erase(0, position);
+    return true;
+}
+
+bool Server::handlePacket(Client &client, uint8_t header, const std::string &body)
+{
+    uint8_t type = header >> 4;
+    if (!client.connected && type != CONNECT)
+    {
+        return false;
+    }
+
+    switch (type)
+    {
+    case CONNECT:
+        handleConnect(client, body);
+        return true;
+    case PUBLISH:
+        handlePublish(client, header, body);
+        return true;
+    case SUBSCRIBE:
+        handleSubscribe(client, body);
+        return true;
+    case UNSUBSCRIBE:
+        handleUnsubscribe(client, body);
+        return true;
+    case PINGREQ:
+        send(client, packet(PINGRESP << 4, std::string()));
+        return true;
+    case PUBACK:
+        return true;
+    default:
+        // DISCONNECT, QoS 2 and anything else ends the session
+        return false;
+    }
+}
+
+void Server::handleConnect(Client &client, const std::string &body)
+{
+    Reader reader(body);
+    std::string protocol = reader.string();
+    uint8_t level = reader.u8();
+    uint8_t flags = reader.u8();
+    reader.u16(); // Keep alive is not enforced
+    client.id = reader.string();
+    if (flags & 0x04)
+    {
+        reader.string(); // Will topic
+        reader.string(); // Will message
+    }
+    std::string username = (flags & 0x80) ? reader.string() : std::string();
+    std::string password = (flags & 0x40) ? reader.string() : std::string();
+
+    ConnectReturnCode code;
+    if (!reader.ok || protocol != "MQTT" || level != 4)
+    {
+        code = CRC_UNACCEPTABLE_PROTOCOL_VERSION;
+    }
+    else
+    {
+        HeapMonitor::Tracking tracked(true);
+        code = auth(client.id.c_str(), (flags & 0x80) ? username.c_str() : nullptr,
+                    (flags & 0x40) ? password.c_str() : nullptr);
+    }
+
+    std::string reply;
+    reply += '\0';
+    reply += static_cast<char>(code);
+    send(client, packet(CONNACK << 4, reply));
+    client.connected = code == CRC_ACCEPTED;
+    client.closing = !client.connected;
+}
+
+void Server::handleSubscribe(Client &client, const std::string &body)
+{
+    Reader reader(body);
+    uint16_t packetId = reader.u16();
+    std::vector<std::string> added;
+    std::string reply;
+    putU16(reply, packetId);
+
+    while (reader.remaining())
+    {
+        std::string filter = reader.string();
+        reader.u8(); // Requested QoS; everything is delivered at QoS 0
+        if (!reader.ok)
+        {
+            break;
+        }
+        client.filters.push_back(filter);
+        added.push_back(filter);
+        reply += '\0';
+    }
+    send(client, packet(SUBACK << 4, reply));
+
+    for (const std::string &filter : added)
+    {
+        HeapMonitor::Tracking tracked(true);
+        on_subscribe(client.id.c_str(), filter.c_str());
+    }
+}
+
+void Server::handleUnsubscribe(Client &client, const std::string &body)
+{
+    Reader reader(body);
+    uint16_t packetId = reader.u16();
+
+    while (reader.remaining())
+    {
+        std::string filter = reader.string();
+        if (!reader.ok)
+        {
+            break;
+        }
+        for (size_t i = 0; i < client.filters.size(); i++)
+        {
+            if (client.filters[i] == filter)
+            {
+                client.filters.erase(client.filters.begin() + i);
+                HeapMonitor::Tracking tracked(true);
+                on_unsubscribe(client.id.c_str(), filter.c_str());
+                break;
+            }
+        }
+    }
+
+    std::string reply;
+    putU16(reply, packetId);
+    send(client, packet(UNSUBACK << 4, reply));
+}
+
+void Server::handlePublish(Client &client, uint8_t header, const std::string &body)
+{
+    uint8_t qos = (header >> 1) & 0x03;
+    Reader reader(body);
+    std::string topic = reader.string();
+    uint16_t packetId = qos ? reader.u16() : 0;
+    if (!reader.ok || qos > 1)
+    {
+        client.closing = true;
+        return;
+    }
+
+    std::string payload = body.substr(reader.position);
+    if (qos == 1)
+    {
+        std::string reply;
+        putU16(reply, packetId);
+        send(client, packet(PUBACK << 4, reply));
+    }
+    deliver(topic.c_str(), payload.c_str(), false);
+}
+
+bool Server::publish(const char *topic, const char *payload, uint8_t qos, bool retain)
+{
+    HeapMonitor::Tracking untracked(false);
+    deliver(topic, payload, retain);
+    return true;
+}
+
+/**
+ * Sends the message once to every client with a matching filter, then runs the
+ * matching local callbacks.
+ */
+void Server::deliver(const char *topic, const char *payload, bool retain)
+{
+    std::string encoded;
+    for (Client *client : clients)
+    {
+        if (!client->connected || client->closing)
+        {
+            continue;
+        }
+        for (const std::string &filter : client->filters)
+        {
+            if (!topicMatches(filter.c_str(), topic))
+            {
+                continue;
+            }
+            if (encoded.empty())
+            {
+                std::string body;
+                putString(body, topic);
+                body += payload;
+                encoded = packet(PUBLISH << 4 | (retain ? 1 : 0), body);
+            }
+            if (client->out.size() + encoded.size() > HOST_MQTT_CLIENT_BUFFER)
+            {
+                dropped++;
+            }
+            else
+            {
+                send(*client, encoded);
+            }
+            break;
+        }
+    }
+
+    // Callbacks may subscribe or publish; index so the table can grow under us
+    for (size_t i = 0; i < subscriptions.size(); i++)
+    {
+        if (!topicMatches(subscriptions[i].filter.c_str(), topic))
+        {
+            continue;
+        }
+        if (subscriptions[i].callback)
+        {
+            MessageCallback callback = subscriptions[i].callback;
+            HeapMonitor::Tracking tracked(true);
+            callback(topic, payload);
+        }
+        else if (subscriptions[i].streamCallback)
+        {
+            StreamCallback callback = subscriptions[i].streamCallback;
+            PayloadStream stream(payload);
+            HeapMonitor::Tracking tracked(true);
+            callback(topic, stream);
+        }
+    }
+}
+
+bool Server::subscribe(const char *filter, MessageCallback callback)
+{
+    subscriptions.push_back({filter, callback, StreamCallback()});
+    return true;
+}
+
+bool Server::subscribe(const char *filter, StreamCallback callback)
+{
+    subscriptions.push_back({filter, MessageCallback(), callback});
+    return true;
+}
+
+bool Server::subscribe(const char *filter)
+{
+    return subscribe(filter, MessageCallback());
+}
+
+void Server::unsubscribe(const char *filter)
+{
+    for (size_t i = 0; i < subscriptions.size();)
+    {
+        if (subscriptions[i].filter == filter)
+        {
+            subscriptions.erase(subscriptions.begin() + i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+/**
+ * Queues a packet and writes as much as the socket takes right away, the way the
+ * ESP32 server writes straight into the TCP stack.
+ */
+void Server::send(Client &client, const std::string &packet)
+{
+    client.out += packet;
+    flush(client);
+}
+
+/**
+ * @return false when the socket failed.
+ */
+bool Server::flush(Client &client)
+{
+    while (!client.out.empty())
+    {
+        ssize_t sent = ::send(client.socket, client.out.data(), client.out.size(), MSG_NOSIGNAL);
+        if (sent > 0)
+        {
+            client.out.erase(0, static_cast<size_t>(sent));
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return true;
+        }
+        return false;
+    }
+    return true;
+}
+
+} // namespace PicoMQTT
@@ -0,0 +1,328 @@
+/*
+ * uart_driver.cpp
+ * Description: In-memory UART ports behind the host driver/uart.h.
+ *
+ * Positions returned by uart_pattern_pop_pos() are relative to the unread data,
+ * as in ESP-IDF, so UartLink reads exactly one frame per pattern event.
+ */
+
+#include "host_uart.h"
+#include "heap_monitor.h"
+#include "freertos/queue.h"
+#include <deque>
+#include <mutex>
+#include <string.h>
+
+struct HostUartPort
+{
+    std::mutex mutex;
+    bool installed = false;
+    std::deque<uint8_t> rx;
+    size_t rxSize = 0;
+    size_t rxHighWater = 0;
+    uint64_t consumed = 0;              /**< Bytes read or flushed since install */
+    std::deque<uint64_t> positions;     /**< Absolute offsets of pending delimiters */
+    size_t positionLimit = 32;
+    bool positionOverflow = false;
+    bool patternEnabled = false;
+    char pattern = '\n';
+    uint32_t baud = 115200;
+    QueueHandle_t events = nullptr;
+    uint64_t overflows = 0;
+    HostUartSink sink;
+};
+
+static HostUartPort ports[UART_NUM_MAX];
+
+static HostUartPort *portFor(uart_port_t port)
+{
+    return (port >= 0 && port < UART_NUM_MAX) ? &ports[port] : nullptr;
+}
+
+static void postEvent(HostUartPort &p, uart_event_type_t type, size_t size)
+{
+    uart_event_t event = {};
+    event.type = type;
+    event.size = size;
+    xQueueSend(p.events, &event, 0); // A full event queue loses the event, like the ISR
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rxBufferSize, int txBufferSize, int queueSize,
+                              QueueHandle_t *queue, int flags)
+{
+    HostUartPort *p = portFor(port);
+    if (!p || p->installed || rxBufferSize <= 0)
+    {
+        return ESP_FAIL;
+    }
+
+    std::lock_guard<std::mutex> lock(p->mutex);
+    p->installed = true;
+    p->rxSize = static_cast<size_t>(rxBufferSize);
+    p->events = queueSize > 0 ? xQueueCreate(queueSize, sizeof(uart_event_t)) : nullptr;
+    if (queue)
+    {
+        *queue = p->events;
+    }
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+    HostUartPort *p = portFor(port);
+    if (!p || !config)
+    {
+        return ESP_FAIL;
+    }
+    p->baud = static_cast<uint32_t>(config->baud_rate);
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+    return portFor(port) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baud)
+{
+    HostUartPort *p = portFor(port);
+    if (!p)
+    {
+        return ESP_FAIL;
+    }
+    p->baud = baud;
+    return ESP_OK;
+}
+
+esp_err_t uart_get_baudrate(uart_port_t port, uint32_t *baud)
+{
+    HostUartPort *p = portFor(port);
+    if (!p || !baud)
+    {
+        return ESP_FAIL;
+    }
+    *baud = p->baud;
+    return ESP_OK;
+}
+
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t port, char pattern, uint8_t count, int gap, int preIdle,
+                                            int postIdle)
+{
+    HostUartPort *p = portFor(port);
+    if (!p)
+    {
+        return ESP_FAIL;
+    }
+    std::lock_guard<std::mutex> lock(p->mutex);
+    p->pattern = pattern;
+    p->patternEnabled = true;
+    return ESP_OK;
+}
+
+esp_err_t uart_pattern_queue_reset(uart_port_t port, int length)
+{
+    HostUartPort *p = portFor(port);
+    if (!p)
+    {
+        return ESP_FAIL;
+    }
+    std::lock_guard<std::mutex> lock(p->mutex);
+    p->positions.clear();
+    p->positionLimit = static_cast<size_t>(length);
+    p->positionOverflow = false;
+    return ESP_OK;
+}
+
+int uart_pattern_pop_pos(uart_port_t port)
+{
+    HostUartPort *p = portFor(port);
+    if (!p)
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(p->mutex);
+
+    if (p->positionOverflow || p->positions.empty())
+    {
+        p->positionOverflow = false;
+        p->positions.clear();
+        return -1;
+    }
+    uint64_t position = p->positions.front();
+    p->positions.pop_front();
+    return static_cast<int>(position - p->consumed);
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    HostUartPort *p = portFor(port);
+    if (!p)
+    {
+        return ESP_FAIL;
+    }
+    std::lock_guard<std::mutex> lock(p->mutex);
+    p->consumed += p->rx.size();
+    p->rx.clear();
+    p->positions.clear();
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size)
+{
+    HostUartPort *p = portFor(port);
+    if (!p || !size)
+    {
+        return ESP_FAIL;
+    }
+    std::lock_guard<std::mutex> lock(p->mutex);
+    *size = p->rx.size();
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t port, void *buffer, uint32_t length, TickType_t ticks)
+{
+    HostUartPort *p = portFor(port);
+    if (!p)
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(p->mutex);
+
+    size_t count = length < p->rx.size() ? length : p->rx.size();
+    uint8_t *out = static_cast<uint8_t *>(buffer);
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = p->rx.front();
+        p->rx.pop_front();
+    }
+    p->consumed += count;
+    return static_cast<int>(count);
+}
+
+int uart_write_bytes(uart_port_t port, const void *data, size_t length)
+{
+    HostUartPort *p = portFor(port);
+    if (!p)
+    {
+        return -1;
+    }
+
+    // The sink plays the board at the other end of the wire, not the bridge
+    HeapMonitor::Tracking untracked(false);
+    HostUartSink sink;
+    {
+        std::lock_guard<std::mutex> lock(p->mutex);
+        sink = p->sink;
+    }
+    if (sink)
+    {
+        sink(static_cast<const uint8_t *>(data), length);
+    }
+    return static_cast<int>(length);
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks)
+{
+    return portFor(port) ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * Puts bytes on the RX side of a port, as if sent by a board.
+ * @return Number of bytes accepted.
+ */
+size_t host_uart_inject(uart_port_t port, const void *data, size_t length)
+{
+    HostUartPort *p = portFor(port);
+    if (!p || !p->installed)
+    {
+        return 0;
+    }
+
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    size_t accepted = 0;
+    size_t patterns = 0;
+    bool full = false;
+    {
+        std::lock_guard<std::mutex> lock(p->mutex);
+        for (; accepted < length; accepted++)
+        {
+            if (p->rx.size() >= p->rxSize)
+            {
+                full = true;
+                p->overflows += length - accepted;
+                break;
+            }
+            if (p->patternEnabled && bytes[accepted] == static_cast<uint8_t>(p->pattern))
+            {
+                if (p->positions.size() >= p->positionLimit)
+                {
+                    p->positionOverflow = true;
+                }
+                else
+                {
+                    p->positions.push_back(p->consumed + p->rx.size());
+                }
+                patterns++;
+            }
+            p->rx.push_back(bytes[accepted]);
+        }
+        if (p->rx.size() > p->rxHighWater)
+        {
+            p->rxHighWater = p->rx.size();
+        }
+    }
+
+    if (p->events)
+    {
+        for (size_t i = 0; i < patterns; i++)
+        {
+            postEvent(*p, UART_PATTERN_DET, 0);
+        }
+        if (full)
+        {
+            postEvent(*p, UART_BUFFER_FULL, 0);
+        }
+    }
+    return accepted;
+}
+
+/**
+ * Sets the receiver of the gateway's writes on a port (nullptr discards them).
+ */
+void host_uart_set_sink(uart_port_t port, HostUartSink sink)
+{
+    HostUartPort *p = portFor(port);
+    if (p)
+    {
+        std::lock_guard<std::mutex> lock(p->mutex);
+        p->sink = sink;
+    }
+}
+
+/**
+ * Bytes lost on a port because its RX ring was full.
+ */
+uint64_t host_uart_overflows(uart_port_t port)
+{
+    HostUartPort *p = portFor(port);
+    if (!p)
+    {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(p->mutex);
+    return p->overflows;
+}
+
+/**
+ * Highest RX ring occupancy seen on a port, in bytes.
+ */
+size_t host_uart_rx_high_water(uart_port_t port)
+{
+    HostUartPort *p = portFor(port);
+    if (!p)
+    {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(p->mutex);
+    return p->rxHighWater;
+}
@@ -0,0 +1,592 @@
+/*
+ * bridge_loadgen.cpp
+ * Description: Load test of the host build of the bridge. Plays the rack0 boards on
+ *              the fake UARTs and dashboard clients over MQTT, then reports the
+ *              throughput, latency percentiles and memory high-water marks of
+ *              three paths:
+ *                uart->mqtt  sensor line on UART2 to the MQTT subscriber
+ *                uart->uart  sensor line on UART2 to its process value on UART1
+ *                mqtt->uart  actuator command from a client to UART1
+ *              Every message carries a sequence number as its value, so each
+ *              arrival is matched to its send time.
+ */
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <malloc.h>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "host_uart.h"
+#include "mqtt_client.h"
+#include "utils.h"
+
+void setup();
+extern MyMQTT myMQTTServer;
+
+#define BOARD_APPLY_US 20 /**< Apply time in the simulated actuator board's ACKs */
+#define BOARD_LINE_SLOTS 8 /**< Received lines the simulated actuator board can hold, as LINK_LINE_SLOTS */
+#define BOARD_GRANT_MS 1000 /**< Periodic grant of the simulated actuator board */
+
+/* =======================
+ * Options
+ * =======================
+ */
+struct Options
+{
+    double duration = 10.0;    /**< Seconds of load */
+    double sensorRate = 200.0; /**< Sensor lines per second on UART2 */
+    double commandRate = 50.0; /**< Actuator commands per second, all clients together */
+    int clients = 4;           /**< MQTT clients publishing commands */
+    int port = 18830;          /**< MQTT port of the bridge */
+    double ackLoss = 0.0;      /**< Share of command ACKs the simulated board drops */
+    double boardRate = 0.0;    /**< Lines per second the simulated actuator board reads, 0 for no limit */
+    std::string fsRoot;        /**< LittleFS directory, a fresh temporary one by default */
+};
+
+static void usage(const char *program)
+{
+    printf("usage: %s [--duration s] [--sensor-rate lines/s] [--command-rate msgs/s]\n"
+           "          [--clients n] [--port p] [--fs dir] [--ack-loss 0..1] [--board-rate lines/s]\n"
+           "Set BRIDGE_HOST_CONSOLE=1 to see the bridge's PC Serial output.\n",
+           program);
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string name = argv[i];
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (name == "--duration")
+            options.duration = atof(value);
+        else if (name == "--sensor-rate")
+            options.sensorRate = atof(value);
+        else if (name == "--command-rate")
+            options.commandRate = atof(value);
+        else if (name == "--clients")
+            options.clients = atoi(value);
+        else if (name == "--port")
+            options.port = atoi(value);
+        else if (name == "--fs")
+            options.fsRoot = value;
+        else if (name == "--ack-loss")
+            options.ackLoss = atof(value);
+        else if (name == "--board-rate")
+            options.boardRate = atof(value);
+        else
+            return false;
+    }
+    return options.duration > 0 && options.sensorRate >= 0 && options.commandRate >= 0 && options.clients > 0 &&
+           options.boardRate >= 0;
+}
+
+/* =======================
+ * Latency Streams
+ * =======================
+ */
+
+/**
+ * One measured path: send time of every sequence number and the latency of every
+ * arrival.
+ */
+struct Path
+{
+    const char *name;
+    std::unique_ptr<std::atomic<int64_t>[]> sentAt;
+    size_t capacity;
+    std::atomic<uint64_t> sent{0};
+    std::mutex mutex;
+    std::vector<uint32_t> latencies;
+
+    Path(const char *name, size_t capacity)
+        : name(name), sentAt(new std::atomic<int64_t>[capacity]), capacity(capacity)
+    {
+        for (size_t i = 0; i < capacity; i++)
+        {
+            sentAt[i] = -1;
+        }
+        latencies.reserve(capacity);
+    }
+
+    /**
+     * @return The sequence number to send, or -1 once the path is full.
+     */
+    long next()
+    {
+        uint64_t seq = sent.fetch_add(1);
+        if (seq >= capacity)
+        {
+            sent--;
+            return -1;
+        }
+        sentAt[seq] = esp_timer_get_time();
+        return static_cast<long>(seq);
+    }
+
+    void arrived(const char *value)
+    {
+        char *end;
+        unsigned long seq = strtoul(value, &end, 10);
+        if (end == value || *end != '\0' || seq >= capacity)
+        {
+            return;
+        }
+        int64_t start = sentAt[seq].exchange(-1);
+        if (start < 0)
+        {
+            return; // Duplicate
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        latencies.push_back(static_cast<uint32_t>(esp_timer_get_time() - start));
+    }
+
+    size_t received()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return latencies.size();
+    }
+};
+
+/**
+ * Answers a baud proposal "100*RATE" like the boards do, accepting every rate.
+ * @return true if the line was a proposal.
+ */
+static bool answerBaud(uart_port_t port, const std::string &line)
+{
+    if (line.compare(0, sizeof(UART_BAUD_ID), UART_BAUD_ID "*") != 0)
+    {
+        return false;
+    }
+    std::string answer = UART_BAUD_TOPIC "*" + line.substr(sizeof(UART_BAUD_ID)) + "\r\n";
+    host_uart_inject(port, answer.data(), answer.size());
+    return true;
+}
+
+/**
+ * The sensor board only reads baud proposals.
+ */
+struct SensorBoard
+{
+    std::string pending;
+
+    void receive(const uint8_t *data, size_t length)
+    {
+        pending.append(reinterpret_cast<const char *>(data), length);
+        size_t end;
+        while ((end = pending.find("\r\n")) != std::string::npos)
+        {
+            answerBaud(UART_NUM_2, pending.substr(0, end));
+            pending.erase(0, end + 2);
+        }
+    }
+};
+
+/**
+ * Splits the UART1 byte stream into "ID*value" lines: IDs from PV_ID_BASE are
+ * forwarded process values, the others actuator commands. Commands carrying a
+ * sequence number ("ID*value#SEQ") are acknowledged like the TEXT_V2 board does,
+ * with a nominal apply time. Baud proposals are answered.
+ *
+ * Like the firmware, the board holds BOARD_LINE_SLOTS lines and grants credit
+ * "credit*RECEIVED,FREE" for them. With a board rate, a thread reads the held
+ * lines at that rate, so the gateway has to hold commands; lines arriving with
+ * every slot taken are counted as overflows, which credit should prevent.
+ */
+struct ActuatorBoard
+{
+    std::string pending;
+    Path *processValues;
+    Path *commands;
+    double ackLoss;
+    double rate;
+    std::mutex mutex;
+    std::deque<std::string> held;
+    uint16_t received = 0;     /**< Data lines received, control lines excluded */
+    uint16_t grantReceived = 0;
+    uint16_t grantFree = 0;
+    size_t heldPeak = 0;
+    uint64_t overflows = 0;
+
+    ActuatorBoard(Path *processValues, Path *commands, double ackLoss, double rate)
+        : processValues(processValues), commands(commands), ackLoss(ackLoss), rate(rate)
+    {
+    }
+
+    void receive(const uint8_t *data, size_t length)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.append(reinterpret_cast<const char *>(data), length);
+        size_t end;
+        while ((end = pending.find("\r\n")) != std::string::npos)
+        {
+            std::string line = pending.substr(0, end);
+            pending.erase(0, end + 2);
+            if (answerBaud(UART_NUM_1, line) || line.compare(0, sizeof(UART_CREDIT_ID), UART_CREDIT_ID "*") == 0)
+            {
+                continue;
+            }
+            received++;
+            if (rate <= 0)
+            {
+                handle(line);
+                grant(false);
+            }
+            else if (held.size() >= BOARD_LINE_SLOTS)
+            {
+                overflows++;
+            }
+            else
+            {
+                held.push_back(line);
+                heldPeak = std::max(heldPeak, held.size());
+            }
+        }
+    }
+
+    /**
+     * Reads held lines at the board rate and grants periodically, until stopped.
+     */
+    void run(const std::atomic<bool> &running)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto granted = start;
+        uint64_t read = 0;
+        while (running)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            auto now = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lock(mutex);
+            double elapsed = std::chrono::duration<double>(now - start).count();
+            while (rate > 0 && !held.empty() && read < static_cast<uint64_t>(elapsed * rate))
+            {
+                handle(held.front());
+                held.pop_front();
+                read++;
+                grant(false);
+            }
+            if (rate > 0 && held.empty())
+            {
+                read = static_cast<uint64_t>(elapsed * rate); // No catching up after idling
+            }
+            if (now - granted >= std::chrono::milliseconds(BOARD_GRANT_MS))
+            {
+                grant(true);
+                granted = now;
+            }
+        }
+    }
+
+private:
+    /**
+     * Grants when forced, or like the firmware once half the slots were freed
+     * since the last grant.
+     */
+    void grant(bool force)
+    {
+        uint16_t free = static_cast<uint16_t>(BOARD_LINE_SLOTS - held.size());
+        int remaining = static_cast<int16_t>(grantFree - static_cast<uint16_t>(received - grantReceived));
+        if (!force && free - remaining < BOARD_LINE_SLOTS / 2)
+        {
+            return;
+        }
+        char line[32];
+        int length = snprintf(line, sizeof(line), UART_CREDIT_TOPIC "*%u,%u\r\n", static_cast<unsigned>(received),
+                              static_cast<unsigned>(free));
+        host_uart_inject(UART_NUM_1, line, static_cast<size_t>(length));
+        grantReceived = received;
+        grantFree = free;
+    }
+
+    void handle(std::string line)
+    {
+        size_t separator = line.find('*');
+        if (separator == std::string::npos)
+        {
+            return;
+        }
+        size_t mark = line.find('#', separator);
+        if (mark != std::string::npos && drand48() >= ackLoss)
+        {
+            char ack[32];
+            int length = snprintf(ack, sizeof(ack), "ack*%s,0,%d\r\n", line.c_str() + mark + 1, BOARD_APPLY_US);
+            host_uart_inject(UART_NUM_1, ack, static_cast<size_t>(length));
+        }
+        if (mark != std::string::npos)
+        {
+            line.resize(mark);
+        }
+        int id = atoi(line.c_str());
+        (id >= PV_ID_BASE ? processValues : commands)->arrived(line.c_str() + separator + 1);
+    }
+};
+
+/* =======================
+ * Memory
+ * =======================
+ */
+static std::atomic<bool> sampling{true};
+static std::atomic<size_t> heapPeak{0};
+
+static size_t heapInUse()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+static void sampleHeap()
+{
+    while (sampling)
+    {
+        size_t used = heapInUse();
+        if (used > heapPeak)
+        {
+            heapPeak = used;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
+
+/* =======================
+ * Load
+ * =======================
+ */
+
+/**
+ * Calls send() rate times per second for the given duration, catching up after
+ * late wake-ups instead of drifting.
+ */
+template <typename Send>
+static void paced(double rate, double duration, Send send)
+{
+    if (rate <= 0)
+    {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    size_t total = static_cast<size_t>(rate * duration);
+    for (size_t i = 0; i < total; i++)
+    {
+        std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<int64_t>(i * 1e6 / rate)));
+        send(i);
+    }
+}
+
+/**
+ * Registry callback: prints the negotiated rate, byte counts and credit of the links.
+ */
+static void printLinkMetric(void *ctx, const char *name, const char *value)
+{
+    size_t length = strlen(name);
+    if (strncmp(name, "uart/", 5) == 0 && (strcmp(name + length - 5, "/baud") == 0 ||
+                                           strcmp(name + length - 6, "_bytes") == 0 || strstr(name, "credit")))
+    {
+        printf("  %-28s %s\n", name, value);
+    }
+}
+
+/**
+ * Registry callback: prints the command shaping and tracking metrics.
+ */
+static void printCommandMetric(void *ctx, const char *name, const char *value)
+{
+    if (strncmp(name, "cmd/", 4) == 0 || strncmp(name, "shaper/", 7) == 0)
+    {
+        printf("  %-22s %s\n", name, value);
+    }
+}
+
+static void printPath(Path &path, double seconds)
+{
+    std::vector<uint32_t> samples;
+    {
+        std::lock_guard<std::mutex> lock(path.mutex);
+        samples = path.latencies;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto at = [&samples](double q) -> unsigned long
+    {
+        return samples.empty() ? 0 : samples[std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()))];
+    };
+
+    uint64_t sent = path.sent;
+    printf("%-12s %8lu %8lu %6lu %9.1f %8lu %8lu %8lu %8lu\n", path.name, static_cast<unsigned long>(sent),
+           static_cast<unsigned long>(samples.size()), static_cast<unsigned long>(sent - samples.size()),
+           samples.size() / seconds, at(0.50), at(0.90), at(0.99), samples.empty() ? 0ul : samples.back());
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    char portText[8];
+    snprintf(portText, sizeof(portText), "%d", options.port);
+    setenv("BRIDGE_HOST_PORT", portText, 1);
+    if (options.fsRoot.empty())
+    {
+        char pattern[] = "/tmp/bridge_fs_XXXXXX";
+        options.fsRoot = mkdtemp(pattern);
+    }
+    LittleFS.setRoot(options.fsRoot);
+    Serial.setEcho(getenv("BRIDGE_HOST_CONSOLE") != nullptr);
+
+    size_t sensorLines = static_cast<size_t>(options.sensorRate * options.duration) + 1;
+    size_t commandCount = static_cast<size_t>(options.commandRate * options.duration) + 1;
+    Path toMqtt("uart->mqtt", sensorLines);
+    Path toActuators("uart->uart", sensorLines);
+    Path commands("mqtt->uart", commandCount);
+
+    ActuatorBoard actuatorBoard(&toActuators, &commands, options.ackLoss, options.boardRate);
+    host_uart_set_sink(UART_NUM_1, [&actuatorBoard](const uint8_t *data, size_t length)
+                       { actuatorBoard.receive(data, length); });
+    SensorBoard sensorBoard;
+    host_uart_set_sink(UART_NUM_2, [&sensorBoard](const uint8_t *data, size_t length)
+                       { sensorBoard.receive(data, length); });
+
+    std::atomic<bool> boardRunning{true};
+    std::thread boardThread([&]() { actuatorBoard.run(boardRunning); });
+
+    size_t heapBaseline = heapInUse();
+    std::thread sampler(sampleHeap);
+    setup();
+    size_t heapAfterSetup = heapInUse();
+
+    // Dashboard: one subscriber on the sensor topics
+    std::vector<std::string> sensorTopics;
+    for (int i = 0; i < static_cast<int>(SensorTopic::SENSOR_COUNT); i++)
+    {
+        sensorTopics.push_back(get_sensor_topic(static_cast<SensorTopic>(i)));
+    }
+    MqttClient subscriber;
+    if (subscriber.connect("127.0.0.1", options.port, "loadgen-sub", "adrian", "librecultivo") != 0 ||
+        !subscriber.subscribe("rack0/sens/#", [&](const std::string &topic, const std::string &payload)
+                              {
+                                  // Rollup aggregates share the prefix
+                                  if (std::find(sensorTopics.begin(), sensorTopics.end(), topic) != sensorTopics.end())
+                                  {
+                                      toMqtt.arrived(payload.c_str());
+                                  }
+                              }))
+    {
+        fprintf(stderr, "cannot subscribe on port %d\n", options.port);
+        _exit(1);
+    }
+
+    std::vector<std::unique_ptr<MqttClient>> publishers;
+    for (int i = 0; i < options.clients; i++)
+    {
+        char id[24];
+        snprintf(id, sizeof(id), "loadgen-pub%d", i);
+        publishers.emplace_back(new MqttClient());
+        if (publishers.back()->connect("127.0.0.1", options.port, id, "adrian", "librecultivo") != 0)
+        {
+            fprintf(stderr, "client %s rejected\n", id);
+            _exit(1);
+        }
+    }
+
+    // Sensor board on UART2
+    uint32_t allocationsBeforeLoad = heapMonitor.bridgeAllocations();
+    std::vector<std::thread> load;
+    load.emplace_back([&]()
+                      {
+                          paced(options.sensorRate, options.duration, [&](size_t i)
+                                {
+                                    long seq = toMqtt.next();
+                                    toActuators.sentAt[seq] = toMqtt.sentAt[seq].load();
+                                    toActuators.sent++;
+                                    char line[96];
+                                    int length = snprintf(line, sizeof(line), "%s*%ld\r\n",
+                                                          sensorTopics[i % sensorTopics.size()].c_str(), seq);
+                                    host_uart_inject(UART_NUM_2, line, static_cast<size_t>(length));
+                                });
+                      });
+
+    // Dashboards sending actuator commands, the first eight actuators in turn
+    for (int c = 0; c < options.clients; c++)
+    {
+        load.emplace_back([&, c]()
+                          {
+                              MqttClient &client = *publishers[c];
+                              paced(options.commandRate / options.clients, options.duration, [&](size_t i)
+                                    {
+                                        long seq = commands.next();
+                                        if (seq < 0)
+                                        {
+                                            return;
+                                        }
+                                        char payload[24];
+                                        snprintf(payload, sizeof(payload), "%ld", seq);
+                                        client.publish(get_actuator_topic(static_cast<ActuatorTopic>(seq % 8)),
+                                                       payload);
+                                    });
+                          });
+    }
+    for (std::thread &thread : load)
+    {
+        thread.join();
+    }
+
+    // Let the last messages through
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (std::chrono::steady_clock::now() < deadline &&
+           (toMqtt.received() < toMqtt.sent || toActuators.received() < toActuators.sent ||
+            commands.received() < commands.sent))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    sampling = false;
+    sampler.join();
+    boardRunning = false;
+    boardThread.join();
+    uint32_t loadAllocations = heapMonitor.bridgeAllocations() - allocationsBeforeLoad;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("bridge_loadgen: %.1f s, %.0f sensor lines/s, %.0f commands/s from %d clients\n", options.duration,
+           options.sensorRate, options.commandRate, options.clients);
+    printf("%-12s %8s %8s %6s %9s %8s %8s %8s %8s\n", "path", "sent", "recv", "lost", "msg/s", "p50 us", "p90 us",
+           "p99 us", "max us");
+    printPath(toMqtt, options.duration);
+    printPath(toActuators, options.duration);
+    printPath(commands, options.duration);
+    printf("heap: %zu KiB after setup, %zu KiB peak (process start %zu KiB); RSS peak %ld KiB\n",
+           heapAfterSetup / 1024, heapPeak.load() / 1024, heapBaseline / 1024, usage.ru_maxrss);
+    printf("command shaping and tracking (whole run):\n");
+    metrics.forEach(printCommandMetric, nullptr);
+    printf("uart links (whole run):\n");
+    metrics.forEach(printLinkMetric, nullptr);
+    printf("actuator board: %zu of %d line slots peak, %lu lines overflowed\n", actuatorBoard.heldPeak,
+           BOARD_LINE_SLOTS, static_cast<unsigned long>(actuatorBoard.overflows));
+    printf("bridge task allocations: %u during the load, %u since start\n", loadAllocations,
+           heapMonitor.bridgeAllocations());
+    printf("uart2 rx: %zu B high water, %lu B lost to overflow, %u frames dropped; "
+           "uart1 tx: %u lines refused, %u process values coalesced; mqtt drops: %u\n",
+           host_uart_rx_high_water(UART_NUM_2), static_cast<unsigned long>(host_uart_overflows(UART_NUM_2)),
+           sensorLink.droppedMessages(), actuatorLink.refusedCommands(), actuatorLink.coalescedValues(),
+           myMQTTServer.droppedMessages());
+    fflush(stdout);
+
+    // The bridge tasks never return
+    _exit(0);
+}
@@ -0,0 +1,394 @@
+/*
+ * broker_bench.cpp
+ * Description: Scale benchmark of the MQTT broker, over the network only, so it
+ *              runs against the host build (bridge_host) or a gateway on the LAN.
+ *              N simulated racks publish sensor topics at a fixed rate and M
+ *              dashboard clients subscribe to them. The JSON report has the
+ *              connection setup times, the publish-to-deliver latency histogram,
+ *              the dropped deliveries and, when the broker's PID is given, the
+ *              broker's memory per client.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency_histogram.h"
+#include "mqtt_client.h"
+#include "rack_proto.h"
+
+
+/* =======================
+ * Options
+ * =======================
+ */
+struct Options
+{
+    std::string host = "127.0.0.1";
+    int port = 18830;
+    int racks = 4;           /**< Simulated racks, one publishing client each */
+    int subscribers = 8;     /**< Dashboard clients */
+    double rate = 12.0;      /**< Sensor messages per second per rack */
+    double duration = 10.0;  /**< Seconds of load */
+    bool perRack = false;    /**< Subscriber i follows rack i % racks instead of "+/sens/#" */
+    int pid = 0;             /**< Broker process on this host, for memory figures */
+    std::string username = "adrian";
+    std::string password = "librecultivo";
+    std::string label;       /**< Free text copied into the report (version, board) */
+    std::string output;      /**< Report file, stdout if empty */
+};
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [--host h] [--port p] [--racks n] [--subscribers m] [--rate msgs/s per rack]\n"
+            "          [--duration s] [--filter all|rack] [--pid broker-pid] [--user u] [--password p]\n"
+            "          [--label text] [--out report.json]\n",
+            program);
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string name = argv[i];
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (name == "--host")
+            options.host = value;
+        else if (name == "--port")
+            options.port = atoi(value);
+        else if (name == "--racks")
+            options.racks = atoi(value);
+        else if (name == "--subscribers")
+            options.subscribers = atoi(value);
+        else if (name == "--rate")
+            options.rate = atof(value);
+        else if (name == "--duration")
+            options.duration = atof(value);
+        else if (name == "--filter")
+            options.perRack = strcmp(value, "rack") == 0;
+        else if (name == "--pid")
+            options.pid = atoi(value);
+        else if (name == "--user")
+            options.username = value;
+        else if (name == "--password")
+            options.password = value;
+        else if (name == "--label")
+            options.label = value;
+        else if (name == "--out")
+            options.output = value;
+        else
+            return false;
+    }
+    return options.racks > 0 && options.subscribers >= 0 && options.rate > 0 && options.duration > 0;
+}
+
+/* =======================
+ * Measurements
+ * =======================
+ */
+static int64_t nowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * Resident memory of a process in KiB, from /proc; -1 if unknown.
+ */
+static long residentKiB(int pid)
+{
+    char path[64];
+    char line[128];
+    long kib = -1;
+
+    if (pid <= 0)
+    {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE *status = fopen(path, "r");
+    if (!status)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), status))
+    {
+        if (strncmp(line, "VmRSS:", 6) == 0)
+        {
+            kib = atol(line + 6);
+            break;
+        }
+    }
+    fclose(status);
+    return kib;
+}
+
+/**
+ * Exact percentiles of a small sample set (connection times).
+ */
+struct Timings
+{
+    std::vector<uint32_t> samples;
+
+    void write(FILE *out, const char *name)
+    {
+        std::sort(samples.begin(), samples.end());
+        auto at = [this](double q) -> unsigned long
+        {
+            return samples.empty() ? 0 : samples[std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()))];
+        };
+        fprintf(out, "  \"%s\": {\"count\": %zu, \"p50\": %lu, \"p90\": %lu, \"p99\": %lu, \"max\": %lu},\n", name,
+                samples.size(), at(0.50), at(0.90), at(0.99), samples.empty() ? 0ul : samples.back());
+    }
+};
+
+/**
+ * One dashboard: its deliveries and their latencies, written by its reader thread.
+ */
+struct Subscriber
+{
+    MqttClient client;
+    int rack = -1; /**< Followed rack, -1 for all */
+    std::atomic<uint64_t> delivered{0};
+    LatencyHistogram latency;
+};
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Every message carries its sequence number; its send time is kept here
+    size_t perRack = static_cast<size_t>(options.rate * options.duration);
+    size_t capacity = perRack * options.racks;
+    std::unique_ptr<std::atomic<int64_t>[]> sentAt(new std::atomic<int64_t>[capacity]);
+    for (size_t i = 0; i < capacity; i++)
+    {
+        sentAt[i] = -1;
+    }
+    std::atomic<bool> measuring{false};
+
+    long rssBefore = residentKiB(options.pid);
+    Timings connectTimes;
+    Timings subscribeTimes;
+
+    // Dashboards first, so no published message goes unseen
+    std::vector<std::unique_ptr<Subscriber>> subscribers;
+    for (int i = 0; i < options.subscribers; i++)
+    {
+        subscribers.emplace_back(new Subscriber());
+        Subscriber &s = *subscribers.back();
+        char id[32];
+        char filter[48];
+        snprintf(id, sizeof(id), "bench-dash%d", i);
+        s.rack = options.perRack ? i % options.racks : -1;
+        if (s.rack >= 0)
+            snprintf(filter, sizeof(filter), "rack%d/sens/#", s.rack);
+        else
+            snprintf(filter, sizeof(filter), "+/sens/#");
+
+        int64_t start = nowMicros();
+        if (s.client.connect(options.host.c_str(), options.port, id, options.username.c_str(),
+                             options.password.c_str()) != 0)
+        {
+            fprintf(stderr, "%s: connection refused after %d clients\n", id, i);
+            return 1;
+        }
+        int64_t connected = nowMicros();
+        bool subscribed = s.client.subscribe(filter, [&s, &sentAt, &measuring, capacity](const std::string &topic,
+                                                                                         const std::string &payload)
+                                             {
+                                                 char *end;
+                                                 unsigned long seq = strtoul(payload.c_str(), &end, 10);
+                                                 // Retained replays and rollup aggregates are not ours
+                                                 if (!measuring || end == payload.c_str() || *end || seq >= capacity)
+                                                 {
+                                                     return;
+                                                 }
+                                                 int64_t start = sentAt[seq];
+                                                 if (start >= 0)
+                                                 {
+                                                     s.latency.record(static_cast<uint32_t>(nowMicros() - start));
+                                                     s.delivered++;
+                                                 }
+                                             });
+        if (!subscribed)
+        {
+            fprintf(stderr, "%s: subscribe failed\n", id);
+            return 1;
+        }
+        connectTimes.samples.push_back(static_cast<uint32_t>(connected - start));
+        subscribeTimes.samples.push_back(static_cast<uint32_t>(nowMicros() - connected));
+    }
+
+    std::vector<std::unique_ptr<MqttClient>> racks;
+    for (int r = 0; r < options.racks; r++)
+    {
+        char id[32];
+        snprintf(id, sizeof(id), "bench-rack%d", r);
+        racks.emplace_back(new MqttClient());
+        int64_t start = nowMicros();
+        if (racks.back()->connect(options.host.c_str(), options.port, id, options.username.c_str(),
+                                  options.password.c_str()) != 0)
+        {
+            fprintf(stderr, "%s: connection refused\n", id);
+            return 1;
+        }
+        connectTimes.samples.push_back(static_cast<uint32_t>(nowMicros() - start));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200)); // Let retained replays pass
+    long rssConnected = residentKiB(options.pid);
+    std::atomic<long> rssPeak{rssConnected};
+
+    // Load: every rack paced on its own thread, catching up after late wake-ups
+    measuring = true;
+    std::atomic<uint64_t> publishFailures{0};
+    std::vector<std::thread> load;
+    for (int r = 0; r < options.racks; r++)
+    {
+        load.emplace_back([&, r]()
+                          {
+                              auto start = std::chrono::steady_clock::now();
+                              for (size_t i = 0; i < perRack; i++)
+                              {
+                                  std::this_thread::sleep_until(
+                                      start + std::chrono::microseconds(static_cast<int64_t>(i * 1e6 / options.rate)));
+                                  size_t seq = r * perRack + i;
+                                  char topic[64];
+                                  char payload[24];
+                                  snprintf(topic, sizeof(topic), "rack%d/%s", r, RackProto_SensorTopics[i % RACK_SENSOR_COUNT]);
+                                  snprintf(payload, sizeof(payload), "%zu", seq);
+                                  sentAt[seq] = nowMicros();
+                                  if (!racks[r]->publish(topic, payload))
+                                  {
+                                      publishFailures++;
+                                  }
+                              }
+                          });
+    }
+    std::thread memorySampler([&]()
+                              {
+                                  while (measuring)
+                                  {
+                                      long rss = residentKiB(options.pid);
+                                      if (rss > rssPeak)
+                                      {
+                                          rssPeak = rss;
+                                      }
+                                      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                                  }
+                              });
+    for (std::thread &thread : load)
+    {
+        thread.join();
+    }
+
+    // Expected deliveries: every rack for "+/sens/#", one rack for per-rack filters
+    uint64_t expected = 0;
+    for (auto &s : subscribers)
+    {
+        expected += s->rack >= 0 ? perRack : capacity;
+    }
+    auto delivered = [&subscribers]()
+    {
+        uint64_t total = 0;
+        for (auto &s : subscribers)
+        {
+            total += s->delivered;
+        }
+        return total;
+    };
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+    while (delivered() < expected && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    measuring = false;
+    memorySampler.join();
+
+    for (auto &s : subscribers)
+    {
+        s->client.disconnect();
+    }
+    for (auto &rack : racks)
+    {
+        rack->disconnect();
+    }
+
+    LatencyHistogram latency;
+    for (auto &s : subscribers)
+    {
+        latency.merge(s->latency);
+    }
+
+    // Report
+    FILE *out = options.output.empty() ? stdout : fopen(options.output.c_str(), "w");
+    if (!out)
+    {
+        perror(options.output.c_str());
+        return 1;
+    }
+    uint64_t total = delivered();
+    int clients = options.racks + options.subscribers;
+    fprintf(out, "{\n  \"tool\": \"broker_bench\",\n  \"format\": 1,\n  \"label\": \"%s\",\n", options.label.c_str());
+    fprintf(out, "  \"target\": {\"host\": \"%s\", \"port\": %d},\n", options.host.c_str(), options.port);
+    fprintf(out,
+            "  \"config\": {\"racks\": %d, \"subscribers\": %d, \"rate_per_rack\": %g, \"duration_s\": %g, "
+            "\"filter\": \"%s\"},\n",
+            options.racks, options.subscribers, options.rate, options.duration, options.perRack ? "rack" : "all");
+    connectTimes.write(out, "connect_us");
+    subscribeTimes.write(out, "subscribe_us");
+    fprintf(out,
+            "  \"published\": %zu,\n  \"publish_failures\": %lu,\n  \"expected_deliveries\": %lu,\n"
+            "  \"delivered\": %lu,\n  \"dropped\": %lu,\n  \"delivered_per_s\": %.1f,\n",
+            capacity, static_cast<unsigned long>(publishFailures.load()), static_cast<unsigned long>(expected),
+            static_cast<unsigned long>(total), static_cast<unsigned long>(expected - std::min(expected, total)),
+            total / options.duration);
+    fprintf(out, "  \"latency_us\": {\"count\": %u, \"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u,\n",
+            latency.count(), latency.percentile(50), latency.percentile(90), latency.percentile(99), latency.max());
+    fprintf(out, "    \"buckets\": [");
+    bool first = true;
+    for (uint8_t b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        if (latency.bucket(b))
+        {
+            // Bucket b holds [2^(b-1), 2^b) us
+            fprintf(out, "%s{\"lt\": %llu, \"count\": %u}", first ? "" : ", ", 1ULL << b, latency.bucket(b));
+            first = false;
+        }
+    }
+    fprintf(out, "]},\n");
+    if (rssBefore >= 0 && rssConnected >= 0)
+    {
+        fprintf(out,
+                "  \"memory\": {\"rss_before_kib\": %ld, \"rss_connected_kib\": %ld, \"rss_peak_kib\": %ld, "
+                "\"per_client_bytes\": %ld}\n",
+                rssBefore, rssConnected, rssPeak.load(), (rssConnected - rssBefore) * 1024 / clients);
+    }
+    else
+    {
+        fprintf(out, "  \"memory\": null\n");
+    }
+    fprintf(out, "}\n");
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    return total < expected ? 3 : 0;
+}
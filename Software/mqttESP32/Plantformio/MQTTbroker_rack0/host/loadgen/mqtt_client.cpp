@@ -0,0 +1,226 @@
+/*
+ * mqtt_client.cpp
+ * Description: Blocking MQTT 3.1.1 client over a POSIX socket.
+ */
+
+#include "mqtt_client.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static std::string packet(uint8_t header, const std::string &body)
+{
+    std::string out(1, static_cast<char>(header));
+    size_t length = body.size();
+    do
+    {
+        uint8_t digit = length % 128;
+        length /= 128;
+        out += static_cast<char>(length ? digit | 0x80 : digit);
+    } while (length);
+    return out + body;
+}
+
+static void putString(std::string &out, const char *text)
+{
+    size_t length = strlen(text);
+    out += static_cast<char>(length >> 8);
+    out += static_cast<char>(length & 0xFF);
+    out.append(text, length);
+}
+
+int MqttClient::connect(const char *host, uint16_t port, const char *clientId, const char *username,
+                        const char *password)
+{
+    struct addrinfo hints = {};
+    struct addrinfo *found = nullptr;
+    char service[8];
+
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%u", port);
+    if (getaddrinfo(host, service, &hints, &found) != 0)
+    {
+        return -1;
+    }
+    socketFd = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+    bool opened = socketFd >= 0 && ::connect(socketFd, found->ai_addr, found->ai_addrlen) == 0;
+    freeaddrinfo(found);
+    if (!opened)
+    {
+        disconnect();
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+    std::string body;
+    putString(body, "MQTT");
+    body += '\x04';
+    body += static_cast<char>((username ? 0x80 : 0) | (password ? 0x40 : 0) | 0x02); // Clean session
+    body += '\0';
+    body += '\x3C'; // Keep alive 60 s
+    putString(body, clientId);
+    if (username)
+    {
+        putString(body, username);
+    }
+    if (password)
+    {
+        putString(body, password);
+    }
+
+    uint8_t header;
+    std::string reply;
+    if (!sendAll(packet(0x10, body)) || !readPacket(header, reply) || (header >> 4) != 2 || reply.size() < 2)
+    {
+        disconnect();
+        return -1;
+    }
+    return static_cast<uint8_t>(reply[1]);
+}
+
+bool MqttClient::subscribe(const char *filter, MessageCallback onMessage)
+{
+    std::string body("\x00\x01", 2);
+    putString(body, filter);
+    body += '\0';
+
+    uint8_t header;
+    std::string reply;
+    if (!sendAll(packet(0x82, body)))
+    {
+        return false;
+    }
+    // Retained messages may arrive before the SUBACK
+    callback = onMessage;
+    do
+    {
+        if (!readPacket(header, reply))
+        {
+            return false;
+        }
+        dispatch(header, reply);
+    } while ((header >> 4) != 9);
+
+    running = true;
+    reader = std::thread(&MqttClient::readLoop, this);
+    return true;
+}
+
+bool MqttClient::publish(const char *topic, const char *payload)
+{
+    std::string body;
+    putString(body, topic);
+    body += payload;
+    return sendAll(packet(0x30, body));
+}
+
+void MqttClient::disconnect()
+{
+    if (socketFd >= 0)
+    {
+        sendAll(std::string("\xE0\x00", 2));
+        running = false;
+        shutdown(socketFd, SHUT_RDWR);
+        if (reader.joinable())
+        {
+            reader.join();
+        }
+        close(socketFd);
+        socketFd = -1;
+    }
+}
+
+bool MqttClient::sendAll(const std::string &data)
+{
+    std::lock_guard<std::mutex> lock(writeMutex);
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t count = ::send(socketFd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (count <= 0)
+        {
+            return false;
+        }
+        sent += static_cast<size_t>(count);
+    }
+    return true;
+}
+
+bool MqttClient::readExact(void *buffer, size_t length)
+{
+    uint8_t *out = static_cast<uint8_t *>(buffer);
+    while (length)
+    {
+        ssize_t count = recv(socketFd, out, length, 0);
+        if (count <= 0)
+        {
+            return false;
+        }
+        out += count;
+        length -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+bool MqttClient::readPacket(uint8_t &header, std::string &body)
+{
+    size_t length = 0;
+    uint8_t digit;
+    int shift = 0;
+
+    if (!readExact(&header, 1))
+    {
+        return false;
+    }
+    do
+    {
+        if (shift > 21 || !readExact(&digit, 1))
+        {
+            return false;
+        }
+        length |= static_cast<size_t>(digit & 0x7F) << shift;
+        shift += 7;
+    } while (digit & 0x80);
+
+    body.resize(length);
+    return length == 0 || readExact(&body[0], length);
+}
+
+void MqttClient::readLoop()
+{
+    uint8_t header;
+    std::string body;
+
+    while (running && readPacket(header, body))
+    {
+        dispatch(header, body);
+    }
+}
+
+/**
+ * Hands a PUBLISH to the callback; other packets are ignored.
+ */
+void MqttClient::dispatch(uint8_t header, const std::string &body)
+{
+    if ((header >> 4) != 3 || body.size() < 2)
+    {
+        return;
+    }
+    size_t length = static_cast<uint8_t>(body[0]) << 8 | static_cast<uint8_t>(body[1]);
+    size_t offset = 2 + length + ((header & 0x06) ? 2 : 0);
+    if (offset > body.size())
+    {
+        return;
+    }
+    received++;
+    if (callback)
+    {
+        callback(body.substr(2, length), body.substr(offset));
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * mqtt_client.h
+ * Description: Minimal blocking MQTT 3.1.1 client for the load tools: QoS 0
+ *              publish, subscribe, and a reader thread that hands every
+ *              received message to a callback.
+ */
+
+#ifndef MQTT_CLIENT_H_
+#define MQTT_CLIENT_H_
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+class MqttClient
+{
+public:
+    /**
+     * Called from the reader thread for every PUBLISH received.
+     */
+    typedef std::function<void(const std::string &topic, const std::string &payload)> MessageCallback;
+
+    MqttClient() : socketFd(-1), running(false), received(0) {}
+    ~MqttClient() { disconnect(); }
+
+    /**
+     * Opens the TCP connection and waits for the CONNACK.
+     * @return The CONNACK return code, or -1 if the connection failed.
+     */
+    int connect(const char *host, uint16_t port, const char *clientId, const char *username,
+                const char *password);
+
+    /**
+     * Subscribes and waits for the SUBACK, then starts the reader thread.
+     * @return true if the broker acknowledged the subscription.
+     */
+    bool subscribe(const char *filter, MessageCallback callback);
+
+    /**
+     * Sends a QoS 0 PUBLISH. Safe to call while the reader thread runs.
+     */
+    bool publish(const char *topic, const char *payload);
+
+    void disconnect();
+
+    uint64_t messagesReceived() const { return received; }
+
+private:
+    int socketFd;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> received;
+    std::mutex writeMutex;
+    std::thread reader;
+    MessageCallback callback;
+
+    bool sendAll(const std::string &data);
+    bool readPacket(uint8_t &header, std::string &body);
+    bool readExact(void *buffer, size_t length);
+    void readLoop();
+    void dispatch(uint8_t header, const std::string &body);
+};
+
+#endif /* MQTT_CLIENT_H_ */
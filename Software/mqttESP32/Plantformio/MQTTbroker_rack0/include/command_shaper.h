@@ -0,0 +1,142 @@
+/*
+ * command_shaper.h
+ * Description: Per-actuator coalescing and per-rack rate limiting of the
+ *              commands written to the actuator boards.
+ */
+
+#ifndef COMMAND_SHAPER_H_
+#define COMMAND_SHAPER_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "command_tracker.h"
+#include "metrics.h"
+
+/* =======================
+ * Macros
+ * =======================
+ */
+#define SHAPER_RACKS 4         /**< Racks with a bucket (>= RACK_MAX) */
+#define SHAPER_ACTUATORS 24    /**< Actuators per rack (>= ACTUATOR_COUNT) */
+#define SHAPER_WINDOW_MS 100   /**< Shortest interval between two commands to one actuator */
+#define SHAPER_RATE 50         /**< Commands per second to one board, on average */
+#define SHAPER_BURST 10        /**< Commands sent back to back after an idle period */
+
+/**
+ * Sends a command to a board.
+ * @param ctx Caller context.
+ * @param rack The rack.
+ * @param id The actuator.
+ * @param value The value.
+ * @param receivedUs esp_timer time the latest value was routed.
+ * @param urgent true for a safety command, written ahead of the queued lines.
+ * @return true if queued on the link.
+ */
+typedef bool (*ShaperSend)(void *ctx, uint8_t rack, uint8_t id, const char *value, uint32_t receivedUs,
+                           bool urgent);
+
+/* =======================
+ * CommandShaper Class
+ * =======================
+ * A command goes out at once if its actuator has not been commanded within
+ * SHAPER_WINDOW_MS and the rack's token bucket (SHAPER_RATE per second, up to
+ * SHAPER_BURST) has a token. Otherwise it waits in its actuator's slot, where a
+ * newer value replaces it, and poll() sends it once both allow. A dragged
+ * slider therefore costs one command per window and always ends on its last
+ * value, and a flood of commands can take at most SHAPER_RATE lines per second
+ * from the link, leaving the rest to the process values.
+ *
+ * Urgent commands (pump off) skip both and drop the value waiting for their
+ * actuator, so an older "on" can never follow them. Broker task only.
+ *
+ * A command send() cannot queue is never lost: its token is refunded and it
+ * waits in its slot like a deferred one. A waiting urgent command is retried on
+ * every poll(), regardless of the window and the tokens.
+ */
+class CommandShaper
+{
+public:
+    CommandShaper();
+
+    /**
+     * Sends a command now or keeps it for poll().
+     * @param rack The rack (< SHAPER_RACKS).
+     * @param id The actuator (< SHAPER_ACTUATORS).
+     * @param value The value, truncated to CMD_VALUE_SIZE.
+     * @param receivedUs esp_timer time the MQTT message was routed.
+     * @param nowMs millis().
+     * @param urgent true to skip the window and the rate limit.
+     * @param send Sends the command.
+     * @param ctx Callback context.
+     * @return false if the command was neither sent nor kept (rack or actuator
+     *         out of range and send() failed).
+     */
+    bool submit(uint8_t rack, uint8_t id, const char *value, uint32_t receivedUs, uint32_t nowMs, bool urgent,
+                ShaperSend send, void *ctx);
+
+    /**
+     * Sends the waiting urgent commands, then the others whose window has
+     * elapsed, as tokens allow. Actuators are served in turn, so a busy one
+     * cannot hold back the others. A command send() cannot queue stays waiting
+     * and is retried on the next poll().
+     * @param nowMs millis().
+     * @param send Sends a command.
+     * @param ctx Callback context.
+     */
+    void poll(uint32_t nowMs, ShaperSend send, void *ctx);
+
+    /**
+     * Registers shaper/deferred, shaper/coalesced, shaper/urgent and shaper/pending.
+     * @param registry The registry.
+     */
+    void registerMetrics(MetricsRegistry &registry);
+
+    /**
+     * Samples shaper/pending, from the broker task before publication.
+     */
+    void sampleMetrics();
+
+private:
+    struct Slot
+    {
+        char value[CMD_VALUE_SIZE]; /**< Latest value not sent yet */
+        uint32_t receivedUs;
+        uint32_t sentMs;            /**< Last command sent to the actuator */
+        bool pending;
+        bool urgent;                /**< The waiting value goes on the urgent lane */
+    };
+
+    struct Bucket
+    {
+        uint32_t tokens;     /**< Thousandths of a command */
+        uint32_t refilledMs;
+        uint8_t pending;     /**< Slots waiting */
+        uint8_t urgent;      /**< Of which urgent */
+        uint8_t next;        /**< First slot looked at by the next poll() */
+    };
+
+    bool takeToken(Bucket &bucket, uint32_t nowMs);
+
+    /**
+     * Keeps a value in its slot for poll(), replacing the one waiting.
+     */
+    void hold(Bucket &bucket, Slot &slot, const char *value, uint32_t receivedUs, bool urgent);
+
+    /**
+     * Frees a waiting slot once its command is sent or dropped.
+     */
+    void release(Bucket &bucket, Slot &slot);
+
+    Slot slots[SHAPER_RACKS][SHAPER_ACTUATORS];
+    Bucket buckets[SHAPER_RACKS];
+    Counter deferred;  /**< Commands that had to wait */
+    Counter coalesced; /**< Waiting values replaced or dropped before being sent */
+    Counter urgentCommands; /**< Commands sent on the urgent lane */
+    Gauge waiting;     /**< Slots waiting, sampled */
+};
+
+#endif /* COMMAND_SHAPER_H_ */
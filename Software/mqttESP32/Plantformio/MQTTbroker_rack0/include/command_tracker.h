@@ -0,0 +1,172 @@
+/*
+ * command_tracker.h
+ * Description: Sequence numbers, acknowledgements, retries and per-hop latency of
+ *              the commands sent to the actuator boards.
+ */
+
+#ifndef COMMAND_TRACKER_H_
+#define COMMAND_TRACKER_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "metrics.h"
+#include "rack_proto.h"
+
+/* =======================
+ * Macros
+ * =======================
+ */
+#define CMD_TRACK_SLOTS 16      /**< Commands awaiting an ACK (power of two) */
+#define CMD_VALUE_SIZE 24       /**< Longest command value, including the terminator */
+#define CMD_ACK_TIMEOUT_MS 250  /**< Wait for an ACK before sending again */
+#define CMD_RETRIES 2           /**< Resends before the command is reported as timed out */
+#define CMD_ACK_TOPIC RACK_PROTO_ACK_TOPIC /**< Board frame "ack*SEQ,CODE,APPLY_US" */
+
+/* =======================
+ * Structures
+ * =======================
+ */
+
+/**
+ * Command awaiting its ACK.
+ */
+struct TrackedCommand
+{
+    uint16_t seq;                    /**< 1..65535, 0 while the slot is free */
+    uint8_t rack;
+    uint8_t id;                      /**< Board-side ID */
+    uint8_t attempts;                /**< Times queued on the link */
+    uint32_t receivedUs;             /**< esp_timer time the MQTT message was routed */
+    std::atomic<uint32_t> sentUs;    /**< esp_timer time of the last UART write, 0 until written */
+    uint32_t deadlineMs;             /**< Resend or give up after this */
+    char value[CMD_VALUE_SIZE];
+};
+
+/**
+ * Final state of a command.
+ */
+enum class CommandOutcome : uint8_t
+{
+    APPLIED,  /**< ACK with code 0 */
+    REJECTED, /**< ACK with the board's error code, or RACK_PROTO_NOT_QUEUED */
+    TIMEOUT   /**< No ACK after CMD_RETRIES resends */
+};
+
+/**
+ * Hop latencies of a completed command, in microseconds (0 when unknown).
+ */
+struct CommandTiming
+{
+    uint32_t mqttToTx;    /**< Routed to written to the UART driver, first attempt only */
+    uint32_t uartToApply; /**< Frame received to command applied, measured by the board on TIM2 */
+    uint32_t roundTrip;   /**< Written to the UART driver to ACK received */
+};
+
+/**
+ * Queues a command on its link again.
+ * @param ctx Caller context.
+ * @param command The command; its attempts and sentUs are already updated.
+ * @return true if queued.
+ */
+typedef bool (*CommandResend)(void *ctx, TrackedCommand &command);
+
+/**
+ * Receives the outcome of every tracked command.
+ * @param ctx Caller context.
+ * @param command The command.
+ * @param outcome APPLIED, REJECTED or TIMEOUT.
+ * @param code The board's error code (0 unless REJECTED).
+ * @param timing Hop latencies, all 0 on TIMEOUT.
+ */
+typedef void (*CommandResult)(void *ctx, const TrackedCommand &command, CommandOutcome outcome, int code,
+                              const CommandTiming &timing);
+
+/* =======================
+ * CommandTracker Class
+ * =======================
+ * The broker task opens a slot per command and sends "ID*VAL#SEQ"; the board
+ * answers "ack*SEQ,CODE,APPLY_US" once the handler returns. A slot is found from
+ * its sequence number alone (seq % CMD_TRACK_SLOTS), so ACKs are matched without
+ * a search. A newer command for the same actuator supersedes a pending one, so a
+ * resend can never apply a stale value after a fresh one.
+ *
+ * Everything except the sentUs stamp (written by the link's egress task) runs on
+ * the broker task.
+ */
+class CommandTracker
+{
+public:
+    CommandTracker();
+
+    /**
+     * Opens a slot for a new command.
+     * @param rack The rack.
+     * @param id The board-side ID.
+     * @param value The value, truncated to CMD_VALUE_SIZE.
+     * @param receivedUs esp_timer time the MQTT message was routed.
+     * @param nowMs millis().
+     * @return The slot, with its sequence number set. If CMD_TRACK_SLOTS commands
+     *         are already waiting, the oldest is dropped from tracking.
+     */
+    TrackedCommand &open(uint8_t rack, uint8_t id, const char *value, uint32_t receivedUs, uint32_t nowMs);
+
+    /**
+     * Frees a slot whose command could not be queued, reporting it as REJECTED
+     * with RACK_PROTO_NOT_QUEUED.
+     * @param command The slot from open().
+     * @param result Called with the outcome.
+     * @param ctx Callback context.
+     */
+    void cancel(TrackedCommand &command, CommandResult result, void *ctx);
+
+    /**
+     * Matches an ACK frame value "SEQ,CODE,APPLY_US" to its command.
+     * @param rack The rack whose actuator link received it.
+     * @param ack The frame value.
+     * @param rxUs esp_timer time the frame was received.
+     * @param result Called when the ACK completes a command.
+     * @param ctx Callback context.
+     * @return false if the ACK is malformed or matches no pending command.
+     */
+    bool acknowledge(uint8_t rack, const char *ack, uint32_t rxUs, CommandResult result, void *ctx);
+
+    /**
+     * Resends the commands whose ACK is overdue and gives up on the ones out of
+     * retries.
+     * @param nowMs millis().
+     * @param resend Queues a command again.
+     * @param result Called for every command that timed out.
+     * @param ctx Callback context.
+     */
+    void poll(uint32_t nowMs, CommandResend resend, CommandResult result, void *ctx);
+
+    /**
+     * Registers cmd/sent, cmd/applied, cmd/rejected, cmd/retries, cmd/timeouts,
+     * cmd/superseded, cmd/evicted, cmd/unmatched_acks and the hop histograms
+     * cmd/mqtt_to_tx_us, cmd/uart_to_apply_us and cmd/round_trip_us.
+     * @param registry The registry.
+     */
+    void registerMetrics(MetricsRegistry &registry);
+
+private:
+    TrackedCommand slots[CMD_TRACK_SLOTS];
+    uint16_t nextSeq;
+    Counter sent;
+    Counter applied;
+    Counter rejected;
+    Counter retries;
+    Counter timeouts;
+    Counter superseded;
+    Counter evicted;
+    Counter unmatchedAcks;
+    Histogram mqttToTx;
+    Histogram uartToApply;
+    Histogram roundTrip;
+};
+
+#endif /* COMMAND_TRACKER_H_ */
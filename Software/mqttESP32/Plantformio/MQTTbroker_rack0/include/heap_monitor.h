@@ -0,0 +1,92 @@
+/*
+ * heap_monitor.h
+ * Description: Heap fragmentation and allocation telemetry of the gateway.
+ */
+
+#ifndef HEAP_MONITOR_H_
+#define HEAP_MONITOR_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "metrics.h"
+
+/* =======================
+ * HeapMonitor Class
+ * =======================
+ * Samples free heap against the largest free block, which shows fragmentation
+ * building up long before an allocation fails, and counts the allocations made
+ * by the bridge tasks (broker, UART ingest and egress) once they run.
+ *
+ * Counting needs the allocator wrapped at link time, which platformio.ini and
+ * the host build do:
+ *   -DHEAP_MONITOR_WRAP -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+ * Without it the allocation counters stay at zero. Whether the calling task is
+ * watched is a thread-local flag, so the check costs no lock and no lookup.
+ */
+class HeapMonitor
+{
+public:
+    /**
+     * Counts the allocations of the calling task from now on. Called first thing
+     * by every bridge task.
+     */
+    static void watchCurrentTask();
+
+    /**
+     * Called by the allocator wrappers.
+     * @param size Requested bytes.
+     */
+    void countAllocation(size_t size);
+
+    /**
+     * Stops or resumes counting for the calling task until the scope ends. Lets a
+     * library stand-in leave its own bookkeeping out of the bridge's count.
+     */
+    class Tracking
+    {
+    public:
+        explicit Tracking(bool enabled);
+        ~Tracking();
+        Tracking(const Tracking &) = delete;
+        Tracking &operator=(const Tracking &) = delete;
+
+    private:
+        bool previous;
+    };
+
+    /**
+     * Registers heap/free, heap/min_free, heap/largest_block,
+     * heap/largest_block_min, heap/fragmentation_pct, heap/allocs,
+     * heap/allocs_bridge and heap/alloc_bytes_bridge.
+     * @param registry The registry.
+     */
+    void registerMetrics(MetricsRegistry &registry);
+
+    /**
+     * Reads the allocator state into the gauges. Called before each publication.
+     */
+    void sampleMetrics();
+
+    /**
+     * Allocations made by watched tasks since boot.
+     */
+    uint32_t bridgeAllocations() const { return bridgeAllocs.value(); }
+
+private:
+    Counter allocs;           /**< Every wrapped allocation, any task */
+    Counter bridgeAllocs;     /**< Allocations made by watched tasks */
+    Counter bridgeAllocBytes; /**< Bytes requested by watched tasks */
+    Gauge freeBytes;
+    Gauge minFreeBytes;
+    Gauge largestBlock;
+    Gauge largestBlockMin;    /**< Smallest largest-block seen at a sample */
+    Gauge fragmentation;      /**< 100 - largest block * 100 / free */
+};
+
+extern HeapMonitor heapMonitor;
+
+#endif /* HEAP_MONITOR_H_ */
@@ -0,0 +1,75 @@
+/*
+ * latency_histogram.h
+ * Description: Fixed-size log2 histogram for latency percentiles, with no allocation.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <stdint.h>
+
+/* =======================
+ * Macros
+ * =======================
+ */
+#define LATENCY_BUCKETS 32 /**< Bucket i holds samples in [2^(i-1), 2^i) microseconds */
+
+/* =======================
+ * LatencyHistogram Class
+ * =======================
+ * Written by a single task. Percentiles are reported as the upper bound of the
+ * bucket they fall in, so they are accurate to a factor of two.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() { reset(); }
+
+    /**
+     * Adds one sample.
+     * @param us Latency in microseconds.
+     */
+    void record(uint32_t us);
+
+    /**
+     * Upper bound of the bucket holding a percentile.
+     * @param percent Percentile (0-100).
+     * @return Latency in microseconds, 0 if there are no samples.
+     */
+    uint32_t percentile(uint8_t percent) const;
+
+    /**
+     * Clears every sample.
+     */
+    void reset();
+
+    /**
+     * Adds the samples of another histogram.
+     * @param other The histogram to merge in.
+     */
+    void merge(const LatencyHistogram &other);
+
+    uint32_t count() const { return samples; }
+    uint32_t max() const { return largest; }
+    uint32_t bucket(uint8_t index) const { return buckets[index]; }
+
+    /**
+     * Bucket of a sample.
+     * @param us Latency in microseconds.
+     * @return Index of the bucket.
+     */
+    static uint8_t bucketOf(uint32_t us);
+
+private:
+    friend class Histogram; // Lock-free variant in metrics.h, drains into this one
+
+    uint32_t buckets[LATENCY_BUCKETS];
+    uint32_t samples;
+    uint32_t largest;
+};
+
+#endif /* LATENCY_HISTOGRAM_H_ */
@@ -0,0 +1,65 @@
+/*
+ * line_assembler.h
+ * Description: Incremental, allocation-free assembler for newline-terminated UART frames.
+ */
+
+#ifndef LINE_ASSEMBLER_H_
+#define LINE_ASSEMBLER_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/* =======================
+ * Macros
+ * =======================
+ */
+#define LINE_ASSEMBLER_SIZE 128 /**< Longest frame accepted, including the terminator */
+
+/* =======================
+ * LineAssembler Class
+ * =======================
+ * Collects bytes as they arrive and reports when a complete line is ready.
+ * '\r' is dropped and '\n' ends the line; a line longer than the buffer is
+ * discarded up to its terminator so it cannot corrupt the next frame.
+ */
+class LineAssembler
+{
+public:
+    LineAssembler() : length(0), overflow(false), complete(false), dropped(0) { buffer[0] = '\0'; }
+
+    /**
+     * Feeds one received byte.
+     * @param c The byte.
+     * @return true when a complete, non-empty line is available through line().
+     */
+    bool push(uint8_t c);
+
+    /**
+     * Last complete line, null-terminated, without the line terminator.
+     * Valid until the next call to push(); may be split in place by the caller.
+     */
+    char *line() { return buffer; }
+
+    /**
+     * Discards any partial line.
+     */
+    void reset();
+
+    /**
+     * Number of lines dropped because they did not fit in the buffer.
+     */
+    uint32_t droppedLines() const { return dropped; }
+
+private:
+    char buffer[LINE_ASSEMBLER_SIZE];
+    size_t length;
+    bool overflow;
+    bool complete;
+    uint32_t dropped;
+};
+
+#endif /* LINE_ASSEMBLER_H_ */
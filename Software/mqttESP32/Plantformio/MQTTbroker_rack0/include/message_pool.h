@@ -0,0 +1,163 @@
+/*
+ * message_pool.h
+ * Description: Fixed pool of equally sized message buffers with RAII handles.
+ */
+
+#ifndef MESSAGE_POOL_H_
+#define MESSAGE_POOL_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "metrics.h"
+
+/* =======================
+ * MessagePool Class
+ * =======================
+ * BlockCount buffers of BlockSize bytes reserved at build time, so taking a
+ * message buffer never touches the general heap and cannot fragment it. The
+ * free blocks are the set bits of one word, claimed and returned with a
+ * compare-and-swap, so any task or core may acquire and release.
+ *
+ * acquire() hands out a Buffer that owns its block and returns it when it goes
+ * out of scope or is moved from. An empty Buffer means the pool was exhausted:
+ * the caller drops the message and the exhaustion is counted.
+ */
+template <size_t BlockSize, size_t BlockCount>
+class MessagePool
+{
+    static_assert(BlockCount >= 1 && BlockCount <= 32, "MessagePool holds 1 to 32 blocks");
+
+public:
+    /**
+     * Owner of one block. Move-only.
+     */
+    class Buffer
+    {
+    public:
+        Buffer() : pool(nullptr), block(0) {}
+        Buffer(Buffer &&other) : pool(other.pool), block(other.block) { other.pool = nullptr; }
+        Buffer &operator=(Buffer &&other)
+        {
+            if (this != &other)
+            {
+                reset();
+                pool = other.pool;
+                block = other.block;
+                other.pool = nullptr;
+            }
+            return *this;
+        }
+        Buffer(const Buffer &) = delete;
+        Buffer &operator=(const Buffer &) = delete;
+        ~Buffer() { reset(); }
+
+        explicit operator bool() const { return pool != nullptr; }
+        char *data() { return pool->blocks[block]; }
+        static constexpr size_t size() { return BlockSize; }
+
+        /**
+         * Returns the block to the pool now.
+         */
+        void reset()
+        {
+            if (pool)
+            {
+                pool->release(block);
+                pool = nullptr;
+            }
+        }
+
+    private:
+        friend class MessagePool;
+        Buffer(MessagePool *pool, uint8_t block) : pool(pool), block(block) {}
+
+        MessagePool *pool;
+        uint8_t block;
+    };
+
+    MessagePool() : freeMask(allBlocks()), inUse(0), highWater(0) {}
+
+    /**
+     * Takes a free block.
+     * @return The buffer, empty if every block is taken.
+     */
+    Buffer acquire()
+    {
+        uint32_t mask = freeMask.load(std::memory_order_relaxed);
+        uint32_t bit;
+        do
+        {
+            if (mask == 0)
+            {
+                exhausted.add();
+                return Buffer();
+            }
+            bit = mask & (~mask + 1); // Lowest free block
+        } while (!freeMask.compare_exchange_weak(mask, mask & ~bit, std::memory_order_acquire,
+                                                 std::memory_order_relaxed));
+
+        uint32_t used = inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+        uint32_t peak = highWater.load(std::memory_order_relaxed);
+        while (used > peak && !highWater.compare_exchange_weak(peak, used, std::memory_order_relaxed))
+        {
+        }
+        return Buffer(this, static_cast<uint8_t>(__builtin_ctz(bit)));
+    }
+
+    /**
+     * Registers <prefix>/in_use, <prefix>/high_water and <prefix>/exhausted.
+     * @param registry The registry.
+     * @param prefix Name prefix (e.g. "pool/payload").
+     */
+    void registerMetrics(MetricsRegistry &registry, const char *prefix)
+    {
+        char name[METRICS_NAME_SIZE];
+
+        snprintf(name, sizeof(name), "%s/in_use", prefix);
+        registry.add(name, inUseGauge);
+        snprintf(name, sizeof(name), "%s/high_water", prefix);
+        registry.add(name, highWaterGauge);
+        snprintf(name, sizeof(name), "%s/exhausted", prefix);
+        registry.add(name, exhausted);
+    }
+
+    /**
+     * Copies the occupancy into the gauges. Called before each publication.
+     */
+    void sampleMetrics()
+    {
+        inUseGauge.set(static_cast<int32_t>(inUse.load(std::memory_order_relaxed)));
+        highWaterGauge.set(static_cast<int32_t>(highWater.load(std::memory_order_relaxed)));
+    }
+
+    static constexpr size_t blockSize() { return BlockSize; }
+    static constexpr size_t blockCount() { return BlockCount; }
+
+private:
+    char blocks[BlockCount][BlockSize];
+    std::atomic<uint32_t> freeMask; /**< Bit i set while block i is free */
+    std::atomic<uint32_t> inUse;
+    std::atomic<uint32_t> highWater;
+    Counter exhausted;
+    Gauge inUseGauge;
+    Gauge highWaterGauge;
+
+    static constexpr uint32_t allBlocks()
+    {
+        return BlockCount == 32 ? 0xFFFFFFFFu : (1u << (BlockCount % 32)) - 1;
+    }
+
+    void release(uint8_t block)
+    {
+        inUse.fetch_sub(1, std::memory_order_relaxed);
+        freeMask.fetch_or(1u << block, std::memory_order_release);
+    }
+};
+
+#endif /* MESSAGE_POOL_H_ */
@@ -0,0 +1,157 @@
+/*
+ * metrics.h
+ * Description: Runtime metrics of the gateway: counters, gauges and latency
+ *              histograms, published periodically under $SYS.
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "latency_histogram.h"
+
+/* =======================
+ * Macros
+ * =======================
+ */
+#define METRICS_RACKS 4                  /**< Racks with link metrics (>= RACK_MAX) */
+#define METRICS_GATEWAY 40               /**< Metrics of the broker, pools, shaper, tracker, rules and uplink */
+#define METRICS_PER_LINK 20              /**< Metrics of one UART link */
+#define METRICS_MAX (METRICS_GATEWAY + METRICS_RACKS * 2 * METRICS_PER_LINK) /**< Registered metrics */
+#define METRICS_NAME_SIZE 40             /**< Longest metric name, including the terminator */
+#define METRICS_TOPIC_PREFIX "$SYS/rack0/" /**< Topic of a metric: prefix + name */
+#define METRICS_PERIOD_MS 10000          /**< Publication period */
+
+/* =======================
+ * Metric Types
+ * =======================
+ * Updated from any task or core with relaxed atomics: no lock and no
+ * allocation on the hot path.
+ */
+
+/**
+ * Monotonic event count.
+ */
+class Counter
+{
+public:
+    constexpr Counter() : count(0) {}
+
+    void add(uint32_t n = 1) { count.fetch_add(n, std::memory_order_relaxed); }
+    uint32_t value() const { return count.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint32_t> count;
+};
+
+/**
+ * Last sampled level (queue depth, free heap).
+ */
+class Gauge
+{
+public:
+    constexpr Gauge() : level(0) {}
+
+    void set(int32_t value) { level.store(value, std::memory_order_relaxed); }
+    int32_t value() const { return level.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int32_t> level;
+};
+
+/**
+ * Latency histogram with the buckets of LatencyHistogram. Samples accumulate
+ * until drained by the publisher, so each publication covers one period.
+ */
+class Histogram
+{
+public:
+    Histogram();
+
+    /**
+     * Adds one sample.
+     * @param us Latency in microseconds.
+     */
+    void record(uint32_t us);
+
+    /**
+     * Moves the samples collected since the last drain into a plain histogram.
+     * A sample recorded meanwhile lands in this period or the next, never both.
+     * @param window Receives the samples (reset first).
+     */
+    void drain(LatencyHistogram &window);
+
+private:
+    std::atomic<uint32_t> buckets[LATENCY_BUCKETS];
+    std::atomic<uint32_t> largest;
+};
+
+/* =======================
+ * MetricsRegistry Class
+ * =======================
+ * Names the metrics owned by the modules. Registration happens from setup(),
+ * before the tasks start; publication from the broker task.
+ */
+class MetricsRegistry
+{
+public:
+    /**
+     * Called once per metric with its name and its value as text.
+     */
+    typedef void (*MetricFn)(void *ctx, const char *name, const char *value);
+
+    MetricsRegistry() : count(0), dropped(0) {}
+
+    /**
+     * Registers a metric. Names longer than METRICS_NAME_SIZE are truncated.
+     * @param name Name relative to METRICS_TOPIC_PREFIX (e.g. "heap/free").
+     * @return false if the registry is full.
+     */
+    bool add(const char *name, Counter &counter);
+    bool add(const char *name, Gauge &gauge);
+    bool add(const char *name, Histogram &histogram);
+
+    /**
+     * Formats every metric. Histograms are drained and reported as JSON with the
+     * count, p50, p90, p99 and max of the period.
+     * @param fn Called for each metric.
+     * @param ctx Passed to fn.
+     */
+    void forEach(MetricFn fn, void *ctx);
+
+    size_t size() const { return count; }
+
+    /**
+     * Metrics not registered because the registry was full.
+     */
+    size_t rejected() const { return dropped; }
+
+private:
+    enum class Type : uint8_t
+    {
+        COUNTER,
+        GAUGE,
+        HISTOGRAM
+    };
+
+    struct Entry
+    {
+        char name[METRICS_NAME_SIZE];
+        Type type;
+        void *metric;
+    };
+
+    Entry entries[METRICS_MAX];
+    size_t count;
+    size_t dropped;
+
+    bool add(const char *name, Type type, void *metric);
+};
+
+#endif /* METRICS_H_ */
@@ -0,0 +1,91 @@
+/*
+ * persistent_queue.h
+ * Description: Bounded FIFO of MQTT messages on flash, for store-and-forward.
+ */
+
+#ifndef PERSISTENT_QUEUE_H_
+#define PERSISTENT_QUEUE_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <FS.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* =======================
+ * Macros
+ * =======================
+ * Records are appended to numbered segment files (/uplink/<hex seq>) and read
+ * back oldest first. When the queue is full the oldest segment is dropped, so
+ * the flash used never exceeds PQ_MAX_SEGMENTS * PQ_SEGMENT_SIZE. The read
+ * position is saved after each pop batch; after a reset at most one batch is
+ * sent twice (at-least-once delivery).
+ */
+#define PQ_DIR "/uplink"            /**< Queue directory */
+#define PQ_SEGMENT_SIZE 8192        /**< Bytes per segment file */
+#define PQ_MAX_SEGMENTS 24          /**< Segments kept (192 KB) */
+#define PQ_TOPIC_SIZE 96            /**< Longest topic, including the terminator */
+#define PQ_PAYLOAD_SIZE 512         /**< Longest payload, including the terminator */
+
+/* =======================
+ * PersistentQueue Class
+ * =======================
+ * Used from a single task.
+ */
+class PersistentQueue
+{
+public:
+    PersistentQueue() : fs(nullptr), head(0), tail(0), readOffset(0), tailBytes(0), peekLength(0), dropped(0) {}
+
+    /**
+     * Opens the queue, resuming the messages left by a previous run.
+     * @param fileSystem The file system (LittleFS).
+     * @return true if successful.
+     */
+    bool begin(fs::FS &fileSystem);
+
+    /**
+     * Appends a message, dropping the oldest segment if the queue is full.
+     * @return false if the message is too long or cannot be written.
+     */
+    bool push(const char *topic, const char *payload);
+
+    /**
+     * Reads the oldest message without removing it.
+     * @return false if the queue is empty.
+     */
+    bool peek(char *topic, char *payload);
+
+    /**
+     * Removes the message returned by peek().
+     */
+    void pop();
+
+    /**
+     * Saves the read position (call after a batch of pops).
+     */
+    void commit();
+
+    bool empty();
+
+    /**
+     * Segments dropped because the queue was full.
+     */
+    uint32_t droppedSegments() const { return dropped; }
+
+private:
+    void segmentPath(char *path, size_t size, uint32_t seq) const;
+    void dropHead();
+
+    fs::FS *fs;
+    uint32_t head;        /**< Oldest segment */
+    uint32_t tail;        /**< Segment being written */
+    size_t readOffset;    /**< Next record in the head segment */
+    size_t tailBytes;     /**< Size of the tail segment */
+    size_t peekLength;    /**< Size of the record returned by peek() */
+    uint32_t dropped;
+};
+
+#endif /* PERSISTENT_QUEUE_H_ */
@@ -0,0 +1,101 @@
+/*
+ * rollup.h
+ * Description: Streaming min/max/mean/count/last aggregation over fixed time windows.
+ */
+
+#ifndef ROLLUP_H_
+#define ROLLUP_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/* =======================
+ * Macros
+ * =======================
+ */
+#define ROLLUP_MAX_SERIES 24 /**< One series per sensor topic of up to 4 racks */
+#define ROLLUP_WINDOWS 3    /**< 1 minute, 15 minutes, 1 hour */
+
+/* =======================
+ * Structures
+ * =======================
+ */
+
+/**
+ * Aggregate of one closed window. Values are in thousandths of the unit.
+ */
+struct RollupResult
+{
+    uint32_t start; /**< Window start, seconds (aligned to the window length) */
+    int32_t min;
+    int32_t max;
+    int32_t mean;
+    int32_t last;
+    uint32_t count;
+};
+
+/**
+ * Receives closed windows.
+ * @param ctx Caller context.
+ * @param series Series index.
+ * @param window Window index (see Rollup::windowName()).
+ * @param result The aggregate.
+ */
+typedef void (*RollupEmit)(void *ctx, uint8_t series, uint8_t window, const RollupResult &result);
+
+/* =======================
+ * Rollup Class
+ * =======================
+ * Each series keeps one running accumulator per window length, so memory does not
+ * depend on the sample rate. Windows are aligned to multiples of their length and
+ * are emitted when a sample or poll() crosses their end.
+ */
+class Rollup
+{
+public:
+    Rollup();
+
+    /**
+     * Adds a sample.
+     * @param series Series index (< ROLLUP_MAX_SERIES).
+     * @param now Time in seconds.
+     * @param value Value in thousandths.
+     * @param emit Called for every window closed by this sample.
+     * @param ctx Callback context.
+     */
+    void add(uint8_t series, uint32_t now, int32_t value, RollupEmit emit, void *ctx);
+
+    /**
+     * Closes the windows that ended without new samples.
+     * @param now Time in seconds.
+     * @param emit Called for every closed window.
+     * @param ctx Callback context.
+     */
+    void poll(uint32_t now, RollupEmit emit, void *ctx);
+
+    /**
+     * Topic suffix of a window ("1m", "15m", "1h").
+     */
+    static const char *windowName(uint8_t window);
+
+private:
+    struct Accumulator
+    {
+        uint32_t start;
+        int32_t min;
+        int32_t max;
+        int64_t sum;
+        int32_t last;
+        uint32_t count;
+    };
+
+    void close(uint8_t series, uint8_t window, RollupEmit emit, void *ctx);
+
+    Accumulator acc[ROLLUP_MAX_SERIES][ROLLUP_WINDOWS];
+};
+
+#endif /* ROLLUP_H_ */
@@ -0,0 +1,189 @@
+/*
+ * rule_engine.h
+ * Description: Edge automations on the gateway: declarative rules compiled to
+ *              bytecode and evaluated when their input topics change.
+ */
+
+#ifndef RULE_ENGINE_H_
+#define RULE_ENGINE_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <FS.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "metrics.h"
+
+/* =======================
+ * Macros
+ * =======================
+ * Programs are fixed, so loading and evaluating rules never allocates.
+ */
+#define RULES_MAX 16                          /**< Rules per program */
+#define RULES_MAX_INPUTS 32                   /**< Distinct input topics (bits of a rule's input mask) */
+#define RULES_MAX_CONSTS 64                   /**< Thresholds and hysteresis bands */
+#define RULES_CODE_SIZE 384                   /**< Bytecode of all the conditions */
+#define RULES_TEXT_SIZE 768                   /**< Topics and output values */
+#define RULES_SOURCE_SIZE 1024                /**< Longest rules text */
+#define RULES_STACK 8                         /**< Evaluation stack depth */
+#define RULES_ERROR_SIZE 64                   /**< Compile error message */
+#define RULES_FILE "/rules.txt"               /**< Last accepted rules text */
+#define RULES_CONFIG_TOPIC "rack0/rules/set"  /**< Replaces the rules (retained by the sender) */
+#define RULES_STATUS_TOPIC "rack0/rules/status" /**< Outcome of the last load, JSON */
+
+/* =======================
+ * Structures
+ * =======================
+ */
+
+/**
+ * Publishes the output of a rule that changed state.
+ * @param ctx Caller context.
+ * @param topic The rule's target topic.
+ * @param value The rule's "then" or "else" value.
+ */
+typedef void (*RuleOutput)(void *ctx, const char *topic, const char *value);
+
+/* =======================
+ * RuleEngine Class
+ * =======================
+ * One rule per line (or ';'), tokens separated by spaces, '#' starts a comment:
+ *
+ *   if <topic> <op> <number> [hyst <number>] {and|or <condition>}
+ *       then <topic> = <value> [else <value>] [min_on <s>] [min_off <s>]
+ *
+ * with <op> one of > < >= <= == !=, and "and" binding tighter than "or". E.g.
+ *
+ *   if rack0/sens/ambient/temperature > 28 hyst 1 then rack0/actu/fan/control0 = 80 else 0 min_on 60
+ *
+ * Each condition compiles to postfix bytecode over the input values, in
+ * thousandths. A rule publishes its "then" value when its condition becomes
+ * true and its "else" value (if any) when it becomes false. Hysteresis widens
+ * a threshold while the rule is on, so a reading hovering around it does not
+ * toggle the output; min_on/min_off hold a state for at least that long, the
+ * postponed change being applied by poll().
+ *
+ * Inputs are matched by the caller (the gateway routes them through its topic
+ * trie) and passed by index to update(), which evaluates only the rules that
+ * read that input. Outputs published from the output callback may feed other
+ * rules; those run once the current evaluation returns. Broker task only.
+ */
+class RuleEngine
+{
+public:
+    RuleEngine();
+
+    /**
+     * Loads the rules saved on flash.
+     * @param fileSystem The file system (LittleFS).
+     * @return true if RULES_FILE exists and compiled.
+     */
+    bool begin(fs::FS &fileSystem);
+
+    /**
+     * Compiles a rules text and, if it is valid, replaces the running rules and
+     * saves the text on flash. Input values are carried over by topic, and every
+     * rule is evaluated on the next poll(). The running rules are kept on error,
+     * and also when the text is the one already running (a retained config
+     * sent again on reconnect).
+     * @param text The rules text (an empty text removes every rule).
+     * @param error Receives "line N: reason" on failure.
+     * @param errorSize Size of error.
+     * @return true if loaded.
+     */
+    bool configure(const char *text, char *error, size_t errorSize);
+
+    /**
+     * Updates an input and evaluates the rules that read it, unless the value
+     * is unchanged.
+     * @param input Input index (< inputCount()).
+     * @param value The value in thousandths.
+     * @param nowMs millis().
+     * @param output Called for every rule that changes state.
+     * @param ctx Callback context.
+     */
+    void update(uint8_t input, int32_t value, uint32_t nowMs, RuleOutput output, void *ctx);
+
+    /**
+     * Evaluates the rules of a new program and applies the state changes that
+     * min_on/min_off postponed.
+     * @param nowMs millis().
+     * @param output Called for every rule that changes state.
+     * @param ctx Callback context.
+     */
+    void poll(uint32_t nowMs, RuleOutput output, void *ctx);
+
+    size_t ruleCount() const { return programs[active].ruleCount; }
+    size_t inputCount() const { return programs[active].inputCount; }
+
+    /**
+     * Topic of an input, for routing.
+     * @param input Input index (< inputCount()).
+     */
+    const char *inputTopic(uint8_t input) const;
+
+    /**
+     * Registers rules/count, rules/evaluations, rules/fired, rules/held and
+     * rules/rejected.
+     * @param registry The registry.
+     */
+    void registerMetrics(MetricsRegistry &registry);
+
+private:
+    struct Input
+    {
+        uint16_t topic; /**< Offset in the text pool */
+        bool valid;     /**< A numeric value was received */
+        int32_t value;
+    };
+
+    struct Rule
+    {
+        uint16_t code;     /**< Offset of the condition in the bytecode */
+        uint32_t inputs;   /**< Mask of the inputs read by the condition */
+        uint16_t target;   /**< Offsets in the text pool */
+        uint16_t onValue;
+        uint16_t offValue; /**< RULE_NO_TEXT without "else" */
+        uint16_t minOnS;
+        uint16_t minOffS;
+        int8_t state;      /**< -1 until first evaluated, then 0 or 1 */
+        bool dirty;        /**< An input changed since the last evaluation */
+        bool held;         /**< A change is postponed by min_on/min_off */
+        uint32_t changedMs;
+    };
+
+    struct Program
+    {
+        uint8_t code[RULES_CODE_SIZE];
+        int32_t consts[RULES_MAX_CONSTS];
+        char text[RULES_TEXT_SIZE];
+        Input inputs[RULES_MAX_INPUTS];
+        Rule rules[RULES_MAX];
+        uint16_t codeLength;
+        uint8_t constCount;
+        uint16_t textLength;
+        uint8_t inputCount;
+        uint8_t ruleCount;
+        uint32_t sourceHash; /**< FNV-1a of the rules text, 0 before the first load */
+    };
+
+    bool compile(Program &program, const char *text, char *error, size_t errorSize);
+    int evaluate(const Program &program, const Rule &rule) const;
+    void apply(Rule &rule, uint32_t nowMs, RuleOutput output, void *ctx);
+    void drain(uint32_t nowMs, RuleOutput output, void *ctx);
+    bool save(const char *text);
+
+    Program programs[2]; /**< Running and staging */
+    uint8_t active;
+    bool evaluating;     /**< Inside drain(): nested updates only mark rules dirty */
+    fs::FS *fs;
+    Gauge loaded;
+    Counter evaluations;
+    Counter fired;
+    Counter holds;
+    Counter rejected;
+};
+
+#endif /* RULE_ENGINE_H_ */
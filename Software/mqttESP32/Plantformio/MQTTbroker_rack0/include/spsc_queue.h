@@ -0,0 +1,92 @@
+/*
+ * spsc_queue.h
+ * Description: Lock-free single-producer single-consumer queue of preallocated slots.
+ */
+
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <atomic>
+#include <stddef.h>
+
+/* =======================
+ * SpscQueue Class
+ * =======================
+ * Ring of N slots shared by exactly one producer and one consumer, which may run
+ * on different cores. Slots are written and read in place: the producer fills
+ * reserve() and publishes it with commit(), the consumer reads front() and frees
+ * it with pop(). Head and tail are each written by a single side, so
+ * acquire/release ordering is enough and no lock or critical section is taken.
+ * N must be a power of two.
+ */
+template <typename T, size_t N>
+class SpscQueue
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    /**
+     * Producer: slot to fill next.
+     * @return The slot, or nullptr if the queue is full.
+     */
+    T *reserve()
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= N)
+        {
+            return nullptr;
+        }
+        return &slots[h & (N - 1)];
+    }
+
+    /**
+     * Producer: makes the slot returned by reserve() visible to the consumer.
+     */
+    void commit()
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * Consumer: oldest committed slot.
+     * @return The slot, or nullptr if the queue is empty.
+     */
+    T *front()
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t)
+        {
+            return nullptr;
+        }
+        return &slots[t & (N - 1)];
+    }
+
+    /**
+     * Consumer: returns the slot from front() to the producer.
+     */
+    void pop()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * Number of committed slots (approximate when called from a third party).
+     */
+    size_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+private:
+    T slots[N];
+    std::atomic<size_t> head; /**< Written by the producer only */
+    std::atomic<size_t> tail; /**< Written by the consumer only */
+};
+
+#endif /* SPSC_QUEUE_H_ */
@@ -0,0 +1,101 @@
+/*
+ * state_cache.h
+ * Description: Last-value cache of the Rack0 sensor and actuator topics.
+ */
+
+#ifndef STATE_CACHE_H_
+#define STATE_CACHE_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/* =======================
+ * Macros
+ * =======================
+ */
+#define STATE_MAX_TOPICS 112                  /**< Cached topics (sensors + actuators of up to 4 racks) */
+#define STATE_VALUE_SIZE 24                   /**< Longest cached payload, including the terminator */
+#define STATE_SNAPSHOT_SIZE 6144              /**< JSON snapshot buffer */
+#define STATE_GET_TOPIC "rack0/state/get"     /**< Request a full snapshot (any payload) */
+#define STATE_SNAPSHOT_TOPIC "rack0/state"    /**< Snapshot response, JSON object topic -> value */
+
+/* =======================
+ * StateCache Class
+ * =======================
+ * Fixed table of topic slots bound at startup, each holding the last payload seen.
+ * Used from the broker task only.
+ */
+class StateCache
+{
+public:
+    StateCache() : count(0), replayDepth(0) {}
+
+    /**
+     * Binds the next slot to a topic.
+     * @param topic The topic string, must outlive the cache.
+     * @return The slot index, or -1 if the table is full.
+     */
+    int bind(const char *topic);
+
+    /**
+     * Stores the last payload of a slot. Longer payloads are not cached.
+     * @param slot The slot index.
+     * @param payload The payload.
+     */
+    void update(int slot, const char *payload);
+
+    /**
+     * Calls fn(topic, value) for every cached slot matching an MQTT topic filter.
+     * @param filter Topic filter, may contain '+' and '#'.
+     * @param fn Callback.
+     */
+    template <typename F>
+    void forEachMatching(const char *filter, F fn) const
+    {
+        for (int slot = 0; slot < count; slot++)
+        {
+            if (valid[slot] && topicMatches(filter, topics[slot]))
+            {
+                fn(topics[slot], values[slot]);
+            }
+        }
+    }
+
+    /**
+     * Writes every cached value as a JSON object {"topic":"value",...}, escaping
+     * quotes, backslashes and control characters.
+     * @param buffer Destination buffer.
+     * @param size Size of the buffer.
+     * @return Length written, 0 if the snapshot does not fit.
+     */
+    size_t snapshot(char *buffer, size_t size) const;
+
+    /**
+     * Marks the start or end of a replay, while cached values are republished.
+     * Subscription handlers use replaying() to avoid re-sending them to the boards.
+     */
+    void beginReplay() { replayDepth++; }
+    void endReplay() { replayDepth--; }
+    bool replaying() const { return replayDepth > 0; }
+
+    /**
+     * MQTT topic filter matching ('+' one level, '#' the remaining levels).
+     * @param filter The topic filter.
+     * @param topic The topic name.
+     * @return true if the topic matches.
+     */
+    static bool topicMatches(const char *filter, const char *topic);
+
+private:
+    const char *topics[STATE_MAX_TOPICS];
+    char values[STATE_MAX_TOPICS][STATE_VALUE_SIZE];
+    bool valid[STATE_MAX_TOPICS];
+    int count;
+    int replayDepth;
+};
+
+#endif /* STATE_CACHE_H_ */
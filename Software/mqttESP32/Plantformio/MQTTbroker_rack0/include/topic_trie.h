@@ -0,0 +1,164 @@
+/*
+ * topic_trie.h
+ * Description: Topic-level trie matching MQTT topics against filters with + and # wildcards.
+ */
+
+#ifndef TOPIC_TRIE_H_
+#define TOPIC_TRIE_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* =======================
+ * Macros
+ * =======================
+ * Pools are fixed, so matching never allocates.
+ */
+#define TRIE_MAX_NODES 256  /**< Topic levels over all filters */
+#define TRIE_MAX_ROUTES 192 /**< Values attached to filters */
+#define TRIE_TEXT_SIZE 2048 /**< Characters of all the levels */
+
+typedef uint16_t TrieValue;
+
+/* =======================
+ * TopicTrie Class
+ * =======================
+ * Each node is one topic level of the inserted filters; "+" and "#" are regular
+ * nodes that the walk treats as wildcards. Matching a topic visits only the
+ * branches whose level is equal to the topic's, "+" or "#", so its cost depends
+ * on the depth of the topic and not on the number of filters. Topics starting
+ * with '$' are not matched by a leading wildcard, as required by MQTT.
+ */
+class TopicTrie
+{
+public:
+    TopicTrie() { clear(); }
+
+    /**
+     * Removes every filter.
+     */
+    void clear();
+
+    /**
+     * Attaches a value to a filter. A filter may hold several values.
+     * @param filter MQTT filter ("rack0/actu/#", "+/sens/+/ph").
+     * @param value Value returned by match().
+     * @return false if the filter is invalid or the pools are full.
+     */
+    bool insert(const char *filter, TrieValue value);
+
+    /**
+     * Calls fn(value) for every value whose filter matches the topic.
+     * @param topic Topic name (no wildcards).
+     * @param fn Callback.
+     * @return Number of values matched.
+     */
+    template <typename Fn>
+    size_t match(const char *topic, Fn fn) const
+    {
+        return walk(0, topic, true, fn);
+    }
+
+    size_t nodeCount() const { return nodes; }
+
+private:
+    struct Node
+    {
+        uint16_t text;   /**< Offset of the level in the text pool */
+        uint8_t length;  /**< Level length */
+        int16_t child;   /**< First child, -1 if none */
+        int16_t sibling; /**< Next child of the parent, -1 if none */
+        int16_t routes;  /**< First value, -1 if none */
+    };
+
+    struct Route
+    {
+        TrieValue value;
+        int16_t next;
+    };
+
+    /**
+     * Matches the rest of a topic below a node.
+     * @param node Node of the levels matched so far.
+     * @param level Start of the next topic level, nullptr once the topic is consumed.
+     * @param first Whether level is the first level of the topic.
+     */
+    template <typename Fn>
+    size_t walk(int16_t node, const char *level, bool first, Fn &fn) const
+    {
+        size_t matched = 0;
+
+        if (!level)
+        {
+            // "a/#" also matches "a"
+            matched += emit(pool[node].routes, fn);
+            for (int16_t c = pool[node].child; c >= 0; c = pool[c].sibling)
+            {
+                if (isWildcard(c, '#'))
+                {
+                    matched += emit(pool[c].routes, fn);
+                }
+            }
+            return matched;
+        }
+
+        const char *end = strchr(level, '/');
+        size_t length = end ? static_cast<size_t>(end - level) : strlen(level);
+        const char *next = end ? end + 1 : nullptr;
+        bool wildcards = !(first && level[0] == '$');
+
+        for (int16_t c = pool[node].child; c >= 0; c = pool[c].sibling)
+        {
+            if (isWildcard(c, '#'))
+            {
+                matched += wildcards ? emit(pool[c].routes, fn) : 0;
+            }
+            else if (isWildcard(c, '+'))
+            {
+                matched += wildcards ? walk(c, next, false, fn) : 0;
+            }
+            else if (pool[c].length == length && memcmp(&text[pool[c].text], level, length) == 0)
+            {
+                matched += walk(c, next, false, fn);
+            }
+        }
+        return matched;
+    }
+
+    template <typename Fn>
+    size_t emit(int16_t route, Fn &fn) const
+    {
+        size_t matched = 0;
+        for (; route >= 0; route = routes[route].next)
+        {
+            fn(routes[route].value);
+            matched++;
+        }
+        return matched;
+    }
+
+    bool isWildcard(int16_t node, char wildcard) const
+    {
+        return pool[node].length == 1 && text[pool[node].text] == wildcard;
+    }
+
+    /**
+     * Finds or creates the child of a node for one level.
+     * @return The child, or -1 if the pools are full.
+     */
+    int16_t child(int16_t node, const char *level, size_t length);
+
+    Node pool[TRIE_MAX_NODES];
+    Route routes[TRIE_MAX_ROUTES];
+    char text[TRIE_TEXT_SIZE];
+    size_t nodes;
+    size_t routeCount;
+    size_t textUsed;
+};
+
+#endif /* TOPIC_TRIE_H_ */
@@ -0,0 +1,147 @@
+/*
+ * ts_codec.h
+ * Description: Bit-packed time-series segment codec (delta-of-delta timestamps, delta values).
+ */
+
+#ifndef TS_CODEC_H_
+#define TS_CODEC_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/* =======================
+ * Macros
+ * =======================
+ * Segment layout: 12-byte header (magic, version, first sample) followed by one
+ * bit-packed record per further sample, MSB first.
+ *
+ *   timestamp delta-of-delta (zigzag)   value delta (zigzag, milli-units)
+ *   0                   : 0             0                   : 0
+ *   10  + 7 bits        : < 128         10  + 7 bits        : < 128
+ *   110 + 12 bits       : < 4096        110 + 14 bits       : < 16384
+ *   111 + 32 bits       : any           111 + 32 bits       : any
+ *
+ * A regular 1 Hz series with a steady reading costs 2 bits per sample. The last
+ * byte is padded with 1 bits, which never decode to a complete record, so a
+ * segment cut at any byte boundary decodes to a prefix of its samples.
+ */
+#define TS_HEADER_SIZE 12     /**< Segment header bytes */
+#define TS_MAGIC0 'T'
+#define TS_MAGIC1 'S'
+#define TS_VERSION 1
+#define TS_MAX_RECORD_BITS 70 /**< Worst-case record (35 + 35 bits) */
+
+/* =======================
+ * Structures
+ * =======================
+ */
+
+/**
+ * One sample: Unix time in seconds and value in thousandths of the sensor unit.
+ */
+struct TsSample
+{
+    uint32_t ts;
+    int32_t value;
+};
+
+/* =======================
+ * TsEncoder Class
+ * =======================
+ * Appends samples to a caller-provided segment buffer.
+ */
+class TsEncoder
+{
+public:
+    TsEncoder() : buffer(nullptr), capacity(0), bitPos(0), lastTs(0), lastDelta(0), lastValue(0), samples(0) {}
+
+    /**
+     * Starts a segment with its first sample, stored in the header.
+     * @param data Segment buffer, cleared by this call.
+     * @param size Size of the buffer (more than TS_HEADER_SIZE).
+     * @param first The first sample.
+     */
+    void begin(uint8_t *data, size_t size, const TsSample &first);
+
+    /**
+     * Appends a sample.
+     * @param sample The sample, not older than the previous one.
+     * @return false if the segment is full (or the sample goes back in time).
+     */
+    bool append(const TsSample &sample);
+
+    /**
+     * Bytes that will not change any more (header plus whole bytes of the bit stream).
+     */
+    size_t completeBytes() const { return bitPos / 8; }
+
+    /**
+     * Pads the last byte and closes the segment.
+     * @return Total segment length in bytes.
+     */
+    size_t finish();
+
+    /**
+     * Copies the segment as it would be if finished now, leaving it open.
+     * @param out Destination buffer, at least as large as the segment buffer.
+     * @return Length copied.
+     */
+    size_t snapshot(uint8_t *out) const;
+
+    uint32_t count() const { return samples; }
+    uint32_t lastTimestamp() const { return lastTs; }
+
+private:
+    void putBits(uint32_t value, uint8_t bits);
+
+    uint8_t *buffer;
+    size_t capacity;
+    size_t bitPos;
+    uint32_t lastTs;
+    int64_t lastDelta;
+    int32_t lastValue;
+    uint32_t samples;
+};
+
+/* =======================
+ * TsDecoder Class
+ * =======================
+ * Reads the samples of a segment in order.
+ */
+class TsDecoder
+{
+public:
+    TsDecoder() : buffer(nullptr), length(0), bitPos(0), lastTs(0), lastDelta(0), lastValue(0), first(false) {}
+
+    /**
+     * Starts decoding a segment.
+     * @param data Segment bytes.
+     * @param size Number of bytes available.
+     * @return false if the header is missing or invalid.
+     */
+    bool begin(const uint8_t *data, size_t size);
+
+    /**
+     * Decodes the next sample.
+     * @param sample Receives the sample.
+     * @return false at the end of the segment.
+     */
+    bool next(TsSample &sample);
+
+private:
+    bool getBits(uint8_t bits, uint32_t &value);
+
+    const uint8_t *buffer;
+    size_t length;
+    size_t bitPos;
+    uint32_t lastTs;
+    int64_t lastDelta;
+    int32_t lastValue;
+    bool first;
+};
+
+#endif /* TS_CODEC_H_ */
@@ -0,0 +1,124 @@
+/*
+ * ts_store.h
+ * Description: Append-only time-series store on the gateway flash (LittleFS).
+ */
+
+#ifndef TS_STORE_H_
+#define TS_STORE_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <FS.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ts_codec.h"
+
+/* =======================
+ * Macros
+ * =======================
+ * Each series is a directory of segments named after their first timestamp
+ * (/ts/<series>/<hex time>). The open segment is encoded in RAM and its finished
+ * bytes are appended to flash every TS_FLUSH_PERIOD_MS, so at most that much
+ * history is lost on a power cut.
+ */
+#define TS_ROOT "/ts"                  /**< Store directory */
+#define TS_MAX_SERIES 24               /**< Upper bound on the series passed to begin() */
+#define TS_SEGMENT_SIZE 2048           /**< Segment size in bytes (RAM per series) */
+#define TS_MAX_SEGMENTS 256            /**< Segments kept per series, at most */
+#define TS_FS_SHARE_PERCENT 60         /**< Share of the file system used by the store */
+#define TS_FLUSH_PERIOD_MS 60000       /**< Open segments written to flash this often */
+#define TS_MIN_VALID_TIME 1704067200UL /**< Samples before 2024-01-01 mean NTP has not synced */
+
+/* =======================
+ * Types
+ * =======================
+ */
+
+/**
+ * Receives query results.
+ * @param ctx Caller context.
+ * @param ts Unix time in seconds (start of the step for aggregated results).
+ * @param value Value in thousandths of the unit (mean over the step).
+ */
+typedef void (*TsEmit)(void *ctx, uint32_t ts, int32_t value);
+
+/* =======================
+ * TimeSeriesStore Class
+ * =======================
+ * Used from the broker task only.
+ */
+class TimeSeriesStore
+{
+public:
+    TimeSeriesStore() : fs(nullptr), maxSegments(0), lastFlush(0), seriesCount(0), seriesData(nullptr) {}
+
+    /**
+     * Binds the store to a mounted file system and allocates the open segments.
+     * The flash share and the RAM are split between the configured series only.
+     * @param fileSystem The file system (LittleFS).
+     * @param fsBytes Total size of the file system, used to size the retention.
+     * @param series Number of series (one per sensor topic of each configured rack).
+     * @return true if successful.
+     */
+    bool begin(fs::FS &fileSystem, size_t fsBytes, size_t series);
+
+    /**
+     * Appends a sample to a series.
+     * @param series Series index (< the count given to begin()).
+     * @param ts Unix time in seconds.
+     * @param value Value in thousandths of the unit.
+     * @return true if stored.
+     */
+    bool append(uint8_t series, uint32_t ts, int32_t value);
+
+    /**
+     * Writes the open segments to flash once per TS_FLUSH_PERIOD_MS.
+     * @param nowMs Current millis().
+     */
+    void poll(uint32_t nowMs);
+
+    /**
+     * Writes the finished bytes of every open segment to flash.
+     */
+    void flush();
+
+    /**
+     * Reads the samples of a series between two times.
+     * @param series Series index.
+     * @param from First time, inclusive.
+     * @param to Last time, inclusive.
+     * @param step Aggregation step in seconds (mean per step), 0 for raw samples.
+     * @param emit Result callback.
+     * @param ctx Callback context.
+     * @return Number of results emitted.
+     */
+    size_t query(uint8_t series, uint32_t from, uint32_t to, uint32_t step, TsEmit emit, void *ctx);
+
+private:
+    struct Series
+    {
+        uint8_t buffer[TS_SEGMENT_SIZE];
+        TsEncoder encoder;
+        bool open = false;
+        uint32_t name = 0;   /**< File name of the open segment */
+        size_t flushed = 0;  /**< Bytes of the open segment already on flash */
+    };
+
+    void segmentPath(char *path, size_t size, uint8_t series, uint32_t name) const;
+    void openSegment(uint8_t series, const TsSample &first);
+    void closeSegment(uint8_t series);
+    void persist(uint8_t series, size_t upTo);
+    size_t listSegments(uint8_t series);
+
+    fs::FS *fs;
+    size_t maxSegments;
+    uint32_t lastFlush;
+    size_t seriesCount;
+    Series *seriesData; /**< seriesCount entries, allocated by begin() */
+    uint32_t segmentNames[TS_MAX_SEGMENTS]; /**< Scratch for listSegments() */
+    uint8_t readBuffer[TS_SEGMENT_SIZE];    /**< Scratch for query() */
+};
+
+#endif /* TS_STORE_H_ */
@@ -0,0 +1,369 @@
+/*
+ * uart_link.h
+ * Description: UART link to a rack board, received through the ESP-IDF UART event queue,
+ *              at a baud rate negotiated with the board and with credit-based flow control.
+ */
+
+#ifndef UART_LINK_H_
+#define UART_LINK_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ * ESP-IDF UART driver and FreeRTOS primitives used by the link tasks.
+ */
+#include <Arduino.h>
+#include <driver/uart.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "line_assembler.h"
+#include "metrics.h"
+#include "rack_proto.h"
+#include "spsc_queue.h"
+
+/* =======================
+ * Macros
+ * =======================
+ * Driver buffers, handoff queues, task configuration, baud negotiation and flow control.
+ */
+#define UART_FRAME_DELIMITER '\n' /**< End of a "topic*value" frame, detected by the UART hardware */
+#define UART_RX_RING_SIZE 16384   /**< Driver RX ring buffer, ~80 ms of a busy board at 2 Mbaud */
+#define UART_TX_RING_SIZE 4096    /**< Driver TX ring buffer, writes return without waiting for the wire */
+#define UART_EVENT_QUEUE_LEN 64   /**< Driver events (pattern, overflow) waiting for the ingest task */
+#define UART_RX_SLOTS 32          /**< Frames waiting for the broker (power of two) */
+#define UART_TX_SLOTS 32          /**< Commands waiting for the egress task (power of two) */
+#define UART_URGENT_SLOTS 8       /**< Urgent commands, written ahead of the others (power of two) */
+#define UART_VALUE_SLOTS 16       /**< Latest-value lines, written after the commands (<= 32) */
+#define UART_TASK_STACK 3072      /**< Ingest and egress task stack in bytes */
+#define UART_TASK_PRIORITY 10     /**< Above the broker task */
+#define UART_TASK_CORE 1          /**< UART work runs away from Wi-Fi and the broker (core 0) */
+
+#define UART_BAUD_DEFAULT 115200  /**< Rate of a board after reset, and the fallback */
+#define UART_BAUD_MAX 2000000     /**< Highest rate proposed to the boards */
+#define UART_BAUD_ID RACK_PROTO_STR(RACK_PROTO_BAUD_ID) /**< Board ID of the control line "100*RATE" (ignored by older boards) */
+#define UART_BAUD_TOPIC RACK_PROTO_BAUD_TOPIC /**< Board answer "baud*RATE", or "baud*0" for a rate it cannot set */
+#define UART_BAUD_REPLY_MS 200    /**< Wait for an answer before giving up on a rate */
+#define UART_BAUD_SETTLE_MS 500   /**< After an unconfirmed rate, longer than the board's 300 ms confirm window */
+#define UART_BAUD_RETRY_MS 20000  /**< Next attempt after a board that did not answer, longer than its silence timeout */
+#define UART_BAUD_KEEPALIVE_MS 5000 /**< Negotiated rate proposed again, keeps the board on it */
+#define UART_BAUD_MISSED 3        /**< Unanswered keepalives before falling back (board resets after 15 s) */
+
+#define UART_CREDIT_ID RACK_PROTO_STR(RACK_PROTO_CREDIT_ID) /**< Board ID of the gateway's grant "101*RECEIVED,FREE" */
+#define UART_CREDIT_TOPIC RACK_PROTO_CREDIT_TOPIC /**< Board grant "credit*RECEIVED,FREE" */
+#define UART_CREDIT_PERIOD_MS 1000 /**< Grants are repeated at least this often, replacing lost ones */
+#define UART_CREDIT_TIMEOUT_MS 3000 /**< Without a grant for this long, frames go to the board unchecked */
+#define UART_CREDIT_SETTLE_MS 100 /**< Idle time after which frames the board has not counted are lost */
+#define UART_RTS_THRESHOLD 100    /**< RX FIFO bytes before RTS is deasserted, with hardware flow control */
+
+/* =======================
+ * Structures
+ * =======================
+ */
+
+/**
+ * Frame received from a rack board, stamped when its delimiter was read.
+ */
+struct UartFrame
+{
+    int64_t rxMicros;                /**< esp_timer time of reception */
+    char line[LINE_ASSEMBLER_SIZE];  /**< Frame without its terminator */
+};
+
+/**
+ * Command waiting to be written to a rack board.
+ */
+struct UartCommand
+{
+    char line[LINE_ASSEMBLER_SIZE];  /**< Command without its terminator */
+    std::atomic<uint32_t> *sentUs;   /**< Stamped with esp_timer time when written, may be nullptr */
+};
+
+/**
+ * Latest value of a slot, written to a rack board as "ID*VALUE".
+ */
+struct UartValue
+{
+    std::atomic<int32_t> id;         /**< Board ID of the line */
+    std::atomic<int32_t> milli;      /**< Value in thousandths */
+};
+
+/* =======================
+ * UartLink Class
+ * =======================
+ * Owns one UART port. An ingest task sleeps on the driver event queue and is
+ * only woken by the hardware when a frame delimiter arrives (or on overflow), so
+ * the work done per second scales with messages instead of bits. An egress task
+ * writes queued commands, urgent ones (safety commands) first, then the latest
+ * value of each value slot (process values), newest wins. Both are pinned
+ * to UART_TASK_CORE; frames and commands cross to the broker core through
+ * lock-free SPSC queues of preallocated slots, values through atomics.
+ *
+ * The link starts at UART_BAUD_DEFAULT and the egress task then negotiates the
+ * fastest rate the board accepts: it proposes "100*RATE", the board answers
+ * "baud*RATE" and switches, and the egress task switches and proposes the same
+ * rate again, which the board confirms. A rate that is refused or not confirmed
+ * sends both ends back to the default rate and the next rate down is tried.
+ * The negotiated rate is proposed again every UART_BAUD_KEEPALIVE_MS; when the
+ * board stops answering (it was reset), the link falls back and renegotiates.
+ * Commands are held while a rate is being switched.
+ *
+ * Flow control is credit based, in both directions. The receiving end grants
+ * "RECEIVED,FREE": how many frames it has received so far (16 bits, wrapping)
+ * and how many it can still queue. The sender holds its frames while
+ * SENT - RECEIVED >= FREE. The gateway grants the free slots of the frame
+ * queue as "101*RECEIVED,FREE" whenever the broker frees half of the last grant,
+ * and every UART_CREDIT_PERIOD_MS; the board grants its line slots as
+ * "credit*RECEIVED,FREE". Because the counts are cumulative, a lost grant is
+ * replaced by the next one. Frames the board never counted (lost on the wire)
+ * are written off once the link has been idle for UART_CREDIT_SETTLE_MS. A board
+ * that does not grant (older firmware) is written to unchecked. With RTS/CTS
+ * pins, the UART hardware also stops the board when the RX FIFO fills.
+ *
+ * The broker side (takeFrame/releaseFrame/println) must be used by one task only.
+ */
+class UartLink
+{
+public:
+    /**
+     * Constructor for UartLink.
+     * @param port ESP-IDF UART port (UART_NUM_1, UART_NUM_2).
+     * @param name Task name prefix, for debugging.
+     */
+    UartLink(uart_port_t port, const char *name);
+
+    /**
+     * Installs the UART driver and starts the ingest and egress tasks.
+     * The link starts at UART_BAUD_DEFAULT.
+     * @param baud Highest rate to negotiate, UART_BAUD_DEFAULT to keep the default.
+     * @param rxPin RX GPIO.
+     * @param txPin TX GPIO.
+     * @param rtsPin RTS GPIO, UART_PIN_NO_CHANGE without hardware flow control.
+     * @param ctsPin CTS GPIO, UART_PIN_NO_CHANGE without hardware flow control.
+     * @return true if successful.
+     */
+    bool begin(uint32_t baud, int rxPin, int txPin, int rtsPin = UART_PIN_NO_CHANGE,
+               int ctsPin = UART_PIN_NO_CHANGE);
+
+    /**
+     * Sets the task notified whenever a frame is queued.
+     * @param task The consumer task (broker).
+     */
+    void setConsumer(TaskHandle_t task) { consumer = task; }
+
+    /**
+     * Oldest received frame, left in its slot until releaseFrame().
+     * The line may be modified in place.
+     * @return The frame, or nullptr if there is none.
+     */
+    UartFrame *takeFrame() { return rxQueue.front(); }
+
+    /**
+     * Returns the slot of the frame from takeFrame() to the ingest task, and
+     * asks the egress task for a grant once half of the last one is used.
+     */
+    void releaseFrame();
+
+    /**
+     * Queues a line for the egress task, which terminates it with "\r\n".
+     * @param line The null-terminated line.
+     * @param sentUs Receives the esp_timer time (low 32 bits) just before the line
+     *               is handed to the driver, nullptr if not needed.
+     * @param urgent true to write it ahead of the lines already queued. Lines
+     *               already in the driver's TX ring still go first.
+     * @return true if queued, false if the queue is full or the line too long.
+     *         The line is not kept: the caller holds it and tries again.
+     */
+    bool println(const char *line, std::atomic<uint32_t> *sentUs = nullptr, bool urgent = false);
+
+    /**
+     * Sets the latest value of a slot, written as "ID*VALUE" once the queued
+     * commands are out. A value not written yet is replaced, so a flood of
+     * readings costs one line per slot and never takes the commands' room.
+     * @param slot The slot (< UART_VALUE_SLOTS).
+     * @param id Board ID of the line.
+     * @param milli The value in thousandths.
+     * @return false if the slot is out of range.
+     */
+    bool setValue(uint8_t slot, int id, int32_t milli);
+
+    /**
+     * Whether println() has room for one more line on a lane.
+     * @param urgent The urgent lane.
+     */
+    bool canQueue(bool urgent) { return (urgent ? urgentQueue.reserve() : txQueue.reserve()) != nullptr; }
+
+    /**
+     * Current baud rate.
+     */
+    uint32_t baudRate() const { return static_cast<uint32_t>(baud.value()); }
+
+    /**
+     * Frames lost to a full queue or a driver overflow.
+     */
+    uint32_t droppedMessages() const { return dropped.value(); }
+
+    /**
+     * Lines println() refused because their queue was full.
+     */
+    uint32_t refusedCommands() const { return refusedTx.value(); }
+
+    /**
+     * Values replaced by setValue() before being written.
+     */
+    uint32_t coalescedValues() const { return valuesCoalesced.value(); }
+
+    /**
+     * Registers the link's metrics as "<prefix>/frames", "<prefix>/dropped", ...
+     * @param registry The registry.
+     * @param prefix Name prefix (e.g. "uart/rack0/sens").
+     */
+    void registerMetrics(MetricsRegistry &registry, const char *prefix);
+
+    /**
+     * Samples the queue depth and throughput gauges, from the broker task before publication.
+     */
+    void sampleMetrics();
+
+    /**
+     * UART-to-publish latency, recorded by the broker task.
+     */
+    Histogram latency;
+
+private:
+    static void ingestTask(void *arg);
+    static void egressTask(void *arg);
+
+    /**
+     * Waits on the driver event queue forever.
+     */
+    void ingest();
+
+    /**
+     * Writes queued commands and values forever.
+     */
+    void egress();
+
+    /**
+     * Hands one command to the driver.
+     * @param command The command.
+     */
+    void write(const UartCommand &command);
+
+    /**
+     * Hands the next value waiting to the driver, slots in turn.
+     * @param dirty The slots waiting.
+     * @return false if the line could not be encoded (nothing written).
+     */
+    bool writeValue(uint32_t dirty);
+
+    /**
+     * Advances the baud negotiation, from the egress task.
+     * @param nowMs millis().
+     * @return Milliseconds until the next step.
+     */
+    uint32_t negotiate(uint32_t nowMs);
+
+    /**
+     * Applies the board's latest grant, from the egress task.
+     * @param nowMs millis().
+     */
+    void takeGrant(uint32_t nowMs);
+
+    /**
+     * Whether the board has room for one more frame, from the egress task.
+     * @param nowMs millis().
+     * @return true if a frame may be written.
+     */
+    bool hasCredit(uint32_t nowMs);
+
+    /**
+     * Writes "101*RECEIVED,FREE" when asked by releaseFrame() or when the last
+     * grant is UART_CREDIT_PERIOD_MS old, from the egress task.
+     * @param nowMs millis().
+     * @return Milliseconds until the next periodic grant.
+     */
+    uint32_t grantCredit(uint32_t nowMs);
+
+    /**
+     * Writes the control line "100*RATE".
+     * @param rate The proposed rate.
+     */
+    void proposeBaud(uint32_t rate);
+
+    /**
+     * Switches the port to a rate once the lines already written are out.
+     * @param rate The new rate.
+     */
+    void setBaud(uint32_t rate);
+
+    enum class BaudState : uint8_t
+    {
+        IDLE,       /**< On the default rate, next proposal at baudDeadlineMs */
+        PROPOSED,   /**< Waiting for the board to accept the candidate */
+        CONFIRMING, /**< Switched, waiting for the board to confirm the candidate */
+        NEGOTIATED  /**< On the candidate, keepalive at baudDeadlineMs */
+    };
+
+    /**
+     * Reads bytes already in the RX ring buffer through the assembler.
+     * @param length Number of bytes to read.
+     */
+    void readFrame(size_t length);
+
+    uart_port_t port;
+    const char *name;
+    QueueHandle_t events;
+    TaskHandle_t egressHandle;
+    volatile TaskHandle_t consumer;
+    LineAssembler assembler;
+    SpscQueue<UartFrame, UART_RX_SLOTS> rxQueue;   /**< Ingest task -> broker */
+    SpscQueue<UartCommand, UART_TX_SLOTS> txQueue; /**< Broker -> egress task */
+    SpscQueue<UartCommand, UART_URGENT_SLOTS> urgentQueue; /**< Broker -> egress task, drained first */
+    UartValue values[UART_VALUE_SLOTS]; /**< Broker -> egress task, drained last */
+    std::atomic<uint32_t> valuesDirty; /**< Bit per value not written yet */
+    uint8_t valueNext;                 /**< First value slot looked at, egress task only */
+    uint32_t maxBaud;                  /**< Highest rate to negotiate */
+    BaudState baudState;               /**< Egress task only */
+    uint8_t candidate;                 /**< Index of the rate being negotiated */
+    uint8_t missedKeepalives;
+    uint32_t baudDeadlineMs;
+    std::atomic<uint32_t> baudAnswer;  /**< Last "baud*RATE" read by the ingest task */
+    std::atomic<uint16_t> rxCount;     /**< Frames received from the board, ingest task */
+    std::atomic<uint32_t> boardGrant;  /**< Last "credit*RECEIVED,FREE" (RECEIVED << 16 | FREE) */
+    std::atomic<bool> boardGranted;    /**< boardGrant not applied yet */
+    std::atomic<uint16_t> grantReceived; /**< rxCount in the last grant to the board */
+    std::atomic<uint16_t> grantFree;   /**< Free slots in the last grant to the board */
+    std::atomic<bool> grantWanted;     /**< Set by the broker task, cleared by the egress task */
+    uint32_t grantMs;                  /**< Last grant written, egress task only */
+    uint16_t txCount;                  /**< Frames written to the board, egress task only */
+    uint16_t boardReceived;            /**< From the board's last grant */
+    uint16_t boardFree;
+    uint32_t boardGrantMs;
+    uint32_t lastWriteMs;
+    bool creditActive;                 /**< The board grants credit */
+    uint32_t sampledMs;                /**< Throughput sampling, broker task only */
+    uint32_t sampledRxBytes;
+    uint32_t sampledTxBytes;
+    Counter frames;        /**< Frames queued for the broker */
+    Counter dropped;       /**< Frames lost */
+    Counter framingErrors; /**< Frame/parity errors and overlong lines */
+    Counter commands;      /**< Commands written */
+    Counter urgentCommands; /**< Of which on the urgent lane */
+    Counter refusedTx;     /**< Lines refused by a full queue, kept by the caller */
+    Counter valueLines;    /**< Values written */
+    Counter valuesCoalesced; /**< Values replaced before being written */
+    Counter rxBytes;       /**< Bytes read from the driver */
+    Counter txBytes;       /**< Bytes handed to the driver */
+    Counter baudFallbacks; /**< Negotiated rates lost to an unanswered keepalive */
+    Counter creditStalls;  /**< Times commands were held for lack of credit */
+    Counter creditLost;    /**< Frames written but never counted by the board */
+    Gauge txCredit;        /**< Frames the board can still take, -1 when it does not grant */
+    Gauge baud;            /**< Current rate */
+    Gauge rxThroughput;    /**< Bytes per second read, between the last two samples */
+    Gauge txThroughput;    /**< Bytes per second written, between the last two samples */
+    Gauge rxBacklog;       /**< Frames waiting for the broker */
+    Gauge txBacklog;       /**< Commands and values waiting for the egress task */
+};
+
+#endif /* UART_LINK_H_ */
@@ -0,0 +1,176 @@
+/*
+ * uplink.h
+ * Description: Store-and-forward bridge from the local broker to an upstream broker.
+ */
+
+#ifndef UPLINK_H_
+#define UPLINK_H_
+
+/* =======================
+ * Libraries
+ * =======================
+ */
+#include <Arduino.h>
+#include <FS.h>
+#include <PubSubClient.h>
+#include <WiFiClient.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "metrics.h"
+#include "persistent_queue.h"
+#include "spsc_queue.h"
+
+/* =======================
+ * Macros
+ * =======================
+ * Queueing, reconnection and task configuration.
+ */
+#define UPLINK_RAM_SLOTS 16            /**< Messages waiting for the uplink task (power of two) */
+#define UPLINK_PAYLOAD_SIZE 192        /**< Longest forwarded payload, including the terminator */
+#define UPLINK_BATCH 32                /**< Messages sent per pass, so the client keeps being serviced */
+#define UPLINK_BACKOFF_MIN_MS 1000     /**< First retry after a failed connection */
+#define UPLINK_BACKOFF_MAX_MS 60000    /**< Retry interval cap */
+#define UPLINK_SOCKET_TIMEOUT_S 3      /**< Longest wait for the CONNACK */
+#define UPLINK_KEEPALIVE_S 30          /**< MQTT keep-alive towards the upstream broker */
+#define UPLINK_POLL_MS 50              /**< Longest sleep of the uplink task */
+#define UPLINK_TASK_STACK 6144         /**< Uplink task stack in bytes */
+#define UPLINK_TASK_PRIORITY 3         /**< Below the broker and UART tasks */
+#define UPLINK_TASK_CORE 1             /**< A blocking connect never stalls the broker (core 0) */
+
+/* =======================
+ * Structures
+ * =======================
+ */
+
+/**
+ * Upstream broker and the local topics forwarded to it.
+ */
+struct UplinkConfig
+{
+    const char *host;              /**< Upstream broker, empty to disable the uplink */
+    uint16_t port;
+    const char *clientId;
+    const char *username;          /**< nullptr for anonymous */
+    const char *password;
+    const char *topicPrefix;       /**< Prepended to every forwarded topic ("" for none) */
+    const char *const *filters;    /**< MQTT filters (+ and #) of the forwarded topics */
+    size_t filterCount;
+};
+
+/**
+ * Message waiting for the uplink task.
+ */
+struct UplinkMessage
+{
+    char topic[PQ_TOPIC_SIZE];
+    char payload[UPLINK_PAYLOAD_SIZE];
+};
+
+/* =======================
+ * Uplink Class
+ * =======================
+ * The broker task hands the messages matching the configured filters over
+ * through a lock-free SPSC queue.
+ * The uplink task owns the upstream client: while connected it forwards them
+ * directly; while disconnected (or while older messages are still spooled) it
+ * appends them to a PersistentQueue on flash, which is drained in order once the
+ * connection is back. Reconnection is attempted at most once per backoff interval,
+ * doubling up to UPLINK_BACKOFF_MAX_MS, so an unreachable upstream costs one
+ * connection attempt per interval instead of a blocking retry loop.
+ */
+class Uplink
+{
+public:
+    Uplink();
+
+    /**
+     * Opens the spool and starts the uplink task.
+     * @param fileSystem The file system holding the spool (LittleFS).
+     * @param config The upstream broker; must outlive the uplink.
+     * @return true if started, false if disabled or on error.
+     */
+    bool begin(fs::FS &fileSystem, const UplinkConfig &config);
+
+    /**
+     * Queues a message for the upstream broker. Broker task only.
+     * @return false if the uplink is disabled, the queue is full or the message too long.
+     */
+    bool enqueue(const char *topic, const char *payload);
+
+    bool enabled() const { return task != nullptr; }
+    bool connected() const { return online; }
+
+    /**
+     * Messages delivered to the upstream broker.
+     */
+    uint32_t forwardedMessages() const { return forwarded.value(); }
+
+    /**
+     * Messages written to the flash spool while the upstream was unreachable.
+     */
+    uint32_t spooledMessages() const { return spooled.value(); }
+
+    /**
+     * Messages lost to a full RAM queue, an oversized payload or a spool error.
+     */
+    uint32_t droppedMessages() const { return dropped.value(); }
+
+    /**
+     * Spool segments discarded because the outage outlasted the flash budget.
+     */
+    uint32_t droppedSegments() const { return spool.droppedSegments(); }
+
+    /**
+     * Registers "uplink/forwarded", "uplink/spooled", "uplink/dropped" and
+     * "uplink/connected".
+     * @param registry The registry.
+     */
+    void registerMetrics(MetricsRegistry &registry);
+
+private:
+    static void uplinkTask(void *arg);
+
+    /**
+     * Services the connection and the queues forever.
+     */
+    void run();
+
+    /**
+     * Attempts a connection and schedules the next one on failure.
+     */
+    void connect();
+
+    /**
+     * Moves every queued message to the flash spool.
+     */
+    void spoolPending();
+
+    /**
+     * Sends up to UPLINK_BATCH messages, spooled ones first.
+     */
+    void drain();
+
+    /**
+     * Publishes one message with the configured prefix.
+     * @return false if the client refused it (connection lost).
+     */
+    bool send(const char *topic, const char *payload);
+
+    const UplinkConfig *config;
+    WiFiClient net;
+    PubSubClient client;
+    PersistentQueue spool;
+    SpscQueue<UplinkMessage, UPLINK_RAM_SLOTS> queue; /**< Broker -> uplink task */
+    TaskHandle_t task;
+    volatile bool online;
+    uint32_t backoff;
+    uint32_t lastAttempt;
+    char spoolTopic[PQ_TOPIC_SIZE];
+    char spoolPayload[PQ_PAYLOAD_SIZE];
+    Counter forwarded;
+    Counter spooled;
+    Counter dropped; /**< Counted by the broker task (enqueue) and the uplink task */
+    Gauge onlineGauge;
+};
+
+#endif /* UPLINK_H_ */
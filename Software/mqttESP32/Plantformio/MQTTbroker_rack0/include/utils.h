@@ -17,6 +17,20 @@
 #include "PicoMQTT.h"  // Lightweight MQTT server library
 #include <Arduino.h>   // Core Arduino functionalities
 #include <IPAddress.h> // IP Address utility class
+#include "rack_proto.h"      // Wire protocol shared with the rack boards
+#include "line_assembler.h" // Non-blocking UART frame assembly
+#include "uart_link.h"      // Event-driven UART links to the rack boards
+#include "state_cache.h"    // Last value of every Rack0 topic
+#include "ts_store.h"       // Sensor history on flash
+#include "rollup.h"         // 1m/15m/1h sensor aggregates
+#include "uplink.h"         // Store-and-forward to an upstream broker
+#include "topic_trie.h"     // Wildcard topic routing
+#include "metrics.h"        // $SYS counters, gauges and histograms
+#include "message_pool.h"   // Fixed buffers for incoming payloads
+#include "heap_monitor.h"   // Heap fragmentation and allocation counts
+#include "command_tracker.h" // Command sequence numbers, ACKs and retries
+#include "command_shaper.h"  // Command coalescing and rate limiting
+#include "rule_engine.h"     // Edge automations
 
 /* =======================
  * Macros
@@ -26,6 +40,38 @@
 #define WIFI_SSID ""          /**< WiFi network SSID */
 #define WIFI_PASSWORD ""      /**< WiFi network password */
 #define MQTT_BROKER_PORT 1883 /**< MQTT broker listening port */
+#define PV_ID_BASE RACK_PROTO_PV_ID_BASE /**< Actuator board ID of forwarded process values (+ SensorTopic) */
+#define SERIAL_LINK_COUNT 1   /**< Serial ports polled by the broker loop (PC console) */
+#define NTP_SERVER "pool.ntp.org"          /**< Time source for the sensor history */
+#define TS_QUERY_TOPIC "rack0/ts/query"    /**< History request: "topic,from,to,step" (Unix s, step 0 = raw) */
+#define TS_RESULT_TOPIC "rack0/ts/result"  /**< History response, JSON chunks */
+#define TS_REPLY_SIZE 1024                 /**< Largest response chunk */
+#define ROLLUP_TOPIC_SUFFIX "/agg/"        /**< Aggregates on "<sensor topic>/agg/1m|15m|1h" */
+#define CMD_RESULT_SUFFIX "/cmd/result"    /**< Outcome of each tracked command on "<rack prefix>/cmd/result" */
+#define RACK_MAX 4                         /**< Racks served by one gateway */
+#define RACK_TOPIC_SIZE 64                 /**< Longest "<rack prefix>/<topic>" */
+#define UPLINK_HOST ""                     /**< Upstream broker, empty disables the uplink */
+#define UPLINK_PORT 1883                   /**< Upstream broker port */
+#define UPLINK_CLIENT_ID "rack0-gateway"   /**< Client ID at the upstream broker */
+#define UPLINK_TOPIC_PREFIX ""             /**< Prepended to forwarded topics (e.g. "site0/") */
+#define PAYLOAD_POOL_BLOCK_SIZE 256        /**< Longest routed payload, including the terminator */
+#define PAYLOAD_POOL_BLOCKS 4              /**< Payloads in flight (routing nests on local publishes) */
+
+/**
+ * Per-message prints on the PC Serial (every command and published line).
+ * Off by default: enable with build_flags = -DBRIDGE_DEBUG=1.
+ */
+#ifndef BRIDGE_DEBUG
+#define BRIDGE_DEBUG 0
+#endif
+#if BRIDGE_DEBUG
+#define DEBUG_PRINTF(...) Serial.printf(__VA_ARGS__)
+#else
+#define DEBUG_PRINTF(...) \
+    do                    \
+    {                     \
+    } while (0)
+#endif
 
 /* =======================
  * Enums
@@ -61,9 +107,45 @@ enum class ActuatorTopic
     RACK0_FAN_CONTROL0,       /**< Fan control 0 actuator topic */
     RACK0_FAN_CONTROL1,       /**< Fan control 1 actuator topic */
     RACK0_HUMIDIFIER_CONTROL, /**< Humidifier control actuator topic */
+    RACK0_PWM_FREQ_TIM3,      /**< TIM3 PWM frequency (Hz) configuration topic */
+    RACK0_PWM_FREQ_TIM4,      /**< TIM4 PWM frequency (Hz) configuration topic */
+    RACK0_FAN_RPM0,           /**< Fan 0 closed-loop speed (RPM) topic */
+    RACK0_FAN_RPM1,           /**< Fan 1 closed-loop speed (RPM) topic */
+    RACK0_PID_SETPOINT0,      /**< PID loop 0 setpoint topic */
+    RACK0_PID_SETPOINT1,      /**< PID loop 1 setpoint topic */
+    RACK0_PID_ENABLE0,        /**< PID loop 0 enable topic */
+    RACK0_PID_ENABLE1,        /**< PID loop 1 enable topic */
+    RACK0_HUMIDIFIER_SYNC,    /**< Humidifier actual state (resync, no press) topic */
+    RACK0_RTC_TIME,           /**< Actuator board time of day (HHMM) topic */
+    RACK0_SCHEDULE_ENABLE,    /**< On-device schedule enable topic */
     ACTUATOR_COUNT            /**< Total number of actuator topics */
 };
 
+/**
+ * Wire protocol of a rack's boards.
+ */
+enum class RackProtocol
+{
+    TEXT_V1, /**< Commands "ID*VAL\r\n", frames "topic*value\r\n" */
+    TEXT_V2  /**< TEXT_V1, plus actuator commands "ID*VAL#SEQ\r\n" answered by "ack*SEQ,CODE,APPLY_US\r\n" */
+};
+
+/* =======================
+ * Structures
+ * =======================
+ */
+
+/**
+ * One rack served by the gateway. Its topics are "<prefix>/<topic table entry>".
+ */
+struct RackConfig
+{
+    const char *prefix;    /**< First topic level ("rack0") */
+    UartLink *actuators;   /**< Actuator board link, nullptr if absent */
+    UartLink *sensors;     /**< Sensor board link, nullptr if absent */
+    RackProtocol protocol; /**< Protocol of both boards */
+};
+
 /* =======================
  * Static IP Configuration
  * =======================
@@ -75,41 +157,145 @@ extern IPAddress gateway;  /**< Network gateway */
 extern IPAddress subnet;   /**< Network subnet mask */
 extern IPAddress dns;      /**< DNS server address */
 
+/* =======================
+ * UART Links
+ * =======================
+ * Links to the rack boards, defined in the corresponding .cpp file.
+ */
+extern UartLink actuatorLink; /**< UART1, actuator board */
+extern UartLink sensorLink;   /**< UART2, sensor board */
+
+/* =======================
+ * Rack Table
+ * =======================
+ * The position in the table is the rack ID used by the router.
+ */
+extern const RackConfig racks[];
+extern const size_t rackCount;
+
+/* =======================
+ * State Cache
+ * =======================
+ * Last value of each sensor and actuator topic, defined in the corresponding .cpp file.
+ */
+extern StateCache stateCache;
+
+/* =======================
+ * Time-Series Store
+ * =======================
+ * Sensor history on LittleFS, one series per SensorTopic.
+ */
+extern TimeSeriesStore tsStore;
+
+/* =======================
+ * Rollups
+ * =======================
+ * Windowed aggregates of the sensor topics.
+ */
+extern Rollup rollup;
+
+/* =======================
+ * Uplink
+ * =======================
+ * Forwarding of selected local topics to the upstream broker.
+ */
+extern Uplink uplink;
+extern const UplinkConfig uplinkConfig;
+
+/* =======================
+ * Rules
+ * =======================
+ * Edge automations, loaded from flash and RULES_CONFIG_TOPIC.
+ */
+extern RuleEngine ruleEngine;
+
+/* =======================
+ * Metrics
+ * =======================
+ * Runtime metrics published under METRICS_TOPIC_PREFIX.
+ */
+extern MetricsRegistry metrics;
+
 /* =======================
  * Function Prototypes
  * =======================
  * Declare utility functions for topic handling.
  */
+class MyMQTT;
 
 /**
  * Retrieves the MQTT topic string for a specific sensor.
  * @param sensor SensorTopic enum value.
+ * @param rack Rack ID.
  * @return Corresponding topic string.
  */
-std::string get_sensor_topic(SensorTopic sensor);
+const char *get_sensor_topic(SensorTopic sensor, uint8_t rack = 0);
 
 /**
  * Retrieves the MQTT topic string for a specific actuator.
  * @param actuator ActuatorTopic enum value.
+ * @param rack Rack ID.
  * @return Corresponding topic string.
  */
-std::string get_actuator_topic(ActuatorTopic actuator);
+const char *get_actuator_topic(ActuatorTopic actuator, uint8_t rack = 0);
+
+/**
+ * Parses a decimal payload into thousandths (e.g. "23.45" -> 23450).
+ * @param text The payload.
+ * @param value Receives the value.
+ * @return true if the payload is a number.
+ */
+bool parseMilli(const char *text, int32_t &value);
+
+/**
+ * Formats thousandths as a decimal number (e.g. 23450 -> "23.450").
+ * @param buffer Destination buffer.
+ * @param size Size of the buffer.
+ * @param value The value in thousandths.
+ * @return Length written.
+ */
+int formatMilli(char *buffer, size_t size, int32_t value);
+
+/**
+ * Current time in seconds: Unix time once NTP has synced, uptime before that.
+ */
+uint32_t nowSeconds();
+
+/**
+ * Looks up the series of a sensor topic.
+ * @param topic The topic string.
+ * @return rack * SENSOR_COUNT + SensorTopic index, or -1 if the topic is not a sensor topic.
+ */
+int findSensorTopic(const char *topic);
 
 /**
  * Handles incoming messages for actuator topics.
- * Sends payload data to the appropriate actuator device via UART.
- * @param topic The MQTT topic string.
+ * Sends payload data to the rack's actuator device via UART, through the
+ * command shaper, formatted on the stack without heap allocations.
+ * @param rack The rack of the topic.
+ * @param actuator The actuator of the topic.
  * @param payload The message payload associated with the topic.
+ * @param broker Publishes the result of a command the link could not queue.
  */
-void handleActuatorTopic(const char *topic, const char *payload);
+void handleActuatorTopic(uint8_t rack, ActuatorTopic actuator, const char *payload, MyMQTT &broker);
 
 /**
  * Handles incoming messages for sensor topics.
- * Sends payload data to the appropriate sensor device via UART.
- * @param topic The MQTT topic string.
+ * Sends payload data to the rack's sensor device via UART,
+ * formatted on the stack without heap allocations.
+ * @param rack The rack of the topic.
+ * @param sensor The sensor of the topic.
  * @param payload The message payload associated with the topic.
  */
-void handleSensorTopic(const char *topic, const char *payload);
+void handleSensorTopic(uint8_t rack, SensorTopic sensor, const char *payload);
+
+/**
+ * Forwards a sensor reading to the actuator device of the same rack via UART,
+ * so its PID loops get process values without a round trip through MQTT.
+ * @param topic The MQTT topic string.
+ * @param payload The sensor value.
+ */
+void forwardProcessValue(const char *topic, const char *payload);
 
 /* =======================
  * MyMQTT Class
@@ -140,13 +326,88 @@ public:
 
     /**
      * Forwards UART data as MQTT messages.
-     * Parses incoming data for topic and payload.
+     * Drains only the bytes already received, so it never blocks the broker loop,
+     * and publishes every complete "topic*value" line.
      * @param serialPort The UART port for communication.
      * @param broker The MQTT server instance.
      */
     void UART_MQTT(HardwareSerial &serialPort, MyMQTT &broker);
 
+    /**
+     * Forwards the frames collected by a UART link as MQTT messages.
+     * The first topic level sent by the board is replaced by the rack prefix, so
+     * boards running the same firmware can serve any rack.
+     * Must be called from the broker task (the link's single consumer).
+     * @param rack The rack of the link.
+     * @param link The UART link.
+     * @param broker The MQTT server instance.
+     * @return Number of frames published.
+     */
+    size_t UART_MQTT(uint8_t rack, UartLink &link, MyMQTT &broker);
+
+    /**
+     * Publishes the whole state cache as one JSON message on STATE_SNAPSHOT_TOPIC.
+     */
+    void publishSnapshot();
+
+    /**
+     * Answers a history request on TS_RESULT_TOPIC.
+     * @param request "topic,from,to,step".
+     */
+    void handleHistoryQuery(const char *request);
+
+    /**
+     * Feeds a sensor reading to the flash history and the rollups.
+     * @param rack The rack.
+     * @param sensor The sensor.
+     * @param payload The reading.
+     */
+    void recordReading(uint8_t rack, SensorTopic sensor, const char *payload);
+
+    /**
+     * Publishes the rollup windows that ended without new readings.
+     */
+    void pollRollups();
+
+    /**
+     * Sends the actuator commands held by the shaper, resends the ones whose ACK
+     * is overdue and reports the ones that ran out of retries.
+     */
+    void pollCommands();
+
+    /**
+     * Loads the rules received on RULES_CONFIG_TOPIC, reports the outcome on
+     * RULES_STATUS_TOPIC and applies the rule changes held by min_on/min_off.
+     */
+    void pollRules();
+
+    /**
+     * Registers the gateway, link and uplink metrics. Called from setup(), before
+     * the broker task starts.
+     */
+    void registerMetrics();
+
+    /**
+     * Samples the gauges and publishes every metric on METRICS_TOPIC_PREFIX.
+     * Broker task only.
+     */
+    void publishMetrics();
+
+    /**
+     * Duration of one broker loop iteration, recorded by the broker task.
+     */
+    Histogram loopTime;
+
 protected:
+    /**
+     * Replays the cached value of a new exact-topic subscription as a retained
+     * message, so dashboards show the current state as soon as they connect.
+     * Wildcard subscribers request a snapshot on STATE_GET_TOPIC instead.
+     * @param client_id The subscribing client.
+     * @param topic The subscribed topic filter.
+     */
+    virtual void on_subscribe(const char *client_id, const char *topic) override;
+
     /**
      * Overrides the authentication mechanism for the MQTT server.
      * Validates client credentials (username and password).
@@ -156,6 +417,53 @@ protected:
      * @return Connection return code indicating authentication status.
      */
     virtual PicoMQTT::ConnectReturnCode auth(const char *client_id, const char *username, const char *password) override;
+
+private:
+    /**
+     * Partial frame state of one serial port.
+     */
+    struct SerialLink
+    {
+        HardwareSerial *port = nullptr;
+        LineAssembler assembler;
+    };
+
+    SerialLink serialLinks[SERIAL_LINK_COUNT];
+
+    /**
+     * Returns the assembler bound to a serial port, binding a free one on first use.
+     * @param serialPort The UART port.
+     * @return The assembler, or nullptr if every link is taken.
+     */
+    LineAssembler *assemblerFor(HardwareSerial &serialPort);
+
+    /**
+     * Fills the routing trie from the topic tables, the uplink filters and the
+     * rule inputs. Must not run inside a walk of the trie.
+     */
+    void buildRoutes();
+
+    /**
+     * Reads an incoming payload into a pooled buffer and routes it.
+     * @param topic The topic name.
+     * @param payload The payload, streamed by the library.
+     */
+    void routeIncoming(const char *topic, Stream &payload);
+
+    /**
+     * Dispatches a message to the handlers of every route matching its topic.
+     * @param topic The topic name.
+     * @param payload The payload.
+     */
+    void routeMessage(const char *topic, const char *payload);
+
+    /**
+     * Publishes one complete "topic*value" line.
+     * @param line The line, split in place.
+     * @param broker The MQTT server instance.
+     * @param rackPrefix Replaces the first topic level, nullptr to publish the topic as sent.
+     */
+    void publishLine(char *line, MyMQTT &broker, const char *rackPrefix = nullptr);
 };
 
 #endif /* UTILS_H_ */
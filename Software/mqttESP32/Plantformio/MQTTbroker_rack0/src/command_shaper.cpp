@@ -0,0 +1,194 @@
+/*
+ * command_shaper.cpp
+ * Description: Implementation of the actuator command shaper.
+ */
+
+#include "command_shaper.h"
+#include <stdio.h>
+
+CommandShaper::CommandShaper()
+{
+    for (size_t rack = 0; rack < SHAPER_RACKS; rack++)
+    {
+        for (Slot &slot : slots[rack])
+        {
+            slot.pending = false;
+            slot.urgent = false;
+            slot.sentMs = 0u - SHAPER_WINDOW_MS; // The first command of each actuator is never held
+        }
+        buckets[rack] = {SHAPER_BURST * 1000u, 0, 0, 0, 0};
+    }
+}
+
+/**
+ * Refills a bucket for the time elapsed and takes one token from it.
+ * @return false if the bucket holds less than one token.
+ */
+bool CommandShaper::takeToken(Bucket &bucket, uint32_t nowMs)
+{
+    // SHAPER_RATE commands per second are SHAPER_RATE thousandths per millisecond
+    uint64_t tokens = bucket.tokens + static_cast<uint64_t>(nowMs - bucket.refilledMs) * SHAPER_RATE;
+    bucket.tokens = tokens > SHAPER_BURST * 1000u ? SHAPER_BURST * 1000u : static_cast<uint32_t>(tokens);
+    bucket.refilledMs = nowMs;
+
+    if (bucket.tokens < 1000)
+    {
+        return false;
+    }
+    bucket.tokens -= 1000;
+    return true;
+}
+
+/**
+ * Keeps a value in its slot for poll(), replacing the one waiting.
+ */
+void CommandShaper::hold(Bucket &bucket, Slot &slot, const char *value, uint32_t receivedUs, bool urgent)
+{
+    if (slot.pending)
+    {
+        coalesced.add(); // Latest value wins
+        if (slot.urgent)
+        {
+            bucket.urgent--;
+        }
+    }
+    else
+    {
+        slot.pending = true;
+        bucket.pending++;
+        deferred.add();
+    }
+    slot.urgent = urgent;
+    if (urgent)
+    {
+        bucket.urgent++;
+    }
+    snprintf(slot.value, sizeof(slot.value), "%s", value);
+    slot.receivedUs = receivedUs;
+}
+
+/**
+ * Frees a waiting slot once its command is sent or dropped.
+ */
+void CommandShaper::release(Bucket &bucket, Slot &slot)
+{
+    if (slot.urgent)
+    {
+        slot.urgent = false;
+        bucket.urgent--;
+    }
+    slot.pending = false;
+    bucket.pending--;
+}
+
+/**
+ * Sends a command now or keeps it for poll().
+ */
+bool CommandShaper::submit(uint8_t rack, uint8_t id, const char *value, uint32_t receivedUs, uint32_t nowMs,
+                           bool urgent, ShaperSend send, void *ctx)
+{
+    if (rack >= SHAPER_RACKS || id >= SHAPER_ACTUATORS)
+    {
+        return send(ctx, rack, id, value, receivedUs, urgent);
+    }
+
+    Slot &slot = slots[rack][id];
+    Bucket &bucket = buckets[rack];
+
+    if (urgent)
+    {
+        if (send(ctx, rack, id, value, receivedUs, true))
+        {
+            if (slot.pending)
+            {
+                release(bucket, slot);
+                coalesced.add();
+            }
+            slot.sentMs = nowMs;
+            urgentCommands.add();
+            return true;
+        }
+    }
+    else if (!slot.pending && nowMs - slot.sentMs >= SHAPER_WINDOW_MS && takeToken(bucket, nowMs))
+    {
+        if (send(ctx, rack, id, value, receivedUs, false))
+        {
+            slot.sentMs = nowMs;
+            return true;
+        }
+        bucket.tokens += 1000; // Link queue full: refund the token and keep the value
+    }
+
+    hold(bucket, slot, value, receivedUs, urgent);
+    return true;
+}
+
+/**
+ * Sends the waiting urgent commands, then the others whose window has elapsed,
+ * as tokens allow.
+ */
+void CommandShaper::poll(uint32_t nowMs, ShaperSend send, void *ctx)
+{
+    for (uint8_t rack = 0; rack < SHAPER_RACKS; rack++)
+    {
+        Bucket &bucket = buckets[rack];
+
+        for (uint8_t id = 0; id < SHAPER_ACTUATORS && bucket.urgent > 0; id++)
+        {
+            Slot &slot = slots[rack][id];
+            if (!slot.urgent)
+            {
+                continue;
+            }
+            if (!send(ctx, rack, id, slot.value, slot.receivedUs, true))
+            {
+                break; // Urgent queue full: retry on the next poll
+            }
+            release(bucket, slot);
+            slot.sentMs = nowMs;
+            urgentCommands.add();
+        }
+
+        for (uint8_t n = 0; n < SHAPER_ACTUATORS && bucket.pending > 0; n++)
+        {
+            uint8_t id = static_cast<uint8_t>((bucket.next + n) % SHAPER_ACTUATORS);
+            Slot &slot = slots[rack][id];
+            if (!slot.pending || slot.urgent || nowMs - slot.sentMs < SHAPER_WINDOW_MS)
+            {
+                continue;
+            }
+            if (!takeToken(bucket, nowMs))
+            {
+                break;
+            }
+
+            if (!send(ctx, rack, id, slot.value, slot.receivedUs, false))
+            {
+                bucket.tokens += 1000; // Link queue full: keep the value and retry from this slot next poll
+                bucket.next = id;
+                break;
+            }
+            release(bucket, slot);
+            slot.sentMs = nowMs;
+            bucket.next = static_cast<uint8_t>((id + 1) % SHAPER_ACTUATORS);
+        }
+    }
+}
+
+void CommandShaper::registerMetrics(MetricsRegistry &registry)
+{
+    registry.add("shaper/deferred", deferred);
+    registry.add("shaper/coalesced", coalesced);
+    registry.add("shaper/urgent", urgentCommands);
+    registry.add("shaper/pending", waiting);
+}
+
+void CommandShaper::sampleMetrics()
+{
+    int32_t pending = 0;
+    for (const Bucket &bucket : buckets)
+    {
+        pending += bucket.pending;
+    }
+    waiting.set(pending);
+}
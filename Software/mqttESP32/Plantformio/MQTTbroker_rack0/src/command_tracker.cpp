@@ -0,0 +1,166 @@
+/*
+ * command_tracker.cpp
+ * Description: Implementation of the actuator command tracker.
+ */
+
+#include "command_tracker.h"
+#include <esp_system.h>
+#include <stdio.h>
+
+static_assert((CMD_TRACK_SLOTS & (CMD_TRACK_SLOTS - 1)) == 0, "CMD_TRACK_SLOTS must be a power of two");
+
+// Random first sequence number: the boards drop a command repeating the last
+// sequence number of its actuator, which a count restarting at 1 after a gateway
+// reboot would hit.
+CommandTracker::CommandTracker() : nextSeq(static_cast<uint16_t>(esp_random() % 0xFFFF + 1))
+{
+    for (TrackedCommand &slot : slots)
+    {
+        slot.seq = 0;
+        slot.sentUs.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Opens a slot for a new command, superseding any pending one for the same
+ * actuator.
+ */
+TrackedCommand &CommandTracker::open(uint8_t rack, uint8_t id, const char *value, uint32_t receivedUs, uint32_t nowMs)
+{
+    for (TrackedCommand &slot : slots)
+    {
+        if (slot.seq != 0 && slot.rack == rack && slot.id == id)
+        {
+            slot.seq = 0;
+            superseded.add();
+        }
+    }
+
+    uint16_t seq = nextSeq++;
+    if (nextSeq == 0)
+    {
+        nextSeq = 1;
+    }
+
+    TrackedCommand &slot = slots[seq & (CMD_TRACK_SLOTS - 1)];
+    if (slot.seq != 0)
+    {
+        evicted.add(); // CMD_TRACK_SLOTS commands were already waiting
+    }
+    slot.seq = seq;
+    slot.rack = rack;
+    slot.id = id;
+    slot.attempts = 1;
+    slot.receivedUs = receivedUs;
+    slot.sentUs.store(0, std::memory_order_relaxed);
+    slot.deadlineMs = nowMs + CMD_ACK_TIMEOUT_MS;
+    snprintf(slot.value, sizeof(slot.value), "%s", value);
+    sent.add();
+    return slot;
+}
+
+/**
+ * Frees a slot whose command could not be queued, reporting it as REJECTED.
+ */
+void CommandTracker::cancel(TrackedCommand &command, CommandResult result, void *ctx)
+{
+    rejected.add();
+    if (result)
+    {
+        CommandTiming timing = {0, 0, 0};
+        result(ctx, command, CommandOutcome::REJECTED, RACK_PROTO_NOT_QUEUED, timing);
+    }
+    command.seq = 0;
+}
+
+/**
+ * Matches an ACK frame value "SEQ,CODE,APPLY_US" to its command.
+ */
+bool CommandTracker::acknowledge(uint8_t rack, const char *ack, uint32_t rxUs, CommandResult result, void *ctx)
+{
+    RackAck decoded;
+    if (RackProto_DecodeAck(ack, &decoded) != RACK_PROTO_SUCCESS)
+    {
+        unmatchedAcks.add();
+        return false;
+    }
+    int code = decoded.code;
+
+    TrackedCommand &slot = slots[decoded.seq & (CMD_TRACK_SLOTS - 1)];
+    if (slot.seq != decoded.seq || slot.rack != rack)
+    {
+        unmatchedAcks.add(); // Late ACK of a resent, superseded or evicted command
+        return false;
+    }
+
+    CommandTiming timing = {0, decoded.applyUs, 0};
+    uint32_t sentUs = slot.sentUs.load(std::memory_order_acquire);
+    if (sentUs != 0 && static_cast<int32_t>(rxUs - sentUs) >= 0)
+    {
+        if (slot.attempts == 1) // After a retry, sentUs is the last write and would add the ACK timeouts
+        {
+            timing.mqttToTx = sentUs - slot.receivedUs;
+            mqttToTx.record(timing.mqttToTx);
+        }
+        timing.roundTrip = rxUs - sentUs;
+        roundTrip.record(timing.roundTrip);
+    }
+    uartToApply.record(timing.uartToApply);
+
+    CommandOutcome outcome = code == 0 ? CommandOutcome::APPLIED : CommandOutcome::REJECTED;
+    (code == 0 ? applied : rejected).add();
+    if (result)
+    {
+        result(ctx, slot, outcome, code, timing);
+    }
+    slot.seq = 0;
+    return true;
+}
+
+/**
+ * Resends the commands whose ACK is overdue and gives up on the ones out of
+ * retries.
+ */
+void CommandTracker::poll(uint32_t nowMs, CommandResend resend, CommandResult result, void *ctx)
+{
+    for (TrackedCommand &slot : slots)
+    {
+        if (slot.seq == 0 || static_cast<int32_t>(nowMs - slot.deadlineMs) < 0)
+        {
+            continue;
+        }
+
+        if (slot.attempts <= CMD_RETRIES)
+        {
+            slot.attempts++;
+            slot.sentUs.store(0, std::memory_order_relaxed);
+            slot.deadlineMs = nowMs + CMD_ACK_TIMEOUT_MS;
+            retries.add();
+            resend(ctx, slot);
+            continue;
+        }
+
+        timeouts.add();
+        if (result)
+        {
+            CommandTiming timing = {0, 0, 0};
+            result(ctx, slot, CommandOutcome::TIMEOUT, 0, timing);
+        }
+        slot.seq = 0;
+    }
+}
+
+void CommandTracker::registerMetrics(MetricsRegistry &registry)
+{
+    registry.add("cmd/sent", sent);
+    registry.add("cmd/applied", applied);
+    registry.add("cmd/rejected", rejected);
+    registry.add("cmd/retries", retries);
+    registry.add("cmd/timeouts", timeouts);
+    registry.add("cmd/superseded", superseded);
+    registry.add("cmd/evicted", evicted);
+    registry.add("cmd/unmatched_acks", unmatchedAcks);
+    registry.add("cmd/mqtt_to_tx_us", mqttToTx);
+    registry.add("cmd/uart_to_apply_us", uartToApply);
+    registry.add("cmd/round_trip_us", roundTrip);
+}
@@ -0,0 +1,107 @@
+/*
+ * heap_monitor.cpp
+ * Description: Heap sampling and the link-time allocator wrappers.
+ */
+
+#include "heap_monitor.h"
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+
+// Constant-initialized, so allocations made before main() are counted safely
+HeapMonitor heapMonitor;
+
+static thread_local bool taskWatched = false;   /**< Set by watchCurrentTask() */
+static thread_local bool taskSuspended = false; /**< Inside Tracking(false) */
+
+void HeapMonitor::watchCurrentTask()
+{
+    taskWatched = true;
+}
+
+/**
+ * Called by the allocator wrappers.
+ * @param size Requested bytes.
+ */
+void HeapMonitor::countAllocation(size_t size)
+{
+    allocs.add();
+    if (taskWatched && !taskSuspended)
+    {
+        bridgeAllocs.add();
+        bridgeAllocBytes.add(static_cast<uint32_t>(size));
+    }
+}
+
+HeapMonitor::Tracking::Tracking(bool enabled) : previous(!taskSuspended)
+{
+    taskSuspended = !enabled;
+}
+
+HeapMonitor::Tracking::~Tracking()
+{
+    taskSuspended = !previous;
+}
+
+void HeapMonitor::registerMetrics(MetricsRegistry &registry)
+{
+    registry.add("heap/free", freeBytes);
+    registry.add("heap/min_free", minFreeBytes);
+    registry.add("heap/largest_block", largestBlock);
+    registry.add("heap/largest_block_min", largestBlockMin);
+    registry.add("heap/fragmentation_pct", fragmentation);
+    registry.add("heap/allocs", allocs);
+    registry.add("heap/allocs_bridge", bridgeAllocs);
+    registry.add("heap/alloc_bytes_bridge", bridgeAllocBytes);
+}
+
+/**
+ * Reads the allocator state into the gauges.
+ */
+void HeapMonitor::sampleMetrics()
+{
+    uint32_t free = esp_get_free_heap_size();
+    uint32_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    freeBytes.set(static_cast<int32_t>(free));
+    minFreeBytes.set(static_cast<int32_t>(esp_get_minimum_free_heap_size()));
+    largestBlock.set(static_cast<int32_t>(largest));
+    if (largestBlockMin.value() == 0 || static_cast<int32_t>(largest) < largestBlockMin.value())
+    {
+        largestBlockMin.set(static_cast<int32_t>(largest));
+    }
+    fragmentation.set(free ? static_cast<int32_t>(100 - static_cast<uint64_t>(largest) * 100 / free) : 0);
+}
+
+/* =======================
+ * Allocator Wrappers
+ * =======================
+ * With --wrap, every reference to malloc/calloc/realloc outside this file binds
+ * to __wrap_*, and __real_* to the allocator itself. operator new reaches them
+ * through malloc.
+ */
+#ifdef HEAP_MONITOR_WRAP
+extern "C"
+{
+    void *__real_malloc(size_t size);
+    void *__real_calloc(size_t count, size_t size);
+    void *__real_realloc(void *pointer, size_t size);
+
+    void *__wrap_malloc(size_t size)
+    {
+        heapMonitor.countAllocation(size);
+        return __real_malloc(size);
+    }
+
+    void *__wrap_calloc(size_t count, size_t size)
+    {
+        heapMonitor.countAllocation(count * size);
+        return __real_calloc(count, size);
+    }
+
+    void *__wrap_realloc(void *pointer, size_t size)
+    {
+        heapMonitor.countAllocation(size);
+        return __real_realloc(pointer, size);
+    }
+}
+#endif
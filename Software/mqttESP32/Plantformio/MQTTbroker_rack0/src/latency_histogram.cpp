@@ -0,0 +1,92 @@
+/*
+ * latency_histogram.cpp
+ * Description: Implementation of the log2 latency histogram.
+ */
+
+#include "latency_histogram.h"
+
+/**
+ * Adds one sample.
+ * @param us Latency in microseconds.
+ */
+void LatencyHistogram::record(uint32_t us)
+{
+    buckets[bucketOf(us)]++;
+    samples++;
+    if (us > largest)
+    {
+        largest = us;
+    }
+}
+
+/**
+ * Bucket of a sample: bucket i holds [2^(i-1), 2^i) microseconds.
+ * @param us Latency in microseconds.
+ * @return Index of the bucket.
+ */
+uint8_t LatencyHistogram::bucketOf(uint32_t us)
+{
+    uint8_t bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && (us >> bucket) != 0)
+    {
+        bucket++;
+    }
+    return bucket;
+}
+
+/**
+ * Upper bound of the bucket holding a percentile.
+ * @param percent Percentile (0-100).
+ * @return Latency in microseconds, 0 if there are no samples.
+ */
+uint32_t LatencyHistogram::percentile(uint8_t percent) const
+{
+    if (samples == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank = ((uint64_t)samples * percent + 99) / 100;
+    uint64_t seen = 0;
+
+    for (uint8_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        seen += buckets[bucket];
+        if (seen >= rank && seen > 0)
+        {
+            uint32_t bound = (bucket == 0) ? 0 : (uint32_t)((1ULL << bucket) - 1);
+            return (bound < largest) ? bound : largest;
+        }
+    }
+    return largest;
+}
+
+/**
+ * Adds the samples of another histogram.
+ * @param other The histogram to merge in.
+ */
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (uint8_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        buckets[bucket] += other.buckets[bucket];
+    }
+    samples += other.samples;
+    if (other.largest > largest)
+    {
+        largest = other.largest;
+    }
+}
+
+/**
+ * Clears every sample.
+ */
+void LatencyHistogram::reset()
+{
+    for (uint8_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        buckets[bucket] = 0;
+    }
+    samples = 0;
+    largest = 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * line_assembler.cpp
+ * Description: Implementation of the incremental UART line assembler.
+ */
+
+#include "line_assembler.h"
+
+/**
+ * Feeds one received byte.
+ * @param c The byte.
+ * @return true when a complete, non-empty line is available through line().
+ */
+bool LineAssembler::push(uint8_t c)
+{
+    // The previous line has been consumed: start a new one
+    if (complete)
+    {
+        complete = false;
+        length = 0;
+        buffer[0] = '\0';
+    }
+
+    if (c == '\r')
+    {
+        return false;
+    }
+
+    if (c == '\n')
+    {
+        if (overflow)
+        {
+            // Tail of an oversized frame: resynchronise on its terminator
+            overflow = false;
+            length = 0;
+            dropped++;
+            return false;
+        }
+        if (length == 0)
+        {
+            return false;
+        }
+        buffer[length] = '\0';
+        complete = true;
+        return true;
+    }
+
+    if (overflow)
+    {
+        return false;
+    }
+
+    if (length + 1 >= LINE_ASSEMBLER_SIZE)
+    {
+        overflow = true;
+        return false;
+    }
+
+    buffer[length++] = static_cast<char>(c);
+    return false;
+}
+
+/**
+ * Discards any partial line.
+ */
+void LineAssembler::reset()
+{
+    length = 0;
+    overflow = false;
+    complete = false;
+    buffer[0] = '\0';
+}
@@ -12,6 +12,8 @@
  */
 #include <Arduino.h>
 #include <WiFi.h>
+#include <LittleFS.h>
+#include <esp_timer.h>
 #include "utils.h"
 
 /* =======================
@@ -19,18 +21,23 @@
  * =======================
  * Pin configurations for Serial communication.
  */
-#define SERIAL2_RX_PIN 16 /**< RX pin for Serial2 (Sensors) */
-#define SERIAL2_TX_PIN 17 /**< TX pin for Serial2 (Sensors) */
-#define SERIAL1_RX_PIN 4  /**< RX pin for Serial1 (Actuators) */
-#define SERIAL1_TX_PIN 5  /**< TX pin for Serial1 (Actuators) */
+#define SERIAL2_RX_PIN 16 /**< RX pin for UART2 (Sensors) */
+#define SERIAL2_TX_PIN 17 /**< TX pin for UART2 (Sensors) */
+#define SERIAL1_RX_PIN 4  /**< RX pin for UART1 (Actuators) */
+#define SERIAL1_TX_PIN 5  /**< TX pin for UART1 (Actuators) */
+#define SERIAL2_RTS_PIN -1 /**< RTS pin for UART2, -1 without hardware flow control */
+#define SERIAL2_CTS_PIN -1 /**< CTS pin for UART2, -1 without hardware flow control */
+#define SERIAL1_RTS_PIN -1 /**< RTS pin for UART1, -1 without hardware flow control */
+#define SERIAL1_CTS_PIN -1 /**< CTS pin for UART1, -1 without hardware flow control */
 
-/* =======================
- * Global Variables
- * =======================
- * Flags to indicate new data availability on respective Serial ports.
+/**
+ * Broker task configuration. The broker shares core 0 with the Wi-Fi and lwIP
+ * tasks; UART ingest and egress run on core 1 (UART_TASK_CORE).
  */
-volatile bool newDataSerial1 = false; /**< Flag for new data on Serial1 */
-volatile bool newDataSerial2 = false; /**< Flag for new data on Serial2 */
+#define BROKER_TASK_CORE 0          /**< Core of the PicoMQTT server */
+#define BROKER_TASK_STACK 8192      /**< Broker task stack in bytes */
+#define BROKER_TASK_PRIORITY 5      /**< Below the UART tasks */
+#define BROKER_IDLE_TICKS 1         /**< Longest wait for a frame before polling the server again */
 
 /* =======================
  * Instances
@@ -42,10 +49,9 @@ MyMQTT myMQTTServer(MQTT_BROKER_PORT); /**< MQTT Server instance */
 /* =======================
  * Function Declarations
  * =======================
- * Prototypes for interrupt routines and utility functions.
+ * Prototypes for the broker task and utility functions.
  */
-void serial1InterruptRoutine();
-void serial2InterruptRoutine();
+void brokerTask(void *arg);
 void checkPCSerial();
 
 /* =======================
@@ -56,13 +62,20 @@ void checkPCSerial();
 void setup()
 {
     // Initialize serial ports
-    Serial.begin(115200);                                              // PC Serial
-    Serial1.begin(115200, SERIAL_8N1, SERIAL1_RX_PIN, SERIAL1_TX_PIN); // Serial1 for Actuators
-    Serial2.begin(115200, SERIAL_8N1, SERIAL2_RX_PIN, SERIAL2_TX_PIN); // Serial2 for Sensors
+    Serial.begin(115200); // PC Serial
 
-    // Attach interrupts for Serial RX
-    attachInterrupt(digitalPinToInterrupt(SERIAL1_RX_PIN), serial1InterruptRoutine, FALLING);
-    attachInterrupt(digitalPinToInterrupt(SERIAL2_RX_PIN), serial2InterruptRoutine, FALLING);
+    // Rack board links, received by their own event-driven tasks, at the fastest rate each board accepts
+    // and with credit-based flow control (RTS/CTS as well when the pins are wired)
+    if (!actuatorLink.begin(UART_BAUD_MAX, SERIAL1_RX_PIN, SERIAL1_TX_PIN, SERIAL1_RTS_PIN,
+                            SERIAL1_CTS_PIN)) // UART1 for Actuators
+    {
+        Serial.println("Actuator UART link failed");
+    }
+    if (!sensorLink.begin(UART_BAUD_MAX, SERIAL2_RX_PIN, SERIAL2_TX_PIN, SERIAL2_RTS_PIN,
+                          SERIAL2_CTS_PIN)) // UART2 for Sensors
+    {
+        Serial.println("Sensor UART link failed");
+    }
 
     // Configure static IP for Wi-Fi
     if (!WiFi.config(local_IP, gateway, subnet, dns))
@@ -80,61 +93,117 @@ void setup()
     }
     Serial.printf("Wi-Fi connected! IP: %s\n", WiFi.localIP().toString().c_str());
 
+    // Sensor history: UTC from NTP, segments on LittleFS
+    configTime(0, 0, NTP_SERVER);
+    if (!LittleFS.begin(true) || !tsStore.begin(LittleFS, LittleFS.totalBytes(), rackCount * static_cast<size_t>(SensorTopic::SENSOR_COUNT)))
+    {
+        Serial.println("Time-series store unavailable");
+    }
+
+    // Upstream broker, with a flash spool for outages
+    if (!uplink.begin(LittleFS, uplinkConfig))
+    {
+        Serial.println("Uplink disabled");
+    }
+
+    // Edge rules saved by the last RULES_CONFIG_TOPIC message, routed by subscribeToTopics()
+    if (ruleEngine.begin(LittleFS))
+    {
+        Serial.printf("%u edge rules loaded\n", (unsigned)ruleEngine.ruleCount());
+    }
+
     // Initialize MQTT server
     myMQTTServer.subscribeToTopics(); // Subscribe to predefined topics
+    myMQTTServer.registerMetrics();   // $SYS counters of the gateway, links and uplink
     myMQTTServer.begin();             // Start the MQTT server
+
+    // Hand the server over to its own task on the Wi-Fi core
+    TaskHandle_t broker = nullptr;
+    xTaskCreatePinnedToCore(brokerTask, "broker", BROKER_TASK_STACK, nullptr, BROKER_TASK_PRIORITY,
+                            &broker, BROKER_TASK_CORE);
+    for (size_t rack = 0; rack < rackCount; rack++)
+    {
+        for (UartLink *link : {racks[rack].actuators, racks[rack].sensors})
+        {
+            if (link)
+            {
+                link->setConsumer(broker);
+            }
+        }
+    }
 }
 
 /* =======================
  * Loop Function
  * =======================
- * Continuously checks for new data on Serial ports and maintains MQTT server.
+ * All the work runs in pinned tasks; the Arduino loop task is not needed.
  */
 void loop()
 {
-    // Maintain MQTT server
-    myMQTTServer.loop();
-
-    // Handle new data from Serial1 (Actuators)
-    if (newDataSerial1)
-    {
-        myMQTTServer.UART_MQTT(Serial1, myMQTTServer); // Process Serial1 data
-        newDataSerial1 = false;                        // Reset flag
-    }
-
-    // Handle new data from Serial2 (Sensors)
-    if (newDataSerial2)
-    {
-        myMQTTServer.UART_MQTT(Serial2, myMQTTServer); // Process Serial2 data
-        newDataSerial2 = false;                        // Reset flag
-    }
-
-    // Handle PC Serial data (debugging or additional commands)
-    checkPCSerial();
+    vTaskDelete(nullptr);
 }
 
 /* =======================
- * Interrupt Service Routines
+ * Broker Task
  * =======================
- * Triggered on receiving data on respective Serial ports.
+ * Sole owner of the MQTT server. Subscription callbacks run here, so this is also
+ * the single producer of every link's command queue.
  */
 
 /**
- * ISR for Serial1 (Actuators).
- * Sets the flag indicating new data is available on Serial1.
+ * Maintains the MQTT server and publishes the frames collected by the UART links.
+ * Sleeps until an ingest task signals a frame, or for BROKER_IDLE_TICKS at most
+ * so client traffic keeps being served.
+ * @param arg Unused.
  */
-void serial1InterruptRoutine()
+void brokerTask(void *arg)
 {
-    newDataSerial1 = true; // Set flag for Serial1
-}
+    uint32_t lastMetrics = millis();
 
-/**
- * ISR for Serial2 (Sensors).
- * Sets the flag indicating new data is available on Serial2.
- */
-void serial2InterruptRoutine()
-{
-    newDataSerial2 = true; // Set flag for Serial2
+    HeapMonitor::watchCurrentTask();
+    for (;;)
+    {
+        int64_t started = esp_timer_get_time();
+
+        // Maintain MQTT server
+        myMQTTServer.loop();
+
+        // Publish frames from every board of every rack
+        size_t published = 0;
+        for (uint8_t rack = 0; rack < rackCount; rack++)
+        {
+            for (UartLink *link : {racks[rack].actuators, racks[rack].sensors})
+            {
+                if (link)
+                {
+                    published += myMQTTServer.UART_MQTT(rack, *link, myMQTTServer);
+                }
+            }
+        }
+
+        // Handle PC Serial data (debugging or additional commands)
+        checkPCSerial();
+
+        // Persist the open history segments, close finished rollup windows, send
+        // the shaped commands, resend the ones whose ACK is overdue and run the
+        // held rules
+        tsStore.poll(millis());
+        myMQTTServer.pollRollups();
+        myMQTTServer.pollCommands();
+        myMQTTServer.pollRules();
+
+        if (millis() - lastMetrics >= METRICS_PERIOD_MS)
+        {
+            lastMetrics = millis();
+            myMQTTServer.publishMetrics();
+        }
+
+        myMQTTServer.loopTime.record(static_cast<uint32_t>(esp_timer_get_time() - started));
+        if (published == 0)
+        {
+            ulTaskNotifyTake(pdTRUE, BROKER_IDLE_TICKS);
+        }
+    }
 }
 
 /* =======================
@@ -0,0 +1,108 @@
+/*
+ * metrics.cpp
+ * Description: Implementation of the metric types and their registry.
+ */
+
+#include "metrics.h"
+#include <stdio.h>
+#include <string.h>
+
+Histogram::Histogram() : largest(0)
+{
+    for (uint8_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        buckets[bucket].store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Adds one sample.
+ * @param us Latency in microseconds.
+ */
+void Histogram::record(uint32_t us)
+{
+    buckets[LatencyHistogram::bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t seen = largest.load(std::memory_order_relaxed);
+    while (us > seen && !largest.compare_exchange_weak(seen, us, std::memory_order_relaxed))
+    {
+    }
+}
+
+/**
+ * Moves the samples collected since the last drain into a plain histogram.
+ * @param window Receives the samples (reset first).
+ */
+void Histogram::drain(LatencyHistogram &window)
+{
+    window.reset();
+    for (uint8_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        uint32_t n = buckets[bucket].exchange(0, std::memory_order_relaxed);
+        window.buckets[bucket] = n;
+        window.samples += n;
+    }
+    window.largest = largest.exchange(0, std::memory_order_relaxed);
+}
+
+bool MetricsRegistry::add(const char *name, Counter &counter)
+{
+    return add(name, Type::COUNTER, &counter);
+}
+
+bool MetricsRegistry::add(const char *name, Gauge &gauge)
+{
+    return add(name, Type::GAUGE, &gauge);
+}
+
+bool MetricsRegistry::add(const char *name, Histogram &histogram)
+{
+    return add(name, Type::HISTOGRAM, &histogram);
+}
+
+bool MetricsRegistry::add(const char *name, Type type, void *metric)
+{
+    if (count >= METRICS_MAX)
+    {
+        dropped++;
+        return false;
+    }
+    Entry &entry = entries[count++];
+    snprintf(entry.name, sizeof(entry.name), "%s", name);
+    entry.type = type;
+    entry.metric = metric;
+    return true;
+}
+
+/**
+ * Formats every metric, draining the histograms.
+ * @param fn Called for each metric.
+ * @param ctx Passed to fn.
+ */
+void MetricsRegistry::forEach(MetricFn fn, void *ctx)
+{
+    char value[96];
+    LatencyHistogram window;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const Entry &entry = entries[i];
+        switch (entry.type)
+        {
+        case Type::COUNTER:
+            snprintf(value, sizeof(value), "%lu", (unsigned long)static_cast<Counter *>(entry.metric)->value());
+            break;
+        case Type::GAUGE:
+            snprintf(value, sizeof(value), "%ld", (long)static_cast<Gauge *>(entry.metric)->value());
+            break;
+        case Type::HISTOGRAM:
+            static_cast<Histogram *>(entry.metric)->drain(window);
+            snprintf(value, sizeof(value), "{\"count\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"max\":%lu}",
+                     (unsigned long)window.count(), (unsigned long)window.percentile(50),
+                     (unsigned long)window.percentile(90), (unsigned long)window.percentile(99),
+                     (unsigned long)window.max());
+            break;
+        }
+        fn(ctx, entry.name, value);
+    }
+}
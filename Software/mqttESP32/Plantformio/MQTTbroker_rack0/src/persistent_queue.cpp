@@ -0,0 +1,228 @@
+/*
+ * persistent_queue.cpp
+ * Description: Implementation of the flash-backed message queue.
+ *
+ * Record layout: topic length (u16), payload length (u16), topic, payload.
+ */
+
+#include "persistent_queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PQ_RECORD_HEADER 4
+#define PQ_OFFSET_FILE PQ_DIR "/offset"
+
+/**
+ * Opens the queue, resuming the messages left by a previous run.
+ * @param fileSystem The file system (LittleFS).
+ * @return true if successful.
+ */
+bool PersistentQueue::begin(fs::FS &fileSystem)
+{
+    fs = &fileSystem;
+    fs->mkdir(PQ_DIR);
+
+    // Find the oldest and newest segments left on flash
+    bool found = false;
+    fs::File dir = fs->open(PQ_DIR);
+    if (dir && dir.isDirectory())
+    {
+        for (fs::File entry = dir.openNextFile(); entry; entry = dir.openNextFile())
+        {
+            const char *name = strrchr(entry.name(), '/');
+            name = name ? name + 1 : entry.name();
+
+            char *end;
+            uint32_t seq = (uint32_t)strtoul(name, &end, 16);
+            if (end == name || *end != '\0')
+            {
+                continue; // Not a segment (offset file)
+            }
+            if (!found || seq < head)
+            {
+                head = seq;
+            }
+            if (!found || seq > tail)
+            {
+                tail = seq;
+                tailBytes = entry.size();
+            }
+            found = true;
+        }
+    }
+
+    if (!found)
+    {
+        head = tail = 0;
+        tailBytes = 0;
+    }
+
+    // Resume the read position if it belongs to the oldest segment
+    readOffset = 0;
+    fs::File offset = fs->open(PQ_OFFSET_FILE, "r");
+    if (offset)
+    {
+        uint32_t saved[2];
+        if (offset.read(reinterpret_cast<uint8_t *>(saved), sizeof(saved)) == sizeof(saved) && saved[0] == head)
+        {
+            readOffset = saved[1];
+        }
+        offset.close();
+    }
+    return true;
+}
+
+/**
+ * Appends a message, dropping the oldest segment if the queue is full.
+ * @return false if the message is too long or cannot be written.
+ */
+bool PersistentQueue::push(const char *topic, const char *payload)
+{
+    size_t topicLength = strlen(topic);
+    size_t payloadLength = strlen(payload);
+    size_t recordLength = PQ_RECORD_HEADER + topicLength + payloadLength;
+
+    if (!fs || topicLength >= PQ_TOPIC_SIZE || payloadLength >= PQ_PAYLOAD_SIZE)
+    {
+        return false;
+    }
+
+    if (tailBytes > 0 && tailBytes + recordLength > PQ_SEGMENT_SIZE)
+    {
+        tail++;
+        tailBytes = 0;
+    }
+    while (tail - head >= PQ_MAX_SEGMENTS)
+    {
+        dropHead();
+    }
+
+    uint8_t header[PQ_RECORD_HEADER] = {
+        (uint8_t)topicLength, (uint8_t)(topicLength >> 8),
+        (uint8_t)payloadLength, (uint8_t)(payloadLength >> 8)};
+    char path[32];
+    segmentPath(path, sizeof(path), tail);
+
+    fs::File file = fs->open(path, "a");
+    if (!file)
+    {
+        return false;
+    }
+    size_t written = file.write(header, sizeof(header));
+    written += file.write(reinterpret_cast<const uint8_t *>(topic), topicLength);
+    written += file.write(reinterpret_cast<const uint8_t *>(payload), payloadLength);
+    file.close();
+
+    tailBytes += written;
+    return written == recordLength;
+}
+
+/**
+ * Reads the oldest message without removing it.
+ * @return false if the queue is empty.
+ */
+bool PersistentQueue::peek(char *topic, char *payload)
+{
+    while (!empty())
+    {
+        char path[32];
+        segmentPath(path, sizeof(path), head);
+        fs::File file = fs->open(path, "r");
+
+        if (file && file.seek(readOffset) && readOffset + PQ_RECORD_HEADER <= file.size())
+        {
+            uint8_t header[PQ_RECORD_HEADER];
+            file.read(header, sizeof(header));
+            size_t topicLength = header[0] | (header[1] << 8);
+            size_t payloadLength = header[2] | (header[3] << 8);
+
+            if (topicLength < PQ_TOPIC_SIZE && payloadLength < PQ_PAYLOAD_SIZE &&
+                file.read(reinterpret_cast<uint8_t *>(topic), topicLength) == topicLength &&
+                file.read(reinterpret_cast<uint8_t *>(payload), payloadLength) == payloadLength)
+            {
+                topic[topicLength] = '\0';
+                payload[payloadLength] = '\0';
+                peekLength = PQ_RECORD_HEADER + topicLength + payloadLength;
+                file.close();
+                return true;
+            }
+        }
+        if (file)
+        {
+            file.close();
+        }
+
+        // End of the head segment (or a torn record): move on
+        if (head == tail)
+        {
+            readOffset = tailBytes; // Nothing valid left
+            return false;
+        }
+        dropHead();
+        dropped--; // Consumed, not lost
+    }
+    return false;
+}
+
+/**
+ * Removes the message returned by peek().
+ */
+void PersistentQueue::pop()
+{
+    readOffset += peekLength;
+    peekLength = 0;
+}
+
+/**
+ * Saves the read position (call after a batch of pops).
+ */
+void PersistentQueue::commit()
+{
+    if (!fs)
+    {
+        return;
+    }
+
+    // Fully drained: start over so the files do not linger
+    if (head == tail && readOffset >= tailBytes && tailBytes > 0)
+    {
+        char path[32];
+        segmentPath(path, sizeof(path), head);
+        fs->remove(path);
+        head = ++tail;
+        tailBytes = 0;
+        readOffset = 0;
+    }
+
+    uint32_t saved[2] = {head, (uint32_t)readOffset};
+    fs::File offset = fs->open(PQ_OFFSET_FILE, "w");
+    if (offset)
+    {
+        offset.write(reinterpret_cast<const uint8_t *>(saved), sizeof(saved));
+        offset.close();
+    }
+}
+
+bool PersistentQueue::empty()
+{
+    return head == tail && readOffset >= tailBytes;
+}
+
+void PersistentQueue::segmentPath(char *path, size_t size, uint32_t seq) const
+{
+    snprintf(path, size, PQ_DIR "/%08lx", (unsigned long)seq);
+}
+
+/**
+ * Removes the oldest segment.
+ */
+void PersistentQueue::dropHead()
+{
+    char path[32];
+    segmentPath(path, sizeof(path), head);
+    fs->remove(path);
+    head++;
+    readOffset = 0;
+    dropped++;
+}
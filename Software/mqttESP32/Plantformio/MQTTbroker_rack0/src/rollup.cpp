@@ -0,0 +1,110 @@
+/*
+ * rollup.cpp
+ * Description: Implementation of the streaming window aggregation.
+ */
+
+#include "rollup.h"
+
+/** Window lengths in seconds and their topic suffixes */
+static const uint32_t windowSeconds[ROLLUP_WINDOWS] = {60, 900, 3600};
+static const char *const windowNames[ROLLUP_WINDOWS] = {"1m", "15m", "1h"};
+
+Rollup::Rollup()
+{
+    for (uint8_t series = 0; series < ROLLUP_MAX_SERIES; series++)
+    {
+        for (uint8_t window = 0; window < ROLLUP_WINDOWS; window++)
+        {
+            acc[series][window].count = 0;
+        }
+    }
+}
+
+/**
+ * Adds a sample.
+ * @param series Series index (< ROLLUP_MAX_SERIES).
+ * @param now Time in seconds.
+ * @param value Value in thousandths.
+ * @param emit Called for every window closed by this sample.
+ * @param ctx Callback context.
+ */
+void Rollup::add(uint8_t series, uint32_t now, int32_t value, RollupEmit emit, void *ctx)
+{
+    if (series >= ROLLUP_MAX_SERIES)
+    {
+        return;
+    }
+
+    for (uint8_t window = 0; window < ROLLUP_WINDOWS; window++)
+    {
+        Accumulator &a = acc[series][window];
+        uint32_t start = now - now % windowSeconds[window];
+
+        // A sample from another window (later, or earlier after a clock step) closes it
+        if (a.count > 0 && a.start != start)
+        {
+            close(series, window, emit, ctx);
+        }
+
+        if (a.count == 0)
+        {
+            a.start = start;
+            a.min = value;
+            a.max = value;
+            a.sum = 0;
+        }
+        a.min = value < a.min ? value : a.min;
+        a.max = value > a.max ? value : a.max;
+        a.sum += value;
+        a.last = value;
+        a.count++;
+    }
+}
+
+/**
+ * Closes the windows that ended without new samples.
+ * @param now Time in seconds.
+ * @param emit Called for every closed window.
+ * @param ctx Callback context.
+ */
+void Rollup::poll(uint32_t now, RollupEmit emit, void *ctx)
+{
+    for (uint8_t series = 0; series < ROLLUP_MAX_SERIES; series++)
+    {
+        for (uint8_t window = 0; window < ROLLUP_WINDOWS; window++)
+        {
+            Accumulator &a = acc[series][window];
+            if (a.count > 0 && now - a.start >= windowSeconds[window])
+            {
+                close(series, window, emit, ctx);
+            }
+        }
+    }
+}
+
+/**
+ * Topic suffix of a window ("1m", "15m", "1h").
+ */
+const char *Rollup::windowName(uint8_t window)
+{
+    return window < ROLLUP_WINDOWS ? windowNames[window] : "";
+}
+
+void Rollup::close(uint8_t series, uint8_t window, RollupEmit emit, void *ctx)
+{
+    Accumulator &a = acc[series][window];
+    RollupResult result;
+
+    result.start = a.start;
+    result.min = a.min;
+    result.max = a.max;
+    result.mean = (int32_t)(a.sum / (int64_t)a.count);
+    result.last = a.last;
+    result.count = a.count;
+    a.count = 0;
+
+    if (emit)
+    {
+        emit(ctx, series, window, result);
+    }
+}
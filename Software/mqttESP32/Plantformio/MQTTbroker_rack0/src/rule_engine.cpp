@@ -0,0 +1,757 @@
+/*
+ * rule_engine.cpp
+ * Description: Implementation of the rule compiler and bytecode evaluator.
+ */
+
+#include "rule_engine.h"
+#include <Arduino.h>
+#include "rack_proto.h"
+#include <stdio.h>
+#include <string.h>
+
+#define RULE_NO_TEXT 0xFFFF /**< Rule without an "else" value */
+
+static_assert(RULES_MAX_INPUTS <= 32, "Rule input masks are 32 bits");
+static_assert(RULES_MAX_CONSTS <= 256 && RULES_MAX_INPUTS <= 256, "Operands are one byte");
+static_assert(RULES_TEXT_SIZE < RULE_NO_TEXT, "Text offsets are 16 bits");
+
+/**
+ * Bytecode. Operands follow their opcode as one byte.
+ */
+enum RuleOp : uint8_t
+{
+    OP_END,   /**< The condition is the value left on the stack */
+    OP_INPUT, /**< Operand: input. Pushes its value; the rule is undecided while it has none */
+    OP_CONST, /**< Operand: constant. Pushes it */
+    OP_GT,    /**< a b -> a > b */
+    OP_LT,
+    OP_GE,
+    OP_LE,
+    OP_EQ,
+    OP_NE,
+    OP_HGT,   /**< a b h -> a > b, or a > b - h while the rule is on */
+    OP_HLT,   /**< a b h -> a < b, or a < b + h while the rule is on */
+    OP_HGE,
+    OP_HLE,
+    OP_AND,   /**< a b -> a && b */
+    OP_OR     /**< a b -> a || b */
+};
+
+/**
+ * A space-separated word of a rule line.
+ */
+struct Token
+{
+    const char *text;
+    size_t length;
+};
+
+/**
+ * Reads the next token of a line.
+ * @param cursor Position in the line, advanced past the token.
+ * @param end End of the line.
+ * @param token Receives the token.
+ * @return false at the end of the line.
+ */
+static bool nextToken(const char *&cursor, const char *end, Token &token)
+{
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r'))
+    {
+        cursor++;
+    }
+    if (cursor == end)
+    {
+        return false;
+    }
+
+    token.text = cursor;
+    while (cursor < end && *cursor != ' ' && *cursor != '\t' && *cursor != '\r')
+    {
+        cursor++;
+    }
+    token.length = static_cast<size_t>(cursor - token.text);
+    return true;
+}
+
+static bool tokenIs(const Token &token, const char *word)
+{
+    return token.length == strlen(word) && memcmp(token.text, word, token.length) == 0;
+}
+
+/**
+ * Parses a decimal number into thousandths, like parseMilli() but over a token.
+ */
+static bool parseNumber(const Token &token, int32_t &value)
+{
+    char number[24];
+
+    if (token.length >= sizeof(number))
+    {
+        return false;
+    }
+    memcpy(number, token.text, token.length);
+    number[token.length] = '\0';
+
+    const char *end = RackProto_ParseMilli(number, &value);
+    return end && *end == '\0';
+}
+
+static bool parseSeconds(const Token &token, uint16_t &seconds)
+{
+    int32_t milli;
+    if (!parseNumber(token, milli) || milli < 0 || milli / 1000 > UINT16_MAX)
+    {
+        return false;
+    }
+    seconds = static_cast<uint16_t>(milli / 1000);
+    return true;
+}
+
+/**
+ * Comparison opcode of an operator token, OP_END if it is not one.
+ */
+static RuleOp comparison(const Token &token)
+{
+    static const struct
+    {
+        const char *text;
+        RuleOp op;
+    } operators[] = {{">", OP_GT}, {"<", OP_LT}, {">=", OP_GE}, {"<=", OP_LE}, {"==", OP_EQ}, {"!=", OP_NE}};
+
+    for (const auto &entry : operators)
+    {
+        if (tokenIs(token, entry.text))
+        {
+            return entry.op;
+        }
+    }
+    return OP_END;
+}
+
+/**
+ * Input and target topics are plain topic names.
+ */
+static bool validTopic(const Token &token)
+{
+    return memchr(token.text, '+', token.length) == nullptr && memchr(token.text, '#', token.length) == nullptr;
+}
+
+/**
+ * FNV-1a hash of a rules text.
+ */
+static uint32_t hashText(const char *text)
+{
+    uint32_t hash = 2166136261UL;
+    for (; *text != '\0'; text++)
+    {
+        hash = (hash ^ static_cast<uint8_t>(*text)) * 16777619UL;
+    }
+    return hash;
+}
+
+RuleEngine::RuleEngine() : active(0), evaluating(false), fs(nullptr)
+{
+    programs[0].ruleCount = 0;
+    programs[0].inputCount = 0;
+    programs[0].sourceHash = 0;
+}
+
+/**
+ * Loads the rules saved on flash.
+ * @param fileSystem The file system (LittleFS).
+ * @return true if RULES_FILE exists and compiled.
+ */
+bool RuleEngine::begin(fs::FS &fileSystem)
+{
+    char text[RULES_SOURCE_SIZE];
+    char error[RULES_ERROR_SIZE];
+    bool ok = false;
+
+    if (fileSystem.exists(RULES_FILE))
+    {
+        fs::File file = fileSystem.open(RULES_FILE, "r");
+        size_t length = file ? file.read(reinterpret_cast<uint8_t *>(text), sizeof(text) - 1) : 0;
+        file.close();
+        text[length] = '\0';
+
+        ok = configure(text, error, sizeof(error)); // Not saved again: fs is still unset
+        if (!ok)
+        {
+            Serial.printf("Rules on flash rejected: %s\n", error);
+        }
+    }
+    fs = &fileSystem;
+    return ok;
+}
+
+/**
+ * Compiles a rules text into the staging program and swaps it in.
+ */
+bool RuleEngine::configure(const char *text, char *error, size_t errorSize)
+{
+    Program &staging = programs[active ^ 1];
+    const Program &running = programs[active];
+    uint32_t hash = hashText(text);
+
+    if (hash == running.sourceHash)
+    {
+        return true; // Already running; keeps the rule states and spares the flash
+    }
+    if (!compile(staging, text, error, errorSize))
+    {
+        rejected.add();
+        return false;
+    }
+    staging.sourceHash = hash;
+
+    // Inputs shared with the running rules keep their last value
+    for (uint8_t i = 0; i < staging.inputCount; i++)
+    {
+        for (uint8_t j = 0; j < running.inputCount; j++)
+        {
+            if (running.inputs[j].valid &&
+                strcmp(staging.text + staging.inputs[i].topic, running.text + running.inputs[j].topic) == 0)
+            {
+                staging.inputs[i].valid = true;
+                staging.inputs[i].value = running.inputs[j].value;
+                break;
+            }
+        }
+    }
+
+    active ^= 1;
+    loaded.set(staging.ruleCount);
+    save(text);
+    return true;
+}
+
+/**
+ * Compiles every line of a rules text.
+ * @param program Receives the bytecode, constants, inputs and rules.
+ * @param text The rules text.
+ * @param error Receives "line N: reason" on failure.
+ * @param errorSize Size of error.
+ * @return true if every line compiled.
+ */
+bool RuleEngine::compile(Program &program, const char *text, char *error, size_t errorSize)
+{
+    unsigned lineNumber = 0;
+    const char *reason = nullptr;
+
+    program.codeLength = 0;
+    program.constCount = 0;
+    program.textLength = 0;
+    program.inputCount = 0;
+    program.ruleCount = 0;
+
+    // Appends one byte; overflow is reported once the rule is complete
+    auto emit = [&program](uint8_t byte)
+    {
+        if (program.codeLength < RULES_CODE_SIZE)
+        {
+            program.code[program.codeLength] = byte;
+        }
+        program.codeLength++;
+    };
+
+    auto addText = [&program](const Token &token) -> int
+    {
+        if (program.textLength + token.length + 1 > RULES_TEXT_SIZE)
+        {
+            return -1;
+        }
+        int offset = program.textLength;
+        memcpy(&program.text[offset], token.text, token.length);
+        program.text[offset + token.length] = '\0';
+        program.textLength += token.length + 1;
+        return offset;
+    };
+
+    auto addInput = [&](const Token &token) -> int
+    {
+        for (uint8_t i = 0; i < program.inputCount; i++)
+        {
+            const char *topic = program.text + program.inputs[i].topic;
+            if (strlen(topic) == token.length && memcmp(topic, token.text, token.length) == 0)
+            {
+                return i;
+            }
+        }
+        int offset = program.inputCount < RULES_MAX_INPUTS ? addText(token) : -1;
+        if (offset < 0)
+        {
+            return -1;
+        }
+        program.inputs[program.inputCount] = {static_cast<uint16_t>(offset), false, 0};
+        return program.inputCount++;
+    };
+
+    auto addConst = [&program](int32_t value) -> int
+    {
+        for (uint8_t i = 0; i < program.constCount; i++)
+        {
+            if (program.consts[i] == value)
+            {
+                return i;
+            }
+        }
+        if (program.constCount == RULES_MAX_CONSTS)
+        {
+            return -1;
+        }
+        program.consts[program.constCount] = value;
+        return program.constCount++;
+    };
+
+    for (const char *line = text; *line != '\0' && !reason;)
+    {
+        const char *end = line + strcspn(line, "\n;");
+        const char *cursor = line;
+        Token token;
+
+        lineNumber++;
+        line = (*end != '\0') ? end + 1 : end;
+        if (!nextToken(cursor, end, token) || token.text[0] == '#')
+        {
+            continue; // Blank line or comment
+        }
+        if (!tokenIs(token, "if"))
+        {
+            reason = "expected 'if'";
+            break;
+        }
+        if (program.ruleCount == RULES_MAX)
+        {
+            reason = "too many rules";
+            break;
+        }
+
+        Rule &rule = program.rules[program.ruleCount];
+        memset(&rule, 0, sizeof(rule));
+        rule.code = program.codeLength;
+        rule.offValue = RULE_NO_TEXT;
+        rule.state = -1;
+        rule.dirty = true;
+
+        // Conditions: "and" terms are reduced as they come, "or" once the next term is complete
+        bool andPending = false;
+        bool orPending = false;
+        while (!reason)
+        {
+            Token topic, op, number, next, band;
+            int32_t threshold, hysteresis;
+
+            if (!nextToken(cursor, end, topic) || !nextToken(cursor, end, op) || !nextToken(cursor, end, number))
+            {
+                reason = "incomplete condition";
+                break;
+            }
+            RuleOp compare = comparison(op);
+            int input = validTopic(topic) ? addInput(topic) : -2;
+            int constant = parseNumber(number, threshold) ? addConst(threshold) : -2;
+            if (compare == OP_END)
+            {
+                reason = "unknown comparison";
+                break;
+            }
+            if (input == -2)
+            {
+                reason = "input topic has wildcards";
+                break;
+            }
+            if (constant == -2)
+            {
+                reason = "threshold is not a number";
+                break;
+            }
+            if (input < 0 || constant < 0)
+            {
+                reason = "too many inputs or constants";
+                break;
+            }
+            emit(OP_INPUT);
+            emit(static_cast<uint8_t>(input));
+            emit(OP_CONST);
+            emit(static_cast<uint8_t>(constant));
+            rule.inputs |= 1UL << input;
+
+            if (!nextToken(cursor, end, next))
+            {
+                reason = "expected 'then'";
+                break;
+            }
+            if (tokenIs(next, "hyst"))
+            {
+                if (compare == OP_EQ || compare == OP_NE)
+                {
+                    reason = "hyst needs <, >, <= or >=";
+                    break;
+                }
+                if (!nextToken(cursor, end, band) || !parseNumber(band, hysteresis) || hysteresis < 0)
+                {
+                    reason = "hyst is not a positive number";
+                    break;
+                }
+                if ((constant = addConst(hysteresis)) < 0)
+                {
+                    reason = "too many inputs or constants";
+                    break;
+                }
+                emit(OP_CONST);
+                emit(static_cast<uint8_t>(constant));
+                emit(static_cast<uint8_t>(compare + (OP_HGT - OP_GT)));
+                if (!nextToken(cursor, end, next))
+                {
+                    reason = "expected 'then'";
+                    break;
+                }
+            }
+            else
+            {
+                emit(compare);
+            }
+
+            if (andPending)
+            {
+                emit(OP_AND);
+                andPending = false;
+            }
+            if (tokenIs(next, "and"))
+            {
+                andPending = true;
+            }
+            else if (tokenIs(next, "or"))
+            {
+                if (orPending)
+                {
+                    emit(OP_OR);
+                }
+                orPending = true;
+            }
+            else if (tokenIs(next, "then"))
+            {
+                break;
+            }
+            else
+            {
+                reason = "expected 'and', 'or' or 'then'";
+            }
+        }
+        if (reason)
+        {
+            break;
+        }
+        if (orPending)
+        {
+            emit(OP_OR);
+        }
+        emit(OP_END);
+
+        // Action and options
+        Token target, assign, value;
+        int offset;
+        if (!nextToken(cursor, end, target) || !nextToken(cursor, end, assign) || !tokenIs(assign, "=") ||
+            !nextToken(cursor, end, value))
+        {
+            reason = "expected 'then <topic> = <value>'";
+            break;
+        }
+        if (!validTopic(target))
+        {
+            reason = "target topic has wildcards";
+            break;
+        }
+        if ((offset = addText(target)) < 0)
+        {
+            reason = "rules too long";
+            break;
+        }
+        rule.target = static_cast<uint16_t>(offset);
+        if ((offset = addText(value)) < 0)
+        {
+            reason = "rules too long";
+            break;
+        }
+        rule.onValue = static_cast<uint16_t>(offset);
+
+        while (!reason && nextToken(cursor, end, token))
+        {
+            Token argument;
+            if (!nextToken(cursor, end, argument))
+            {
+                reason = "option without a value";
+            }
+            else if (tokenIs(token, "else"))
+            {
+                offset = addText(argument);
+                rule.offValue = static_cast<uint16_t>(offset);
+                reason = offset < 0 ? "rules too long" : nullptr;
+            }
+            else if (tokenIs(token, "min_on"))
+            {
+                reason = parseSeconds(argument, rule.minOnS) ? nullptr : "min_on is not a number of seconds";
+            }
+            else if (tokenIs(token, "min_off"))
+            {
+                reason = parseSeconds(argument, rule.minOffS) ? nullptr : "min_off is not a number of seconds";
+            }
+            else
+            {
+                reason = "unknown option";
+            }
+        }
+        if (!reason && program.codeLength > RULES_CODE_SIZE)
+        {
+            reason = "rules too long";
+        }
+        if (!reason)
+        {
+            program.ruleCount++;
+        }
+    }
+
+    if (reason)
+    {
+        snprintf(error, errorSize, "line %u: %s", lineNumber, reason);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Runs the condition of a rule.
+ * @return 1 or 0, or -1 while one of its inputs has no value.
+ */
+int RuleEngine::evaluate(const Program &program, const Rule &rule) const
+{
+    int32_t stack[RULES_STACK];
+    size_t depth = 0;
+    bool on = rule.state == 1;
+
+    for (size_t pc = rule.code;;)
+    {
+        uint8_t op = program.code[pc++];
+        switch (op)
+        {
+        case OP_END:
+            return stack[0] != 0;
+        case OP_INPUT:
+        {
+            const Input &input = program.inputs[program.code[pc++]];
+            if (!input.valid)
+            {
+                return -1;
+            }
+            stack[depth++] = input.value;
+            break;
+        }
+        case OP_CONST:
+            stack[depth++] = program.consts[program.code[pc++]];
+            break;
+        case OP_AND:
+            depth--;
+            stack[depth - 1] = stack[depth - 1] && stack[depth];
+            break;
+        case OP_OR:
+            depth--;
+            stack[depth - 1] = stack[depth - 1] || stack[depth];
+            break;
+        default:
+        {
+            // The band moves the threshold against the change, so an output that is
+            // on stays on until the input is clearly back on the other side
+            int64_t band = 0;
+            if (op >= OP_HGT)
+            {
+                band = on ? stack[depth - 1] : 0;
+                depth--;
+                op -= OP_HGT - OP_GT;
+            }
+            int64_t b = stack[--depth];
+            int64_t a = stack[depth - 1];
+            bool result = false;
+            switch (op)
+            {
+            case OP_GT:
+                result = a > b - band;
+                break;
+            case OP_LT:
+                result = a < b + band;
+                break;
+            case OP_GE:
+                result = a >= b - band;
+                break;
+            case OP_LE:
+                result = a <= b + band;
+                break;
+            case OP_EQ:
+                result = a == b;
+                break;
+            case OP_NE:
+                result = a != b;
+                break;
+            }
+            stack[depth - 1] = result;
+            break;
+        }
+        }
+    }
+}
+
+/**
+ * Evaluates a rule and publishes its new output, unless min_on/min_off hold the
+ * current one.
+ */
+void RuleEngine::apply(Rule &rule, uint32_t nowMs, RuleOutput output, void *ctx)
+{
+    const Program &program = programs[active];
+
+    rule.dirty = false;
+    int result = evaluate(program, rule);
+    evaluations.add();
+    if (result < 0 || result == rule.state)
+    {
+        rule.held = false;
+        return;
+    }
+
+    if (rule.state >= 0)
+    {
+        uint32_t holdMs = static_cast<uint32_t>(rule.state ? rule.minOnS : rule.minOffS) * 1000;
+        if (nowMs - rule.changedMs < holdMs)
+        {
+            if (!rule.held)
+            {
+                rule.held = true;
+                holds.add();
+            }
+            return;
+        }
+    }
+
+    rule.held = false;
+    rule.state = static_cast<int8_t>(result);
+    rule.changedMs = nowMs;
+    uint16_t value = result ? rule.onValue : rule.offValue;
+    if (value != RULE_NO_TEXT)
+    {
+        fired.add();
+        output(ctx, program.text + rule.target, program.text + value);
+    }
+}
+
+/**
+ * Evaluates the dirty rules until none is left. An output feeding another rule
+ * marks it dirty from a nested update(); a chain that keeps toggling is cut
+ * after RULES_MAX passes and resumes on the next poll().
+ */
+void RuleEngine::drain(uint32_t nowMs, RuleOutput output, void *ctx)
+{
+    Program &program = programs[active];
+    bool pending = true;
+
+    evaluating = true;
+    for (size_t pass = 0; pending && pass < RULES_MAX; pass++)
+    {
+        pending = false;
+        for (uint8_t i = 0; i < program.ruleCount; i++)
+        {
+            if (program.rules[i].dirty)
+            {
+                apply(program.rules[i], nowMs, output, ctx);
+            }
+        }
+        for (uint8_t i = 0; i < program.ruleCount; i++)
+        {
+            pending = pending || program.rules[i].dirty;
+        }
+    }
+    evaluating = false;
+}
+
+/**
+ * Updates an input and evaluates the rules that read it.
+ */
+void RuleEngine::update(uint8_t input, int32_t value, uint32_t nowMs, RuleOutput output, void *ctx)
+{
+    Program &program = programs[active];
+    if (input >= program.inputCount)
+    {
+        return;
+    }
+
+    Input &in = program.inputs[input];
+    if (in.valid && in.value == value)
+    {
+        return;
+    }
+    in.valid = true;
+    in.value = value;
+
+    for (uint8_t i = 0; i < program.ruleCount; i++)
+    {
+        if (program.rules[i].inputs & (1UL << input))
+        {
+            program.rules[i].dirty = true;
+        }
+    }
+    if (!evaluating)
+    {
+        drain(nowMs, output, ctx);
+    }
+}
+
+/**
+ * Evaluates the rules of a new program and retries the postponed changes.
+ */
+void RuleEngine::poll(uint32_t nowMs, RuleOutput output, void *ctx)
+{
+    Program &program = programs[active];
+    bool pending = false;
+
+    for (uint8_t i = 0; i < program.ruleCount; i++)
+    {
+        Rule &rule = program.rules[i];
+        rule.dirty = rule.dirty || rule.held;
+        pending = pending || rule.dirty;
+    }
+    if (pending)
+    {
+        drain(nowMs, output, ctx);
+    }
+}
+
+const char *RuleEngine::inputTopic(uint8_t input) const
+{
+    const Program &program = programs[active];
+    return input < program.inputCount ? program.text + program.inputs[input].topic : "";
+}
+
+/**
+ * Writes the accepted rules text to flash.
+ */
+bool RuleEngine::save(const char *text)
+{
+    if (!fs)
+    {
+        return false;
+    }
+    fs::File file = fs->open(RULES_FILE, "w");
+    if (!file)
+    {
+        return false;
+    }
+    size_t length = strlen(text);
+    bool ok = file.write(reinterpret_cast<const uint8_t *>(text), length) == length;
+    file.close();
+    return ok;
+}
+
+void RuleEngine::registerMetrics(MetricsRegistry &registry)
+{
+    registry.add("rules/count", loaded);
+    registry.add("rules/evaluations", evaluations);
+    registry.add("rules/fired", fired);
+    registry.add("rules/held", holds);
+    registry.add("rules/rejected", rejected);
+}
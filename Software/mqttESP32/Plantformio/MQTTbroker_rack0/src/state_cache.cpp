@@ -0,0 +1,181 @@
+/*
+ * state_cache.cpp
+ * Description: Implementation of the last-value cache.
+ */
+
+#include "state_cache.h"
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Binds the next slot to a topic.
+ * @param topic The topic string, must outlive the cache.
+ * @return The slot index, or -1 if the table is full.
+ */
+int StateCache::bind(const char *topic)
+{
+    if (count >= STATE_MAX_TOPICS)
+    {
+        return -1;
+    }
+    topics[count] = topic;
+    values[count][0] = '\0';
+    valid[count] = false;
+    return count++;
+}
+
+/**
+ * Stores the last payload of a slot. Longer payloads are not cached.
+ * @param slot The slot index.
+ * @param payload The payload.
+ */
+void StateCache::update(int slot, const char *payload)
+{
+    if (slot < 0 || slot >= count)
+    {
+        return;
+    }
+
+    size_t length = strlen(payload);
+    if (length >= STATE_VALUE_SIZE)
+    {
+        return;
+    }
+    memcpy(values[slot], payload, length + 1);
+    valid[slot] = true;
+}
+
+/**
+ * Appends text as a JSON string, quoted and escaped.
+ * @return false if it does not fit, with one byte left for the terminator.
+ */
+static bool appendJsonString(char *buffer, size_t size, size_t &length, const char *text)
+{
+    if (length + 1 >= size)
+    {
+        return false;
+    }
+    buffer[length++] = '"';
+
+    for (const char *c = text; *c; c++)
+    {
+        char escaped[7];
+        size_t n = 0;
+        unsigned char ch = static_cast<unsigned char>(*c);
+        if (ch == '"' || ch == '\\')
+        {
+            escaped[n++] = '\\';
+            escaped[n++] = static_cast<char>(ch);
+        }
+        else if (ch < 0x20)
+        {
+            n = static_cast<size_t>(snprintf(escaped, sizeof(escaped), "\\u%04x", ch));
+        }
+        else
+        {
+            escaped[n++] = static_cast<char>(ch);
+        }
+        if (length + n >= size)
+        {
+            return false;
+        }
+        memcpy(buffer + length, escaped, n);
+        length += n;
+    }
+
+    if (length + 1 >= size)
+    {
+        return false;
+    }
+    buffer[length++] = '"';
+    return true;
+}
+
+/**
+ * Writes every cached value as a JSON object {"topic":"value",...}, escaping
+ * quotes, backslashes and control characters.
+ * @param buffer Destination buffer.
+ * @param size Size of the buffer.
+ * @return Length written, 0 if the snapshot does not fit.
+ */
+size_t StateCache::snapshot(char *buffer, size_t size) const
+{
+    size_t length = 0;
+    bool first = true;
+
+    if (size < 3)
+    {
+        return 0;
+    }
+    buffer[length++] = '{';
+
+    for (int slot = 0; slot < count; slot++)
+    {
+        if (!valid[slot])
+        {
+            continue;
+        }
+
+        if (!first)
+        {
+            if (length + 1 >= size)
+            {
+                return 0;
+            }
+            buffer[length++] = ',';
+        }
+        if (!appendJsonString(buffer, size, length, topics[slot]) || length + 1 >= size)
+        {
+            return 0;
+        }
+        buffer[length++] = ':';
+        if (!appendJsonString(buffer, size, length, values[slot]))
+        {
+            return 0;
+        }
+        first = false;
+    }
+
+    if (length + 2 > size)
+    {
+        return 0;
+    }
+    buffer[length++] = '}';
+    buffer[length] = '\0';
+    return length;
+}
+
+/**
+ * MQTT topic filter matching ('+' one level, '#' the remaining levels).
+ * @param filter The topic filter.
+ * @param topic The topic name.
+ * @return true if the topic matches.
+ */
+bool StateCache::topicMatches(const char *filter, const char *topic)
+{
+    while (*filter)
+    {
+        if (*filter == '#')
+        {
+            return true;
+        }
+        if (*filter == '+')
+        {
+            // Consume one level of the topic
+            while (*topic && *topic != '/')
+            {
+                topic++;
+            }
+            filter++;
+            continue;
+        }
+        if (*filter != *topic)
+        {
+            // "a/#" also matches "a"
+            return *topic == '\0' && filter[0] == '/' && filter[1] == '#' && filter[2] == '\0';
+        }
+        filter++;
+        topic++;
+    }
+    return *topic == '\0';
+}
@@ -0,0 +1,107 @@
+/*
+ * topic_trie.cpp
+ * Description: Implementation of the topic-level trie.
+ */
+
+#include "topic_trie.h"
+
+/**
+ * Removes every filter.
+ */
+void TopicTrie::clear()
+{
+    // Node 0 is the root, above the first level
+    pool[0].text = 0;
+    pool[0].length = 0;
+    pool[0].child = -1;
+    pool[0].sibling = -1;
+    pool[0].routes = -1;
+    nodes = 1;
+    routeCount = 0;
+    textUsed = 0;
+}
+
+/**
+ * Attaches a value to a filter. A filter may hold several values.
+ * @param filter MQTT filter ("rack0/actu/#", "+/sens/+/ph").
+ * @param value Value returned by match().
+ * @return false if the filter is invalid or the pools are full.
+ */
+bool TopicTrie::insert(const char *filter, TrieValue value)
+{
+    if (!filter || routeCount >= TRIE_MAX_ROUTES)
+    {
+        return false;
+    }
+
+    int16_t node = 0;
+    const char *level = filter;
+
+    for (;;)
+    {
+        const char *end = strchr(level, '/');
+        size_t length = end ? static_cast<size_t>(end - level) : strlen(level);
+
+        // Wildcards take a whole level, and '#' only the last one
+        for (size_t i = 0; i < length; i++)
+        {
+            if ((level[i] == '+' || level[i] == '#') && length != 1)
+            {
+                return false;
+            }
+        }
+        if (level[0] == '#' && end)
+        {
+            return false;
+        }
+
+        node = child(node, level, length);
+        if (node < 0)
+        {
+            return false;
+        }
+        if (!end)
+        {
+            break;
+        }
+        level = end + 1;
+    }
+
+    Route &route = routes[routeCount];
+    route.value = value;
+    route.next = pool[node].routes;
+    pool[node].routes = static_cast<int16_t>(routeCount++);
+    return true;
+}
+
+/**
+ * Finds or creates the child of a node for one level.
+ * @return The child, or -1 if the pools are full.
+ */
+int16_t TopicTrie::child(int16_t node, const char *level, size_t length)
+{
+    for (int16_t c = pool[node].child; c >= 0; c = pool[c].sibling)
+    {
+        if (pool[c].length == length && memcmp(&text[pool[c].text], level, length) == 0)
+        {
+            return c;
+        }
+    }
+
+    if (nodes >= TRIE_MAX_NODES || length > UINT8_MAX || textUsed + length > TRIE_TEXT_SIZE)
+    {
+        return -1;
+    }
+
+    Node &added = pool[nodes];
+    memcpy(&text[textUsed], level, length);
+    added.text = static_cast<uint16_t>(textUsed);
+    added.length = static_cast<uint8_t>(length);
+    added.child = -1;
+    added.sibling = pool[node].child;
+    added.routes = -1;
+    textUsed += length;
+
+    pool[node].child = static_cast<int16_t>(nodes);
+    return static_cast<int16_t>(nodes++);
+}
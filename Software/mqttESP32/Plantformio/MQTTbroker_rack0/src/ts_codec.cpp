@@ -0,0 +1,350 @@
+/*
+ * ts_codec.cpp
+ * Description: Implementation of the bit-packed time-series segment codec.
+ */
+
+#include "ts_codec.h"
+#include <string.h>
+
+/* =======================
+ * Helpers
+ * =======================
+ */
+
+static inline uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static inline void putU32(uint8_t *data, uint32_t value)
+{
+    data[0] = (uint8_t)value;
+    data[1] = (uint8_t)(value >> 8);
+    data[2] = (uint8_t)(value >> 16);
+    data[3] = (uint8_t)(value >> 24);
+}
+
+static inline uint32_t getU32(const uint8_t *data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/* =======================
+ * TsEncoder
+ * =======================
+ */
+
+/**
+ * Starts a segment with its first sample, stored in the header.
+ * @param data Segment buffer, cleared by this call.
+ * @param size Size of the buffer (more than TS_HEADER_SIZE).
+ * @param first The first sample.
+ */
+void TsEncoder::begin(uint8_t *data, size_t size, const TsSample &first)
+{
+    buffer = data;
+    capacity = size;
+    memset(buffer, 0, capacity);
+
+    buffer[0] = TS_MAGIC0;
+    buffer[1] = TS_MAGIC1;
+    buffer[2] = TS_VERSION;
+    buffer[3] = 0;
+    putU32(&buffer[4], first.ts);
+    putU32(&buffer[8], (uint32_t)first.value);
+
+    bitPos = TS_HEADER_SIZE * 8;
+    lastTs = first.ts;
+    lastDelta = 0;
+    lastValue = first.value;
+    samples = 1;
+}
+
+/**
+ * Appends a sample.
+ * @param sample The sample, not older than the previous one.
+ * @return false if the segment is full (or the sample goes back in time).
+ */
+bool TsEncoder::append(const TsSample &sample)
+{
+    if (!buffer || sample.ts < lastTs || bitPos + TS_MAX_RECORD_BITS > capacity * 8)
+    {
+        return false;
+    }
+
+    int64_t delta = (int64_t)sample.ts - lastTs;
+    int64_t dod = delta - lastDelta;
+    uint32_t z = (dod >= INT32_MIN && dod <= INT32_MAX) ? zigzag((int32_t)dod) : 0xFFFFFFFFu;
+
+    if (z == 0)
+    {
+        putBits(0, 1);
+    }
+    else if (z < 128)
+    {
+        putBits(0x2, 2);
+        putBits(z, 7);
+    }
+    else if (z < 4096)
+    {
+        putBits(0x6, 3);
+        putBits(z, 12);
+    }
+    else
+    {
+        // Raw delta: also covers delta-of-delta overflow
+        putBits(0x7, 3);
+        putBits((uint32_t)delta, 32);
+    }
+
+    uint32_t v = zigzag((int32_t)((uint32_t)sample.value - (uint32_t)lastValue));
+
+    if (v == 0)
+    {
+        putBits(0, 1);
+    }
+    else if (v < 128)
+    {
+        putBits(0x2, 2);
+        putBits(v, 7);
+    }
+    else if (v < 16384)
+    {
+        putBits(0x6, 3);
+        putBits(v, 14);
+    }
+    else
+    {
+        putBits(0x7, 3);
+        putBits((uint32_t)sample.value, 32);
+    }
+
+    lastDelta = delta;
+    lastTs = sample.ts;
+    lastValue = sample.value;
+    samples++;
+    return true;
+}
+
+/**
+ * Pads the last byte and closes the segment.
+ * @return Total segment length in bytes.
+ */
+size_t TsEncoder::finish()
+{
+    uint8_t pad = (uint8_t)((8 - (bitPos % 8)) % 8);
+    if (pad > 0)
+    {
+        putBits((1u << pad) - 1, pad);
+    }
+    return bitPos / 8;
+}
+
+/**
+ * Copies the segment as it would be if finished now, leaving it open.
+ * @param out Destination buffer, at least as large as the segment buffer.
+ * @return Length copied.
+ */
+size_t TsEncoder::snapshot(uint8_t *out) const
+{
+    size_t length = (bitPos + 7) / 8;
+    uint8_t pad = (uint8_t)((8 - (bitPos % 8)) % 8);
+
+    memcpy(out, buffer, length);
+    if (pad > 0)
+    {
+        out[length - 1] |= (uint8_t)((1u << pad) - 1);
+    }
+    return length;
+}
+
+void TsEncoder::putBits(uint32_t value, uint8_t bits)
+{
+    while (bits-- > 0)
+    {
+        if ((value >> bits) & 1u)
+        {
+            buffer[bitPos / 8] |= (uint8_t)(0x80u >> (bitPos % 8));
+        }
+        bitPos++;
+    }
+}
+
+/* =======================
+ * TsDecoder
+ * =======================
+ */
+
+/**
+ * Starts decoding a segment.
+ * @param data Segment bytes.
+ * @param size Number of bytes available.
+ * @return false if the header is missing or invalid.
+ */
+bool TsDecoder::begin(const uint8_t *data, size_t size)
+{
+    if (size < TS_HEADER_SIZE || data[0] != TS_MAGIC0 || data[1] != TS_MAGIC1 || data[2] != TS_VERSION)
+    {
+        return false;
+    }
+
+    buffer = data;
+    length = size;
+    bitPos = TS_HEADER_SIZE * 8;
+    lastTs = getU32(&data[4]);
+    lastValue = (int32_t)getU32(&data[8]);
+    lastDelta = 0;
+    first = true;
+    return true;
+}
+
+/**
+ * Decodes the next sample.
+ * @param sample Receives the sample.
+ * @return false at the end of the segment.
+ */
+bool TsDecoder::next(TsSample &sample)
+{
+    if (!buffer)
+    {
+        return false;
+    }
+
+    if (first)
+    {
+        first = false;
+        sample.ts = lastTs;
+        sample.value = lastValue;
+        return true;
+    }
+
+    // Decode into locals and commit only once the whole record is present
+    size_t start = bitPos;
+    uint32_t prefix;
+    uint32_t raw;
+    int64_t delta;
+    int32_t value;
+
+    if (!getBits(1, prefix))
+    {
+        return false;
+    }
+    if (prefix == 0)
+    {
+        delta = lastDelta;
+    }
+    else
+    {
+        uint32_t more;
+        if (!getBits(1, more))
+        {
+            bitPos = start;
+            return false;
+        }
+        if (more == 0)
+        {
+            if (!getBits(7, raw))
+            {
+                bitPos = start;
+                return false;
+            }
+            delta = lastDelta + unzigzag(raw);
+        }
+        else
+        {
+            if (!getBits(1, more))
+            {
+                bitPos = start;
+                return false;
+            }
+            if (more == 0)
+            {
+                if (!getBits(12, raw))
+                {
+                    bitPos = start;
+                    return false;
+                }
+                delta = lastDelta + unzigzag(raw);
+            }
+            else
+            {
+                if (!getBits(32, raw))
+                {
+                    bitPos = start;
+                    return false;
+                }
+                delta = raw;
+            }
+        }
+    }
+
+    if (!getBits(1, prefix))
+    {
+        bitPos = start;
+        return false;
+    }
+    if (prefix == 0)
+    {
+        value = lastValue;
+    }
+    else
+    {
+        uint32_t more;
+        uint8_t bits;
+        bool absolute = false;
+
+        if (!getBits(1, more))
+        {
+            bitPos = start;
+            return false;
+        }
+        if (more == 0)
+        {
+            bits = 7;
+        }
+        else
+        {
+            if (!getBits(1, more))
+            {
+                bitPos = start;
+                return false;
+            }
+            bits = (more == 0) ? 14 : 32;
+            absolute = (more != 0);
+        }
+        if (!getBits(bits, raw))
+        {
+            bitPos = start;
+            return false;
+        }
+        value = absolute ? (int32_t)raw : (int32_t)((uint32_t)lastValue + (uint32_t)unzigzag(raw));
+    }
+
+    lastDelta = delta;
+    lastTs = (uint32_t)(lastTs + delta);
+    lastValue = value;
+    sample.ts = lastTs;
+    sample.value = lastValue;
+    return true;
+}
+
+bool TsDecoder::getBits(uint8_t bits, uint32_t &value)
+{
+    if (bitPos + bits > length * 8)
+    {
+        return false;
+    }
+
+    value = 0;
+    while (bits-- > 0)
+    {
+        value = (value << 1) | ((buffer[bitPos / 8] >> (7 - (bitPos % 8))) & 1u);
+        bitPos++;
+    }
+    return true;
+}
@@ -0,0 +1,324 @@
+/*
+ * ts_store.cpp
+ * Description: Implementation of the append-only time-series store.
+ */
+
+#include "ts_store.h"
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Binds the store to a mounted file system and allocates the open segments.
+ * The flash share and the RAM are split between the configured series only.
+ * @param fileSystem The file system (LittleFS).
+ * @param fsBytes Total size of the file system, used to size the retention.
+ * @param series Number of series (one per sensor topic of each configured rack).
+ * @return true if successful.
+ */
+bool TimeSeriesStore::begin(fs::FS &fileSystem, size_t fsBytes, size_t series)
+{
+    if (seriesData || series == 0 || series > TS_MAX_SERIES)
+    {
+        return false;
+    }
+
+    maxSegments = fsBytes / 100 * TS_FS_SHARE_PERCENT / TS_SEGMENT_SIZE / series;
+    if (maxSegments > TS_MAX_SEGMENTS)
+    {
+        maxSegments = TS_MAX_SEGMENTS;
+    }
+    if (maxSegments < 2)
+    {
+        return false;
+    }
+
+    seriesData = new (std::nothrow) Series[series];
+    if (!seriesData)
+    {
+        return false;
+    }
+    seriesCount = series;
+    fs = &fileSystem;
+
+    fs->mkdir(TS_ROOT);
+    for (size_t i = 0; i < seriesCount; i++)
+    {
+        char path[24];
+        snprintf(path, sizeof(path), TS_ROOT "/%u", (unsigned)i);
+        fs->mkdir(path);
+    }
+    return true;
+}
+
+/**
+ * Appends a sample to a series.
+ * @param series Series index (< the count given to begin()).
+ * @param ts Unix time in seconds.
+ * @param value Value in thousandths of the unit.
+ * @return true if stored.
+ */
+bool TimeSeriesStore::append(uint8_t series, uint32_t ts, int32_t value)
+{
+    if (!fs || series >= seriesCount || ts < TS_MIN_VALID_TIME)
+    {
+        return false;
+    }
+
+    Series &s = seriesData[series];
+    TsSample sample = {ts, value};
+
+    if (s.open && s.encoder.append(sample))
+    {
+        return true;
+    }
+
+    // Segment full, or the clock went backwards: start a new one
+    if (s.open)
+    {
+        closeSegment(series);
+    }
+    openSegment(series, sample);
+    return true;
+}
+
+/**
+ * Writes the open segments to flash once per TS_FLUSH_PERIOD_MS.
+ * @param nowMs Current millis().
+ */
+void TimeSeriesStore::poll(uint32_t nowMs)
+{
+    if (nowMs - lastFlush >= TS_FLUSH_PERIOD_MS)
+    {
+        lastFlush = nowMs;
+        flush();
+    }
+}
+
+/**
+ * Writes the finished bytes of every open segment to flash.
+ */
+void TimeSeriesStore::flush()
+{
+    for (uint8_t series = 0; series < seriesCount; series++)
+    {
+        if (seriesData[series].open)
+        {
+            persist(series, seriesData[series].encoder.completeBytes());
+        }
+    }
+}
+
+/**
+ * Reads the samples of a series between two times.
+ * Segments are visited oldest first; one that ends before the next one starts is
+ * skipped without being read when it lies entirely before the range.
+ * @param series Series index.
+ * @param from First time, inclusive.
+ * @param to Last time, inclusive.
+ * @param step Aggregation step in seconds (mean per step), 0 for raw samples.
+ * @param emit Result callback.
+ * @param ctx Callback context.
+ * @return Number of results emitted.
+ */
+size_t TimeSeriesStore::query(uint8_t series, uint32_t from, uint32_t to, uint32_t step, TsEmit emit, void *ctx)
+{
+    if (!fs || series >= seriesCount || from > to)
+    {
+        return 0;
+    }
+
+    Series &s = seriesData[series];
+    size_t count = listSegments(series);
+    size_t emitted = 0;
+    bool haveBucket = false;
+    uint32_t bucket = 0;
+    int64_t sum = 0;
+    uint32_t samples = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (segmentNames[i] > to)
+        {
+            break;
+        }
+        if (i + 1 < count && segmentNames[i + 1] <= from)
+        {
+            continue;
+        }
+
+        size_t length = 0;
+        if (s.open && segmentNames[i] == s.name)
+        {
+            length = s.encoder.snapshot(readBuffer); // Newest data is still in RAM
+        }
+        else
+        {
+            char path[32];
+            segmentPath(path, sizeof(path), series, segmentNames[i]);
+            fs::File file = fs->open(path, "r");
+            if (!file)
+            {
+                continue;
+            }
+            length = file.read(readBuffer, sizeof(readBuffer));
+            file.close();
+        }
+
+        TsDecoder decoder;
+        TsSample sample;
+        if (!decoder.begin(readBuffer, length))
+        {
+            continue;
+        }
+
+        while (decoder.next(sample))
+        {
+            if (sample.ts < from)
+            {
+                continue;
+            }
+            if (sample.ts > to)
+            {
+                break;
+            }
+            if (step == 0)
+            {
+                emit(ctx, sample.ts, sample.value);
+                emitted++;
+                continue;
+            }
+
+            uint32_t start = from + (sample.ts - from) / step * step;
+            if (haveBucket && start != bucket)
+            {
+                emit(ctx, bucket, (int32_t)(sum / samples));
+                emitted++;
+                sum = 0;
+                samples = 0;
+            }
+            haveBucket = true;
+            bucket = start;
+            sum += sample.value;
+            samples++;
+        }
+    }
+
+    if (haveBucket && samples > 0)
+    {
+        emit(ctx, bucket, (int32_t)(sum / samples));
+        emitted++;
+    }
+    return emitted;
+}
+
+void TimeSeriesStore::segmentPath(char *path, size_t size, uint8_t series, uint32_t name) const
+{
+    snprintf(path, size, TS_ROOT "/%u/%08lx", series, (unsigned long)name);
+}
+
+/**
+ * Starts a segment, dropping the oldest ones beyond the retention.
+ */
+void TimeSeriesStore::openSegment(uint8_t series, const TsSample &first)
+{
+    Series &s = seriesData[series];
+    size_t count = listSegments(series);
+    char path[32];
+
+    for (size_t i = 0; count - i >= maxSegments && i < count; i++)
+    {
+        segmentPath(path, sizeof(path), series, segmentNames[i]);
+        fs->remove(path);
+    }
+
+    // Never append to an existing file (restart within the same second)
+    s.name = first.ts;
+    segmentPath(path, sizeof(path), series, s.name);
+    while (fs->exists(path))
+    {
+        s.name++;
+        segmentPath(path, sizeof(path), series, s.name);
+    }
+
+    s.encoder.begin(s.buffer, sizeof(s.buffer), first);
+    s.flushed = 0;
+    s.open = true;
+}
+
+/**
+ * Pads and writes the rest of the open segment.
+ */
+void TimeSeriesStore::closeSegment(uint8_t series)
+{
+    Series &s = seriesData[series];
+
+    persist(series, s.encoder.finish());
+    s.open = false;
+}
+
+/**
+ * Appends the bytes of the open segment not yet on flash.
+ */
+void TimeSeriesStore::persist(uint8_t series, size_t upTo)
+{
+    Series &s = seriesData[series];
+
+    if (upTo <= s.flushed)
+    {
+        return;
+    }
+
+    char path[32];
+    segmentPath(path, sizeof(path), series, s.name);
+    fs::File file = fs->open(path, "a");
+    if (!file)
+    {
+        return;
+    }
+    s.flushed += file.write(&s.buffer[s.flushed], upTo - s.flushed);
+    file.close();
+}
+
+/**
+ * Lists the segments of a series into segmentNames, oldest first.
+ * @return Number of segments.
+ */
+size_t TimeSeriesStore::listSegments(uint8_t series)
+{
+    Series &s = seriesData[series];
+    char path[24];
+    size_t count = 0;
+    bool openListed = false;
+
+    snprintf(path, sizeof(path), TS_ROOT "/%u", series);
+    fs::File dir = fs->open(path);
+    if (dir && dir.isDirectory())
+    {
+        for (fs::File entry = dir.openNextFile(); entry && count < TS_MAX_SEGMENTS; entry = dir.openNextFile())
+        {
+            const char *name = strrchr(entry.name(), '/');
+            name = name ? name + 1 : entry.name();
+
+            uint32_t value = (uint32_t)strtoul(name, nullptr, 16);
+            openListed = openListed || (s.open && value == s.name);
+
+            // Insertion sort, the lists are short
+            size_t i = count++;
+            while (i > 0 && segmentNames[i - 1] > value)
+            {
+                segmentNames[i] = segmentNames[i - 1];
+                i--;
+            }
+            segmentNames[i] = value;
+        }
+    }
+
+    // The open segment has no file until its first flush; it is always the newest
+    if (s.open && !openListed && count < TS_MAX_SEGMENTS)
+    {
+        segmentNames[count++] = s.name;
+    }
+    return count;
+}
@@ -0,0 +1,767 @@
+/*
+ * uart_link.cpp
+ * Description: Implementation of the event-queue driven UART link.
+ */
+
+#include "uart_link.h"
+#include <esp_timer.h>
+#include "heap_monitor.h"
+
+/** Rates proposed to the boards, fastest first */
+static const uint32_t baudCandidates[] = {2000000, 1000000, 460800, 230400};
+static const size_t baudCandidateCount = sizeof(baudCandidates) / sizeof(baudCandidates[0]);
+
+/** No "baud*RATE" answer since the last step */
+static const uint32_t BAUD_NO_ANSWER = UINT32_MAX;
+
+/** Frames in flight and credit are compared as 16-bit differences, like the board does */
+static inline int16_t creditDelta(uint16_t a, uint16_t b)
+{
+    return static_cast<int16_t>(static_cast<uint16_t>(a - b));
+}
+
+/**
+ * Constructor for UartLink.
+ * @param port ESP-IDF UART port (UART_NUM_1, UART_NUM_2).
+ * @param name Task name prefix, for debugging.
+ */
+UartLink::UartLink(uart_port_t port, const char *name)
+    : port(port), name(name), events(nullptr), egressHandle(nullptr), consumer(nullptr), valuesDirty(0), valueNext(0), maxBaud(UART_BAUD_DEFAULT),
+      baudState(BaudState::IDLE), candidate(0), missedKeepalives(0), baudDeadlineMs(0), baudAnswer(BAUD_NO_ANSWER),
+      rxCount(0), boardGrant(0), boardGranted(false), grantReceived(0), grantFree(0), grantWanted(false), grantMs(0),
+      txCount(0), boardReceived(0), boardFree(0), boardGrantMs(0), lastWriteMs(0), creditActive(false), sampledMs(0), sampledRxBytes(0), sampledTxBytes(0)
+{
+    for (UartValue &value : values)
+    {
+        value.id.store(0, std::memory_order_relaxed);
+        value.milli.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Installs the UART driver and starts the ingest and egress tasks.
+ * The link starts at UART_BAUD_DEFAULT.
+ * @param baud Highest rate to negotiate.
+ * @param rxPin RX GPIO.
+ * @param txPin TX GPIO.
+ * @param rtsPin RTS GPIO, UART_PIN_NO_CHANGE without hardware flow control.
+ * @param ctsPin CTS GPIO, UART_PIN_NO_CHANGE without hardware flow control.
+ * @return true if successful.
+ */
+bool UartLink::begin(uint32_t baud, int rxPin, int txPin, int rtsPin, int ctsPin)
+{
+    bool hardwareFlow = rtsPin != UART_PIN_NO_CHANGE && ctsPin != UART_PIN_NO_CHANGE;
+
+    uart_config_t config = {};
+    config.baud_rate = UART_BAUD_DEFAULT;
+    config.data_bits = UART_DATA_8_BITS;
+    config.parity = UART_PARITY_DISABLE;
+    config.stop_bits = UART_STOP_BITS_1;
+    config.flow_ctrl = hardwareFlow ? UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE;
+    config.rx_flow_ctrl_thresh = UART_RTS_THRESHOLD;
+    config.source_clk = UART_SCLK_APB;
+
+    if (uart_driver_install(port, UART_RX_RING_SIZE, UART_TX_RING_SIZE, UART_EVENT_QUEUE_LEN, &events, 0) != ESP_OK ||
+        uart_param_config(port, &config) != ESP_OK ||
+        uart_set_pin(port, txPin, rxPin, hardwareFlow ? rtsPin : UART_PIN_NO_CHANGE,
+                     hardwareFlow ? ctsPin : UART_PIN_NO_CHANGE) != ESP_OK)
+    {
+        return false;
+    }
+
+    // One event per delimiter; the positions are queued by the driver
+    uart_enable_pattern_det_baud_intr(port, UART_FRAME_DELIMITER, 1, 9, 0, 0);
+    uart_pattern_queue_reset(port, UART_EVENT_QUEUE_LEN);
+
+    maxBaud = baud;
+    this->baud.set(UART_BAUD_DEFAULT);
+    txCredit.set(-1);
+    sampledMs = millis();
+    boardGrantMs = sampledMs; // A board that grants does so within UART_CREDIT_TIMEOUT_MS
+
+    char taskName[configMAX_TASK_NAME_LEN];
+
+    snprintf(taskName, sizeof(taskName), "%s_rx", name);
+    if (xTaskCreatePinnedToCore(ingestTask, taskName, UART_TASK_STACK, this, UART_TASK_PRIORITY,
+                                nullptr, UART_TASK_CORE) != pdPASS)
+    {
+        return false;
+    }
+
+    snprintf(taskName, sizeof(taskName), "%s_tx", name);
+    return xTaskCreatePinnedToCore(egressTask, taskName, UART_TASK_STACK, this, UART_TASK_PRIORITY,
+                                   &egressHandle, UART_TASK_CORE) == pdPASS;
+}
+
+/**
+ * Returns the slot of the frame from takeFrame() to the ingest task. Once the
+ * slots freed since the last grant reach a quarter of the queue, or the board
+ * has no credit left, the egress task is asked for a new grant.
+ */
+void UartLink::releaseFrame()
+{
+    rxQueue.pop();
+
+    uint16_t received = rxCount.load();
+    int16_t remaining = static_cast<int16_t>(grantFree.load() - creditDelta(received, grantReceived.load()));
+    int16_t gained = static_cast<int16_t>(UART_RX_SLOTS - rxQueue.size()) - remaining;
+    if (gained >= UART_RX_SLOTS / 4 || (remaining <= 0 && gained > 0))
+    {
+        if (!grantWanted.exchange(true) && egressHandle)
+        {
+            xTaskNotifyGive(egressHandle);
+        }
+    }
+}
+
+/**
+ * Queues a line for the egress task, which terminates it with "\r\n".
+ * @param line The null-terminated line.
+ * @param sentUs Stamped just before the line is handed to the driver, may be nullptr.
+ * @param urgent true to write it ahead of the lines already queued.
+ * @return true if queued, false if the queue is full or the line too long.
+ */
+bool UartLink::println(const char *line, std::atomic<uint32_t> *sentUs, bool urgent)
+{
+    size_t length = strlen(line);
+    UartCommand *slot = urgent ? urgentQueue.reserve() : txQueue.reserve();
+
+    if (!slot || length >= sizeof(slot->line))
+    {
+        refusedTx.add();
+        return false;
+    }
+    memcpy(slot->line, line, length + 1);
+    slot->sentUs = sentUs;
+    if (urgent)
+    {
+        urgentQueue.commit();
+    }
+    else
+    {
+        txQueue.commit();
+    }
+
+    if (egressHandle)
+    {
+        xTaskNotifyGive(egressHandle);
+    }
+    return true;
+}
+
+/**
+ * Sets the latest value of a slot, written by the egress task after the commands.
+ * @param slot The slot.
+ * @param id Board ID of the line.
+ * @param milli The value in thousandths.
+ * @return false if the slot is out of range.
+ */
+bool UartLink::setValue(uint8_t slot, int id, int32_t milli)
+{
+    if (slot >= UART_VALUE_SLOTS)
+    {
+        return false;
+    }
+    values[slot].id.store(id, std::memory_order_relaxed);
+    values[slot].milli.store(milli, std::memory_order_relaxed);
+
+    uint32_t bit = 1u << slot;
+    if (valuesDirty.fetch_or(bit, std::memory_order_release) & bit)
+    {
+        valuesCoalesced.add(); // Latest value wins
+    }
+    else if (egressHandle)
+    {
+        xTaskNotifyGive(egressHandle);
+    }
+    return true;
+}
+
+/**
+ * Ingest task entry point.
+ * @param arg The UartLink instance.
+ */
+void UartLink::ingestTask(void *arg)
+{
+    HeapMonitor::watchCurrentTask();
+    static_cast<UartLink *>(arg)->ingest();
+}
+
+/**
+ * Egress task entry point.
+ * @param arg The UartLink instance.
+ */
+void UartLink::egressTask(void *arg)
+{
+    HeapMonitor::watchCurrentTask();
+    static_cast<UartLink *>(arg)->egress();
+}
+
+/**
+ * Waits on the driver event queue forever.
+ */
+void UartLink::ingest()
+{
+    uart_event_t event;
+
+    for (;;)
+    {
+        if (xQueueReceive(events, &event, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+
+        switch (event.type)
+        {
+        case UART_PATTERN_DET:
+        {
+            // Bytes up to and including the delimiter form one frame
+            int position = uart_pattern_pop_pos(port);
+            if (position < 0)
+            {
+                // Position queue overflowed: frames are lost, resynchronise
+                uart_flush_input(port);
+                assembler.reset();
+                dropped.add();
+            }
+            else
+            {
+                readFrame(static_cast<size_t>(position) + 1);
+            }
+            break;
+        }
+
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            uart_flush_input(port);
+            xQueueReset(events);
+            uart_pattern_queue_reset(port, UART_EVENT_QUEUE_LEN);
+            assembler.reset();
+            dropped.add();
+            break;
+
+        case UART_FRAME_ERR:
+        case UART_PARITY_ERR:
+            framingErrors.add();
+            break;
+
+        default:
+            // UART_DATA: partial frame, left in the ring buffer until its delimiter
+            break;
+        }
+    }
+}
+
+/**
+ * Writes queued commands and values forever. The urgent queue is checked again
+ * before every line, so an urgent command waits for one line at most. Values go
+ * out once both queues are empty, and not before the board's first grant unless
+ * it never grants. Lines are held while the board has no credit; grants wake
+ * the task. Between commands,
+ * the task wakes for the next step of the baud negotiation and for grants.
+ */
+void UartLink::egress()
+{
+    uint32_t waitMs = 0;
+    bool stalled = false;
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+        uint32_t now = millis();
+        waitMs = negotiate(now);
+
+        // The board cannot read lines while the two ends are switching rates
+        if (baudState == BaudState::PROPOSED || baudState == BaudState::CONFIRMING)
+        {
+            continue;
+        }
+
+        uint32_t grantWaitMs = grantCredit(now);
+        waitMs = grantWaitMs < waitMs ? grantWaitMs : waitMs;
+        takeGrant(now);
+
+        for (;;)
+        {
+            bool urgent = urgentQueue.front() != nullptr;
+            UartCommand *command = urgent ? urgentQueue.front() : txQueue.front();
+            // Values wait for the first grant of a board that may still grant, rather than overflow it
+            bool valuesHeld = !creditActive && now - boardGrantMs < UART_CREDIT_TIMEOUT_MS;
+            uint32_t dirty = command || valuesHeld ? 0 : valuesDirty.load(std::memory_order_relaxed);
+            if (!command && dirty == 0)
+            {
+                if (valuesHeld && valuesDirty.load(std::memory_order_relaxed) != 0)
+                {
+                    uint32_t lapseMs = UART_CREDIT_TIMEOUT_MS - (now - boardGrantMs);
+                    waitMs = lapseMs < waitMs ? lapseMs : waitMs;
+                }
+                stalled = false;
+                break;
+            }
+            if (!hasCredit(now))
+            {
+                if (!stalled)
+                {
+                    creditStalls.add();
+                    stalled = true;
+                }
+                // Woken by the next grant, or when unanswered credit lapses
+                uint32_t lapseMs = UART_CREDIT_TIMEOUT_MS - (now - boardGrantMs);
+                waitMs = lapseMs < waitMs ? lapseMs : waitMs;
+                break;
+            }
+            stalled = false;
+            if (!command)
+            {
+                if (writeValue(dirty))
+                {
+                    txCount++;
+                    lastWriteMs = now;
+                }
+                continue;
+            }
+            write(*command);
+            txCount++;
+            lastWriteMs = now;
+            if (urgent)
+            {
+                urgentQueue.pop();
+                urgentCommands.add();
+            }
+            else
+            {
+                txQueue.pop();
+            }
+            commands.add();
+        }
+    }
+}
+
+/**
+ * Hands one command to the driver.
+ * @param command The command.
+ */
+void UartLink::write(const UartCommand &command)
+{
+    // Stamped first: the ACK may be read back before the write returns
+    if (command.sentUs)
+    {
+        command.sentUs->store(static_cast<uint32_t>(esp_timer_get_time()), std::memory_order_release);
+    }
+    size_t length = strlen(command.line);
+    uart_write_bytes(port, command.line, length);
+    uart_write_bytes(port, "\r\n", 2);
+    txBytes.add(static_cast<uint32_t>(length + 2));
+}
+
+/**
+ * Hands the next value waiting to the driver, slots in turn so a busy one cannot
+ * hold back the others.
+ * @param dirty The slots waiting.
+ * @return false if the line could not be encoded (nothing written).
+ */
+bool UartLink::writeValue(uint32_t dirty)
+{
+    uint8_t slot = valueNext;
+    while (!(dirty & (1u << slot)))
+    {
+        slot = static_cast<uint8_t>((slot + 1) % UART_VALUE_SLOTS);
+    }
+    valueNext = static_cast<uint8_t>((slot + 1) % UART_VALUE_SLOTS);
+
+    // Cleared before the read: a value set meanwhile is written again, never lost
+    valuesDirty.fetch_and(~(1u << slot), std::memory_order_acquire);
+    int id = values[slot].id.load(std::memory_order_relaxed);
+    int32_t milli = values[slot].milli.load(std::memory_order_relaxed);
+
+    // Shortest form ("21.5", "7"): trailing zeros of the thousandths are dropped
+    char text[16];
+    int length = RackProto_FormatMilli(text, sizeof(text), milli, 3);
+    if (length > 0 && strchr(text, '.'))
+    {
+        while (text[length - 1] == '0')
+        {
+            text[--length] = '\0';
+        }
+        if (text[length - 1] == '.')
+        {
+            text[--length] = '\0';
+        }
+    }
+
+    UartCommand line;
+    line.sentUs = nullptr;
+    if (length < 0 || RackProto_EncodeCommand(line.line, sizeof(line.line), id, text, 0) < 0)
+    {
+        return false;
+    }
+    write(line);
+    valueLines.add();
+    return true;
+}
+
+/**
+ * Advances the baud negotiation, from the egress task.
+ * @param nowMs millis().
+ * @return Milliseconds until the next step.
+ */
+uint32_t UartLink::negotiate(uint32_t nowMs)
+{
+    uint32_t answer = baudAnswer.exchange(BAUD_NO_ANSWER, std::memory_order_acquire);
+    bool due = static_cast<int32_t>(nowMs - baudDeadlineMs) >= 0;
+
+    switch (baudState)
+    {
+    case BaudState::IDLE:
+        if (!due)
+        {
+            break;
+        }
+        while (candidate < baudCandidateCount && baudCandidates[candidate] > maxBaud)
+        {
+            candidate++;
+        }
+        if (candidate >= baudCandidateCount)
+        {
+            // Nothing faster than the default rate left to try
+            candidate = 0;
+            baudDeadlineMs = nowMs + UART_BAUD_RETRY_MS;
+            break;
+        }
+        proposeBaud(baudCandidates[candidate]);
+        baudState = BaudState::PROPOSED;
+        baudDeadlineMs = nowMs + UART_BAUD_REPLY_MS;
+        break;
+
+    case BaudState::PROPOSED:
+        if (answer == baudCandidates[candidate])
+        {
+            // Accepted: the board switches once its answer is out, so can we
+            setBaud(answer);
+            proposeBaud(answer);
+            baudState = BaudState::CONFIRMING;
+            baudDeadlineMs = nowMs + UART_BAUD_REPLY_MS;
+        }
+        else if (answer == 0)
+        {
+            // Refused: the next rate down, still on the default rate
+            candidate++;
+            baudState = BaudState::IDLE;
+            baudDeadlineMs = nowMs;
+            return 0;
+        }
+        else if (due)
+        {
+            // No board, or a board that does not negotiate
+            candidate = 0;
+            baudState = BaudState::IDLE;
+            baudDeadlineMs = nowMs + UART_BAUD_RETRY_MS;
+        }
+        break;
+
+    case BaudState::CONFIRMING:
+        if (answer == baudCandidates[candidate])
+        {
+            baudState = BaudState::NEGOTIATED;
+            missedKeepalives = 0;
+            baudDeadlineMs = nowMs + UART_BAUD_KEEPALIVE_MS;
+        }
+        else if (due)
+        {
+            // The rate does not work on this wire: the board reverts on its own
+            setBaud(UART_BAUD_DEFAULT);
+            candidate++;
+            baudState = BaudState::IDLE;
+            baudDeadlineMs = nowMs + UART_BAUD_SETTLE_MS;
+        }
+        break;
+
+    case BaudState::NEGOTIATED:
+        if (answer == baudCandidates[candidate])
+        {
+            missedKeepalives = 0;
+        }
+        if (!due)
+        {
+            break;
+        }
+        if (missedKeepalives >= UART_BAUD_MISSED)
+        {
+            // The board was reset, or fell back on its own
+            setBaud(UART_BAUD_DEFAULT);
+            baudFallbacks.add();
+            candidate = 0;
+            baudState = BaudState::IDLE;
+            baudDeadlineMs = nowMs + UART_BAUD_SETTLE_MS;
+            break;
+        }
+        proposeBaud(baudCandidates[candidate]);
+        missedKeepalives++;
+        baudDeadlineMs = nowMs + UART_BAUD_KEEPALIVE_MS;
+        break;
+    }
+
+    int32_t remaining = static_cast<int32_t>(baudDeadlineMs - nowMs);
+    return remaining > 0 ? static_cast<uint32_t>(remaining) : 0;
+}
+
+/**
+ * Applies the board's latest grant, from the egress task. Credit starts with
+ * the first grant and lapses after UART_CREDIT_TIMEOUT_MS without one.
+ * @param nowMs millis().
+ */
+void UartLink::takeGrant(uint32_t nowMs)
+{
+    if (boardGranted.exchange(false, std::memory_order_acquire))
+    {
+        uint32_t grant = boardGrant.load(std::memory_order_relaxed);
+        boardReceived = static_cast<uint16_t>(grant >> 16);
+        boardFree = static_cast<uint16_t>(grant);
+        boardGrantMs = nowMs;
+
+        int16_t inFlight = creditDelta(txCount, boardReceived);
+        if (!creditActive || inFlight < 0)
+        {
+            // First grant, or a board that restarted its count
+            txCount = boardReceived;
+        }
+        else if (inFlight > 0 && static_cast<int32_t>(boardGrantMs - lastWriteMs) >= UART_CREDIT_SETTLE_MS)
+        {
+            // Granted long after the last write and still not counted: lost on the wire
+            creditLost.add(static_cast<uint32_t>(inFlight));
+            txCount = boardReceived;
+        }
+        creditActive = true;
+        txCredit.set(static_cast<int16_t>(boardFree - creditDelta(txCount, boardReceived)));
+    }
+    else if (creditActive && nowMs - boardGrantMs >= UART_CREDIT_TIMEOUT_MS)
+    {
+        // The board stopped granting (reset, or older firmware)
+        creditActive = false;
+        txCredit.set(-1);
+    }
+}
+
+/**
+ * Whether the board has room for one more frame, from the egress task.
+ * @param nowMs millis().
+ * @return true if a frame may be written.
+ */
+bool UartLink::hasCredit(uint32_t nowMs)
+{
+    takeGrant(nowMs);
+    if (!creditActive)
+    {
+        return true;
+    }
+    int16_t credit = static_cast<int16_t>(boardFree - creditDelta(txCount, boardReceived));
+    txCredit.set(credit);
+    return credit > 0;
+}
+
+/**
+ * Writes "101*RECEIVED,FREE" when asked by releaseFrame() or when the last
+ * grant is UART_CREDIT_PERIOD_MS old, from the egress task. FREE counts the
+ * frame queue slots left after the frames counted in RECEIVED.
+ * @param nowMs millis().
+ * @return Milliseconds until the next periodic grant.
+ */
+uint32_t UartLink::grantCredit(uint32_t nowMs)
+{
+    uint32_t age = nowMs - grantMs;
+    if (!grantWanted.exchange(false) && age < UART_CREDIT_PERIOD_MS)
+    {
+        return UART_CREDIT_PERIOD_MS - age;
+    }
+
+    // Counted before the queue is sampled: every counted frame is either queued or released
+    uint16_t received = rxCount.load();
+    uint16_t free = static_cast<uint16_t>(UART_RX_SLOTS - rxQueue.size());
+    char line[24];
+    int length = snprintf(line, sizeof(line), UART_CREDIT_ID "*%u,%u\r\n", static_cast<unsigned>(received),
+                          static_cast<unsigned>(free));
+    uart_write_bytes(port, line, static_cast<size_t>(length));
+    txBytes.add(static_cast<uint32_t>(length));
+    grantReceived.store(received);
+    grantFree.store(free);
+    grantMs = nowMs;
+    return UART_CREDIT_PERIOD_MS;
+}
+
+/**
+ * Writes the control line "100*RATE".
+ * @param rate The proposed rate.
+ */
+void UartLink::proposeBaud(uint32_t rate)
+{
+    char line[24];
+    int length = snprintf(line, sizeof(line), UART_BAUD_ID "*%lu\r\n", static_cast<unsigned long>(rate));
+    uart_write_bytes(port, line, static_cast<size_t>(length));
+    txBytes.add(static_cast<uint32_t>(length));
+}
+
+/**
+ * Switches the port to a rate once the lines already written are out.
+ * @param rate The new rate.
+ */
+void UartLink::setBaud(uint32_t rate)
+{
+    uart_wait_tx_done(port, pdMS_TO_TICKS(UART_BAUD_REPLY_MS));
+    uart_set_baudrate(port, rate);
+    baud.set(static_cast<int32_t>(rate));
+}
+
+/**
+ * Reads bytes already in the RX ring buffer through the assembler.
+ * @param length Number of bytes to read.
+ */
+void UartLink::readFrame(size_t length)
+{
+    uint8_t chunk[64];
+    bool queued = false;
+    uint32_t overlong = assembler.droppedLines();
+
+    while (length > 0)
+    {
+        size_t request = length < sizeof(chunk) ? length : sizeof(chunk);
+        int received = uart_read_bytes(port, chunk, request, 0);
+        if (received <= 0)
+        {
+            break;
+        }
+        length -= static_cast<size_t>(received);
+        rxBytes.add(static_cast<uint32_t>(received));
+
+        for (int i = 0; i < received; i++)
+        {
+            if (!assembler.push(chunk[i]))
+            {
+                continue;
+            }
+
+            // Negotiation answers are for the egress task, not the broker
+            const char *line = assembler.line();
+            if (strncmp(line, UART_BAUD_TOPIC "*", sizeof(UART_BAUD_TOPIC)) == 0)
+            {
+                baudAnswer.store(strtoul(line + sizeof(UART_BAUD_TOPIC), nullptr, 10), std::memory_order_release);
+                if (egressHandle)
+                {
+                    xTaskNotifyGive(egressHandle);
+                }
+                continue;
+            }
+            if (strncmp(line, UART_CREDIT_TOPIC "*", sizeof(UART_CREDIT_TOPIC)) == 0)
+            {
+                char *end;
+                uint32_t received = strtoul(line + sizeof(UART_CREDIT_TOPIC), &end, 10);
+                uint32_t free = *end == ',' ? strtoul(end + 1, nullptr, 10) : 0;
+                boardGrant.store((received & 0xFFFF) << 16 | (free & 0xFFFF), std::memory_order_relaxed);
+                boardGranted.store(true, std::memory_order_release);
+                if (egressHandle)
+                {
+                    xTaskNotifyGive(egressHandle);
+                }
+                continue;
+            }
+
+            // Counted even when dropped, as the board counts it as sent
+            UartFrame *slot = rxQueue.reserve();
+            if (!slot)
+            {
+                rxCount.fetch_add(1);
+                dropped.add(); // Broker is behind
+                continue;
+            }
+            slot->rxMicros = esp_timer_get_time();
+            strcpy(slot->line, line);
+            rxQueue.commit();
+            rxCount.fetch_add(1);
+            frames.add();
+            queued = true;
+        }
+    }
+    if (assembler.droppedLines() != overlong)
+    {
+        framingErrors.add(assembler.droppedLines() - overlong);
+    }
+
+    if (queued && consumer)
+    {
+        xTaskNotifyGive(consumer);
+    }
+}
+
+/**
+ * Registers the link's metrics.
+ * @param registry The registry.
+ * @param prefix Name prefix (e.g. "uart/rack0/sens").
+ */
+void UartLink::registerMetrics(MetricsRegistry &registry, const char *prefix)
+{
+    char metric[METRICS_NAME_SIZE];
+
+    snprintf(metric, sizeof(metric), "%s/frames", prefix);
+    registry.add(metric, frames);
+    snprintf(metric, sizeof(metric), "%s/dropped", prefix);
+    registry.add(metric, dropped);
+    snprintf(metric, sizeof(metric), "%s/framing_errors", prefix);
+    registry.add(metric, framingErrors);
+    snprintf(metric, sizeof(metric), "%s/commands", prefix);
+    registry.add(metric, commands);
+    snprintf(metric, sizeof(metric), "%s/commands_urgent", prefix);
+    registry.add(metric, urgentCommands);
+    snprintf(metric, sizeof(metric), "%s/commands_refused", prefix);
+    registry.add(metric, refusedTx);
+    snprintf(metric, sizeof(metric), "%s/values", prefix);
+    registry.add(metric, valueLines);
+    snprintf(metric, sizeof(metric), "%s/values_coalesced", prefix);
+    registry.add(metric, valuesCoalesced);
+    snprintf(metric, sizeof(metric), "%s/rx_backlog", prefix);
+    registry.add(metric, rxBacklog);
+    snprintf(metric, sizeof(metric), "%s/tx_backlog", prefix);
+    registry.add(metric, txBacklog);
+    snprintf(metric, sizeof(metric), "%s/latency_us", prefix);
+    registry.add(metric, latency);
+    snprintf(metric, sizeof(metric), "%s/baud", prefix);
+    registry.add(metric, baud);
+    snprintf(metric, sizeof(metric), "%s/baud_fallbacks", prefix);
+    registry.add(metric, baudFallbacks);
+    snprintf(metric, sizeof(metric), "%s/rx_bytes", prefix);
+    registry.add(metric, rxBytes);
+    snprintf(metric, sizeof(metric), "%s/tx_bytes", prefix);
+    registry.add(metric, txBytes);
+    snprintf(metric, sizeof(metric), "%s/rx_bytes_s", prefix);
+    registry.add(metric, rxThroughput);
+    snprintf(metric, sizeof(metric), "%s/tx_bytes_s", prefix);
+    registry.add(metric, txThroughput);
+    snprintf(metric, sizeof(metric), "%s/credit_stalls", prefix);
+    registry.add(metric, creditStalls);
+    snprintf(metric, sizeof(metric), "%s/credit_lost", prefix);
+    registry.add(metric, creditLost);
+    snprintf(metric, sizeof(metric), "%s/tx_credit", prefix);
+    registry.add(metric, txCredit);
+}
+
+/**
+ * Samples the queue depth and throughput gauges.
+ */
+void UartLink::sampleMetrics()
+{
+    rxBacklog.set(static_cast<int32_t>(rxQueue.size()));
+    txBacklog.set(static_cast<int32_t>(txQueue.size() + urgentQueue.size() +
+                                       __builtin_popcount(valuesDirty.load(std::memory_order_relaxed))));
+
+    uint32_t now = millis();
+    uint32_t elapsed = now - sampledMs;
+    if (elapsed == 0)
+    {
+        return;
+    }
+    uint32_t rx = rxBytes.value();
+    uint32_t tx = txBytes.value();
+    rxThroughput.set(static_cast<int32_t>(static_cast<uint64_t>(rx - sampledRxBytes) * 1000 / elapsed));
+    txThroughput.set(static_cast<int32_t>(static_cast<uint64_t>(tx - sampledTxBytes) * 1000 / elapsed));
+    sampledMs = now;
+    sampledRxBytes = rx;
+    sampledTxBytes = tx;
+}
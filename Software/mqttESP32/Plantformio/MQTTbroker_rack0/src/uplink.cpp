@@ -0,0 +1,224 @@
+/*
+ * uplink.cpp
+ * Description: Implementation of the store-and-forward bridge to the upstream broker.
+ */
+
+#include "uplink.h"
+
+Uplink::Uplink()
+    : config(nullptr), client(net), task(nullptr), online(false), backoff(UPLINK_BACKOFF_MIN_MS),
+      lastAttempt(0)
+{
+}
+
+/**
+ * Opens the spool and starts the uplink task.
+ * @param fileSystem The file system holding the spool (LittleFS).
+ * @param config The upstream broker; must outlive the uplink.
+ * @return true if started, false if disabled or on error.
+ */
+bool Uplink::begin(fs::FS &fileSystem, const UplinkConfig &config)
+{
+    if (!config.host || config.host[0] == '\0' || !spool.begin(fileSystem))
+    {
+        return false;
+    }
+    this->config = &config;
+
+    client.setServer(config.host, config.port);
+    client.setBufferSize(PQ_TOPIC_SIZE + PQ_PAYLOAD_SIZE + 16);
+    client.setSocketTimeout(UPLINK_SOCKET_TIMEOUT_S);
+    client.setKeepAlive(UPLINK_KEEPALIVE_S);
+
+    // First attempt right away
+    lastAttempt = millis() - backoff;
+
+    return xTaskCreatePinnedToCore(uplinkTask, "uplink", UPLINK_TASK_STACK, this, UPLINK_TASK_PRIORITY,
+                                   &task, UPLINK_TASK_CORE) == pdPASS;
+}
+
+/**
+ * Queues a message for the upstream broker. Broker task only.
+ * @return false if the uplink is disabled, the queue is full or the message too long.
+ */
+bool Uplink::enqueue(const char *topic, const char *payload)
+{
+    if (!task)
+    {
+        return false;
+    }
+
+    size_t topicLength = strlen(topic);
+    size_t payloadLength = strlen(payload);
+    UplinkMessage *slot = queue.reserve();
+
+    if (!slot || topicLength >= sizeof(slot->topic) || payloadLength >= sizeof(slot->payload))
+    {
+        dropped.add();
+        return false;
+    }
+    memcpy(slot->topic, topic, topicLength + 1);
+    memcpy(slot->payload, payload, payloadLength + 1);
+    queue.commit();
+
+    xTaskNotifyGive(task);
+    return true;
+}
+
+/**
+ * Uplink task entry point.
+ * @param arg The Uplink instance.
+ */
+void Uplink::uplinkTask(void *arg)
+{
+    static_cast<Uplink *>(arg)->run();
+}
+
+/**
+ * Services the connection and the queues forever.
+ */
+void Uplink::run()
+{
+    for (;;)
+    {
+        uint32_t now = millis();
+
+        if (client.connected())
+        {
+            client.loop();
+        }
+        else if (now - lastAttempt >= backoff)
+        {
+            connect();
+        }
+        online = client.connected();
+        onlineGauge.set(online ? 1 : 0);
+
+        // Keep the order: nothing bypasses older spooled messages
+        if (!online || !spool.empty())
+        {
+            spoolPending();
+        }
+        if (online)
+        {
+            drain();
+        }
+
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(UPLINK_POLL_MS));
+    }
+}
+
+/**
+ * Attempts a connection and schedules the next one on failure.
+ */
+void Uplink::connect()
+{
+    bool ok = config->username ? client.connect(config->clientId, config->username, config->password)
+                               : client.connect(config->clientId);
+
+    lastAttempt = millis();
+    if (ok)
+    {
+        backoff = UPLINK_BACKOFF_MIN_MS;
+        Serial.printf("Uplink connected to %s:%u\n", config->host, config->port);
+        return;
+    }
+
+    // Exponential backoff with jitter, so gateways do not retry in lockstep
+    backoff = backoff * 2 > UPLINK_BACKOFF_MAX_MS ? UPLINK_BACKOFF_MAX_MS : backoff * 2;
+    backoff += esp_random() % (backoff / 4 + 1);
+    Serial.printf("Uplink connection failed (state %d), retry in %u ms\n", client.state(), (unsigned)backoff);
+}
+
+/**
+ * Moves every queued message to the flash spool.
+ */
+void Uplink::spoolPending()
+{
+    UplinkMessage *message;
+
+    while ((message = queue.front()) != nullptr)
+    {
+        if (spool.push(message->topic, message->payload))
+        {
+            spooled.add();
+        }
+        else
+        {
+            dropped.add();
+        }
+        queue.pop();
+    }
+}
+
+/**
+ * Sends up to UPLINK_BATCH messages, spooled ones first.
+ */
+void Uplink::drain()
+{
+    size_t sent = 0;
+
+    while (sent < UPLINK_BATCH && spool.peek(spoolTopic, spoolPayload))
+    {
+        if (!send(spoolTopic, spoolPayload))
+        {
+            break;
+        }
+        spool.pop();
+        sent++;
+    }
+    if (sent > 0)
+    {
+        spool.commit();
+    }
+
+    // Live messages only once the backlog is gone; a failed send stays queued
+    UplinkMessage *message;
+    while (sent < UPLINK_BATCH && spool.empty() && (message = queue.front()) != nullptr)
+    {
+        if (!send(message->topic, message->payload))
+        {
+            break;
+        }
+        queue.pop();
+        sent++;
+    }
+}
+
+/**
+ * Publishes one message with the configured prefix.
+ * @return false if the client refused it (connection lost).
+ */
+bool Uplink::send(const char *topic, const char *payload)
+{
+    char upstreamTopic[PQ_TOPIC_SIZE + 32];
+
+    int length = snprintf(upstreamTopic, sizeof(upstreamTopic), "%s%s",
+                          config->topicPrefix ? config->topicPrefix : "", topic);
+    if (length < 0 || (size_t)length >= sizeof(upstreamTopic))
+    {
+        dropped.add();
+        return true; // Cannot ever be sent, do not block the queue
+    }
+
+    if (!client.publish(upstreamTopic, payload))
+    {
+        online = false;
+        onlineGauge.set(0);
+        return false;
+    }
+    forwarded.add();
+    return true;
+}
+
+/**
+ * Registers the uplink's metrics.
+ * @param registry The registry.
+ */
+void Uplink::registerMetrics(MetricsRegistry &registry)
+{
+    registry.add("uplink/forwarded", forwarded);
+    registry.add("uplink/spooled", spooled);
+    registry.add("uplink/dropped", dropped);
+    registry.add("uplink/connected", onlineGauge);
+}
@@ -6,30 +6,28 @@
  */
 
 #include "utils.h"
+#include <esp_timer.h>
 
 /* =======================
  * Topics Definitions
  * =======================
- * Arrays to hold MQTT topics for sensors and actuators.
- * Each element represents a specific topic within the Rack0 system.
- */
-const std::string sensor_topics[] = {
-    "rack0/sens/water/temperature",
-    "rack0/sens/ambient/temperature",
-    "rack0/sens/ambient/humidity",
-    "rack0/sens/water/ph",
-    "rack0/sens/water/tds",
-    "rack0/sens/water/ec"};
-
-const std::string actuator_topics[] = {
-    "rack0/actu/watering0",
-    "rack0/actu/dose_pump0",
-    "rack0/actu/dose_pump1",
-    "rack0/actu/dose_pump2",
-    "rack0/actu/light/control",
-    "rack0/actu/fan/control0",
-    "rack0/actu/fan/control1",
-    "rack0/actu/humidifier"};
+ * MQTT topics for sensors and actuators come from the tables of rack_proto,
+ * relative to the rack prefix: the full topic is "<prefix>/<entry>" (e.g.
+ * "rack0/sens/water/ph").
+ */
+
+static constexpr int sensorCount = static_cast<int>(SensorTopic::SENSOR_COUNT);
+static constexpr int actuatorCount = static_cast<int>(ActuatorTopic::ACTUATOR_COUNT);
+static_assert(sensorCount == RACK_SENSOR_COUNT, "SensorTopic out of step with rack_proto");
+static_assert(sensorCount <= UART_VALUE_SLOTS, "Sensors without a process value slot");
+static_assert(actuatorCount == RACK_ACTUATOR_COUNT, "ActuatorTopic out of step with rack_proto");
+
+/**
+ * Full topic names of every rack, built by MyMQTT::subscribeToTopics(). The state
+ * cache keeps pointers to them.
+ */
+static char sensorTopicNames[RACK_MAX][sensorCount][RACK_TOPIC_SIZE];
+static char actuatorTopicNames[RACK_MAX][actuatorCount][RACK_TOPIC_SIZE];
 
 /* =======================
  * Static IP Configuration
@@ -41,6 +39,132 @@ IPAddress gateway(192, 168, 1, 1);
 IPAddress subnet(255, 255, 255, 0);
 IPAddress dns(8, 8, 8, 8);
 
+/* =======================
+ * UART Links
+ * =======================
+ * Ports are installed by UartLink::begin() from setup().
+ */
+UartLink actuatorLink(UART_NUM_1, "uart_actu");
+UartLink sensorLink(UART_NUM_2, "uart_sens");
+
+/* =======================
+ * Rack Table
+ * =======================
+ * UART1 and UART2 are the only free ports of the ESP32; every further rack
+ * needs its own UartLinks (UART0 once the PC console moves off it, or an
+ * external UART). At most RACK_MAX entries.
+ */
+const RackConfig racks[] = {
+    {"rack0", &actuatorLink, &sensorLink, RackProtocol::TEXT_V2}};
+const size_t rackCount = sizeof(racks) / sizeof(racks[0]);
+static_assert(sizeof(racks) / sizeof(racks[0]) <= RACK_MAX, "Too many racks");
+
+/* =======================
+ * State Cache
+ * =======================
+ * Slots are bound to the topic tables by MyMQTT::subscribeToTopics().
+ */
+StateCache stateCache;
+static int sensorSlots[RACK_MAX][sensorCount];
+static int actuatorSlots[RACK_MAX][actuatorCount];
+
+/* =======================
+ * Topic Routing
+ * =======================
+ * Every subscribed filter maps to a route: a kind, a rack and the index of the
+ * topic in its table. Rack topics share the first trie level with their rack
+ * prefix, so the walk picks the rack once. Built by MyMQTT::subscribeToTopics().
+ */
+enum RouteKind : uint8_t
+{
+    ROUTE_SENSOR,    /**< Index: SensorTopic */
+    ROUTE_ACTUATOR,  /**< Index: ActuatorTopic */
+    ROUTE_STATE_GET, /**< Snapshot request */
+    ROUTE_TS_QUERY,  /**< History request */
+    ROUTE_UPLINK,    /**< Forwarded to the upstream broker */
+    ROUTE_RULE_INPUT /**< Index: rule input */
+};
+
+#define ROUTE(kind, rack, index) static_cast<TrieValue>((kind) << 12 | (rack) << 8 | (index))
+#define ROUTE_KIND(route) static_cast<RouteKind>((route) >> 12)
+#define ROUTE_RACK(route) static_cast<uint8_t>(((route) >> 8) & 0x0F)
+#define ROUTE_INDEX(route) static_cast<uint8_t>((route) & 0xFF)
+
+static TopicTrie routes;
+
+/* =======================
+ * Time-Series Store
+ * =======================
+ * Bound to LittleFS from setup().
+ */
+TimeSeriesStore tsStore;
+
+/* =======================
+ * Rollups
+ * =======================
+ */
+Rollup rollup;
+
+/* =======================
+ * Uplink
+ * =======================
+ * Started from setup() when UPLINK_HOST is set. Sensor readings, their
+ * aggregates and actuator commands of every rack are forwarded; the filters
+ * are routes of the topic trie.
+ */
+Uplink uplink;
+static const char *const uplink_filters[] = {
+    "+/sens/#",
+    "+/actu/#"};
+const UplinkConfig uplinkConfig = {
+    UPLINK_HOST, UPLINK_PORT, UPLINK_CLIENT_ID, nullptr, nullptr, UPLINK_TOPIC_PREFIX,
+    uplink_filters, sizeof(uplink_filters) / sizeof(uplink_filters[0])};
+
+/* =======================
+ * Rules
+ * =======================
+ * Loaded from flash by setup(). A text received on RULES_CONFIG_TOPIC is kept
+ * here until MyMQTT::pollRules() loads it outside the route walk, since its
+ * inputs change the routing trie.
+ */
+RuleEngine ruleEngine;
+static char rulesSource[RULES_SOURCE_SIZE]; // Broker task only
+static bool rulesPending = false;
+static bool rulesTruncated = false;
+
+/* =======================
+ * Metrics
+ * =======================
+ * Registered by MyMQTT::registerMetrics(). The gauges below are sampled just
+ * before each publication; the counters are updated by the broker task.
+ */
+MetricsRegistry metrics;
+static Counter routedMessages;   /**< Messages that matched at least one route */
+static Counter unroutedMessages; /**< Messages no route matched */
+static Counter oversizedMessages; /**< Payloads too long for the payload pool, not routed */
+static Gauge uptimeGauge;
+static_assert(RACK_MAX <= METRICS_RACKS, "Racks without room for their link metrics");
+
+/* =======================
+ * Payload Pool
+ * =======================
+ * Incoming payloads are copied out of the library's stream into these blocks
+ * instead of a heap buffer per message.
+ */
+typedef MessagePool<PAYLOAD_POOL_BLOCK_SIZE, PAYLOAD_POOL_BLOCKS> PayloadPool;
+static PayloadPool payloadPool;
+
+/* =======================
+ * Command Tracking
+ * =======================
+ * Actuator commands are coalesced and rate limited per rack, then tracked from
+ * MQTT to the board's ACK on TEXT_V2 racks.
+ */
+static CommandShaper commandShaper;
+static CommandTracker commandTracker;
+static_assert(RACK_MAX <= SHAPER_RACKS, "Racks without a command bucket");
+static_assert(static_cast<int>(ActuatorTopic::ACTUATOR_COUNT) <= SHAPER_ACTUATORS, "Actuators without a shaper slot");
+
 /* =======================
  * Function Implementations
  * =======================
@@ -49,14 +173,15 @@ IPAddress dns(8, 8, 8, 8);
 /**
  * Retrieves the topic string for a given sensor enum value.
  * @param sensor The sensor enum value.
+ * @param rack The rack ID.
  * @return The corresponding topic string or an empty string if out of bounds.
  */
-std::string get_sensor_topic(SensorTopic sensor)
+const char *get_sensor_topic(SensorTopic sensor, uint8_t rack)
 {
     int index = static_cast<int>(sensor);
-    if (index >= 0 && index < static_cast<int>(SensorTopic::SENSOR_COUNT))
+    if (index >= 0 && index < sensorCount && rack < rackCount)
     {
-        return sensor_topics[index];
+        return sensorTopicNames[rack][index];
     }
     return "";
 }
@@ -64,75 +189,773 @@ std::string get_sensor_topic(SensorTopic sensor)
 /**
  * Retrieves the topic string for a given actuator enum value.
  * @param actuator The actuator enum value.
+ * @param rack The rack ID.
  * @return The corresponding topic string or an empty string if out of bounds.
  */
-std::string get_actuator_topic(ActuatorTopic actuator)
+const char *get_actuator_topic(ActuatorTopic actuator, uint8_t rack)
 {
     int index = static_cast<int>(actuator);
-    if (index >= 0 && index < static_cast<int>(ActuatorTopic::ACTUATOR_COUNT))
+    if (index >= 0 && index < actuatorCount && rack < rackCount)
     {
-        return actuator_topics[index];
+        return actuatorTopicNames[rack][index];
     }
     return "";
 }
 
+/**
+ * Formats a command in the rack's protocol on the stack and queues it on a UART
+ * link. Nothing is allocated on the heap.
+ * @param rack The rack of the target board.
+ * @param link The UART link of the target board, nullptr if the rack has none.
+ * @param id The board-side ID.
+ * @param payload The value.
+ * @param tag Debug prefix printed on the PC Serial, nullptr for none.
+ * @param tracked Slot of a TEXT_V2 actuator command, nullptr to send it untracked.
+ * @param urgent true to write it ahead of the lines queued on the link.
+ * @return true if the command was queued.
+ */
+static bool sendCommand(const RackConfig &rack, UartLink *link, int id, const char *payload, const char *tag,
+                        TrackedCommand *tracked = nullptr, bool urgent = false)
+{
+    char command[LINE_ASSEMBLER_SIZE];
+    int length = -1;
+
+    if (!link)
+    {
+        return false;
+    }
+    switch (rack.protocol)
+    {
+    case RackProtocol::TEXT_V1:
+        length = RackProto_EncodeCommand(command, sizeof(command), id, payload, 0);
+        break;
+    case RackProtocol::TEXT_V2:
+        length = RackProto_EncodeCommand(command, sizeof(command), id, payload, tracked ? tracked->seq : 0);
+        break;
+    }
+
+    if (length < 0)
+    {
+        return false; // Would be truncated on the wire
+    }
+    if (tag)
+    {
+        DEBUG_PRINTF("%s %s:%s\n", rack.prefix, tag, command);
+    }
+    return link->println(command, tracked ? &tracked->sentUs : nullptr, urgent);
+}
+
+/**
+ * Safety commands skip the shaper and the queued lines: turning off a pump or
+ * the humidifier.
+ * @param actuator The actuator.
+ * @param payload The value.
+ * @return true if the command is urgent.
+ */
+static bool isSafetyCommand(ActuatorTopic actuator, const char *payload)
+{
+    int32_t value;
+
+    switch (actuator)
+    {
+    case ActuatorTopic::RACK0_WATERING0:
+    case ActuatorTopic::RACK0_DOSE_PUMP0:
+    case ActuatorTopic::RACK0_DOSE_PUMP1:
+    case ActuatorTopic::RACK0_DOSE_PUMP2:
+    case ActuatorTopic::RACK0_HUMIDIFIER_CONTROL:
+        return parseMilli(payload, value) && value == 0;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Tracker callback: queues an overdue command again under its sequence number.
+ * @param ctx Unused.
+ * @param command The command.
+ * @return true if queued.
+ */
+static bool resendCommand(void *ctx, TrackedCommand &command)
+{
+    const RackConfig &rack = racks[command.rack];
+    bool urgent = command.id < actuatorCount && isSafetyCommand(static_cast<ActuatorTopic>(command.id), command.value);
+    return sendCommand(rack, rack.actuators, command.id, command.value, "Resend", &command, urgent);
+}
+
+/**
+ * Tracker callback: publishes the outcome and hop latencies of a command on
+ * "<rack prefix>" CMD_RESULT_SUFFIX.
+ * @param ctx The MyMQTT instance.
+ * @param command The command.
+ * @param outcome APPLIED, REJECTED or TIMEOUT.
+ * @param code The board's error code.
+ * @param timing Hop latencies.
+ */
+static void publishCommandResult(void *ctx, const TrackedCommand &command, CommandOutcome outcome, int code,
+                                 const CommandTiming &timing)
+{
+    static const char *const statusNames[] = {"applied", "rejected", "timeout"};
+    char topic[RACK_TOPIC_SIZE];
+    char message[224];
+
+    snprintf(topic, sizeof(topic), "%s" CMD_RESULT_SUFFIX, racks[command.rack].prefix);
+    snprintf(message, sizeof(message),
+             "{\"seq\":%u,\"topic\":\"%s\",\"status\":\"%s\",\"code\":%d,\"attempts\":%u,"
+             "\"mqtt_to_tx_us\":%lu,\"uart_to_apply_us\":%lu,\"round_trip_us\":%lu}",
+             (unsigned)command.seq,
+             command.id < actuatorCount ? actuatorTopicNames[command.rack][command.id] : "",
+             statusNames[static_cast<int>(outcome)], code, (unsigned)command.attempts,
+             static_cast<unsigned long>(timing.mqttToTx), static_cast<unsigned long>(timing.uartToApply),
+             static_cast<unsigned long>(timing.roundTrip));
+    static_cast<MyMQTT *>(ctx)->publish(topic, message);
+    if (outcome != CommandOutcome::APPLIED)
+    {
+        Serial.printf("%s command %u: %s (code %d)\n", racks[command.rack].prefix, (unsigned)command.seq,
+                      statusNames[static_cast<int>(outcome)], code);
+    }
+}
+
+/**
+ * Shaper callback: sends an actuator command, tracked on TEXT_V2 racks. A tracked
+ * command the link cannot queue is reported as rejected on CMD_RESULT_SUFFIX.
+ * @param ctx The MyMQTT instance.
+ * @param rack The rack.
+ * @param id The actuator.
+ * @param value The value.
+ * @param receivedUs esp_timer time the value was routed.
+ * @param urgent true for a safety command.
+ * @return true if queued.
+ */
+static bool dispatchCommand(void *ctx, uint8_t rack, uint8_t id, const char *value, uint32_t receivedUs, bool urgent)
+{
+    const RackConfig &config = racks[rack];
+    if (config.protocol != RackProtocol::TEXT_V2)
+    {
+        return sendCommand(config, config.actuators, id, value, "ActuadorID", nullptr, urgent);
+    }
+    if (!config.actuators || !config.actuators->canQueue(urgent))
+    {
+        return false; // The shaper keeps the value; no sequence number is spent on it
+    }
+
+    TrackedCommand &command = commandTracker.open(rack, id, value, receivedUs, millis());
+    if (!sendCommand(config, config.actuators, command.id, command.value, "ActuadorID", &command, urgent))
+    {
+        commandTracker.cancel(command, publishCommandResult, ctx);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Rule engine callback: publishes the new output of a rule. The local publish
+ * routes it like any other message (state cache, board, uplink).
+ * @param ctx The MyMQTT instance.
+ * @param topic The rule's target topic.
+ * @param value The output value.
+ */
+static void publishRuleOutput(void *ctx, const char *topic, const char *value)
+{
+    DEBUG_PRINTF("Rule %s:%s\n", topic, value);
+    static_cast<MyMQTT *>(ctx)->publish(topic, value);
+}
+
+/**
+ * Parses a decimal payload into thousandths (e.g. "23.45" -> 23450).
+ * @param text The payload.
+ * @param value Receives the value.
+ * @return true if the payload is a number.
+ */
+bool parseMilli(const char *text, int32_t &value)
+{
+    return RackProto_ParseMilli(text, &value) != nullptr;
+}
+
+/**
+ * Formats thousandths as a decimal number (e.g. 23450 -> "23.450").
+ * @param buffer Destination buffer.
+ * @param size Size of the buffer.
+ * @param value The value in thousandths.
+ * @return Length written, -1 if the buffer is too small.
+ */
+int formatMilli(char *buffer, size_t size, int32_t value)
+{
+    return RackProto_FormatMilli(buffer, size, value, 3);
+}
+
+/**
+ * Current time in seconds: Unix time once NTP has synced, uptime before that.
+ */
+uint32_t nowSeconds()
+{
+    time_t now = time(nullptr);
+    return (now >= static_cast<time_t>(TS_MIN_VALID_TIME)) ? static_cast<uint32_t>(now) : millis() / 1000;
+}
+
+/**
+ * Looks up the series of a sensor topic.
+ * @param topic The topic string.
+ * @return rack * SENSOR_COUNT + SensorTopic index, or -1 if the topic is not a sensor topic.
+ */
+int findSensorTopic(const char *topic)
+{
+    int index = -1;
+
+    routes.match(topic, [&index](TrieValue route)
+                 {
+                     if (ROUTE_KIND(route) == ROUTE_SENSOR)
+                     {
+                         index = ROUTE_RACK(route) * sensorCount + ROUTE_INDEX(route);
+                     }
+                 });
+    return index;
+}
+
 /**
  * Handles incoming messages for actuator topics.
- * Sends the payload to the assigned actuator via UART.
- * @param topic The topic string received.
+ * Sends the payload to the rack's actuator board via UART, now or once the
+ * shaper releases it.
+ * @param rack The rack of the topic.
+ * @param actuator The actuator of the topic.
  * @param payload The payload string associated with the topic.
+ * @param broker The MQTT server instance.
  */
-void handleActuatorTopic(const char *topic, const char *payload)
+void handleActuatorTopic(uint8_t rack, ActuatorTopic actuator, const char *payload, MyMQTT &broker)
 {
-    for (int index = 0; index < static_cast<int>(ActuatorTopic::ACTUATOR_COUNT); index++)
+    stateCache.update(actuatorSlots[rack][static_cast<int>(actuator)], payload);
+    if (stateCache.replaying() || !racks[rack].actuators)
     {
-        if (topic == actuator_topics[index])
-        {
-            String formattedMessage = String(index) + "*" + String(payload);
-            Serial1.println(formattedMessage); // Send via UART1
-            Serial.println("ActuadorID:" + formattedMessage);
-        }
+        return; // Cached value republished for a new subscriber (already applied), or no board
+    }
+
+    if (!commandShaper.submit(rack, static_cast<uint8_t>(actuator), payload,
+                              static_cast<uint32_t>(esp_timer_get_time()), millis(), isSafetyCommand(actuator, payload),
+                              dispatchCommand, &broker))
+    {
+        Serial.printf("Command dropped: %s %s\n", get_actuator_topic(actuator, rack), payload);
     }
 }
 
 /**
  * Handles incoming messages for sensor topics.
- * Sends the payload to the assigned sensor via UART.
- * @param topic The topic string received.
+ * Sends the payload to the rack's sensor board via UART.
+ * @param rack The rack of the topic.
+ * @param sensor The sensor of the topic.
  * @param payload The payload string associated with the topic.
  */
-void handleSensorTopic(const char *topic, const char *payload)
+void handleSensorTopic(uint8_t rack, SensorTopic sensor, const char *payload)
 {
-    for (int index = 0; index < static_cast<int>(SensorTopic::SENSOR_COUNT); index++)
+    stateCache.update(sensorSlots[rack][static_cast<int>(sensor)], payload);
+    if (stateCache.replaying())
     {
-        if (topic == sensor_topics[index])
+        return; // Cached value republished for a new subscriber, already applied
+    }
+
+    sendCommand(racks[rack], racks[rack].sensors, static_cast<int>(sensor), payload, "SensorID");
+}
+
+/**
+ * Forwards a sensor reading to the actuator device of the same rack via UART.
+ * The actuator board receives it as "<PV_ID_BASE + index>*<value>". A non-numeric
+ * reading ("nan") is not forwarded, so the board's process value goes stale.
+ * Readings go to the link's value slot of their sensor, where a newer one
+ * replaces a reading not written yet, so they never fill the command queue.
+ * @param topic The topic string received.
+ * @param payload The sensor value.
+ */
+void forwardProcessValue(const char *topic, const char *payload)
+{
+    int series = findSensorTopic(topic);
+    int32_t value;
+    if (series >= 0 && parseMilli(payload, value))
+    {
+        const RackConfig &rack = racks[series / sensorCount];
+        if (rack.actuators)
         {
-            String formattedMessage = String(index) + "*" + String(payload);
-            Serial2.println(formattedMessage); // Send via UART2
-            Serial.println("SensorID:" + formattedMessage);
+            int sensor = series % sensorCount;
+            rack.actuators->setValue(static_cast<uint8_t>(sensor), PV_ID_BASE + sensor, value);
         }
     }
 }
 
 /**
- * Subscribes to all predefined MQTT topics for sensors and actuators.
- * Uses lambdas to handle incoming messages for each topic.
+ * Builds the routing trie and subscribes to every topic with a single "#" filter,
+ * so each message is dispatched by one trie walk instead of a scan of per-topic
+ * subscriptions. Every sensor and actuator topic also gets a slot in the state cache.
  */
 void MyMQTT::subscribeToTopics()
 {
-    for (int i = 0; i < static_cast<int>(SensorTopic::SENSOR_COUNT); i++)
+    for (uint8_t rack = 0; rack < rackCount; rack++)
+    {
+        for (int i = 0; i < sensorCount; i++)
+        {
+            char *name = sensorTopicNames[rack][i];
+            snprintf(name, RACK_TOPIC_SIZE, "%s/%s", racks[rack].prefix, RackProto_SensorTopics[i]);
+            sensorSlots[rack][i] = stateCache.bind(name);
+        }
+
+        for (int i = 0; i < actuatorCount; i++)
+        {
+            char *name = actuatorTopicNames[rack][i];
+            snprintf(name, RACK_TOPIC_SIZE, "%s/%s", racks[rack].prefix, RackProto_ActuatorTopics[i]);
+            actuatorSlots[rack][i] = stateCache.bind(name);
+        }
+    }
+    buildRoutes();
+
+    // Every local message, including the broker's own publishes
+    subscribe("#", [this](const char *topic, Stream &payload)
+              { routeIncoming(topic, payload); });
+
+    Serial.printf("Subscribed to the topics of %u racks (%u trie nodes).\n", (unsigned)rackCount,
+                  (unsigned)routes.nodeCount());
+}
+
+/**
+ * Fills the routing trie from the topic tables, the uplink filters and the rule
+ * inputs.
+ */
+void MyMQTT::buildRoutes()
+{
+    routes.clear();
+
+    for (uint8_t rack = 0; rack < rackCount; rack++)
+    {
+        for (int i = 0; i < sensorCount; i++)
+        {
+            routes.insert(sensorTopicNames[rack][i], ROUTE(ROUTE_SENSOR, rack, i));
+        }
+        for (int i = 0; i < actuatorCount; i++)
+        {
+            routes.insert(actuatorTopicNames[rack][i], ROUTE(ROUTE_ACTUATOR, rack, i));
+        }
+    }
+
+    routes.insert(STATE_GET_TOPIC, ROUTE(ROUTE_STATE_GET, 0, 0));
+    routes.insert(TS_QUERY_TOPIC, ROUTE(ROUTE_TS_QUERY, 0, 0));
+
+    for (size_t i = 0; i < uplinkConfig.filterCount; i++)
+    {
+        routes.insert(uplinkConfig.filters[i], ROUTE(ROUTE_UPLINK, 0, 0));
+    }
+
+    for (uint8_t i = 0; i < ruleEngine.inputCount(); i++)
+    {
+        if (!routes.insert(ruleEngine.inputTopic(i), ROUTE(ROUTE_RULE_INPUT, 0, i)))
+        {
+            Serial.printf("Rule input %s not routed: trie full\n", ruleEngine.inputTopic(i));
+        }
+    }
+}
+
+/**
+ * Reads an incoming payload into a pooled buffer and routes it. Payloads that do
+ * not fit a block (snapshots, history replies) have no route and are skipped.
+ * Rules texts are read into their own buffer for pollRules().
+ * @param topic The topic name.
+ * @param payload The payload, streamed by the library.
+ */
+void MyMQTT::routeIncoming(const char *topic, Stream &payload)
+{
+    if (strcmp(topic, RULES_CONFIG_TOPIC) == 0)
+    {
+        size_t length = 0;
+        rulesTruncated = false;
+        for (int c = payload.read(); c >= 0; c = payload.read())
+        {
+            if (length == sizeof(rulesSource) - 1)
+            {
+                rulesTruncated = true;
+                break;
+            }
+            rulesSource[length++] = static_cast<char>(c);
+        }
+        rulesSource[length] = '\0';
+        rulesPending = true;
+        return;
+    }
+
+    PayloadPool::Buffer buffer = payloadPool.acquire();
+    if (!buffer)
+    {
+        return; // Counted by the pool
+    }
+
+    char *text = buffer.data();
+    size_t length = 0;
+    for (int c = payload.read(); c >= 0; c = payload.read())
+    {
+        if (length == buffer.size() - 1)
+        {
+            oversizedMessages.add();
+            return;
+        }
+        text[length++] = static_cast<char>(c);
+    }
+    text[length] = '\0';
+
+    routeMessage(topic, text);
+}
+
+/**
+ * Dispatches a message to the handlers of every route matching its topic.
+ * @param topic The topic name.
+ * @param payload The payload.
+ */
+void MyMQTT::routeMessage(const char *topic, const char *payload)
+{
+    bool forward = false;
+    bool routed = false;
+
+    routes.match(topic, [&](TrieValue route)
+                 {
+                     routed = true;
+                     uint8_t rack = ROUTE_RACK(route);
+                     uint8_t index = ROUTE_INDEX(route);
+
+                     switch (ROUTE_KIND(route))
+                     {
+                     case ROUTE_SENSOR:
+                         handleSensorTopic(rack, static_cast<SensorTopic>(index), payload);
+                         if (!stateCache.replaying())
+                         {
+                             recordReading(rack, static_cast<SensorTopic>(index), payload);
+                         }
+                         break;
+                     case ROUTE_ACTUATOR:
+                         handleActuatorTopic(rack, static_cast<ActuatorTopic>(index), payload, *this);
+                         break;
+                     case ROUTE_STATE_GET:
+                         publishSnapshot();
+                         break;
+                     case ROUTE_TS_QUERY:
+                         handleHistoryQuery(payload);
+                         break;
+                     case ROUTE_UPLINK:
+                         forward = true; // Once, however many filters match
+                         break;
+                     case ROUTE_RULE_INPUT:
+                     {
+                         int32_t value;
+                         if (!stateCache.replaying() && parseMilli(payload, value))
+                         {
+                             ruleEngine.update(index, value, millis(), publishRuleOutput, this);
+                         }
+                         break;
+                     }
+                     }
+                 });
+
+    if (forward && !stateCache.replaying())
+    {
+        uplink.enqueue(topic, payload);
+    }
+    (routed ? routedMessages : unroutedMessages).add();
+}
+
+/**
+ * Registers the gateway, link and uplink metrics.
+ */
+void MyMQTT::registerMetrics()
+{
+    char prefix[METRICS_NAME_SIZE];
+
+    metrics.add("uptime_s", uptimeGauge);
+    heapMonitor.registerMetrics(metrics);
+    metrics.add("broker/routed", routedMessages);
+    metrics.add("broker/unrouted", unroutedMessages);
+    metrics.add("broker/oversized", oversizedMessages);
+    payloadPool.registerMetrics(metrics, "pool/payload");
+    commandShaper.registerMetrics(metrics);
+    commandTracker.registerMetrics(metrics);
+    ruleEngine.registerMetrics(metrics);
+    metrics.add("broker/loop_us", loopTime);
+
+    for (size_t rack = 0; rack < rackCount; rack++)
+    {
+        if (racks[rack].actuators)
+        {
+            snprintf(prefix, sizeof(prefix), "uart/%s/actu", racks[rack].prefix);
+            racks[rack].actuators->registerMetrics(metrics, prefix);
+        }
+        if (racks[rack].sensors)
+        {
+            snprintf(prefix, sizeof(prefix), "uart/%s/sens", racks[rack].prefix);
+            racks[rack].sensors->registerMetrics(metrics, prefix);
+        }
+    }
+
+    if (uplink.enabled())
+    {
+        uplink.registerMetrics(metrics);
+    }
+
+    if (metrics.rejected() > 0)
+    {
+        Serial.printf("Metrics registry full: %u metrics not published (METRICS_MAX %u)\n",
+                      (unsigned)metrics.rejected(), (unsigned)METRICS_MAX);
+    }
+}
+
+/**
+ * Registry callback: publishes one metric on "<METRICS_TOPIC_PREFIX><name>".
+ * @param ctx The MyMQTT instance.
+ * @param name The metric name.
+ * @param value The formatted value.
+ */
+static void publishMetric(void *ctx, const char *name, const char *value)
+{
+    char topic[sizeof(METRICS_TOPIC_PREFIX) + METRICS_NAME_SIZE];
+
+    snprintf(topic, sizeof(topic), METRICS_TOPIC_PREFIX "%s", name);
+    static_cast<MyMQTT *>(ctx)->publish(topic, value);
+    DEBUG_PRINTF("%s %s\n", topic, value);
+}
+
+/**
+ * Samples the gauges and publishes every metric.
+ */
+void MyMQTT::publishMetrics()
+{
+    uptimeGauge.set(static_cast<int32_t>(millis() / 1000));
+    heapMonitor.sampleMetrics();
+    payloadPool.sampleMetrics();
+    commandShaper.sampleMetrics();
+
+    for (size_t rack = 0; rack < rackCount; rack++)
+    {
+        for (UartLink *link : {racks[rack].actuators, racks[rack].sensors})
+        {
+            if (link)
+            {
+                link->sampleMetrics();
+            }
+        }
+    }
+
+    metrics.forEach(publishMetric, this);
+}
+
+/**
+ * Publishes the whole state cache as one JSON message on STATE_SNAPSHOT_TOPIC.
+ */
+void MyMQTT::publishSnapshot()
+{
+    static char snapshot[STATE_SNAPSHOT_SIZE]; // Broker task only
+
+    if (stateCache.snapshot(snapshot, sizeof(snapshot)) > 0)
+    {
+        publish(STATE_SNAPSHOT_TOPIC, snapshot);
+    }
+}
+
+/**
+ * History response being assembled. Points are collected as "[ts,value]" and
+ * sent in chunks of at most TS_REPLY_SIZE bytes.
+ */
+struct HistoryReply
+{
+    MyMQTT *broker;
+    const char *topic;
+    uint32_t step;
+    uint16_t seq;
+    size_t length;
+    char points[TS_REPLY_SIZE - 128];
+};
+
+/**
+ * Publishes the points collected so far as one chunk.
+ * @param reply The response.
+ * @param more true if further chunks follow.
+ */
+static void sendHistoryChunk(HistoryReply &reply, bool more)
+{
+    static char message[TS_REPLY_SIZE]; // Broker task only
+
+    snprintf(message, sizeof(message), "{\"topic\":\"%s\",\"step\":%lu,\"seq\":%u,\"more\":%s,\"data\":[%.*s]}",
+             reply.topic, static_cast<unsigned long>(reply.step), reply.seq, more ? "true" : "false",
+             static_cast<int>(reply.length), reply.points);
+    reply.broker->publish(TS_RESULT_TOPIC, message);
+    reply.seq++;
+    reply.length = 0;
+}
+
+/**
+ * TimeSeriesStore::query() callback: adds a point to the response.
+ */
+static void addHistoryPoint(void *ctx, uint32_t ts, int32_t value)
+{
+    HistoryReply &reply = *static_cast<HistoryReply *>(ctx);
+    char number[16];
+    char point[32];
+
+    formatMilli(number, sizeof(number), value);
+    int length = snprintf(point, sizeof(point), "%s[%lu,%s]", reply.length ? "," : "",
+                          static_cast<unsigned long>(ts), number);
+
+    if (reply.length + length >= sizeof(reply.points))
+    {
+        sendHistoryChunk(reply, true);
+        length = snprintf(point, sizeof(point), "[%lu,%s]", static_cast<unsigned long>(ts), number);
+    }
+    memcpy(&reply.points[reply.length], point, length);
+    reply.length += length;
+}
+
+/**
+ * Answers a history request on TS_RESULT_TOPIC.
+ * The series is read from flash in the broker task; long ranges should use a step.
+ * @param request "topic,from,to,step".
+ */
+void MyMQTT::handleHistoryQuery(const char *request)
+{
+    static HistoryReply reply; // Broker task only
+    char topic[64];
+    unsigned long from = 0;
+    unsigned long to = 0;
+    unsigned long step = 0;
+
+    if (sscanf(request, "%63[^,],%lu,%lu,%lu", topic, &from, &to, &step) < 3)
+    {
+        return;
+    }
+
+    int series = findSensorTopic(topic);
+    if (series < 0)
+    {
+        return;
+    }
+
+    tsStore.flush(); // Older segments on flash are complete; the open one is read from RAM
+
+    reply.broker = this;
+    reply.topic = sensorTopicNames[series / sensorCount][series % sensorCount];
+    reply.step = static_cast<uint32_t>(step);
+    reply.seq = 0;
+    reply.length = 0;
+    tsStore.query(static_cast<uint8_t>(series), static_cast<uint32_t>(from), static_cast<uint32_t>(to),
+                  static_cast<uint32_t>(step), addHistoryPoint, &reply);
+    sendHistoryChunk(reply, false);
+}
+
+/**
+ * Rollup callback: publishes a closed window on "<sensor topic>/agg/<window>".
+ * @param ctx The broker.
+ */
+static void publishRollup(void *ctx, uint8_t series, uint8_t window, const RollupResult &result)
+{
+    MyMQTT *broker = static_cast<MyMQTT *>(ctx);
+    char topic[RACK_TOPIC_SIZE + 16];
+    char min[16], max[16], mean[16], last[16];
+    char message[160];
+
+    snprintf(topic, sizeof(topic), "%s" ROLLUP_TOPIC_SUFFIX "%s",
+             sensorTopicNames[series / sensorCount][series % sensorCount], Rollup::windowName(window));
+    formatMilli(min, sizeof(min), result.min);
+    formatMilli(max, sizeof(max), result.max);
+    formatMilli(mean, sizeof(mean), result.mean);
+    formatMilli(last, sizeof(last), result.last);
+    snprintf(message, sizeof(message),
+             "{\"start\":%lu,\"min\":%s,\"max\":%s,\"mean\":%s,\"count\":%lu,\"last\":%s}",
+             static_cast<unsigned long>(result.start), min, max, mean,
+             static_cast<unsigned long>(result.count), last);
+    broker->publish(topic, message);
+}
+
+/**
+ * Feeds a sensor reading to the flash history and the rollups.
+ * Series are numbered rack * SENSOR_COUNT + sensor.
+ * @param rack The rack.
+ * @param sensor The sensor.
+ * @param payload The reading.
+ */
+void MyMQTT::recordReading(uint8_t rack, SensorTopic sensor, const char *payload)
+{
+    int32_t value;
+    if (!parseMilli(payload, value))
+    {
+        return;
+    }
+
+    uint8_t series = static_cast<uint8_t>(rack * sensorCount + static_cast<int>(sensor));
+    uint32_t now = nowSeconds();
+
+    tsStore.append(series, now, value); // Ignored until NTP has set the clock
+    rollup.add(series, now, value, publishRollup, this);
+}
+
+/**
+ * Publishes the rollup windows that ended without new readings.
+ */
+void MyMQTT::pollRollups()
+{
+    rollup.poll(nowSeconds(), publishRollup, this);
+}
+
+/**
+ * Sends the actuator commands held by the shaper, resends the ones whose ACK is
+ * overdue and reports the ones that ran out of retries.
+ */
+void MyMQTT::pollCommands()
+{
+    commandShaper.poll(millis(), dispatchCommand, this);
+    commandTracker.poll(millis(), resendCommand, publishCommandResult, this);
+}
+
+/**
+ * Loads a rules text received on RULES_CONFIG_TOPIC, reports the outcome on
+ * RULES_STATUS_TOPIC (retained) and applies the rule changes held by
+ * min_on/min_off.
+ */
+void MyMQTT::pollRules()
+{
+    if (rulesPending)
     {
-        subscribe(sensor_topics[i].c_str(), [](const char *topic, const char *payload)
-                  { handleSensorTopic(topic, payload); });
+        char error[RULES_ERROR_SIZE] = "";
+        char status[64 + RULES_ERROR_SIZE];
+
+        rulesPending = false;
+        if (rulesTruncated)
+        {
+            snprintf(error, sizeof(error), "rules longer than %d bytes", RULES_SOURCE_SIZE - 1);
+        }
+        else if (ruleEngine.configure(rulesSource, error, sizeof(error)))
+        {
+            buildRoutes();
+        }
+
+        snprintf(status, sizeof(status), "{\"rules\":%u,\"inputs\":%u,\"error\":\"%s\"}",
+                 (unsigned)ruleEngine.ruleCount(), (unsigned)ruleEngine.inputCount(), error);
+        publish(RULES_STATUS_TOPIC, status, 0, true);
+        if (error[0] != '\0')
+        {
+            Serial.printf("Rules rejected: %s\n", error);
+        }
     }
 
-    for (int i = 0; i < static_cast<int>(ActuatorTopic::ACTUATOR_COUNT); i++)
+    ruleEngine.poll(millis(), publishRuleOutput, this);
+}
+
+/**
+ * Replays the cached value of a new exact-topic subscription as a retained message.
+ * PicoMQTT has no per-client publish, so existing subscribers of that topic receive
+ * the value again. Wildcard filters are not replayed: one "#" dashboard would
+ * resend the whole state to every client. Those read STATE_GET_TOPIC instead.
+ * The replay guard keeps the local handlers from sending the value to the boards again.
+ * @param client_id The subscribing client.
+ * @param topic The subscribed topic filter.
+ */
+void MyMQTT::on_subscribe(const char *client_id, const char *topic)
+{
+    if (strpbrk(topic, "+#"))
     {
-        subscribe(actuator_topics[i].c_str(), [](const char *topic, const char *payload)
-                  { handleActuatorTopic(topic, payload); });
+        return;
     }
 
-    Serial.println("Subscribed to all Rack0 topics.");
+    stateCache.beginReplay();
+    stateCache.forEachMatching(topic, [this](const char *cachedTopic, const char *value)
+                               { publish(cachedTopic, value, 0, true); });
+    stateCache.endReplay();
 }
 
 /**
@@ -154,7 +977,16 @@ void MyMQTT::addTopicToSubscription(const char *topic)
  */
 PicoMQTT::ConnectReturnCode MyMQTT::auth(const char *client_id, const char *username, const char *password)
 {
-    if (!client_id || String(client_id).length() < 3)
+    static const struct
+    {
+        const char *username;
+        const char *password;
+    } users[] = {
+        {"adrian", "librecultivo"},
+        {"juan", "pepexd"},
+        {"cel", "celxd"}};
+
+    if (!client_id || strlen(client_id) < 3)
     {
         return PicoMQTT::CRC_IDENTIFIER_REJECTED;
     }
@@ -164,12 +996,12 @@ PicoMQTT::ConnectReturnCode MyMQTT::auth(const char *client_id, const char *user
         return PicoMQTT::CRC_NOT_AUTHORIZED;
     }
 
-    if (
-        (String(username) == "adrian" && String(password) == "librecultivo") ||
-        (String(username) == "juan" && String(password) == "pepexd") ||
-        (String(username) == "cel" && String(password) == "celxd"))
+    for (const auto &user : users)
     {
-        return PicoMQTT::CRC_ACCEPTED;
+        if (strcmp(username, user.username) == 0 && strcmp(password, user.password) == 0)
+        {
+            return PicoMQTT::CRC_ACCEPTED;
+        }
     }
 
     return PicoMQTT::CRC_BAD_USERNAME_OR_PASSWORD;
@@ -183,17 +1015,115 @@ PicoMQTT::ConnectReturnCode MyMQTT::auth(const char *client_id, const char *user
  */
 void MyMQTT::UART_MQTT(HardwareSerial &serialPort, MyMQTT &broker)
 {
-    String message = serialPort.readString();
+    LineAssembler *assembler = assemblerFor(serialPort);
+    if (!assembler)
+    {
+        return;
+    }
 
-    int dashIndex = message.indexOf('*');
-    if (dashIndex != -1)
+    // Only what has already arrived; the rest of a frame is picked up next loop
+    int pending = serialPort.available();
+    while (pending-- > 0)
     {
-        String topicPart = message.substring(0, dashIndex);
-        String valuePart = message.substring(dashIndex + 1);
+        int c = serialPort.read();
+        if (c < 0)
+        {
+            break;
+        }
+        if (assembler->push(static_cast<uint8_t>(c)))
+        {
+            publishLine(assembler->line(), broker);
+        }
+    }
+}
 
-        Serial.println("Topic: " + topicPart);
-        Serial.println("Value: " + valuePart);
+/**
+ * Forwards the frames collected by a UART link as MQTT messages.
+ * The link's ingest task has already assembled them, so this never waits.
+ * Frames are published straight from their queue slot, under the rack prefix.
+ * @param rack The rack of the link.
+ * @param link The UART link.
+ * @param broker The MQTT server instance.
+ * @return Number of frames published.
+ */
+size_t MyMQTT::UART_MQTT(uint8_t rack, UartLink &link, MyMQTT &broker)
+{
+    size_t published = 0;
+    UartFrame *frame;
 
-        broker.publish(topicPart, valuePart);
+    while ((frame = link.takeFrame()) != nullptr)
+    {
+        // "ack*SEQ,CODE,APPLY_US" answers a tracked command and is not published
+        if (&link == racks[rack].actuators && strncmp(frame->line, CMD_ACK_TOPIC "*", sizeof(CMD_ACK_TOPIC)) == 0)
+        {
+            commandTracker.acknowledge(rack, frame->line + sizeof(CMD_ACK_TOPIC),
+                                       static_cast<uint32_t>(frame->rxMicros), publishCommandResult, &broker);
+        }
+        else
+        {
+            publishLine(frame->line, broker, racks[rack].prefix);
+        }
+        link.latency.record(static_cast<uint32_t>(esp_timer_get_time() - frame->rxMicros));
+        link.releaseFrame();
+        published++;
     }
+    return published;
+}
+
+/**
+ * Returns the assembler bound to a serial port, binding a free one on first use.
+ * @param serialPort The UART port.
+ * @return The assembler, or nullptr if every link is taken.
+ */
+LineAssembler *MyMQTT::assemblerFor(HardwareSerial &serialPort)
+{
+    for (SerialLink &link : serialLinks)
+    {
+        if (link.port == &serialPort)
+        {
+            return &link.assembler;
+        }
+        if (link.port == nullptr)
+        {
+            link.port = &serialPort;
+            return &link.assembler;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Publishes one complete "topic*value" line.
+ * @param line The line, split in place.
+ * @param broker The MQTT server instance.
+ * @param rackPrefix Replaces the first topic level, nullptr to publish the topic as sent.
+ */
+void MyMQTT::publishLine(char *line, MyMQTT &broker, const char *rackPrefix)
+{
+    RackFrame frame;
+    if (RackProto_DecodeFrame(line, &frame) != RACK_PROTO_SUCCESS)
+    {
+        return;
+    }
+    const char *topicPart = frame.topic;
+    const char *valuePart = frame.value;
+
+    // "rack0/sens/..." from the board becomes "<rack prefix>/sens/..."
+    char rackTopic[RACK_TOPIC_SIZE];
+    const char *level = strchr(topicPart, '/');
+    if (rackPrefix && level)
+    {
+        int written = snprintf(rackTopic, sizeof(rackTopic), "%s%s", rackPrefix, level);
+        if (written < 0 || written >= static_cast<int>(sizeof(rackTopic)))
+        {
+            return;
+        }
+        topicPart = rackTopic;
+    }
+
+    DEBUG_PRINTF("Topic: %s\n", topicPart);
+    DEBUG_PRINTF("Value: %s\n", valuePart);
+
+    broker.publish(topicPart, valuePart);
+    forwardProcessValue(topicPart, valuePart);
 }